@@ -29,6 +29,7 @@ const char *CDFCache::className = "CDFCache";
 #include "CCDFDataModel.h"
 #include "CCDFNetCDFIO.h"
 #include "CCDFStore.h"
+#include "CMetrics.h"
 //#define CCDFCACHE_DEBUG
 //#define CCDFCACHE_DEBUG_LOW
 
@@ -139,6 +140,7 @@ int CDFCache::open(const char *fileName, CDFObject *cdfObject, bool readOrWrite)
   if (readOrWrite == false) {
     cache->checkCacheSystemReady(cacheDir.c_str(), key.c_str(), fileName, "CDFCache::open");
     bool cacheIsAvailable = cache->cacheIsAvailable();
+    CMetrics::increment(cacheIsAvailable ? CMetrics::COUNTER_CDFCACHE_HITS : CMetrics::COUNTER_CDFCACHE_MISSES);
     if (cacheIsAvailable) {
       CT::string cacheFilename = cache->getCacheFileNameToRead();
       CDFReader *orgCDFReader = (CDFReader *)cdfObject->getCDFReader();
@@ -260,6 +262,7 @@ int CDFCache::readVariableData(CDF::Variable *var, CDFType type, size_t *start,
     // Read dataobject
     cache->checkCacheSystemReady(cacheDir.c_str(), key.c_str(), fileName, "CDFCache::readVariableData");
     bool cacheIsAvailable = cache->cacheIsAvailable();
+    CMetrics::increment(cacheIsAvailable ? CMetrics::COUNTER_CDFCACHE_HITS : CMetrics::COUNTER_CDFCACHE_MISSES);
     if (cacheIsAvailable) {
       CT::string cacheFilename = cache->getCacheFileNameToRead();
       size_t varSize = 0;
@@ -25,10 +25,18 @@
 
 #include "CCDFNetCDFIO.h"
 #include "CStopWatch.h"
+#include <algorithm>
+#include <string.h>
 const char *CDFNetCDFReader::className = "NetCDFReader";
 const char *CDFNetCDFWriter::className = "NetCDFWriter";
 
 #define CDFNetCDFGroupSeparator "/"
+
+/* Default maximum chunk cache per variable, and the maximum size of a block read by the read-then-decimate path */
+#define CDFNETCDFREADER_CHUNKCACHE_LIMIT (64 * 1024 * 1024)
+#define CDFNETCDFREADER_MAX_DECIMATE_BLOCK (256 * 1024 * 1024)
+
+size_t CDFNetCDFReader::chunkCacheLimit = CDFNETCDFREADER_CHUNKCACHE_LIMIT;
 // const char *CCDFWarper::className="CCDFWarper";
 
 //  #define CCDFNETCDFIO_DEBUG
@@ -52,6 +60,150 @@ void CDFNetCDFReader::ncError(int, const char *className, const char *msg, int e
   CDBError("%s %s", msg, nc_strerror(e));
 }
 
+void CDFNetCDFReader::setChunkCacheLimit(size_t bytes) { chunkCacheLimit = bytes; }
+
+template <typename T> static void decimateRow(const void *src, void *dst, size_t count, ptrdiff_t stride) {
+  const T *s = (const T *)src;
+  T *d = (T *)dst;
+  for (size_t j = 0; j < count; j++) d[j] = s[j * stride];
+}
+
+/* Copies every stride'th element of a block with extent span to dst, which gets extent count */
+static void decimateBlock(const char *src, char *dst, size_t typeSize, size_t numDims, const size_t *span, const size_t *count, const ptrdiff_t *stride) {
+  if (numDims == 0) {
+    memcpy(dst, src, typeSize);
+    return;
+  }
+  size_t srcDimStride[NC_MAX_VAR_DIMS], index[NC_MAX_VAR_DIMS];
+  srcDimStride[numDims - 1] = 1;
+  for (size_t d = numDims - 1; d > 0; d--) srcDimStride[d - 1] = srcDimStride[d] * span[d];
+  for (size_t d = 0; d < numDims; d++) index[d] = 0;
+  size_t rowCount = count[numDims - 1];
+  ptrdiff_t rowStride = stride[numDims - 1];
+  while (true) {
+    size_t srcOffset = 0;
+    for (size_t d = 0; d + 1 < numDims; d++) srcOffset += index[d] * stride[d] * srcDimStride[d];
+    const char *srcRow = src + srcOffset * typeSize;
+    if (rowStride == 1) {
+      memcpy(dst, srcRow, rowCount * typeSize);
+    } else if (typeSize == 1) {
+      decimateRow<unsigned char>(srcRow, dst, rowCount, rowStride);
+    } else if (typeSize == 2) {
+      decimateRow<unsigned short>(srcRow, dst, rowCount, rowStride);
+    } else if (typeSize == 4) {
+      decimateRow<unsigned int>(srcRow, dst, rowCount, rowStride);
+    } else if (typeSize == 8) {
+      decimateRow<unsigned long long>(srcRow, dst, rowCount, rowStride);
+    } else {
+      for (size_t j = 0; j < rowCount; j++) memcpy(dst + j * typeSize, srcRow + j * rowStride * typeSize, typeSize);
+    }
+    dst += rowCount * typeSize;
+    size_t d = numDims - 1;
+    while (d > 0) {
+      d--;
+      if (++index[d] < count[d]) break;
+      index[d] = 0;
+      if (d == 0) return;
+    }
+    if (numDims == 1) return;
+  }
+}
+
+/*
+  Reads a hyperslab in the native type of the variable. For chunked variables the chunk cache is grown to hold the chunks along one row of chunks
+  of the read, so they are decompressed only once. Strided reads that touch every chunk anyway are read as chunk aligned blocks and decimated in memory.
+*/
+int CDFNetCDFReader::_readHyperslab(int groupId, CDF::Variable *var, size_t *start, size_t *count, ptrdiff_t *stride, void *data) {
+  size_t numDims = var->dimensionlinks.size();
+  bool useStriding = false;
+  for (size_t d = 0; d < numDims; d++) {
+    if (stride[d] != 1) useStriding = true;
+    if (count[d] == 0) return NC_NOERR;
+  }
+
+  int storage = NC_CONTIGUOUS;
+  size_t chunkSizes[NC_MAX_VAR_DIMS];
+  if (numDims == 0 || numDims > NC_MAX_VAR_DIMS || var->nativeType == CDF_STRING || nc_inq_var_chunking(groupId, var->id, &storage, chunkSizes) != NC_NOERR || storage != NC_CHUNKED) {
+    if (useStriding) return nc_get_vars(groupId, var->id, start, count, stride, data);
+    return nc_get_vara(groupId, var->id, start, count, data);
+  }
+
+  size_t typeSize = CDF::getTypeSize(var->nativeType);
+  size_t span[NC_MAX_VAR_DIMS];
+  size_t chunkBytes = typeSize;
+  for (size_t d = 0; d < numDims; d++) {
+    span[d] = (count[d] - 1) * stride[d] + 1;
+    chunkBytes *= chunkSizes[d];
+  }
+
+  /* The outermost dimension which is read in more than one element, the read proceeds along this dimension */
+  size_t splitDim = 0;
+  while (splitDim + 1 < numDims && count[splitDim] == 1) splitDim++;
+
+  /* Grow the chunk cache to hold one row of chunks along the split dimension */
+  size_t chunksPerRow = 1;
+  for (size_t d = splitDim + 1; d < numDims; d++) {
+    chunksPerRow *= (start[d] + span[d] - 1) / chunkSizes[d] - start[d] / chunkSizes[d] + 1;
+  }
+  size_t cacheSize = 0, cacheElements = 0;
+  float cachePreemption = 0;
+  if (nc_get_var_chunk_cache(groupId, var->id, &cacheSize, &cacheElements, &cachePreemption) == NC_NOERR) {
+    size_t requiredSize = std::min(chunksPerRow * chunkBytes, chunkCacheLimit);
+    if (requiredSize > cacheSize) {
+      cacheElements = std::max(cacheElements, chunksPerRow * 2 + 1);
+      int status = nc_set_var_chunk_cache(groupId, var->id, requiredSize, cacheElements, cachePreemption);
+      if (status != NC_NOERR) {
+        ncError(__LINE__, className, "nc_set_var_chunk_cache: ", status);
+      }
+    }
+  }
+
+  if (!useStriding) {
+    return nc_get_vara(groupId, var->id, start, count, data);
+  }
+
+  /* A stride larger than the chunk size skips chunks, the netcdf strided read is cheaper then */
+  bool touchesAllChunks = true;
+  for (size_t d = 0; d < numDims; d++) {
+    if (stride[d] > 1 && size_t(stride[d]) > chunkSizes[d]) touchesAllChunks = false;
+  }
+  size_t innerElements = 1, outputInnerElements = 1;
+  for (size_t d = splitDim + 1; d < numDims; d++) {
+    innerElements *= span[d];
+    outputInnerElements *= count[d];
+  }
+  size_t blockRows = std::min(chunkSizes[splitDim], span[splitDim]);
+  if (!touchesAllChunks || blockRows * innerElements * typeSize > CDFNETCDFREADER_MAX_DECIMATE_BLOCK) {
+    return nc_get_vars(groupId, var->id, start, count, stride, data);
+  }
+
+  /* Read blocks aligned to the chunk boundaries of the split dimension and keep every stride'th element */
+  std::vector<char> block(blockRows * innerElements * typeSize);
+  size_t readStart[NC_MAX_VAR_DIMS], readCount[NC_MAX_VAR_DIMS];
+  for (size_t d = 0; d < numDims; d++) {
+    readStart[d] = start[d];
+    readCount[d] = span[d];
+  }
+  size_t chunkSize = chunkSizes[splitDim];
+  size_t spanStart = start[splitDim], spanEnd = start[splitDim] + span[splitDim];
+  size_t outputRow = 0;
+  for (size_t blockStart = spanStart; blockStart < spanEnd;) {
+    size_t blockEnd = std::min(spanEnd, (blockStart / chunkSize + 1) * chunkSize);
+    readStart[splitDim] = blockStart;
+    readCount[splitDim] = blockEnd - blockStart;
+    int status = nc_get_vara(groupId, var->id, readStart, readCount, &block[0]);
+    if (status != NC_NOERR) return status;
+    for (; outputRow < count[splitDim]; outputRow++) {
+      size_t sourceRow = spanStart + outputRow * stride[splitDim];
+      if (sourceRow >= blockEnd) break;
+      decimateBlock(&block[0] + (sourceRow - blockStart) * innerElements * typeSize, (char *)data + outputRow * outputInnerElements * typeSize, typeSize, numDims - splitDim - 1, span + splitDim + 1,
+                    count + splitDim + 1, stride + splitDim + 1);
+    }
+    blockStart = blockEnd;
+  }
+  return NC_NOERR;
+}
+
 int CDFNetCDFReader::_readVariableData(CDF::Variable *var, CDFType type) { return _readVariableData(var, type, NULL, NULL, NULL); }
 
 int CDFNetCDFReader::_readVariableData(CDF::Variable *var, CDFType type, size_t *start, size_t *count, ptrdiff_t *stride) {
@@ -244,22 +396,12 @@ int CDFNetCDFReader::_readVariableData(CDF::Variable *var, CDFType type, size_t
 #endif
 
     if (useStartCount == true) {
-      if (useStriding) {
 #ifdef CCDFNETCDFIO_DEBUG_OPEN
-        CDBDebug("READ SCS: [%s]", var->name.c_str());
+      CDBDebug("READ SC%s: [%s]", useStriding ? "S" : "", var->name.c_str());
 #endif
-        status = nc_get_vars(varGroupId, var->id, start, count, stride, voidData);
-        if (status != NC_NOERR) {
-          ncError(__LINE__, className, "nc_get_vars (typeconversion): ", status);
-        }
-      } else {
-#ifdef CCDFNETCDFIO_DEBUG_OPEN
-        CDBDebug("READ SC: [%s]", var->name.c_str());
-#endif
-        status = nc_get_vara(varGroupId, var->id, start, count, voidData);
-        if (status != NC_NOERR) {
-          ncError(__LINE__, className, "nc_get_vara (typeconversion): ", status);
-        }
+      status = _readHyperslab(varGroupId, var, start, count, stride, voidData);
+      if (status != NC_NOERR) {
+        ncError(__LINE__, className, "nc_get_vara (typeconversion): ", status);
       }
     } else {
 #ifdef CCDFNETCDFIO_DEBUG_OPEN
@@ -296,32 +438,17 @@ int CDFNetCDFReader::_readVariableData(CDF::Variable *var, CDFType type, size_t
 
   if (type == var->nativeType) {
     if (useStartCount) {
-      if (useStriding) {
 #ifdef CCDFNETCDFIO_DEBUG_OPEN
-        CT::string dims = "";
-        for (size_t j = 0; j < var->dimensionlinks.size(); j++) {
-          if (j > 0) dims.concat(",");
-          dims.printconcat("%s[%d:%d:%d]", var->dimensionlinks[j]->name.c_str(), start[j], count[j], start[j]);
-        }
-        CDBDebug("READ NSCS: [%s](%s)", var->name.c_str(), dims.c_str());
-#endif
-        status = nc_get_vars(varGroupId, var->id, start, count, stride, var->data);
-        if (status != NC_NOERR) {
-          ncError(__LINE__, className, "nc_get_vars (native): ", status);
-        }
-      } else {
-#ifdef CCDFNETCDFIO_DEBUG_OPEN
-        CT::string dims = "";
-        for (size_t j = 0; j < var->dimensionlinks.size(); j++) {
-          if (j > 0) dims.concat(",");
-          dims.printconcat("%s[%d:%d]", var->dimensionlinks[j]->name.c_str(), start[j], count[j]);
-        }
-        CDBDebug("READ NSC: [%s](%s)", var->name.c_str(), dims.c_str());
+      CT::string dims = "";
+      for (size_t j = 0; j < var->dimensionlinks.size(); j++) {
+        if (j > 0) dims.concat(",");
+        dims.printconcat("%s[%d:%d:%d]", var->dimensionlinks[j]->name.c_str(), start[j], count[j], stride[j]);
+      }
+      CDBDebug("READ NSC%s: [%s](%s)", useStriding ? "S" : "", var->name.c_str(), dims.c_str());
 #endif
-        status = nc_get_vara(varGroupId, var->id, start, count, var->data);
-        if (status != NC_NOERR) {
-          ncError(__LINE__, className, "nc_get_vara (native): ", status);
-        }
+      status = _readHyperslab(varGroupId, var, start, count, stride, var->data);
+      if (status != NC_NOERR) {
+        ncError(__LINE__, className, "nc_get_vara (native): ", status);
       }
     } else {
 #ifdef CCDFNETCDFIO_DEBUG_OPEN
@@ -910,6 +1037,10 @@ void CDFNetCDFWriter::disableReadData() { readData = false; };
 
 void CDFNetCDFWriter::recordNCCommands(bool enable) { listNCCommands = enable; }
 
+void CDFNetCDFWriter::setUnlimitedDimension(const char *dimName) { unlimitedDimensionName = dimName; }
+
+void CDFNetCDFWriter::setChunkSize(const char *dimName, size_t chunkSize) { chunkSizeOverrides[dimName] = chunkSize; }
+
 CT::string CDFNetCDFWriter::getNCCommands() { return NCCommands; };
 
 int CDFNetCDFWriter::write(const char *fileName) { return write(fileName, NULL); }
@@ -1069,7 +1200,9 @@ int CDFNetCDFWriter::_write(void (*progress)(const char *message, float percenta
     dim->setName(cdfObject->dimensions[j]->name.c_str());
     dim->length = cdfObject->dimensions[j]->length;
 
-    status = nc_def_dim(root_id, dim->name.c_str(), dim->length, &dim->id);
+    size_t dimLength = dim->length;
+    if (netcdfMode >= 4 && dim->name.equals(unlimitedDimensionName.c_str())) dimLength = NC_UNLIMITED;
+    status = nc_def_dim(root_id, dim->name.c_str(), dimLength, &dim->id);
 #ifdef CCDFNETCDFWRITER_DEBUG
     CDBDebug("DEF DIM %s %d %d", dim->name.c_str(), dim->length, dim->id);
 #endif
@@ -1175,6 +1308,14 @@ int CDFNetCDFWriter::_write(void (*progress)(const char *message, float percenta
                   }
                 } catch (int e) {
                 }
+                std::map<std::string, size_t>::iterator override = chunkSizeOverrides.find(variable->dimensionlinks[m]->name.c_str());
+                if (override != chunkSizeOverrides.end()) {
+                  chunkSizes[m] = override->second;
+                  if (chunkSizes[m] > variable->dimensionlinks[m]->getSize() && !variable->dimensionlinks[m]->name.equals(unlimitedDimensionName.c_str())) {
+                    chunkSizes[m] = variable->dimensionlinks[m]->getSize();
+                  }
+                }
+                if (chunkSizes[m] == 0) chunkSizes[m] = 1;
               }
 
               //                   for(size_t m=0;m<variable->dimensionlinks.size();m++){
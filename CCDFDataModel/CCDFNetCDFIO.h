@@ -28,6 +28,8 @@
 
 #include <stdio.h>
 #include <vector>
+#include <map>
+#include <string>
 #include <iostream>
 #include <netcdf.h>
 #include <math.h>
@@ -58,6 +60,8 @@ private:
   int readVariables(int groupId, CT::string *groupName, int mode);
   int _readVariableData(CDF::Variable *var, CDFType type);
   int _readVariableData(CDF::Variable *var, CDFType type, size_t *start, size_t *count, ptrdiff_t *stride);
+  int _readHyperslab(int groupId, CDF::Variable *var, size_t *start, size_t *count, ptrdiff_t *stride, void *data);
+  static size_t chunkCacheLimit;
 
   int _findNCGroupIdForCDFVariable(CT::string *varName);
 
@@ -65,6 +69,11 @@ public:
   CDFNetCDFReader();
   ~CDFNetCDFReader();
   void enableLonWarp(bool enableLonWarp);
+
+  /**
+   * @brief Sets the maximum size of the chunk cache per variable, the cache is grown up to this size to hold the chunks a read touches
+   */
+  static void setChunkCacheLimit(size_t bytes);
   int open(const char *fileName);
   int close();
 };
@@ -85,6 +94,8 @@ private:
   DEF_ERRORFUNCTION();
   int root_id, status;
   int netcdfMode;
+  CT::string unlimitedDimensionName;
+  std::map<std::string, size_t> chunkSizeOverrides;
   int _write(void (*progress)(const char *message, float percentage));
   int copyVar(CDF::Variable *variable, int nc_var_id, size_t *start, size_t *count);
 
@@ -99,6 +110,16 @@ public:
   void disableReadData();
   void setDeflateShuffle(int deflate, int deflate_level, int shuffle);
   void recordNCCommands(bool enable);
+
+  /**
+   * @brief Defines the dimension with this name as unlimited, so the written file can be extended along it later on
+   */
+  void setUnlimitedDimension(const char *dimName);
+
+  /**
+   * @brief Overrides the chunk size along the named dimension for all chunked variables, the size is limited to the dimension length
+   */
+  void setChunkSize(const char *dimName, size_t chunkSize);
   int write(const char *fileName);
   int write(const char *fileName, void (*progress)(const char *message, float percentage));
 };
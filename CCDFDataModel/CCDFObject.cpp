@@ -29,6 +29,7 @@
 #include "CCDFObject.h"
 #include "CCDFReader.h"
 #include "CTime.h"
+#include "CMetrics.h"
 
 const char *CDFObject::className = "CDFObject";
 
@@ -64,7 +65,10 @@ int CDFObject::open(const char *fileName) {
   }
   clear();
   currentFile.copy(fileName);
-  return r->open(fileName);
+  CMetrics::Timer timer(CMetrics::PHASE_FILEOPEN);
+  int status = r->open(fileName);
+  if (status == 0) CMetrics::increment(CMetrics::COUNTER_FILES_OPENED);
+  return status;
 }
 
 int CDFObject::close() {
@@ -27,6 +27,7 @@
 #include "CCDFObject.h"
 #include "CCDFReader.h"
 #include "CTime.h"
+#include "CMetrics.h"
 const char *CDF::Variable::className = "Variable";
 
 extern CDF::Variable::CustomMemoryReader customMemoryReaderInstance;
@@ -354,6 +355,7 @@ int CDF::Variable::readData(CDFType type, size_t *_start, size_t *_count, ptrdif
       CDBError("Unable to read data for variable %s", name.c_str());
       return 1;
     }
+    CMetrics::increment(CMetrics::COUNTER_BYTES_READ, (long long)getSize() * CDF::getTypeSize(type));
   }
 #ifdef CCDFDATAMODEL_DEBUG
   CDBDebug("Data for %s read %d", name.c_str(), data != NULL);
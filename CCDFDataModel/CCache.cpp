@@ -24,7 +24,12 @@
  ******************************************************************************/
 
 #include "CCache.h"
-#include <signal.h>
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include "CMetrics.h"
 const char *CCache::className = "CCache";
 
 //#define CCACHE_DEBUG
@@ -34,16 +39,13 @@ CCache::CCache() {
   cacheAvailable = false;
   cacheFileClaimed = false;
   cacheSystemIsBusy = false;
+  claimedLockFd = -1;
 }
 
 CCache::~CCache() {
-  if (fileName.length() != 0) {
-    if (isCacheFileBusy()) {
-      if (cacheFileClaimed) {
-        CDBDebug("!!!!! CACHE FILE NOT RELEASED !!!!");
-        removeClaimedCachefile();
-      }
-    }
+  if (cacheFileClaimed) {
+    CDBDebug("!!!!! CACHE FILE NOT RELEASED !!!!");
+    removeClaimedCachefile();
   }
 }
 
@@ -55,7 +57,7 @@ int CCache::_readPidFile(const char *claimedLockFile) {
     fseek(pFile, 0, SEEK_END);
     size_t fileSize = ftell(pFile);
     rewind(pFile);
-    char *buffer = (char *)malloc(sizeof(char) * fileSize);
+    char *buffer = (char *)malloc(sizeof(char) * (fileSize + 1));
     if (buffer == NULL) {
       CDBError("Memory error", stderr);
       exit(2);
@@ -64,6 +66,7 @@ int CCache::_readPidFile(const char *claimedLockFile) {
     if (result != fileSize) {
       CDBError("Reading error", stderr);
     } else {
+      buffer[fileSize] = 0;
       CT::string s = buffer;
       thePIDThatIsLocking = s.toInt();
     }
@@ -112,6 +115,64 @@ int CCache::_writePidFile(const char *claimedLockFile) {
   return 0;
 }
 
+int CCache::_writePidToLockFile(int fd) {
+  char buffer[20];
+  int length = snprintf(buffer, 19, "%d", int(getpid()));
+  if (ftruncate(fd, 0) != 0 || pwrite(fd, buffer, length, 0) != length) {
+    return 1;
+  }
+  return 0;
+}
+
+int CCache::_claimFileLock(const char *lockFile, bool wait) {
+  while (true) {
+    int fd = open(lockFile, O_RDWR | O_CREAT | O_CLOEXEC, 0777);
+    if (fd < 0) {
+      return -1;
+    }
+    /* Others need to be able to take over the file */
+    (void)!fchmod(fd, 0777);
+    if (flock(fd, wait ? LOCK_EX : LOCK_EX | LOCK_NB) != 0) {
+      int lockErrno = errno;
+      close(fd);
+      errno = lockErrno;
+      return -1;
+    }
+    /* The previous owner removes the file before unlocking, the lock is only valid when we locked the file which is still there */
+    struct stat lockedStat, currentStat;
+    if (fstat(fd, &lockedStat) == 0 && stat(lockFile, &currentStat) == 0 && lockedStat.st_dev == currentStat.st_dev && lockedStat.st_ino == currentStat.st_ino) {
+      return fd;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+}
+
+void CCache::_releaseFileLock(int fd, const char *lockFile) {
+  if (fd < 0) return;
+  remove(lockFile);
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+bool CCache::_waitForFileLock(const char *lockFile, const char *reason) {
+  int fd = open(lockFile, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  if (flock(fd, LOCK_SH | LOCK_NB) == 0) {
+    flock(fd, LOCK_UN);
+    close(fd);
+    return false;
+  }
+  CDBDebug("CCache::LOCK Waiting for procID %d [%s]", _readPidFile(lockFile), reason);
+  while (flock(fd, LOCK_SH) != 0 && errno == EINTR) {
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+  return true;
+}
+
 bool CCache::saveCacheFile() {
   // #ifdef CCACHE_DEBUG
   //   if(saveFieldFile){
@@ -172,123 +233,53 @@ void CCache::checkCacheSystemReady(const char *directory, const char *szfileName
   claimedCacheProcIDFileName.concat("_pid");
   claimedCacheFileName.concat("_tmp");
 
-  // Check if cache is busy
-  if (isCacheFileBusyBlocking(reason)) {
-    saveFieldFile = false;
-    cacheAvailable = false;
-  } else {
-    dateFromFile = CDirReader::getFileDate(resource);
-#ifdef CCACHE_DEBUG
-    CDBDebug("Cache not busy for %s", this->fileName.c_str());
-#endif
-    // Cache is not busy: Check if the cachefile is available
-    if (CCache::isCacheFileAvailable(this->fileName.c_str())) {
-      // Cache is available
-
-      bool cacheIsOutOfDate = true;
-
-      CT::string dateFile = this->fileName.c_str();
-      dateFile.concat("date");
-      try {
-        CT::string dateFromCache = CReadFile::open(dateFile.c_str());
-        if (dateFromCache.equals(dateFromFile)) {
-          cacheIsOutOfDate = false;
-          cacheAvailable = true;
-#ifdef CCACHE_DEBUG
-          CDBDebug("Cache is available");
-#endif
-        }
-      } catch (int e) {
-      }
-      // CDBDebug("claimedCacheFileName = [%s] for [%s]",claimedCacheFileName.c_str(),resource);
-
-      if (cacheIsOutOfDate == true) {
-        // CDBDebug("Cache is available but needs to be refreshed");
-        saveFieldFile = true;
-        // TODO MAKE SURE WE DO NOT REMOVE WRONG FILES!
-        CDBDebug("Removing outdated cachefile %s", fileName.c_str());
-        remove(fileName.c_str());
-      }
-
-      // cacheAvailable = true;
+  dateFromFile = CDirReader::getFileDate(resource);
+  checkCacheFile();
 
-    } else {
-// Cache is not available, but can be created
-#ifdef CCACHE_DEBUG
-      CDBDebug("Cache is not available for %s at location %s", szfileName, this->fileName.c_str());
-#endif
-      saveFieldFile = true;
-    }
+  // When another process is writing the cachefile, wait for it and use its result
+  if (cacheAvailable == false && _waitForFileLock(claimedCacheProcIDFileName.c_str(), reason)) {
+    CDBDebug("CCache::LOCK Another process has finished working on %s", fileName.c_str());
+    checkCacheFile();
   }
   cacheSystemIsBusy = false;
 }
 
-bool CCache::isCacheFileBusy() {
-  if (claimedCacheFileName.length() == 0) return false;
-  FILE *pFile = fopen(claimedCacheFileName.c_str(), "r");
-  if (pFile != NULL) {
-    fclose(pFile);
+void CCache::countLookup(bool served) { CMetrics::increment(served ? CMetrics::COUNTER_CCACHE_HITS : CMetrics::COUNTER_CCACHE_MISSES); }
+
+void CCache::checkCacheFile() {
+  saveFieldFile = false;
+  cacheAvailable = false;
+  if (CCache::isCacheFileAvailable(this->fileName.c_str())) {
+    // Cache is available
+    bool cacheIsOutOfDate = true;
+
+    CT::string dateFile = this->fileName.c_str();
+    dateFile.concat("date");
+    try {
+      CT::string dateFromCache = CReadFile::open(dateFile.c_str());
+      if (dateFromCache.equals(dateFromFile)) {
+        cacheIsOutOfDate = false;
+        cacheAvailable = true;
 #ifdef CCACHE_DEBUG
-    CDBDebug("Cache busy \"%s\"", claimedCacheFileName.c_str());
+        CDBDebug("Cache is available");
 #endif
-    return true;
-  }
-  /*#ifdef CCACHE_DEBUG
-  CDBDebug("Cache not busy \"%s\"",claimedCacheFileName.c_str());
-  #endif
-  */
-  return false;
-}
-
-bool CCache::isCacheFileBusyBlocking(const char *reason) {
-
-  if (fileName.length() == 0) return false;
-  int maxTries = 100;
-  int currentTries = maxTries;
-  bool cacheWasLocked = false;
-  int logEveryNChecks = 10;
-  int logChecks = logEveryNChecks;
-  // Is some kind of process working on any of the cache files?
-  do {
-    if (isCacheFileBusy()) {
-      cacheWasLocked = true;
-      if (currentTries <= 0) {
-        CDBDebug("CCache::LOCK !!! A process is working already 60 seconds on %s for %s, skipping wait", fileName.c_str(), reason);
-        return true;
-      } else {
-        size_t thePIDThatIsLocking = _readPidFile(claimedCacheProcIDFileName.c_str());
-        if (thePIDThatIsLocking > 0) {
-          // Check if the process locking this file is still running
-          int status = kill(thePIDThatIsLocking, 0);
-          if (status == -1) {
-            CDBDebug("WARNING: LOCKED by procID %d [%s] for key %s which is not running, continuing...", thePIDThatIsLocking, reason, claimedCacheFileName.c_str());
-            currentTries = 0;
-          } else {
-            if (logChecks <= 0) {
-              CDBDebug("CCache::LOCKED by procID %d [%s], waiting %f seconds", thePIDThatIsLocking, reason, float(currentTries) / 10.0);
-              logChecks = logEveryNChecks;
-            } else {
-              logChecks--;
-            }
-          }
-        } else {
-          currentTries = 0;
-          break;
-        }
-        if (currentTries > 0) {
-          usleep(100000);
-        }
-      }
-    } else {
-      if (cacheWasLocked) {
-        CDBDebug("CCache::LOCK Another process has finished working on %s", fileName.c_str());
       }
-      return false;
+    } catch (int e) {
     }
-    currentTries--;
-  } while (currentTries > 0);
 
-  return false;
+    if (cacheIsOutOfDate == true) {
+      saveFieldFile = true;
+      // TODO MAKE SURE WE DO NOT REMOVE WRONG FILES!
+      CDBDebug("Removing outdated cachefile %s", fileName.c_str());
+      remove(fileName.c_str());
+    }
+  } else {
+// Cache is not available, but can be created
+#ifdef CCACHE_DEBUG
+    CDBDebug("Cache is not available at location %s", this->fileName.c_str());
+#endif
+    saveFieldFile = true;
+  }
 }
 
 bool CCache::isCacheFileAvailable(const char *fileName) {
@@ -302,9 +293,8 @@ bool CCache::isCacheFileAvailable(const char *fileName) {
 
 int CCache::releaseCacheFile() {
   rename(claimedCacheFileName.c_str(), fileName.c_str());
-  if (claimedCacheProcIDFileName.length() > 0) {
-    remove(claimedCacheProcIDFileName.c_str());
-  }
+  _releaseFileLock(claimedLockFd, claimedCacheProcIDFileName.c_str());
+  claimedLockFd = -1;
 #ifdef CCACHE_DEBUG
   CDBDebug("CCache::LOCK Claimed cachefile released");
 #endif
@@ -330,23 +320,33 @@ int CCache::claimCacheFile() {
     CDBDebug("CCache::LOCK claimCacheFile: Cache is already available for %s", fileName.c_str());
     return 4;
   }
-  if (isCacheFileBusy()) {
-    CDBDebug("CCache::LOCK claimCacheFile: Cache is already working on %s", claimedCacheFileName.c_str());
-    return 3;
-  }
-  // const char buffer[] = { "temp_data\n" };
 
   CT::string directory = claimedCacheFileName.substring(0, claimedCacheFileName.lastIndexOf("/"));
   CDirReader::makePublicDirectory(directory.c_str());
 
-  int status = _writePidFile(claimedCacheFileName.c_str());
-  if (status != 0) {
-    CDBDebug("Unable to write pid file");
+  int lockFd = _claimFileLock(claimedCacheProcIDFileName.c_str(), false);
+  if (lockFd < 0) {
+    if (errno == EWOULDBLOCK) {
+      CDBDebug("CCache::LOCK claimCacheFile: Cache is already working on %s", claimedCacheFileName.c_str());
+      return 3;
+    }
+    CDBDebug("Unable to lock %s", claimedCacheProcIDFileName.c_str());
     return 1;
   }
-  status = _writePidFile(claimedCacheProcIDFileName.c_str());
+  // Another process could have finished the cachefile between checkCacheSystemReady and now
+  if (isCacheFileAvailable(fileName.c_str())) {
+    _releaseFileLock(lockFd, claimedCacheProcIDFileName.c_str());
+    CDBDebug("CCache::LOCK claimCacheFile: Cache is already available for %s", fileName.c_str());
+    return 4;
+  }
+  claimedLockFd = lockFd;
+  cacheFileClaimed = true;
+  _writePidToLockFile(claimedLockFd);
+
+  int status = _writePidFile(claimedCacheFileName.c_str());
   if (status != 0) {
     CDBDebug("Unable to write pid file");
+    removeClaimedCachefile();
     return 1;
   }
 
@@ -360,11 +360,11 @@ int CCache::claimCacheFile() {
     CReadFile::write(dateFile.c_str(), dateFromFile.c_str(), dateFromFile.length());
   } catch (int e) {
     CDBDebug("Unable to write date file");
+    removeClaimedCachefile();
     return 1;
   }
 
   saveFieldFile = true;
-  cacheFileClaimed = true;
 #ifdef CCACHE_DEBUG
   CDBDebug("CCache::LOCK Cache claimed \"%s\"", claimedCacheFileName.c_str());
 #endif
@@ -378,9 +378,8 @@ void CCache::removeClaimedCachefile() {
       CDBDebug("Removing %s", claimedCacheFileName.c_str());
       remove(claimedCacheFileName.c_str());
     }
-    if (claimedCacheProcIDFileName.length() > 0) {
-      remove(claimedCacheProcIDFileName.c_str());
-    }
+    _releaseFileLock(claimedLockFd, claimedCacheProcIDFileName.c_str());
+    claimedLockFd = -1;
   }
 #ifdef CCACHE_DEBUG
   CDBDebug("Claimed cachefile removed");
@@ -389,9 +388,68 @@ void CCache::removeClaimedCachefile() {
   saveFieldFile = false;
 }
 
+class CCacheFileInfo {
+public:
+  std::string fileName;
+  size_t size;
+  time_t modificationTime;
+  bool operator<(const CCacheFileInfo &other) const { return modificationTime < other.modificationTime; }
+};
+
+static bool endsWith(const std::string &value, const char *suffix) {
+  size_t length = strlen(suffix);
+  return value.length() >= length && value.compare(value.length() - length, length, suffix) == 0;
+}
+
+static void listCacheFiles(const std::string &directory, std::vector<CCacheFileInfo> &cacheFiles) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) return;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    std::string fileName = directory + "/" + entry->d_name;
+    struct stat fileStat;
+    if (lstat(fileName.c_str(), &fileStat) != 0) continue;
+    if (S_ISDIR(fileStat.st_mode)) {
+      listCacheFiles(fileName, cacheFiles);
+      continue;
+    }
+    /* Date, lock and temporary files belong to a cachefile and are not counted separately */
+    if (!S_ISREG(fileStat.st_mode) || endsWith(fileName, "date") || endsWith(fileName, "_pid") || endsWith(fileName, "_tmp")) continue;
+    CCacheFileInfo cacheFile;
+    cacheFile.fileName = fileName;
+    cacheFile.size = fileStat.st_size;
+    cacheFile.modificationTime = fileStat.st_mtime;
+    cacheFiles.push_back(cacheFile);
+  }
+  closedir(dir);
+}
+
+void CCache::limitCacheSize(const char *directory, const char *keyPrefix, size_t maxBytes) {
+  if (directory == NULL || keyPrefix == NULL) return;
+  std::string cacheDir = directory;
+  cacheDir += "/adaguc/cache/";
+  cacheDir += keyPrefix;
+  std::vector<CCacheFileInfo> cacheFiles;
+  listCacheFiles(cacheDir, cacheFiles);
+  size_t totalBytes = 0;
+  for (size_t j = 0; j < cacheFiles.size(); j++) totalBytes += cacheFiles[j].size;
+  if (totalBytes <= maxBytes) return;
+  std::sort(cacheFiles.begin(), cacheFiles.end());
+  for (size_t j = 0; j < cacheFiles.size() && totalBytes > maxBytes; j++) {
+    /* Processes which already opened the file can still read it */
+    if (remove(cacheFiles[j].fileName.c_str()) == 0) {
+      remove((cacheFiles[j].fileName + "date").c_str());
+      totalBytes -= cacheFiles[j].size;
+    }
+  }
+  CDBDebug("Limited cache %s to %lu bytes", cacheDir.c_str(), (unsigned long)totalBytes);
+}
+
 CCache::Lock::Lock() {
   claimedLockFile = "";
   claimedLockID = "";
+  claimedLockFd = -1;
   isEnabled = false;
 }
 CCache::Lock::~Lock() { release(); }
@@ -401,95 +459,64 @@ int CCache::Lock::claim(const char *cacheDir, const char *identifier, const char
 
   if (cacheDir == NULL || identifier == NULL) return 0;
 
-  if (claimedLockFile.length() > 0) {
+  if (claimedLockFd >= 0) {
     CDBDebug("Already claimed! %s", claimedLockID.c_str());
+    return 0;
+  }
 
-  } else {
-
-    claimedLockID = identifier;
+  claimedLockID = identifier;
 
-    CT::string myid = "";
-    myid.concat(identifier);
-    myid.replaceSelf(":", "_");
-    // myid.replaceSelf("/","_");
+  CT::string myid = "";
+  myid.concat(identifier);
+  myid.replaceSelf(":", "_");
 
-    int maxlength = CCACHE_MAXFILELENGTH;
-    size_t nrStrings = (myid.length() / maxlength) + 1;
-    CT::string myidinparts = "adaguc/locks";
-    for (size_t j = 0; j < nrStrings; j++) {
-      if (myidinparts.length() > 0) {
-        myidinparts += "/";
-      }
-      myidinparts += myid.substring(j * maxlength, j * maxlength + maxlength);
+  int maxlength = CCACHE_MAXFILELENGTH;
+  size_t nrStrings = (myid.length() / maxlength) + 1;
+  CT::string myidinparts = "adaguc/locks";
+  for (size_t j = 0; j < nrStrings; j++) {
+    if (myidinparts.length() > 0) {
+      myidinparts += "/";
     }
-
-    claimedLockFile = cacheDir;
-    claimedLockFile.concat("/");
-    claimedLockFile.concat(&myidinparts);
-    claimedLockFile.concat("lock.lock");
-
-    CT::string directory = claimedLockFile.substring(0, claimedLockFile.lastIndexOf("/"));
-    CDirReader::makePublicDirectory(directory.c_str());
+    myidinparts += myid.substring(j * maxlength, j * maxlength + maxlength);
   }
 
-  // Check if the file exists...
+  claimedLockFile = cacheDir;
+  claimedLockFile.concat("/");
+  claimedLockFile.concat(&myidinparts);
+  claimedLockFile.concat("lock.lock");
 
-  int maxTries = 100;
-  int logEveryNChecks = 10;
-  int logChecks = 0;
-  bool wasLocked = false;
-  int wasLockedBy = -1;
-  do {
-    // Read by which process the file was locked
-    int thePIDThatIsLocking = CCache::_readPidFile(claimedLockFile.c_str());
-    if (thePIDThatIsLocking > 0) {
-      wasLocked = true;
-      wasLockedBy = thePIDThatIsLocking;
-      // Check if the process locking this file is still running
-      int status = kill(thePIDThatIsLocking, 0);
-      if (status == -1) {
-        CDBDebug("[LOCK] WARNING: LOCKED by procID %d which is not running, needed for [%s] with key [%s] continuing...", thePIDThatIsLocking, reason, claimedLockID.c_str());
-        maxTries = 0;
-      } else {
-        if (logChecks <= 0) {
-          CDBDebug("[LOCK Locked by pid %d] polling every 100ms, waiting %f seconds. I need it for [%s]", thePIDThatIsLocking, float(maxTries) / 10.0, reason);
-          logChecks = logEveryNChecks;
-        } else {
-          logChecks--;
-        }
-      }
-      if (maxTries > 0) {
-        usleep(100 * 1000); // Sleep 100ms
-      }
-
-    } else {
-      maxTries = 0;
-      break;
-    }
-    maxTries--;
-  } while (maxTries > 0);
-  if (wasLocked) {
-    CDBDebug("[LOCK: Released by %d] Continuing operation [%s]", wasLockedBy, reason);
+  CT::string directory = claimedLockFile.substring(0, claimedLockFile.lastIndexOf("/"));
+  CDirReader::makePublicDirectory(directory.c_str());
 
+  // Try without waiting first, so that waiting can be logged
+  claimedLockFd = CCache::_claimFileLock(claimedLockFile.c_str(), false);
+  if (claimedLockFd < 0 && errno == EWOULDBLOCK) {
+    int lockedBy = CCache::_readPidFile(claimedLockFile.c_str());
+    CDBDebug("[LOCK Locked by pid %d] waiting. I need it for [%s]", lockedBy, reason);
+    do {
+      claimedLockFd = CCache::_claimFileLock(claimedLockFile.c_str(), true);
+    } while (claimedLockFd < 0 && errno == EINTR);
+    CDBDebug("[LOCK: Released by %d] Continuing operation [%s]", lockedBy, reason);
+  }
+  if (claimedLockFd < 0) {
+    CDBError("Unable to lock %s. Continuing with operation [%s]", claimedLockFile.c_str(), reason);
+    claimedLockFile = "";
+    return 0;
+  }
 #ifdef CCACHE_DEBUG
-    CDBDebug("LOCK FREED %s,", claimedLockFile.c_str());
+  CDBDebug("LOCK CLAIMED %s,", claimedLockFile.c_str());
 #endif
-  }
 
-  // const char buffer[] = { "temp_data\n" };
-  int status = CCache::_writePidFile(claimedLockFile.c_str());
-  if (status != 0) {
-    CDBError("Unable to write PID file (status %s). Continuing with operation [%s]", status, reason);
+  if (CCache::_writePidToLockFile(claimedLockFd) != 0) {
+    CDBError("Unable to write PID to lockfile. Continuing with operation [%s]", reason);
   }
-
-  // CDBDebug("LOCK Claimed: %s", claimedLockFile.c_str() );
   return 0;
 }
 
 void CCache::Lock::release() {
   if (isEnabled == false) return;
-  if (claimedLockFile.length() == 0) return;
-  // CDBDebug("LOCK release %s",claimedLockID.c_str());
-  remove(claimedLockFile.c_str());
+  if (claimedLockFd < 0) return;
+  CCache::_releaseFileLock(claimedLockFd, claimedLockFile.c_str());
+  claimedLockFd = -1;
   claimedLockFile = "";
 }
@@ -35,6 +35,9 @@
  * Helper class for cache files.
  * The cache system uses a temporary file to write intermediate results.
  * It takes care of multiple processes trying to read save and modify the same cache file.
+ * The process writing a cachefile holds an exclusive flock on the _pid file next to it. Processes needing the same cachefile
+ * block on that lock and read the result when it is released, so concurrent misses on the same key result in one computation.
+ * Kernel locks are released when a process dies, there are no stale locks.
  * This set of methods take care of both the temporary and the non temporary files, moves files when ready and sets permissions
  *
  * Methods should be called in the following order:
@@ -55,25 +58,38 @@ private:
   CT::string dateFromFile;
   CT::string claimedCacheFileName;
   CT::string claimedCacheProcIDFileName;
+  int claimedLockFd;
 
   static int _writePidFile(const char *file);
+  static int _writePidToLockFile(int fd);
   static int _readPidFile(const char *file);
 
-  DEF_ERRORFUNCTION();
+  /**
+   * Opens or creates the lockfile and takes an exclusive flock on it. Retries when the previous owner removed the file meanwhile.
+   * @param lockFile The file to lock
+   * @param wait Block until the lock is available
+   * @return The file descriptor holding the lock, -1 when not locked. errno is EWOULDBLOCK when another process holds the lock.
+   */
+  static int _claimFileLock(const char *lockFile, bool wait);
 
   /**
-   * Check if cachefile is working on a file. Tests _tmp file. When returns true, a new cache file should not be generated
-   * @param fileName
-   * @return true when cache is busy
+   * Removes the lockfile and releases the lock, processes waiting for it wake up immediately.
    */
-  bool isCacheFileBusy();
+  static void _releaseFileLock(int fd, const char *lockFile);
 
   /**
-   * Check if cachefile is working on a file. Tests _tmp file. When returns true, a new cache file should not be generated
-   * @param fileName
-   * @return true when cache is busy
+   * Blocks while another process holds the lock on lockFile.
+   * @return true if another process was holding the lock
    */
-  bool isCacheFileBusyBlocking(const char *reason);
+  static bool _waitForFileLock(const char *lockFile, const char *reason);
+
+  DEF_ERRORFUNCTION();
+
+  /**
+   * Checks if the cachefile exists and belongs to the current version of the resource. Outdated cachefiles are removed.
+   * Sets cacheAvailable or saveFieldFile accordingly.
+   */
+  void checkCacheFile();
 
   /**
    * Check if cachefile is available
@@ -87,11 +103,17 @@ public:
   private:
     CT::string claimedLockFile;
     CT::string claimedLockID;
+    int claimedLockFd;
     bool isEnabled;
 
   public:
     Lock();
     ~Lock();
+
+    /**
+     * Claims the lock for identifier, blocks as long as another process holds it.
+     * @return Zero on success
+     */
     int claim(const char *cacheDir, const char *identifier, const char *reason, bool enable);
     void release();
   };
@@ -106,7 +128,8 @@ public:
   ~CCache();
 
   /**
-   * Checks availability of cachefile and determines if cache is busy. Cache methods saveCacheFile() and cacheIsAvailable() are available to query after this has been called.
+   * Checks availability of cachefile. When another process is writing it, this waits until that process is finished.
+   * Cache methods saveCacheFile() and cacheIsAvailable() are available to query after this has been called.
    * @param fileName;
    */
   void checkCacheSystemReady(const char *directory, const char *fileName, const char *resource, const char *reason);
@@ -144,5 +167,21 @@ public:
    * Removes and unclaims cachefile, necessary in case an error happened and the program is unable to save a cachefile
    */
   void removeClaimedCachefile();
+
+  /**
+   * Removes the oldest cachefiles of which the name starts with keyPrefix, until they take no more than maxBytes together.
+   * Meant to be called after a new cachefile was released, to prevent caches for derived data from growing without bound.
+   * @param directory The cache directory, same as given to checkCacheSystemReady
+   * @param keyPrefix The first part of the cache filenames, e.g. "hillshade"
+   * @param maxBytes The maximum total size of the cachefiles
+   */
+  static void limitCacheSize(const char *directory, const char *keyPrefix, size_t maxBytes);
+
+  /**
+   * Counts a lookup in the cache hit and miss metrics. To be called by readers once they know whether the cachefile served the request,
+   * not for checks made before writing a cachefile.
+   * @param served True when the result was read from the cachefile
+   */
+  static void countLookup(bool served);
 };
 #endif
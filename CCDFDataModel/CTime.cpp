@@ -114,6 +114,10 @@ void CTime::safestrcpy(char *s1, const char *s2, size_t size_s1) {
 CTime::CTime() {
   isInitialized = false;
   mode = CTIME_MODE_UTCALENDAR;
+  fastPathAvailable = false;
+  fastPathEnabled = true;
+  fastPathUnitSeconds = 1;
+  fastPathBaseSeconds = 0;
 }
 CTime::~CTime() { reset(); }
 
@@ -130,6 +134,7 @@ void CTime::reset() {
   currentUnit = "";
   currentCalendar = "";
   isInitialized = false;
+  fastPathAvailable = false;
 }
 
 int CTime::init(CDF::Variable *timeVariable) {
@@ -445,11 +450,127 @@ int CTime::init(const char *units, const char *calendar) {
     return 1;
   }
   mode = CTIME_MODE_UTCALENDAR;
+  fastPathAvailable = initFastPath(units, currentCalendar.c_str());
 
   isInitialized = true;
   return 0;
 }
 
+/* The fast path is only used from this date on, before it udunits switches to the julian calendar */
+#define CTIME_FASTPATH_MIN_SECONDS (-12212553600.) /* 1583-01-01T00:00:00Z */
+#define CTIME_FASTPATH_MAX_SECONDS (253402300800.) /* 10000-01-01T00:00:00Z */
+
+/* Reads up to maxDigits digits, returns the number of digits read */
+static int CTime_readNumber(const char *&p, int maxDigits, int &value) {
+  int n = 0;
+  value = 0;
+  while (n < maxDigits && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p - '0');
+    p++;
+    n++;
+  }
+  return n;
+}
+
+bool CTime::initFastPath(const char *units, const char *calendar) {
+  if (calendar != NULL && strlen(calendar) > 0) {
+    CT::string cal = calendar;
+    if (!cal.equals("standard") && !cal.equals("gregorian") && !cal.equals("proleptic_gregorian")) return false;
+  }
+  const char *p = units;
+  while (*p == ' ') p++;
+  const char *unitStart = p;
+  while (*p != ' ' && *p != 0) p++;
+  CT::string unit;
+  unit.copy(unitStart, p - unitStart);
+  unit.toLowerCaseSelf();
+  if (unit.equals("seconds") || unit.equals("second") || unit.equals("secs") || unit.equals("sec") || unit.equals("s")) {
+    fastPathUnitSeconds = 1;
+  } else if (unit.equals("minutes") || unit.equals("minute") || unit.equals("mins") || unit.equals("min")) {
+    fastPathUnitSeconds = 60;
+  } else if (unit.equals("hours") || unit.equals("hour") || unit.equals("hrs") || unit.equals("hr") || unit.equals("h")) {
+    fastPathUnitSeconds = 3600;
+  } else if (unit.equals("days") || unit.equals("day") || unit.equals("d")) {
+    fastPathUnitSeconds = 86400;
+  } else {
+    return false;
+  }
+  while (*p == ' ') p++;
+  if (strncmp(p, "since ", 6) != 0) return false;
+  p += 6;
+  while (*p == ' ') p++;
+
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  double fraction = 0;
+  if (CTime_readNumber(p, 4, year) == 0 || *p++ != '-') return false;
+  if (CTime_readNumber(p, 2, month) == 0 || *p++ != '-') return false;
+  if (CTime_readNumber(p, 2, day) == 0) return false;
+  if (*p == ' ' || *p == 'T') {
+    const char *timeStart = p + 1;
+    int h;
+    if (CTime_readNumber(timeStart, 2, h) > 0 && *timeStart == ':') {
+      p = timeStart + 1;
+      hour = h;
+      if (CTime_readNumber(p, 2, minute) == 0) return false;
+      if (*p == ':') {
+        p++;
+        if (CTime_readNumber(p, 2, second) == 0) return false;
+        if (*p == '.') {
+          p++;
+          double scale = 0.1;
+          while (*p >= '0' && *p <= '9') {
+            fraction += (*p - '0') * scale;
+            scale /= 10;
+            p++;
+          }
+        }
+      }
+    }
+  }
+  /* Only UTC is handled here, other time zones are left to udunits */
+  while (*p == ' ') p++;
+  if (*p == 'Z') {
+    p++;
+  } else if (strncmp(p, "UTC", 3) == 0) {
+    p += 3;
+  } else if (*p == '+' || *p == '-' || (*p >= '0' && *p <= '9')) {
+    if (*p == '+' || *p == '-') p++;
+    int zoneHours, zoneMinutes = 0;
+    if (CTime_readNumber(p, 2, zoneHours) == 0) return false;
+    if (*p == ':') p++;
+    CTime_readNumber(p, 2, zoneMinutes);
+    if (zoneHours != 0 || zoneMinutes != 0) return false;
+  }
+  while (*p == ' ') p++;
+  if (*p != 0) return false;
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) return false;
+
+  fastPathBaseSeconds = double(daysFromCivil(year, month, day)) * 86400 + hour * 3600 + minute * 60 + second + fraction;
+  if (fastPathBaseSeconds < CTIME_FASTPATH_MIN_SECONDS) return false;
+  return true;
+}
+
+long long CTime::daysFromCivil(int year, int month, int day) {
+  long long y = month <= 2 ? year - 1 : year;
+  long long era = (y >= 0 ? y : y - 399) / 400;
+  long long yoe = y - era * 400;
+  long long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+void CTime::civilFromDays(long long days, int &year, int &month, int &day) {
+  days += 719468;
+  long long era = (days >= 0 ? days : days - 146096) / 146097;
+  long long doe = days - era * 146097;
+  long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  long long mp = (5 * doy + 2) / 153;
+  day = int(doy - (153 * mp + 2) / 5 + 1);
+  month = int(mp < 10 ? mp + 3 : mp - 9);
+  year = int(yoe + era * 400 + (month <= 2 ? 1 : 0));
+}
+
 int CTime::getMonthByDayInYear(int day, int *monthsCumul) {
   for (int j = 1; j < 13; j++) {
     if (monthsCumul[j] >= day) {
@@ -468,6 +589,31 @@ CTime::Date CTime::getDate(double offset) {
   Date date;
   date.offset = offset;
 
+  if (mode == CTIME_MODE_UTCALENDAR && fastPathAvailable && fastPathEnabled) {
+    double seconds = fastPathBaseSeconds + offset * fastPathUnitSeconds;
+    if (seconds >= CTIME_FASTPATH_MIN_SECONDS && seconds < CTIME_FASTPATH_MAX_SECONDS) {
+      /* Round to microseconds, like udunits rounds to the resolution of the value */
+      double wholeSeconds = floor(seconds);
+      double fraction = floor((seconds - wholeSeconds) * 1e6 + 0.5) / 1e6;
+      if (fraction >= 1) {
+        wholeSeconds += 1;
+        fraction = 0;
+      }
+      long long secondsSinceEpoch = (long long)wholeSeconds;
+      long long days = secondsSinceEpoch / 86400;
+      long long secondOfDay = secondsSinceEpoch - days * 86400;
+      if (secondOfDay < 0) {
+        secondOfDay += 86400;
+        days--;
+      }
+      civilFromDays(days, date.year, date.month, date.day);
+      date.hour = int(secondOfDay / 3600);
+      date.minute = int((secondOfDay / 60) % 60);
+      date.second = double(secondOfDay % 60) + fraction;
+      return date;
+    }
+  }
+
   if (mode == CTIME_MODE_360day) {
     if (timeUnits.unitType == CTIME_UNITTYPE_DAYS) {
       double newOffset = timeUnits.dateSinceOffset + offset;
@@ -636,6 +782,11 @@ double CTime::dateToOffset(Date date) {
     return int(date.year) * 10000 + int(date.month - 1) * 100 + int(date.day - 1);
   }
 
+  if (mode == CTIME_MODE_UTCALENDAR && fastPathAvailable && fastPathEnabled && date.year >= 1583 && date.year < 10000) {
+    double seconds = double(daysFromCivil(date.year, date.month, date.day)) * 86400 + date.hour * 3600 + date.minute * 60 + (int)date.second;
+    return (seconds - fastPathBaseSeconds) / fastPathUnitSeconds;
+  }
+
   if (mode == CTIME_MODE_UTCALENDAR) {
     if (utInvCalendar(date.year, date.month, date.day, date.hour, date.minute, (int)date.second, &dataunits, &offset) != 0) {
       CDBError("dateToOffset: Internal error: utInvCalendar with args %s", dateToString(date).c_str());
@@ -739,6 +890,19 @@ CT::string CTime::dateToString(Date date) {
   return s;
 }
 
+size_t CTime::offsetsToISOStrings(const double *offsets, size_t count, CT::string *isoStrings) {
+  size_t numFailed = 0;
+  for (size_t j = 0; j < count; j++) {
+    try {
+      isoStrings[j] = dateToISOString(getDate(offsets[j]));
+    } catch (int e) {
+      isoStrings[j] = "";
+      numFailed++;
+    }
+  }
+  return numFailed;
+}
+
 CT::string CTime::dateToISOString(Date date) {
   CT::string s;
   float second = date.second;
@@ -75,6 +75,11 @@ private:
   bool isInitialized;
   int mode;
 
+  /* Integer civil date arithmetic for "<unit> since <date>" units on the standard calendar, used instead of udunits */
+  bool fastPathAvailable, fastPathEnabled;
+  double fastPathUnitSeconds, fastPathBaseSeconds;
+  bool initFastPath(const char *units, const char *calendar);
+
 public:
   int getMode() { return mode; }
   /**
@@ -143,6 +148,37 @@ public:
   Date getDate(double offset);
   Date offsetToDate(double offset) { return getDate(offset); };
 
+  /**
+   * Converts a series of values to ISO8601 strings in the format of dateToISOString.
+   * Values which cannot be converted result in an empty string, this function does not throw.
+   * @param offsets The values to convert
+   * @param count Number of values
+   * @param isoStrings Array of count strings which receives the results
+   * @return Number of values which could not be converted
+   */
+  size_t offsetsToISOStrings(const double *offsets, size_t count, CT::string *isoStrings);
+
+  /**
+   * Enables or disables the fast conversion path for standard calendars, it is enabled by default.
+   * When disabled all conversions go through udunits, which is useful to compare both.
+   */
+  void setFastPathEnabled(bool enabled) { fastPathEnabled = enabled; }
+
+  /**
+   * Returns true when conversions for the current units use integer civil date arithmetic instead of udunits
+   */
+  bool isFastPathAvailable() { return isInitialized && fastPathAvailable && fastPathEnabled; }
+
+  /**
+   * Returns the number of days since 1970-01-01 for a date in the proleptic gregorian calendar
+   */
+  static long long daysFromCivil(int year, int month, int day);
+
+  /**
+   * Returns the date in the proleptic gregorian calendar for a number of days since 1970-01-01
+   */
+  static void civilFromDays(long long days, int &year, int &month, int &day);
+
   /**
    * Turns date object into double value
    * Throws integer CTIME_CONVERSION_ERROR when fails
@@ -35,6 +35,9 @@
 #include "CCDFDataModel.h"
 #include "CCDFHDF5IO.h"
 #include "utils.h"
+#include <sys/time.h>
+#include <unistd.h>
+#include <netcdf.h>
 
 DEF_ERRORMAIN();
 
@@ -135,6 +138,53 @@ int testCTimeEpochTimeConversion() {
   return failed;
 }
 
+static double testGetSeconds() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Compares the fast standard calendar conversion with udunits and reports the speed of both */
+int testCTimeFastPath(const char *units, double step) {
+  const size_t numOffsets = 100000;
+  std::vector<double> offsets(numOffsets);
+  for (size_t j = 0; j < numOffsets; j++) offsets[j] = double(j) * step;
+
+  CTime fastTime, udunitsTime;
+  if (fastTime.init(units, "standard") != 0 || udunitsTime.init(units, "standard") != 0) {
+    CDBError("[FAILED] testCTimeFastPath: unable to init with %s", units);
+    return 1;
+  }
+  if (!fastTime.isFastPathAvailable()) {
+    CDBError("[FAILED] testCTimeFastPath: no fast path for %s", units);
+    return 1;
+  }
+  udunitsTime.setFastPathEnabled(false);
+
+  std::vector<CT::string> fastStrings(numOffsets), udunitsStrings(numOffsets);
+  double start = testGetSeconds();
+  fastTime.offsetsToISOStrings(&offsets[0], numOffsets, &fastStrings[0]);
+  double fastDuration = testGetSeconds() - start;
+  start = testGetSeconds();
+  udunitsTime.offsetsToISOStrings(&offsets[0], numOffsets, &udunitsStrings[0]);
+  double udunitsDuration = testGetSeconds() - start;
+  CDBDebug("testCTimeFastPath %s: fast %f s, udunits %f s for %d offsets", units, fastDuration, udunitsDuration, (int)numOffsets);
+
+  for (size_t j = 0; j < numOffsets; j++) {
+    if (!fastStrings[j].equals(udunitsStrings[j])) {
+      CDBError("[FAILED] testCTimeFastPath %s: offset %f gives %s instead of %s", units, offsets[j], fastStrings[j].c_str(), udunitsStrings[j].c_str());
+      return 1;
+    }
+    double fastOffset = fastTime.dateToOffset(fastTime.getDate(offsets[j]));
+    if (fastOffset != offsets[j]) {
+      CDBError("[FAILED] testCTimeFastPath %s: offset %f gives %f back", units, offsets[j], fastOffset);
+      return 1;
+    }
+  }
+  CDBDebug("[OK] testCTimeFastPath %s", units);
+  return 0;
+}
+
 int testHDF5Reader() {
   CDBDebug("testHDF5Reader");
   CT::string testFile = "./testdata/variable_string.h5";
@@ -164,6 +214,107 @@ int testHDF5Reader() {
   return 0;
 }
 
+/* Writes a chunked netcdf4 file with an int and a double variable, their values are their linear index */
+static int testCreateChunkedFile(const char *fileName) {
+  int ncId, dimIds[3], intVarId, doubleVarId;
+  size_t dimSizes[3] = {5, 37, 41}, intChunks[3] = {2, 8, 8}, doubleChunks[2] = {8, 8};
+  const char *dimNames[3] = {"time", "y", "x"};
+  if (nc_create(fileName, NC_NETCDF4 | NC_CLOBBER, &ncId) != NC_NOERR) return 1;
+  for (int d = 0; d < 3; d++) nc_def_dim(ncId, dimNames[d], dimSizes[d], &dimIds[d]);
+  nc_def_var(ncId, "intdata", NC_INT, 3, dimIds, &intVarId);
+  nc_def_var_chunking(ncId, intVarId, NC_CHUNKED, intChunks);
+  nc_def_var(ncId, "doubledata", NC_DOUBLE, 2, dimIds + 1, &doubleVarId);
+  nc_def_var_chunking(ncId, doubleVarId, NC_CHUNKED, doubleChunks);
+  nc_enddef(ncId);
+  std::vector<int> intData(5 * 37 * 41);
+  std::vector<double> doubleData(37 * 41);
+  for (size_t j = 0; j < intData.size(); j++) intData[j] = int(j);
+  for (size_t j = 0; j < doubleData.size(); j++) doubleData[j] = double(j) + 0.5;
+  int status = nc_put_var_int(ncId, intVarId, &intData[0]);
+  if (status == NC_NOERR) status = nc_put_var_double(ncId, doubleVarId, &doubleData[0]);
+  nc_close(ncId);
+  return status == NC_NOERR ? 0 : 1;
+}
+
+/* Compares one strided read through the CDFNetCDFReader with nc_get_vars on the same file */
+static int testCompareStridedRead(CDFObject *cdfObject, int ncId, const char *varName, size_t *start, size_t *count, ptrdiff_t *stride) {
+  CDF::Variable *var = cdfObject->getVariable(varName);
+  size_t numDims = var->dimensionlinks.size();
+  CT::string slab;
+  size_t numElements = 1;
+  for (size_t d = 0; d < numDims; d++) {
+    slab.printconcat("[%d:%d:%d]", (int)start[d], (int)count[d], (int)stride[d]);
+    numElements *= count[d];
+  }
+  int varId;
+  nc_inq_varid(ncId, varName, &varId);
+  std::vector<double> expected(numElements);
+  if (nc_get_vars_double(ncId, varId, start, count, stride, &expected[0]) != NC_NOERR) {
+    CDBError("[FAILED] testNetCDFStridedRead: nc_get_vars failed for %s%s", varName, slab.c_str());
+    return 1;
+  }
+  var->freeData();
+  if (var->readData(var->nativeType, start, count, stride) != 0 || var->getSize() != numElements) {
+    CDBError("[FAILED] testNetCDFStridedRead: unable to read %s%s", varName, slab.c_str());
+    return 1;
+  }
+  std::vector<double> actual(numElements);
+  CDF::DataCopier::copy(&actual[0], CDF_DOUBLE, var->data, var->nativeType, 0, 0, numElements);
+  var->freeData();
+  for (size_t j = 0; j < numElements; j++) {
+    if (actual[j] != expected[j]) {
+      CDBError("[FAILED] testNetCDFStridedRead: %s%s element %d is %f instead of %f", varName, slab.c_str(), (int)j, actual[j], expected[j]);
+      return 1;
+    }
+  }
+  CDBDebug("[OK] testNetCDFStridedRead %s%s", varName, slab.c_str());
+  return 0;
+}
+
+/* Strided reads of chunked variables are decimated from chunk aligned blocks, they must give the same values as nc_get_vars */
+int testNetCDFStridedRead() {
+  char fileName[] = "/tmp/testccdfdatamodel_XXXXXX";
+  int fd = mkstemp(fileName);
+  if (fd < 0 || testCreateChunkedFile(fileName) != 0) {
+    CDBError("[FAILED] testNetCDFStridedRead: unable to create %s", fileName);
+    if (fd >= 0) close(fd);
+    unlink(fileName);
+    return 1;
+  }
+  close(fd);
+
+  CDFObject *cdfObject = new CDFObject();
+  CDFReader *cdfReader = new CDFNetCDFReader();
+  cdfObject->attachCDFReader(cdfReader);
+  int ncId = -1;
+  int failed = 0;
+  if (cdfObject->open(fileName) != 0 || nc_open(fileName, NC_NOWRITE, &ncId) != NC_NOERR) {
+    CDBError("[FAILED] testNetCDFStridedRead: unable to open %s", fileName);
+    failed = 1;
+  }
+
+  /* Strides which do and do not divide the dimension sizes, offsets, a single time step and a stride larger than the chunks */
+  size_t intStarts[][3] = {{0, 0, 0}, {0, 0, 0}, {1, 5, 3}, {2, 0, 0}, {0, 1, 2}, {0, 0, 0}};
+  size_t intCounts[][3] = {{5, 37, 41}, {3, 13, 14}, {2, 8, 9}, {1, 10, 21}, {5, 4, 5}, {2, 37, 41}};
+  ptrdiff_t intStrides[][3] = {{1, 1, 1}, {2, 3, 3}, {3, 4, 4}, {1, 4, 2}, {1, 9, 9}, {4, 1, 1}};
+  for (size_t j = 0; j < sizeof(intStarts) / sizeof(intStarts[0]) && failed == 0; j++) {
+    failed = testCompareStridedRead(cdfObject, ncId, "intdata", intStarts[j], intCounts[j], intStrides[j]);
+  }
+  size_t doubleStarts[][2] = {{0, 0}, {3, 1}, {36, 0}};
+  size_t doubleCounts[][2] = {{19, 21}, {6, 7}, {1, 14}};
+  ptrdiff_t doubleStrides[][2] = {{2, 2}, {5, 6}, {1, 3}};
+  for (size_t j = 0; j < sizeof(doubleStarts) / sizeof(doubleStarts[0]) && failed == 0; j++) {
+    failed = testCompareStridedRead(cdfObject, ncId, "doubledata", doubleStarts[j], doubleCounts[j], doubleStrides[j]);
+  }
+
+  if (ncId != -1) nc_close(ncId);
+  cdfObject->close();
+  delete cdfObject;
+  delete cdfReader;
+  unlink(fileName);
+  return failed;
+}
+
 int main(int, char **) {
   bool failed = false;
   CDBDebug("Testing CTime");
@@ -180,8 +331,12 @@ int main(int, char **) {
   if (testCTimeInit(testVarB, "22130222T212000") != 0) failed = true;
 
   if (testCTimeEpochTimeConversion() != 0) failed = true;
+  if (testCTimeFastPath("seconds since 1970-01-01 00:00:00", 3607) != 0) failed = true;
+  if (testCTimeFastPath("hours since 1900-01-01T00:00:00Z", 7) != 0) failed = true;
+  if (testCTimeFastPath("days since 1850-01-01", 1) != 0) failed = true;
 
   if (testHDF5Reader() != 0) failed = true;
+  if (testNetCDFStridedRead() != 0) failed = true;
 
   CTime::cleanInstances();
   delete testVarA;
@@ -0,0 +1,243 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CAdaptiveTiles.h"
+#include <cmath>
+#include <float.h>
+
+const char *CAdaptiveTiles::className = "CAdaptiveTiles";
+
+/* Size of the tiles before subdivision, and the size below which tiles are not subdivided further */
+#define CADAPTIVETILES_MAX_SIZE 64
+#define CADAPTIVETILES_MIN_SIZE 8
+
+/* Allowed distance between the projected center of a tile and the interpolated center, in source cells or destination pixels, whichever is larger */
+#define CADAPTIVETILES_TOLERANCE 0.5
+
+class CAdaptiveTilesSettings {
+public:
+  CImageWarper *warper;
+  CGeoParams *geo;
+  double maskBBOX[4];
+  double cellW, cellH;
+  double sourceCellW, sourceCellH;
+  std::vector<CAdaptiveTile> *tiles;
+};
+
+static void projectPoints(CImageWarper *warper, double *psx, double *psy, int numPoints) {
+  if (!warper->isProjectionRequired()) return;
+  if (warper->destNeedsDegreeRadianConversion) {
+    for (int j = 0; j < numPoints; j++) {
+      psx[j] *= DEG_TO_RAD;
+      psy[j] *= DEG_TO_RAD;
+    }
+  }
+  pj_transform(warper->destpj, warper->sourcepj, numPoints, 0, psx, psy, NULL);
+  if (warper->sourceNeedsDegreeRadianConversion) {
+    for (int j = 0; j < numPoints; j++) {
+      psx[j] /= DEG_TO_RAD;
+      psy[j] /= DEG_TO_RAD;
+    }
+  }
+}
+
+/* Returns true when the center of the tile is too far from where the renderers interpolate it from the corners */
+static bool isDistorted(CAdaptiveTilesSettings *settings, double *psx, double *psy, int width, int height) {
+  for (int j = 0; j < 5; j++) {
+    if (!std::isfinite(psx[j]) || !std::isfinite(psy[j])) return true;
+  }
+  double errX = (psx[4] - (psx[0] + psx[1] + psx[2] + psx[3]) / 4) / settings->sourceCellW;
+  double errY = (psy[4] - (psy[0] + psy[1] + psy[2] + psy[3]) / 4) / settings->sourceCellH;
+  /* Size of a destination pixel in source cells, along the diagonal of the tile */
+  double diagX = (psx[0] - psx[2]) / settings->sourceCellW;
+  double diagY = (psy[0] - psy[2]) / settings->sourceCellH;
+  double destPixel = sqrt(diagX * diagX + diagY * diagY) / sqrt(double(width * width + height * height));
+  double tolerance = CADAPTIVETILES_TOLERANCE * (destPixel > 1 ? destPixel : 1);
+  return errX * errX + errY * errY > tolerance * tolerance;
+}
+
+static void addTile(CAdaptiveTilesSettings *settings, int offsetX, int offsetY, int width, int height) {
+  double left = settings->geo->dfBBOX[0] + offsetX * settings->cellW;
+  double right = settings->geo->dfBBOX[0] + (offsetX + width) * settings->cellW;
+  double top = settings->geo->dfBBOX[3] + offsetY * settings->cellH;
+  double bottom = settings->geo->dfBBOX[3] + (offsetY + height) * settings->cellH;
+  double dfTileW = right - left;
+  double dfTileH = top - bottom;
+  double *mask = settings->maskBBOX;
+  if (!((left > mask[0] - dfTileW && left < mask[2] + dfTileW) && (right > mask[0] - dfTileW && right < mask[2] + dfTileW) && (bottom > mask[1] - dfTileH && bottom < mask[3] + dfTileH) &&
+        (top > mask[1] - dfTileH && top < mask[3] + dfTileH))) {
+    return;
+  }
+
+  double psx[5] = {right, right, left, left, (left + right) / 2};
+  double psy[5] = {top, bottom, bottom, top, (top + bottom) / 2};
+  projectPoints(settings->warper, psx, psy, 5);
+
+  bool splitX = width >= CADAPTIVETILES_MIN_SIZE * 2;
+  bool splitY = height >= CADAPTIVETILES_MIN_SIZE * 2;
+  if ((splitX || splitY) && isDistorted(settings, psx, psy, width, height)) {
+    int widths[2] = {splitX ? width / 2 : width, width - width / 2};
+    int heights[2] = {splitY ? height / 2 : height, height - height / 2};
+    for (int y = 0; y < (splitY ? 2 : 1); y++) {
+      for (int x = 0; x < (splitX ? 2 : 1); x++) {
+        addTile(settings, offsetX + x * widths[0], offsetY + y * heights[0], widths[x], heights[y]);
+      }
+    }
+    return;
+  }
+
+  settings->tiles->push_back(CAdaptiveTile());
+  CAdaptiveTile &tile = settings->tiles->back();
+  tile.offsetX = offsetX;
+  tile.offsetY = offsetY;
+  tile.width = width;
+  tile.height = height;
+  for (int j = 0; j < 4; j++) {
+    tile.x_corners[j] = psx[j];
+    tile.y_corners[j] = psy[j];
+  }
+}
+
+int CAdaptiveTiles::getNumThreads(CDataSource *dataSource) {
+  CStyleConfiguration *styleConfiguration = dataSource->getStyle();
+  if (styleConfiguration != NULL && styleConfiguration->styleConfig != NULL && styleConfiguration->styleConfig->RenderSettings.size() > 0) {
+    CT::string numThreads = styleConfiguration->styleConfig->RenderSettings[0]->attr.numthreads;
+    if (!numThreads.empty()) return numThreads.toInt();
+  }
+  return 0;
+}
+
+bool CAdaptiveTiles::isAdaptive(CDataSource *dataSource) {
+  CStyleConfiguration *styleConfiguration = dataSource->getStyle();
+  if (styleConfiguration != NULL && styleConfiguration->styleConfig != NULL && styleConfiguration->styleConfig->RenderSettings.size() > 0) {
+    return styleConfiguration->styleConfig->RenderSettings[0]->attr.tiling.equals("adaptive");
+  }
+  return false;
+}
+
+/* Fixed tiles of 16x16 pixels on an image extended to a multiple of the tile size, the arithmetic is kept as is so images do not change */
+static void makeFixedTiles(CImageWarper *warper, CGeoParams *geo, double *dfMaskBBOX, std::vector<CAdaptiveTile> &tiles) {
+  int tile_width = 16;
+  int tile_height = 16;
+  int x_div = 1;
+  int y_div = 1;
+  if (warper->isProjectionRequired() == false) {
+    tile_height = geo->dHeight;
+    tile_width = geo->dWidth;
+  } else {
+    x_div = int((float(geo->dWidth) / tile_width)) + 1;
+    y_div = int((float(geo->dHeight) / tile_height)) + 1;
+  }
+  int internalWidth = tile_width * x_div;
+  int internalHeight = tile_height * y_div;
+
+  // New geo location needs to be extended based on new width and height
+  double internalBBOX[4];
+  for (int k = 0; k < 4; k++) internalBBOX[k] = geo->dfBBOX[k];
+  internalBBOX[2] = ((geo->dfBBOX[2] - geo->dfBBOX[0]) / double(geo->dWidth)) * double(internalWidth) + geo->dfBBOX[0];
+  internalBBOX[1] = ((geo->dfBBOX[1] - geo->dfBBOX[3]) / double(geo->dHeight)) * double(internalHeight) + geo->dfBBOX[3];
+
+  double dfSourceBBOX[4];
+  for (int k = 0; k < 4; k++) dfSourceBBOX[k] = dfMaskBBOX[k];
+  if (dfMaskBBOX[3] < dfMaskBBOX[1]) {
+    dfSourceBBOX[1] = dfMaskBBOX[3];
+    dfSourceBBOX[3] = dfMaskBBOX[1];
+  }
+  double dfTileW = (internalBBOX[2] - internalBBOX[0]) / double(x_div);
+  double dfTileH = (internalBBOX[3] - internalBBOX[1]) / double(y_div);
+
+  for (int x = 0; x < x_div; x++) {
+    for (int y = 0; y < y_div; y++) {
+      double dfTiledBBOX[4];
+      dfTiledBBOX[0] = internalBBOX[0] + dfTileW * double(x);
+      dfTiledBBOX[1] = internalBBOX[1] + dfTileH * double((y_div - 1) - y);
+      dfTiledBBOX[2] = dfTiledBBOX[0] + (dfTileW);
+      dfTiledBBOX[3] = dfTiledBBOX[1] + (dfTileH);
+      if (!((dfTiledBBOX[0] > dfSourceBBOX[0] - dfTileW && dfTiledBBOX[0] < dfSourceBBOX[2] + dfTileW) && (dfTiledBBOX[2] > dfSourceBBOX[0] - dfTileW && dfTiledBBOX[2] < dfSourceBBOX[2] + dfTileW) &&
+            (dfTiledBBOX[1] > dfSourceBBOX[1] - dfTileH && dfTiledBBOX[1] < dfSourceBBOX[3] + dfTileH) && (dfTiledBBOX[3] > dfSourceBBOX[1] - dfTileH && dfTiledBBOX[3] < dfSourceBBOX[3] + dfTileH))) {
+        continue;
+      }
+      double psx[4] = {dfTiledBBOX[2], dfTiledBBOX[2], dfTiledBBOX[0], dfTiledBBOX[0]};
+      double psy[4] = {dfTiledBBOX[3], dfTiledBBOX[1], dfTiledBBOX[1], dfTiledBBOX[3]};
+      projectPoints(warper, psx, psy, 4);
+
+      tiles.push_back(CAdaptiveTile());
+      CAdaptiveTile &tile = tiles.back();
+      tile.offsetX = x * tile_width;
+      tile.offsetY = y * tile_height;
+      tile.width = tile_width;
+      tile.height = tile_height;
+      for (int j = 0; j < 4; j++) {
+        tile.x_corners[j] = psx[j];
+        tile.y_corners[j] = psy[j];
+      }
+      // Some safety checks when odd files come out of the projection algorithm
+      if ((psx[0] >= DBL_MAX || psx[0] <= -DBL_MAX) && x_div == 1) {
+        tile.x_corners[0] = internalBBOX[2];
+        tile.x_corners[1] = internalBBOX[2];
+        tile.x_corners[2] = internalBBOX[0];
+        tile.x_corners[3] = internalBBOX[0];
+        tile.y_corners[0] = internalBBOX[3];
+        tile.y_corners[1] = internalBBOX[1];
+        tile.y_corners[2] = internalBBOX[1];
+        tile.y_corners[3] = internalBBOX[3];
+      }
+    }
+  }
+}
+
+void CAdaptiveTiles::makeTiles(CImageWarper *warper, CDataSource *dataSource, CGeoParams *geo, double *dfMaskBBOX, std::vector<CAdaptiveTile> &tiles) {
+  /* Without reprojection the corners can be interpolated exactly, so the whole image is one tile */
+  if (!warper->isProjectionRequired() || !isAdaptive(dataSource)) {
+    makeFixedTiles(warper, geo, dfMaskBBOX, tiles);
+    return;
+  }
+
+  CAdaptiveTilesSettings settings;
+  settings.warper = warper;
+  settings.geo = geo;
+  settings.tiles = &tiles;
+  for (int k = 0; k < 4; k++) settings.maskBBOX[k] = dfMaskBBOX[k];
+  if (dfMaskBBOX[3] < dfMaskBBOX[1]) {
+    settings.maskBBOX[1] = dfMaskBBOX[3];
+    settings.maskBBOX[3] = dfMaskBBOX[1];
+  }
+  settings.cellW = (geo->dfBBOX[2] - geo->dfBBOX[0]) / double(geo->dWidth);
+  settings.cellH = (geo->dfBBOX[1] - geo->dfBBOX[3]) / double(geo->dHeight);
+  settings.sourceCellW = fabs(dataSource->dfBBOX[2] - dataSource->dfBBOX[0]) / double(dataSource->dWidth);
+  settings.sourceCellH = fabs(dataSource->dfBBOX[3] - dataSource->dfBBOX[1]) / double(dataSource->dHeight);
+  if (!(settings.sourceCellW > 0)) settings.sourceCellW = 1;
+  if (!(settings.sourceCellH > 0)) settings.sourceCellH = 1;
+  for (int y = 0; y < geo->dHeight; y += CADAPTIVETILES_MAX_SIZE) {
+    for (int x = 0; x < geo->dWidth; x += CADAPTIVETILES_MAX_SIZE) {
+      int width = geo->dWidth - x < CADAPTIVETILES_MAX_SIZE ? geo->dWidth - x : CADAPTIVETILES_MAX_SIZE;
+      int height = geo->dHeight - y < CADAPTIVETILES_MAX_SIZE ? geo->dHeight - y : CADAPTIVETILES_MAX_SIZE;
+      addTile(&settings, x, y, width, height);
+    }
+  }
+#ifdef CADAPTIVETILES_DEBUG
+  CDBDebug("Made %d tiles for %dx%d pixels", (int)tiles.size(), geo->dWidth, geo->dHeight);
+#endif
+}
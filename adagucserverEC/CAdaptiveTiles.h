@@ -0,0 +1,76 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CADAPTIVETILES_H
+#define CADAPTIVETILES_H
+
+#include <vector>
+#include "CDebugger.h"
+#include "CDataSource.h"
+#include "CImageWarper.h"
+
+/**
+ * @brief A block of destination pixels with its corners projected to the source projection.
+ * Corner 0 is top right, 1 is bottom right, 2 is bottom left and 3 is top left.
+ */
+class CAdaptiveTile {
+public:
+  int offsetX, offsetY, width, height;
+  double x_corners[4], y_corners[4];
+};
+
+/**
+ * @brief Divides the destination image in tiles for the renderers which only project the corners of a tile and interpolate the pixels in between.
+ * By default the tiles are 16x16 pixels. With <RenderSettings tiling="adaptive"/> tiles are large where the projection is close to affine,
+ * and are subdivided where it is not, like near the poles and the dateline.
+ */
+class CAdaptiveTiles {
+private:
+  DEF_ERRORFUNCTION();
+
+public:
+  /**
+   * @brief Returns the number of render threads configured with the numthreads attribute of RenderSettings, or zero when not configured.
+   */
+  static int getNumThreads(CDataSource *dataSource);
+
+  /**
+   * @brief Returns true when adaptive tiling is configured with tiling="adaptive" in RenderSettings.
+   */
+  static bool isAdaptive(CDataSource *dataSource);
+
+  /**
+   * @brief Makes the tiles covering the destination image. Tiles outside the extent of the data are left out.
+   *
+   * @param warper The warper with the source and destination projections
+   * @param dataSource The datasource, its bbox and size are used to determine the size of a source cell
+   * @param geo The destination image
+   * @param dfMaskBBOX The extent of the data in the destination projection, as found by CImageWarper::findExtent
+   * @param tiles Resulting tiles are appended to this vector
+   */
+  static void makeTiles(CImageWarper *warper, CDataSource *dataSource, CGeoParams *geo, double *dfMaskBBOX, std::vector<CAdaptiveTile> &tiles);
+};
+
+#endif
@@ -0,0 +1,150 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CAffineResampler.h"
+#include <math.h>
+#include <algorithm>
+
+const char *CAffineResampler::className = "CAffineResampler";
+
+void CAffineResampler::init(CDataSource *dataSource, CGeoParams *geo) { init(dataSource->dfBBOX, dataSource->dWidth, dataSource->dHeight, geo->dfBBOX, geo->dWidth, geo->dHeight); }
+
+void CAffineResampler::init(const double *sourceBBOX, int sourceWidth, int sourceHeight, const double *imageBBOX, int imageWidth, int imageHeight) {
+  this->sourceWidth = sourceWidth;
+  this->sourceHeight = sourceHeight;
+  width = imageWidth;
+  height = imageHeight;
+
+  /* Source cell coordinate of the center of image pixel (x, y) is (originX + x * stepX, originY + y * stepY) */
+  double sourceCellW = (sourceBBOX[2] - sourceBBOX[0]) / double(sourceWidth);
+  double sourceCellH = (sourceBBOX[1] - sourceBBOX[3]) / double(sourceHeight);
+  double cellW = (imageBBOX[2] - imageBBOX[0]) / double(width);
+  double cellH = (imageBBOX[1] - imageBBOX[3]) / double(height);
+  double originX = (imageBBOX[0] + cellW * 0.5 - sourceBBOX[0]) / sourceCellW;
+  double stepX = cellW / sourceCellW;
+  originY = (imageBBOX[3] + cellH * 0.5 - sourceBBOX[3]) / sourceCellH;
+  stepY = cellH / sourceCellH;
+
+  columns0.resize(width);
+  columns1.resize(width);
+  weightsX.resize(width);
+  for (int x = 0; x < width; x++) {
+    /* Bilinear interpolates between cell centers, like the triangle renderer the last column wraps to the first one */
+    double centerX = originX + x * stepX - 0.5;
+    int column0 = int(floor(centerX));
+    columns0[x] = column0 >= 0 && column0 < sourceWidth ? column0 : -1;
+    columns1[x] = column0 + 1 < sourceWidth ? column0 + 1 : 0;
+    if (columns1[x] < 0) columns1[x] = 0;
+    weightsX[x] = float(centerX - column0);
+  }
+#ifdef CAFFINERESAMPLER_DEBUG
+  CDBDebug("origin %f %f step %f %f", originX, originY, stepX, stepY);
+#endif
+}
+
+bool CAffineResampler::initNearest(const double *sourceBBOX, int sourceWidth, int sourceHeight, const double *x_corners, const double *y_corners, int tileWidth, int tileHeight) {
+  this->sourceWidth = sourceWidth;
+  this->sourceHeight = sourceHeight;
+  width = tileWidth;
+  height = tileHeight;
+  columns.assign(width, -1);
+  rows.assign(height, -1);
+
+  /* Top left, top right, bottom left and bottom right corner in grid cells, as in CAreaMapper::myDrawRawTile */
+  double sourceBBOXWidth = sourceBBOX[2] - sourceBBOX[0];
+  double sourceBBOXHeight = sourceBBOX[1] - sourceBBOX[3];
+  double destPXTL[2] = {((x_corners[3] - sourceBBOX[0]) / sourceBBOXWidth) * sourceWidth, ((y_corners[3] - sourceBBOX[3]) / sourceBBOXHeight) * sourceHeight};
+  double destPXTR[2] = {((x_corners[0] - sourceBBOX[0]) / sourceBBOXWidth) * sourceWidth, ((y_corners[0] - sourceBBOX[3]) / sourceBBOXHeight) * sourceHeight};
+  double destPXBL[2] = {((x_corners[2] - sourceBBOX[0]) / sourceBBOXWidth) * sourceWidth, ((y_corners[2] - sourceBBOX[3]) / sourceBBOXHeight) * sourceHeight};
+  double destPXBR[2] = {((x_corners[1] - sourceBBOX[0]) / sourceBBOXWidth) * sourceWidth, ((y_corners[1] - sourceBBOX[3]) / sourceBBOXHeight) * sourceHeight};
+
+  /* The ribs of the tile need to be vertical and horizontal, then CAreaMapper samples column and row independently */
+  if (destPXTL[0] != destPXBL[0] || destPXTR[0] != destPXBR[0] || destPXTL[1] != destPXTR[1] || destPXBL[1] != destPXBR[1]) return false;
+  double tileSourceW = destPXTR[0] - destPXTL[0];
+  double tileSourceH = destPXBL[1] - destPXTL[1];
+  if (!(tileSourceW != 0 && tileSourceH != 0 && isfinite(destPXTL[0]) && isfinite(destPXTL[1]) && isfinite(tileSourceW) && isfinite(tileSourceH))) return false;
+
+  /* CAreaMapper skips tiles which do not overlap the grid */
+  double dfSourceBBOX[4] = {std::min(sourceBBOX[0], sourceBBOX[2]), std::min(sourceBBOX[1], sourceBBOX[3]), std::max(sourceBBOX[0], sourceBBOX[2]), std::max(sourceBBOX[1], sourceBBOX[3])};
+  int k;
+  for (k = 0; k < 4; k++) {
+    if (fabs(x_corners[k] - x_corners[0]) >= fabs(dfSourceBBOX[2] - dfSourceBBOX[0])) break;
+  }
+  if (k == 4) {
+    for (k = 0; k < 4; k++) {
+      if (x_corners[k] > dfSourceBBOX[0] && x_corners[k] < dfSourceBBOX[2]) break;
+    }
+    if (k == 4) return true;
+  }
+  for (k = 0; k < 4; k++) {
+    if (fabs(y_corners[k] - y_corners[0]) >= fabs(dfSourceBBOX[3] - dfSourceBBOX[1])) break;
+  }
+  if (k == 4) {
+    for (k = 0; k < 4; k++) {
+      if (y_corners[k] > dfSourceBBOX[1] && y_corners[k] < dfSourceBBOX[3]) break;
+    }
+    if (k == 4) return true;
+  }
+
+  double dfTileWidth = tileWidth, dfTileHeight = tileHeight;
+  for (int x = 0; x < width; x++) {
+    double dstpixel_x = x + 0.5;
+    int column = floor((dstpixel_x / (dfTileWidth)) * tileSourceW + destPXTL[0]);
+    columns[x] = column >= 0 && column < sourceWidth ? column : -1;
+  }
+  for (int y = 0; y < height; y++) {
+    double dstpixel_y = y + 0.5;
+    int row = floor((dstpixel_y / (dfTileHeight)) * tileSourceH + destPXTL[1]);
+    rows[y] = row >= 0 && row < sourceHeight ? row : -1;
+  }
+  return true;
+}
+
+bool CAffineResampler::getBilinearRows(int y, int &row0, int &row1, float &weightY) {
+  double centerY = originY + y * stepY - 0.5;
+  row0 = int(floor(centerY));
+  if (row0 < 0 || row0 + 1 >= sourceHeight) return false;
+  row1 = row0 + 1;
+  weightY = float(centerY - row0);
+  return true;
+}
+
+void CAffineResampler::gatherBilinear(const float *sourceRow0, const float *sourceRow1, float weightY, float fNodataValue, float *row) {
+  const int *c0 = &columns0[0];
+  const int *c1 = &columns1[0];
+  const float *wx = &weightsX[0];
+  for (int x = 0; x < width; x++) {
+    bool outside = c0[x] < 0;
+    int column0 = outside ? 0 : c0[x];
+    int column1 = c1[x];
+    float v00 = sourceRow0[column0], v10 = sourceRow0[column1];
+    float v01 = sourceRow1[column0], v11 = sourceRow1[column1];
+    bool skip = outside || v00 == fNodataValue || v10 == fNodataValue || v01 == fNodataValue || v11 == fNodataValue || !(v00 == v00) || !(v10 == v10) || !(v01 == v01) || !(v11 == v11);
+    float top = v00 + (v10 - v00) * wx[x];
+    float bottom = v01 + (v11 - v01) * wx[x];
+    float value = top + (bottom - top) * weightY;
+    row[x] = skip ? fNodataValue : value;
+  }
+}
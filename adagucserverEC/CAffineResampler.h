@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CAFFINERESAMPLER_H
+#define CAFFINERESAMPLER_H
+
+#include <vector>
+#include "CDebugger.h"
+#include "CDataSource.h"
+
+/**
+ * @brief Resamples a grid onto an image in the same projection, where image pixels map to grid cells by scaling and an offset only.
+ * The source columns are computed once for all image rows and the source rows once per image row, so no point is projected.
+ * Rows are gathered with branch free loops which the compiler can vectorize, and can be colored with the span functions of CDrawImage.
+ */
+class CAffineResampler {
+private:
+  DEF_ERRORFUNCTION();
+  int sourceWidth, sourceHeight;
+  double originY, stepY;
+
+public:
+  /**
+   * @brief Size of the image
+   */
+  int width, height;
+
+  /**
+   * @brief Source column for each image column and source row for each image row for nearest neighbour, -1 outside the grid
+   */
+  std::vector<int> columns, rows;
+
+  /**
+   * @brief Left and right source column and the weight of the right column for each image column for bilinear interpolation.
+   * The left column is -1 outside the grid, the right column of the last grid column wraps to the first one.
+   */
+  std::vector<int> columns0, columns1;
+  std::vector<float> weightsX;
+
+  /**
+   * @brief Computes the bilinear mapping from the bounding boxes and sizes of the grid and the image.
+   *
+   * @param dataSource The grid, dfBBOX[3] is the coordinate of the first row
+   * @param geo The image, dfBBOX[3] is the coordinate of the top row
+   */
+  void init(CDataSource *dataSource, CGeoParams *geo);
+
+  /**
+   * @brief Computes the bilinear mapping, see init(CDataSource *, CGeoParams *).
+   */
+  void init(const double *sourceBBOX, int sourceWidth, int sourceHeight, const double *imageBBOX, int imageWidth, int imageHeight);
+
+  /**
+   * @brief Computes the nearest neighbour mapping for a tile of CAreaMapper, with the same arithmetic so the images are identical.
+   * Pixels CAreaMapper would not draw get -1 in columns or rows.
+   *
+   * @param sourceBBOX The bounding box of the grid, sourceBBOX[3] is the coordinate of the first row
+   * @param x_corners The tile corners in grid coordinates: top right, bottom right, bottom left and top left
+   * @param tileWidth Width of the tile and the image
+   * @param tileHeight Height of the tile and the image
+   * @return False when the corners are not an axis aligned rectangle, the tile then needs to be drawn with CAreaMapper
+   */
+  bool initNearest(const double *sourceBBOX, int sourceWidth, int sourceHeight, const double *x_corners, const double *y_corners, int tileWidth, int tileHeight);
+
+  /**
+   * @brief Returns the source row for nearest neighbour for image row y, or -1 when it is outside the grid.
+   */
+  int getNearestRow(int y) { return rows[y]; }
+
+  /**
+   * @brief Gets the upper and lower source row and the weight of the lower one for bilinear interpolation of image row y.
+   *
+   * @return False when the row is outside the grid
+   */
+  bool getBilinearRows(int y, int &row0, int &row1, float &weightY);
+
+  /**
+   * @brief Copies the values of one source row to an image row with the nearest neighbour columns. Pixels outside the grid get fillValue.
+   */
+  template <class T> void gatherNearest(const T *sourceRow, T fillValue, T *row) {
+    const int *c = &columns[0];
+    for (int x = 0; x < width; x++) {
+      int column = c[x];
+      T value = sourceRow[column < 0 ? 0 : column];
+      row[x] = column < 0 ? fillValue : value;
+    }
+  }
+
+  /**
+   * @brief Interpolates an image row between two source rows. Pixels outside the grid or next to a nodata or NaN cell get fNodataValue.
+   */
+  void gatherBilinear(const float *sourceRow0, const float *sourceRow1, float weightY, float fNodataValue, float *row);
+};
+
+#endif
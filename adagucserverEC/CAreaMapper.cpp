@@ -33,11 +33,9 @@
 
 const char *CAreaMapper::className = "CAreaMapper";
 
-void CAreaMapper::init(CDataSource *dataSource, CDrawImage *drawImage, int tileWidth, int tileHeight) {
+void CAreaMapper::init(CDataSource *dataSource, CDrawImage *drawImage) {
   this->dataSource = dataSource;
   this->drawImage = drawImage;
-  dfTileWidth = double(tileWidth);
-  dfTileHeight = double(tileHeight);
   for (int k = 0; k < 4; k++) {
     dfSourceBBOX[k] = dataSource->dfBBOX[k];
     dfImageBBOX[k] = dataSource->dfBBOX[k];
@@ -84,42 +82,42 @@ void CAreaMapper::init(CDataSource *dataSource, CDrawImage *drawImage, int tileW
   internalHeight = height;
 }
 
-int CAreaMapper::drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY) {
+int CAreaMapper::drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY, int tileWidth, int tileHeight) {
   CDFType dataType = dataSource->getDataObject(0)->cdfVariable->getType();
   void *data = dataSource->getDataObject(0)->cdfVariable->data;
   switch (dataType) {
   case CDF_CHAR:
-    return myDrawRawTile((const char *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const char *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_BYTE:
-    return myDrawRawTile((const char *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const char *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_UBYTE:
-    return myDrawRawTile((const unsigned char *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const unsigned char *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_SHORT:
-    return myDrawRawTile((const short *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const short *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_USHORT:
-    return myDrawRawTile((const ushort *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const ushort *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_INT:
-    return myDrawRawTile((const int *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const int *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_UINT:
-    return myDrawRawTile((const uint *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const uint *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_FLOAT:
-    return myDrawRawTile((const float *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const float *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   case CDF_DOUBLE:
-    return myDrawRawTile((const double *)data, x_corners, y_corners, dDestX, dDestY);
+    return myDrawRawTile((const double *)data, x_corners, y_corners, dDestX, dDestY, tileWidth, tileHeight);
     break;
   }
   return 1;
 }
 
-template <class T> int CAreaMapper::myDrawRawTile(const T *data, double *x_corners, double *y_corners, int &dDestX, int &dDestY) {
+template <class T> int CAreaMapper::myDrawRawTile(const T *data, double *x_corners, double *y_corners, int &dDestX, int &dDestY, double dfTileWidth, double dfTileHeight) {
   int imageWidth = drawImage->getWidth();
   int imageHeight = drawImage->getHeight();
   int k;
@@ -34,7 +34,6 @@
 class CAreaMapper {
 private:
   DEF_ERRORFUNCTION();
-  double dfTileWidth, dfTileHeight;
   double dfSourceBBOX[4];
   double dfImageBBOX[4];
   double dfNodataValue;
@@ -50,11 +49,11 @@ private:
   CDrawImage *drawImage;
   bool debug;
   ;
-  template <typename T> int myDrawRawTile(const T *data, double *x_corners, double *y_corners, int &dDestX, int &dDestY);
+  template <typename T> int myDrawRawTile(const T *data, double *x_corners, double *y_corners, int &dDestX, int &dDestY, double dfTileWidth, double dfTileHeight);
 
 public:
-  int drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY);
-  void init(CDataSource *dataSource, CDrawImage *drawImage, int tileWidth, int tileHeight);
+  int drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY, int tileWidth, int tileHeight);
+  void init(CDataSource *dataSource, CDrawImage *drawImage);
 };
 
 #endif
@@ -0,0 +1,394 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CAsyncLogger.h"
+#include <atomic>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CASYNCLOGGER_NUMSLOTS 512 /* Needs to be a power of two */
+#define CASYNCLOGGER_LINESIZE 4096
+#define CASYNCLOGGER_LAYERSIZE 256
+#define CASYNCLOGGER_IDLESLEEP_US 1000
+#define CASYNCLOGGER_FORKWAIT_US 1000000
+#define CASYNCLOGGER_MAXFULLATTEMPTS 1000
+
+class CAsyncLoggerRecord {
+public:
+  std::atomic<size_t> sequence;
+  CAsyncLogger::Level level;
+  size_t prefixLength;
+  size_t length;
+  struct timeval time;
+  char layer[CASYNCLOGGER_LAYERSIZE];
+  char text[CASYNCLOGGER_LINESIZE];
+};
+
+/* Static storage, pages of the ring are only touched when they are used */
+static CAsyncLoggerRecord ring[CASYNCLOGGER_NUMSLOTS];
+static std::atomic<size_t> enqueuePos(0);
+static std::atomic<size_t> dequeuePos(0);
+static std::atomic<bool> consumerRunning(false);
+static std::atomic<bool> stopRequested(false);
+static std::atomic<size_t> numDropped(0);
+static size_t numDroppedReported = 0;
+static pthread_t consumerThread;
+static bool forkHandlersRegistered = false;
+
+static FILE *logFile = NULL;
+static bool flushWhenIdle = true;
+static CAsyncLogger::Format logFormat = CAsyncLogger::FORMAT_TEXT;
+static char requestId[128] = "";
+
+/* setLayer writes the inactive buffer and then swaps, producers copy the active one */
+static char layerBuffers[2][CASYNCLOGGER_LAYERSIZE] = {"", ""};
+static std::atomic<int> activeLayer(0);
+
+/* The line which is being assembled by this thread */
+static thread_local CAsyncLoggerRecord currentLine;
+
+static bool isTaggedPrefix(const char *fragment) { return fragment[0] == '[' && (fragment[1] == 'D' || fragment[1] == 'W' || fragment[1] == 'E') && fragment[2] == ':'; }
+
+static const char *getLevelName(CAsyncLogger::Level level) {
+  switch (level) {
+  case CAsyncLogger::LEVEL_ERROR:
+    return "error";
+  case CAsyncLogger::LEVEL_WARNING:
+    return "warning";
+  default:
+    return "debug";
+  }
+}
+
+static void appendJSONString(std::string &out, const char *text, size_t length) {
+  out += '"';
+  for (size_t j = 0; j < length; j++) {
+    unsigned char c = text[j];
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    default:
+      if (c < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out += escaped;
+      } else {
+        out += char(c);
+      }
+    }
+  }
+  out += '"';
+}
+
+static size_t trimmedLength(const char *text, size_t length) {
+  while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\n')) length--;
+  return length;
+}
+
+/* Formats the record as the synchronous logger did: prefix, local timestamp, message */
+static void formatText(const CAsyncLoggerRecord &record, std::string &out) {
+  out.append(record.text, record.prefixLength);
+  if (record.prefixLength > 0) {
+    struct tm localTime;
+    time_t seconds = record.time.tv_sec;
+    localtime_r(&seconds, &localTime);
+    char timeStamp[64];
+    snprintf(timeStamp, sizeof(timeStamp), "%.4d-%.2d-%.2dT%.2d:%.2d:%.2dZ ", localTime.tm_year + 1900, localTime.tm_mon + 1, localTime.tm_mday, localTime.tm_hour, localTime.tm_min,
+             localTime.tm_sec);
+    out += timeStamp;
+  }
+  out.append(record.text + record.prefixLength, record.length - record.prefixLength);
+}
+
+/* Formats the record as a JSON object, the source is taken from the prefix and StopWatch lines get their durations as fields */
+static void formatJSON(const CAsyncLoggerRecord &record, std::string &out) {
+  struct tm utcTime;
+  time_t seconds = record.time.tv_sec;
+  gmtime_r(&seconds, &utcTime);
+  char field[256];
+  snprintf(field, sizeof(field), "{\"time\":\"%.4d-%.2d-%.2dT%.2d:%.2d:%.2d.%.3dZ\",\"level\":\"%s\",\"pid\":%d,\"requestid\":", utcTime.tm_year + 1900, utcTime.tm_mon + 1, utcTime.tm_mday,
+           utcTime.tm_hour, utcTime.tm_min, utcTime.tm_sec, int(record.time.tv_usec / 1000), getLevelName(record.level), int(getpid()));
+  out += field;
+  appendJSONString(out, requestId, strlen(requestId));
+  out += ",\"layer\":";
+  appendJSONString(out, record.layer, strlen(record.layer));
+
+  /* Prefix looks like "[D:001:pid1234: CRequest.cpp:100 CRequest] " */
+  if (record.prefixLength > 0) {
+    const char *sourceStart = strstr(record.text, ": ");
+    const char *sourceEnd = (const char *)memchr(record.text, ']', record.prefixLength);
+    if (sourceStart != NULL && sourceEnd != NULL && sourceStart + 2 < sourceEnd) {
+      out += ",\"source\":";
+      appendJSONString(out, sourceStart + 2, sourceEnd - sourceStart - 2);
+    }
+  }
+
+  const char *message = record.text + record.prefixLength;
+  size_t messageLength = trimmedLength(message, record.length - record.prefixLength);
+  out += ",\"message\":";
+  appendJSONString(out, message, messageLength);
+
+  /* StopWatch lines look like "[T] 12.3 ms\t4.567 ms: phase" */
+  double elapsed = 0, duration = 0;
+  int phaseOffset = 0;
+  if (strncmp(message, "[T] ", 4) == 0 && sscanf(message, "[T] %lf ms\t%lf ms: %n", &elapsed, &duration, &phaseOffset) == 2 && phaseOffset > 0 && size_t(phaseOffset) <= messageLength) {
+    out += ",\"phase\":";
+    appendJSONString(out, message + phaseOffset, messageLength - phaseOffset);
+    snprintf(field, sizeof(field), ",\"elapsed_ms\":%.3f,\"duration_ms\":%.3f", elapsed, duration);
+    out += field;
+  }
+  out += "}\n";
+}
+
+static void writeRecord(const CAsyncLoggerRecord &record, std::string &out) {
+  out.clear();
+  if (logFormat == CAsyncLogger::FORMAT_JSON) {
+    formatJSON(record, out);
+  } else {
+    formatText(record, out);
+  }
+  fwrite(out.c_str(), 1, out.length(), logFile);
+}
+
+static void writeDroppedNotice(std::string &out) {
+  size_t dropped = numDropped.load();
+  if (dropped == numDroppedReported) return;
+  CAsyncLoggerRecord notice;
+  notice.level = CAsyncLogger::LEVEL_WARNING;
+  gettimeofday(&notice.time, NULL);
+  notice.prefixLength = snprintf(notice.text, CASYNCLOGGER_LINESIZE, "[W:000:pid%lu: CAsyncLogger.cpp CAsyncLogger] ", (unsigned long)getpid());
+  notice.length = notice.prefixLength + snprintf(notice.text + notice.prefixLength, CASYNCLOGGER_LINESIZE - notice.prefixLength, "%lu log lines dropped, log buffer was full\n",
+                                                 (unsigned long)(dropped - numDroppedReported));
+  notice.layer[0] = 0;
+  writeRecord(notice, out);
+  numDroppedReported = dropped;
+}
+
+/* Multi producer enqueue on a bounded ring, each slot carries a sequence number telling whether it is free or filled */
+static CAsyncLoggerRecord *claimSlot(size_t &pos) {
+  pos = enqueuePos.load(std::memory_order_relaxed);
+  while (true) {
+    CAsyncLoggerRecord &slot = ring[pos & (CASYNCLOGGER_NUMSLOTS - 1)];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+    if (diff == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &slot;
+    } else if (diff < 0) {
+      return NULL; /* Full */
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+/* Single consumer dequeue, returns NULL when the next slot is not filled yet */
+static CAsyncLoggerRecord *peekSlot() {
+  size_t pos = dequeuePos.load(std::memory_order_relaxed);
+  CAsyncLoggerRecord &slot = ring[pos & (CASYNCLOGGER_NUMSLOTS - 1)];
+  if (slot.sequence.load(std::memory_order_acquire) != pos + 1) return NULL;
+  return &slot;
+}
+
+static void releaseSlot(CAsyncLoggerRecord *slot) {
+  size_t pos = dequeuePos.load(std::memory_order_relaxed);
+  slot->sequence.store(pos + CASYNCLOGGER_NUMSLOTS, std::memory_order_release);
+  dequeuePos.store(pos + 1, std::memory_order_release);
+}
+
+static void *consumerLoop(void *) {
+  std::string out;
+  bool wroteSinceFlush = false;
+  while (true) {
+    CAsyncLoggerRecord *record = peekSlot();
+    if (record != NULL) {
+      writeRecord(*record, out);
+      releaseSlot(record);
+      wroteSinceFlush = true;
+      continue;
+    }
+    writeDroppedNotice(out);
+    if (wroteSinceFlush && flushWhenIdle) {
+      fflush(logFile);
+      wroteSinceFlush = false;
+    }
+    if (stopRequested.load()) break;
+    usleep(CASYNCLOGGER_IDLESLEEP_US);
+  }
+  return NULL;
+}
+
+/* Lets the consumer write everything queued so far, so that the forked child does not inherit pending lines */
+static void prepareFork() {
+  if (!consumerRunning.load() || logFile == NULL) return;
+  for (int waited = 0; waited < CASYNCLOGGER_FORKWAIT_US && dequeuePos.load() != enqueuePos.load(); waited += CASYNCLOGGER_IDLESLEEP_US) {
+    usleep(CASYNCLOGGER_IDLESLEEP_US);
+  }
+  fflush(logFile);
+}
+
+/* The consumer thread does not exist in the child, the child writes synchronously and leaves with _exit */
+static void childAfterFork() {
+  consumerRunning.store(false);
+  flushWhenIdle = true;
+}
+
+static void stopAtExit() { CAsyncLogger::stop(); }
+
+int CAsyncLogger::start(FILE *file, bool _flushWhenIdle, Format format) {
+  if (file == NULL || consumerRunning.load()) return 1;
+  logFile = file;
+  flushWhenIdle = _flushWhenIdle;
+  logFormat = format;
+
+  const char *httpRequestId = getenv("HTTP_X_REQUEST_ID");
+  if (httpRequestId != NULL && strlen(httpRequestId) > 0) {
+    snprintf(requestId, sizeof(requestId), "%s", httpRequestId);
+  } else {
+    snprintf(requestId, sizeof(requestId), "%d-%ld", int(getpid()), long(time(NULL)));
+  }
+
+  for (size_t j = 0; j < CASYNCLOGGER_NUMSLOTS; j++) {
+    ring[j].sequence.store(j);
+  }
+  enqueuePos.store(0);
+  dequeuePos.store(0);
+  stopRequested.store(false);
+
+  if (!forkHandlersRegistered) {
+    pthread_atfork(prepareFork, NULL, childAfterFork);
+    atexit(stopAtExit);
+    forkHandlersRegistered = true;
+  }
+
+  /* Without a consumer thread lines are written synchronously */
+  if (pthread_create(&consumerThread, NULL, consumerLoop, NULL) != 0) {
+    return 2;
+  }
+  consumerRunning.store(true);
+  return 0;
+}
+
+void CAsyncLogger::stop() {
+  if (consumerRunning.load()) {
+    stopRequested.store(true);
+    pthread_join(consumerThread, NULL);
+    consumerRunning.store(false);
+    /* Lines which were published after the consumer had seen an empty queue */
+    std::string out;
+    CAsyncLoggerRecord *record;
+    while ((record = peekSlot()) != NULL) {
+      writeRecord(*record, out);
+      releaseSlot(record);
+    }
+    writeDroppedNotice(out);
+  }
+  if (logFile != NULL) {
+    fflush(logFile);
+    logFile = NULL;
+  }
+}
+
+void CAsyncLogger::setLayer(const char *layerName) {
+  int inactive = 1 - activeLayer.load();
+  snprintf(layerBuffers[inactive], CASYNCLOGGER_LAYERSIZE, "%s", layerName == NULL ? "" : layerName);
+  activeLayer.store(inactive);
+}
+
+size_t CAsyncLogger::getNumDropped() { return numDropped.load(); }
+
+void CAsyncLogger::write(const char *fragment, Level level) {
+  if (logFile == NULL || fragment == NULL) return;
+  CAsyncLoggerRecord &line = currentLine;
+  size_t fragmentLength = strlen(fragment);
+  if (line.length == 0) {
+    line.level = level;
+    gettimeofday(&line.time, NULL);
+    line.prefixLength = isTaggedPrefix(fragment) ? fragmentLength : 0;
+  } else if (level > line.level) {
+    line.level = level;
+  }
+
+  /* Keep room for the newline, longer lines are truncated */
+  size_t available = CASYNCLOGGER_LINESIZE - 1 - line.length;
+  size_t copyLength = fragmentLength < available ? fragmentLength : available;
+  memcpy(line.text + line.length, fragment, copyLength);
+  line.length += copyLength;
+  if (line.prefixLength > line.length) line.prefixLength = line.length;
+  if (fragmentLength == 0 || fragment[fragmentLength - 1] != '\n') {
+    if (line.length < CASYNCLOGGER_LINESIZE - 1) return;
+    line.text[line.length++] = '\n';
+  }
+  line.text[line.length] = 0;
+  snprintf(line.layer, CASYNCLOGGER_LAYERSIZE, "%s", layerBuffers[activeLayer.load()]);
+
+  if (!consumerRunning.load()) {
+    std::string out;
+    writeRecord(line, out);
+    if (flushWhenIdle) fflush(logFile);
+    line.length = 0;
+    return;
+  }
+
+  /* When the ring is full, give the consumer some time. Debug and warning lines are dropped when it stays full, errors wait. */
+  size_t pos;
+  CAsyncLoggerRecord *slot = claimSlot(pos);
+  for (int attempt = 0; slot == NULL; attempt++) {
+    if (line.level != LEVEL_ERROR && attempt >= CASYNCLOGGER_MAXFULLATTEMPTS) {
+      numDropped++;
+      line.length = 0;
+      return;
+    }
+    sched_yield();
+    slot = claimSlot(pos);
+  }
+  slot->level = line.level;
+  slot->prefixLength = line.prefixLength;
+  slot->length = line.length;
+  slot->time = line.time;
+  memcpy(slot->layer, line.layer, CASYNCLOGGER_LAYERSIZE);
+  memcpy(slot->text, line.text, line.length + 1);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  line.length = 0;
+}
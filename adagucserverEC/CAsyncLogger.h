@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CASYNCLOGGER_H
+#define CASYNCLOGGER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * @brief Writes the server log from a background thread.
+ *
+ * The debug, warning and error functions of CDebugger hand over their fragments with write(). Fragments are assembled
+ * per thread into lines, which are queued in a bounded lock-free ring buffer. A consumer thread formats the lines and writes
+ * them to the log file. When the ring stays full, debug and warning lines are dropped and counted; error lines wait for a free slot.
+ *
+ * Forked children write synchronously, as they leave with _exit and would never drain the queue.
+ */
+class CAsyncLogger {
+public:
+  enum Format { FORMAT_TEXT, FORMAT_JSON };
+  enum Level { LEVEL_DEBUG, LEVEL_WARNING, LEVEL_ERROR };
+
+  /**
+   * @brief Starts the consumer thread. Without a running consumer thread, write() writes directly to the file.
+   *
+   * @param file The file to write to, stays owned by the caller
+   * @param flushWhenIdle Flush the file each time the queue is drained, gives realtime logging
+   * @param format FORMAT_TEXT writes the same lines as the synchronous log, FORMAT_JSON writes one JSON object per line
+   * @return Zero on success
+   */
+  static int start(FILE *file, bool flushWhenIdle, Format format);
+
+  /**
+   * @brief Drains the queue, stops the consumer thread and flushes the file. Safe to call more than once.
+   */
+  static void stop();
+
+  /**
+   * @brief Appends a fragment of a log line, a line is queued when a fragment ends with a newline.
+   *
+   * @param fragment The text as given to the debug, warning or error function
+   * @param level The level of the function, a line gets the highest level of its fragments
+   */
+  static void write(const char *fragment, Level level);
+
+  /**
+   * @brief Sets the layer name which is added to the JSON records from now on
+   */
+  static void setLayer(const char *layerName);
+
+  /**
+   * @brief Returns the number of lines dropped because the ring buffer was full
+   */
+  static size_t getNumDropped();
+};
+
+#endif
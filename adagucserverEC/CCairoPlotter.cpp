@@ -76,7 +76,8 @@ void CCairoPlotter::_cairoPlotterInit(int width, int height, float fontSize, con
   rfr = rfg = rfb = 0;
   rfa = 0;
 
-  library = NULL;
+  font = NULL;
+  useKerning = false;
   initializationFailed = false;
 
   initFont();
@@ -174,6 +175,43 @@ void CCairoPlotter::pixel_blend(int x, int y, unsigned char r, unsigned char g,
   }
 }
 
+void CCairoPlotter::pixel_span_indexed(int x, int y, int n, const short *colorIndices, const unsigned char *red, const unsigned char *green, const unsigned char *blue, const short *alpha) {
+  if (y < 0 || y >= height) return;
+  int start = x < 0 ? -x : 0;
+  int end = x + n > width ? width - x : n;
+  unsigned char *row = ARGBByteBuffer + y * stride;
+  for (int j = start; j < end; j++) {
+    int c = colorIndices[j];
+    if (c < 0 || c > 255) continue;
+    short a = alpha[c];
+    if (a == 255) {
+      unsigned char *p = row + (x + j) * 4;
+      p[0] = blue[c];
+      p[1] = green[c];
+      p[2] = red[c];
+      p[3] = 255;
+    } else if (a > 0) {
+      pixel_blend(x + j, y, red[c], green[c], blue[c], a);
+    } else if (a < 0) {
+      pixel_overwrite(x + j, y, red[c], green[c], blue[c], -(a + 1));
+    }
+  }
+}
+
+void CCairoPlotter::pixel_span_opaque(int x, int y, int n, unsigned char r, unsigned char g, unsigned char b) {
+  if (y < 0 || y >= height) return;
+  int start = x < 0 ? -x : 0;
+  int end = x + n > width ? width - x : n;
+  unsigned char *row = ARGBByteBuffer + y * stride;
+  for (int j = start; j < end; j++) {
+    unsigned char *p = row + (x + j) * 4;
+    p[0] = b;
+    p[1] = g;
+    p[2] = r;
+    p[3] = 255;
+  }
+}
+
 CCairoPlotter::CCairoPlotter(int width, int height, float fontSize, const char *fontLocation, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
   byteBufferPointerIsOwned = true;
   stride = cairo_format_stride_for_width(FORMAT, width);
@@ -204,7 +242,8 @@ CCairoPlotter::CCairoPlotter(int width, int height, unsigned char *_ARGBByteBuff
   this->ARGBByteBuffer = (_ARGBByteBuffer);
   surface = cairo_image_surface_create_for_data(ARGBByteBuffer, CCairoPlotter::FORMAT, width, height, stride);
   cr = cairo_create(this->surface);
-  library = NULL;
+  font = NULL;
+  useKerning = false;
   initializationFailed = false;
 
   initFont();
@@ -238,57 +277,52 @@ int CCairoPlotter::renderFont(FT_Bitmap *bitmap, int left, int top) {
   }
   return 0;
 }
+
+void CCairoPlotter::_blitGlyph(const CFreeTypeGlyphCache::Glyph *glyph, int left, int top) {
+  int startX = left < 0 ? -left : 0;
+  int endX = left + glyph->width > width ? width - left : glyph->width;
+  int startY = top < 0 ? -top : 0;
+  int endY = top + glyph->rows > height ? height - top : glyph->rows;
+  for (int y = startY; y < endY; y++) {
+    const unsigned char *src = &glyph->bitmap[y * glyph->width];
+    for (int x = startX; x < endX; x++) {
+      if (src[x] != 0) pixel_blend(x + left, y + top, r, g, b, src[x]);
+    }
+  }
+}
+
 int CCairoPlotter::initializeFreeType() {
-  // CDBDebug("initializeFreeType(%d)\n", library==NULL);
-  if (library != NULL) {
+  if (font != NULL) {
     CDBError("Freetype is already intialized");
     return 1;
   };
-  int error = FT_Init_FreeType(&library);
-  const char *fontLocation = this->fontLocation;
-  if (error) {
-    CDBError("an error occurred during freetype library initialization");
-    if (library != NULL) {
-      FT_Done_FreeType(library);
-      library = NULL;
-      face = NULL;
-    }
-    return 1;
-  }
-  error = FT_New_Face(library, fontLocation, 0, &face);
-  if (error == FT_Err_Unknown_File_Format) {
-    CDBError("the font file could be opened and read, but it appears that its font format is unsupported %s", fontLocation);
-    if (library != NULL) {
-      FT_Done_FreeType(library);
-      library = NULL;
-      face = NULL;
-    }
-    return 1;
-  } else if (error) {
-    CDBError("Unable to initialize freetype: Could not read fontfile %s", fontLocation);
-    if (library != NULL) {
-      FT_Done_FreeType(library);
-      library = NULL;
-      face = NULL;
-    }
-    return 1;
-  }
+  CFreeTypeGlyphCache::lock();
+  font = CFreeTypeGlyphCache::getFont(fontLocation, fontSize);
+  CFreeTypeGlyphCache::unlock();
+  return font == NULL ? 1 : 0;
+}
 
-  error = FT_Set_Char_Size(face,               /* handle to face object */
-                           0,                  /* char_width in 1/64th of points */
-                           int(fontSize * 64), /* char_height in 1/64th of points */
-                           100,                /* horizontal device resolution */
-                           100);               /* vertical device resolution */
-  if (error) {
-    CDBError("unable to set character size");
-    if (library != NULL) {
-      FT_Done_FreeType(library);
-      library = NULL;
-      face = NULL;
+/* Returns the glyph at the pen position, positioned relative to the whole pixel part of the pen. Upright glyphs come from the cache,
+ * rotated glyphs are rendered into rotatedGlyph. Call with the cache locked. */
+const CFreeTypeGlyphCache::Glyph *CCairoPlotter::_getGlyph(FT_UInt glyphIndex, FT_Matrix *matrix, FT_Vector &pen, CFreeTypeGlyphCache::Glyph &rotatedGlyph) {
+  if (matrix == NULL) return font->getGlyph(glyphIndex, pen.x, pen.y);
+  FT_Face face = font->face;
+  FT_Set_Transform(face, matrix, &pen);
+  if (FT_Load_Glyph(face, glyphIndex, FT_LOAD_RENDER) != 0) return NULL;
+  FT_GlyphSlot slot = face->glyph;
+  rotatedGlyph.left = slot->bitmap_left - (pen.x >> 6);
+  rotatedGlyph.top = slot->bitmap_top - (pen.y >> 6);
+  rotatedGlyph.width = slot->bitmap.width;
+  rotatedGlyph.rows = slot->bitmap.rows;
+  rotatedGlyph.advanceX = slot->advance.x;
+  rotatedGlyph.advanceY = slot->advance.y;
+  rotatedGlyph.bitmap.resize(size_t(rotatedGlyph.width) * rotatedGlyph.rows);
+  for (int y = 0; y < rotatedGlyph.rows; y++) {
+    for (int x = 0; x < rotatedGlyph.width; x++) {
+      rotatedGlyph.bitmap[x + y * rotatedGlyph.width] = slot->bitmap.buffer[x + y * slot->bitmap.pitch];
     }
-    return 1;
   }
-  return 0;
+  return &rotatedGlyph;
 }
 
 int CCairoPlotter::_drawFreeTypeText(int x, int y, int &w, int &h, float angle, const char *text, bool render) {
@@ -296,56 +330,60 @@ int CCairoPlotter::_drawFreeTypeText(int x, int y, int &w, int &h, float angle,
 
   w = 0;
   h = 0;
-  if (library == NULL) {
+  if (font == NULL) {
     int status = initializeFreeType();
     if (status != 0) {
       return 1;
     }
   };
-  int error;
 
-  FT_GlyphSlot slot;
   FT_Matrix matrix; /* transformation matrix */
   FT_Vector pen;    /* untransformed origin */
-  int n;
   int my_target_height = 8;
   int num_chars = strlen(text);
-  slot = face->glyph; /* a small shortcut */
   /* set up matrix */
   matrix.xx = (FT_Fixed)(cos(angle) * 0x10000L);
   matrix.xy = (FT_Fixed)(-sin(angle) * 0x10000L);
   matrix.yx = (FT_Fixed)(sin(angle) * 0x10000L);
   matrix.yy = (FT_Fixed)(cos(angle) * 0x10000L); /* the pen position in 26.6 cartesian space coordinates */
+  CFreeTypeGlyphCache::Glyph rotatedGlyph;
 
-  /* start at (300,200) */
   pen.x = x * 64;
   pen.y = (my_target_height - y) * 64;
+  FT_UInt previousGlyphIndex = 0;
+  CFreeTypeGlyphCache::lock();
   /* Using the 8859-15 standard */
-  for (n = 0; n < num_chars; n++) { /* set transformation */
-
-    FT_Set_Transform(face, &matrix, &pen); /* load glyph image into the slot (erase previous one) */
-
+  for (int n = 0; n < num_chars; n++) {
     unsigned char characterToPrint = (unsigned char)text[n];
     if (characterToPrint == 194) continue;
-    int glyphIndex = FT_Get_Char_Index(face, (characterToPrint));
-    error = FT_Load_Glyph(face, glyphIndex, FT_LOAD_RENDER);
+    FT_UInt glyphIndex = font->getGlyphIndex(characterToPrint);
+    if (useKerning) {
+      FT_Pos kerning = font->getKerning(previousGlyphIndex, glyphIndex);
+      pen.x += FT_Pos(kerning * cos(angle));
+      pen.y += FT_Pos(kerning * sin(angle));
+      w += kerning / 64;
+    }
+    previousGlyphIndex = glyphIndex;
 
-    if (error) {
+    const CFreeTypeGlyphCache::Glyph *glyph = _getGlyph(glyphIndex, angle == 0 ? NULL : &matrix, pen, rotatedGlyph);
+    if (glyph == NULL) {
+      CFreeTypeGlyphCache::unlock();
       CDBError("unable toFT_Load_Char");
       return 1;
     }
     /* now, draw to our target surface (convert position) */
     if (render) {
-      renderFont(&slot->bitmap, slot->bitmap_left, my_target_height - slot->bitmap_top);
+      _blitGlyph(glyph, glyph->left + (pen.x >> 6), my_target_height - (glyph->top + (pen.y >> 6)));
     }
     /* increment pen position */
 
-    if (int(slot->bitmap.rows) > h) h = (int)slot->bitmap.rows;
+    if (glyph->rows > h) h = glyph->rows;
 
-    pen.x += slot->advance.x;
-    pen.y += slot->advance.y;
-    w += slot->advance.x / 64;
+    pen.x += glyph->advanceX;
+    pen.y += glyph->advanceY;
+    w += glyph->advanceX / 64;
   }
+  CFreeTypeGlyphCache::unlock();
   return 0;
 }
 
@@ -383,7 +421,7 @@ int CCairoPlotter::drawFilledText(int x, int y, float angle, const char *text) {
   if (text == NULL) return 0;
   if (strlen(text) == 0) return 0;
   if (initializationFailed == true) return 1;
-  if (library == NULL) {
+  if (font == NULL) {
     int status = initializeFreeType();
     if (status != 0) {
       initializationFailed = true;
@@ -399,7 +437,7 @@ int CCairoPlotter::drawFilledText(int x, int y, float angle, const char *text) {
   matrix.yy = (FT_Fixed)(cos(angle) * 0x10000L); /* the pen position in 26.6 cartesian space coordinates */
 
   // Draw text :)
-  int my_target_height = 8, error;
+  int my_target_height = 8;
   int num_chars = strlen(text);
   int orgr = this->r;
   int orgg = this->g;
@@ -411,10 +449,12 @@ int CCairoPlotter::drawFilledText(int x, int y, float angle, const char *text) {
   pen.y = (my_target_height - y) * 64;
   setColor(255, 255, 255, 0);
   filledRectangle(pen.x / 64 - 5, my_target_height - (pen.y) / 64 + 8, (pen.x) / 64, my_target_height - (pen.y) / 64 - int(fontSize) - 4);
-  for (int n = 0; n < num_chars; n++) {    /* set transformation */
-    FT_Set_Transform(face, &matrix, &pen); /* load glyph image into the  face->glyph (erase previous one) */
-    error = FT_Load_Char(face, text[n], FT_LOAD_RENDER);
-    if (error) {
+  CFreeTypeGlyphCache::Glyph rotatedGlyph;
+  for (int n = 0; n < num_chars; n++) {
+    CFreeTypeGlyphCache::lock();
+    const CFreeTypeGlyphCache::Glyph *glyph = _getGlyph(font->getGlyphIndex((FT_ULong)text[n]), angle == 0 ? NULL : &matrix, pen, rotatedGlyph);
+    CFreeTypeGlyphCache::unlock();
+    if (glyph == NULL) {
       CDBError("unable toFT_Load_Char");
       return 1;
     }
@@ -423,12 +463,12 @@ int CCairoPlotter::drawFilledText(int x, int y, float angle, const char *text) {
     // setFillColor(255,255,255,100);
 
     setColor(255, 255, 255, 0);
-    filledRectangle(pen.x / 64, my_target_height - (pen.y) / 64 + 5, (pen.x + face->glyph->advance.x) / 64, my_target_height - (pen.y) / 64 - int(fontSize) - 4);
+    filledRectangle(pen.x / 64, my_target_height - (pen.y) / 64 + 5, (pen.x + glyph->advanceX) / 64, my_target_height - (pen.y) / 64 - int(fontSize) - 4);
     setColor(orgr, orgg, orgb, orga);
-    renderFont(&face->glyph->bitmap, face->glyph->bitmap_left, my_target_height - face->glyph->bitmap_top);
+    _blitGlyph(glyph, glyph->left + (pen.x >> 6), my_target_height - (glyph->top + (pen.y >> 6)));
     /* increment pen position */
-    pen.x += face->glyph->advance.x;
-    pen.y += face->glyph->advance.y;
+    pen.x += glyph->advanceX;
+    pen.y += glyph->advanceY;
   }
   setColor(255, 255, 255, 0);
   filledRectangle(pen.x / 64, my_target_height - (pen.y) / 64 + 5, (pen.x) / 64 + 5, my_target_height - (pen.y) / 64 - int(fontSize) - 4);
@@ -48,6 +48,7 @@
 #include <math.h>
 
 #include "COctTreeColorQuantizer.h"
+#include "CFreeTypeGlyphCache.h"
 
 cairo_status_t writerFunc(void *closure, const unsigned char *data, unsigned int length);
 class CCairoPlotter {
@@ -65,8 +66,8 @@ private:
   float fontSize;
   const char *fontLocation;
   bool initializationFailed;
-  FT_Library library;
-  FT_Face face;
+  CFreeTypeGlyphCache::Font *font;
+  bool useKerning;
   unsigned char r, g, b;
   float a;
   //   void _plot(int x, int y, float alpha);
@@ -76,6 +77,8 @@ private:
   bool byteBufferPointerIsOwned;
   void _cairoPlotterInit(int width, int height, float fontSize, const char *fontLocation);
   int _drawFreeTypeText(int x, int y, int &w, int &h, float angle, const char *text, bool render);
+  const CFreeTypeGlyphCache::Glyph *_getGlyph(FT_UInt glyphIndex, FT_Matrix *matrix, FT_Vector &pen, CFreeTypeGlyphCache::Glyph &rotatedGlyph);
+  void _blitGlyph(const CFreeTypeGlyphCache::Glyph *glyph, int left, int top);
 
 public:
   bool isAlphaUsed;
@@ -88,6 +91,11 @@ public:
   int renderFont(FT_Bitmap *bitmap, int left, int top);
   int initializeFreeType();
 
+  /**
+   * Enables pair kerning from the font for text drawn with this plotter, off by default
+   */
+  void setKerning(bool useKerning) { this->useKerning = useKerning; }
+
   int getTextSize(int &w, int &h, float angle, const char *text);
   int drawAnchoredText(int x, int y, float angle, const char *text, int anchor);
   int drawCenteredText(int x, int y, float angle, const char *text);
@@ -100,6 +108,17 @@ public:
   void pixel_overwrite(int x, int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
   void pixel_blend(int x, int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
 
+  /**
+   * Draws n pixels from (x,y) to the right, looking up the colors in the given palette. Negative indices are skipped,
+   * a palette alpha of 255 is written directly, other positive alphas are blended and negative alphas overwrite with alpha -(a+1).
+   */
+  void pixel_span_indexed(int x, int y, int n, const short *colorIndices, const unsigned char *red, const unsigned char *green, const unsigned char *blue, const short *alpha);
+
+  /**
+   * Writes n opaque pixels from (x,y) to the right
+   */
+  void pixel_span_opaque(int x, int y, int n, unsigned char r, unsigned char g, unsigned char b);
+
   unsigned char *getByteBuffer();
   void rectangle(int x1, int y1, int x2, int y2);
   void filledRectangle(int x1, int y1, int x2, int y2);
@@ -0,0 +1,83 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CColorIndexMapper.h"
+#include <math.h>
+
+CColorIndexMapper::CColorIndexMapper() {
+  hasNodataValue = false;
+  hasValueRange = false;
+  fNodataValue = 0;
+  lowerRange = 0;
+  upperRange = 0;
+  scale = 1;
+  offset = 0;
+  useLog = false;
+  log10Base = 1;
+}
+
+void CColorIndexMapper::init(CDataSource *dataSource, bool useValueRange) {
+  CDataSource::DataObject *dataObject = dataSource->getDataObject(0);
+  init(dataSource->getStyle(), dataObject->hasNodataValue, float(dataObject->dfNodataValue), useValueRange);
+}
+
+void CColorIndexMapper::init(CStyleConfiguration *styleConfiguration, bool hasNodataValue, float fNodataValue, bool useValueRange) {
+  this->hasNodataValue = hasNodataValue;
+  this->fNodataValue = fNodataValue;
+  hasValueRange = useValueRange && styleConfiguration->hasLegendValueRange;
+  lowerRange = styleConfiguration->legendLowerRange;
+  upperRange = styleConfiguration->legendUpperRange;
+  scale = styleConfiguration->legendScale;
+  offset = styleConfiguration->legendOffset;
+  useLog = styleConfiguration->legendLog != 0;
+  log10Base = useLog ? log10(styleConfiguration->legendLog) : 1;
+}
+
+void CColorIndexMapper::mapRow(const float *values, size_t n, short *colorIndices) const {
+  /* Kept as separate loops without calls or early exits, so each one can be vectorized */
+  const float noData = fNodataValue, lower = lowerRange, upper = upperRange;
+  const float s = scale, o = offset;
+  const bool checkNodata = hasNodataValue, checkRange = hasValueRange;
+  if (useLog) {
+    for (size_t j = 0; j < n; j++) {
+      float v = values[j];
+      bool skip = (checkNodata && (v == noData || !(v == v))) || (checkRange && (v < lower || v > upper));
+      float c = float(log10(v + .000001) / log10Base);
+      c = c * s + o;
+      c = c > 0 ? c : 0;
+      c = c < 239 ? c : 239;
+      colorIndices[j] = skip ? -1 : short(c);
+    }
+    return;
+  }
+  for (size_t j = 0; j < n; j++) {
+    float v = values[j];
+    bool skip = (checkNodata && (v == noData || !(v == v))) || (checkRange && (v < lower || v > upper));
+    float c = v * s + o;
+    c = c > 0 ? c : 0; /* Also maps NaN to 0 */
+    c = c < 239 ? c : 239;
+    colorIndices[j] = skip ? -1 : short(c);
+  }
+}
@@ -0,0 +1,76 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CCOLORINDEXMAPPER_H
+#define CCOLORINDEXMAPPER_H
+
+#include <stddef.h>
+#include "CDataSource.h"
+
+/**
+ * @brief Maps rows of data values to legend color indices, using the nodata value, value range, log and scale settings of a style.
+ * The settings are looked up once in init, the rows are mapped with branch free loops which the compiler can vectorize.
+ * The resulting spans are drawn with CDrawImage::setPixelIndexedSpan.
+ */
+class CColorIndexMapper {
+private:
+  bool hasNodataValue, hasValueRange;
+  float fNodataValue, lowerRange, upperRange;
+  float scale, offset;
+  bool useLog;
+  double log10Base;
+
+public:
+  CColorIndexMapper();
+
+  /**
+   * @brief Takes the settings from the style and first data object of the datasource
+   *
+   * @param useValueRange Skip values outside the ValueRange of the style
+   */
+  void init(CDataSource *dataSource, bool useValueRange = true);
+
+  /**
+   * @brief Takes the settings from a style configuration
+   */
+  void init(CStyleConfiguration *styleConfiguration, bool hasNodataValue, float fNodataValue, bool useValueRange = true);
+
+  /**
+   * @brief Maps n values to color indices 0-239. Nodata values and values outside the value range become -1, these pixels are not drawn.
+   * NaN counts as nodata when the data has a nodata value.
+   */
+  void mapRow(const float *values, size_t n, short *colorIndices) const;
+
+  /**
+   * @brief Maps a single value, see mapRow
+   */
+  short map(float value) const {
+    short colorIndex;
+    mapRow(&value, 1, &colorIndex);
+    return colorIndex;
+  }
+};
+
+#endif
@@ -26,9 +26,88 @@
 #include "CConvertCurvilinear.h"
 #include "CFillTriangle.h"
 #include "CImageWarper.h"
+#include "CPolygonRasterizer.h"
+#include <float.h>
 // #define CCONVERTCURVILINEAR_DEBUG
 const char *CConvertCurvilinear::className = "CConvertCurvilinear";
 
+class CConvertCurvilinearCells {
+public:
+  const float *lonData, *latData;
+  float fillValueLon, fillValueLat;
+  int numRows, numCols;
+};
+
+static inline void addToCellBBOX(float *bbox, float lon, float lat, float fillValueLon, float fillValueLat, bool &isValid) {
+  if (lon == fillValueLon || lat == fillValueLat || !(fabs(lon) < INFINITY) || !(fabs(lat) < INFINITY)) isValid = false;
+  bbox[0] = std::min(bbox[0], lon);
+  bbox[1] = std::min(bbox[1], lat);
+  bbox[2] = std::max(bbox[2], lon);
+  bbox[3] = std::max(bbox[3], lat);
+}
+
+/* Bounding boxes of the quads connecting the centers of 2x2 neighbouring cells, used for bilinear rendering */
+static void getQuadBBOXes(std::vector<float> &cellBBOX, void *userData) {
+  CConvertCurvilinearCells *cells = (CConvertCurvilinearCells *)userData;
+  int numQuadCols = cells->numCols - 1;
+  cellBBOX.assign(size_t(cells->numRows - 1) * numQuadCols * 4, NAN);
+  for (int y = 0; y < cells->numRows - 1; y++) {
+    for (int x = 0; x < numQuadCols; x++) {
+      size_t p = x + size_t(y) * cells->numCols;
+      size_t corners[4] = {p, p + 1, p + cells->numCols, p + cells->numCols + 1};
+      float bbox[4] = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+      bool isValid = true;
+      for (int j = 0; j < 4; j++) addToCellBBOX(bbox, cells->lonData[corners[j]], cells->latData[corners[j]], cells->fillValueLon, cells->fillValueLat, isValid);
+      if (isValid) std::copy(bbox, bbox + 4, &cellBBOX[(x + size_t(y) * numQuadCols) * 4]);
+    }
+  }
+}
+
+/* Bounding boxes of the cells described by lon_bnds and lat_bnds, used for nearest neighbour rendering */
+static void getBoundsBBOXes(std::vector<float> &cellBBOX, void *userData) {
+  CConvertCurvilinearCells *cells = (CConvertCurvilinearCells *)userData;
+  size_t numCells = size_t(cells->numRows) * cells->numCols;
+  cellBBOX.assign(numCells * 4, NAN);
+  for (size_t c = 0; c < numCells; c++) {
+    float bbox[4] = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    bool isValid = true;
+    for (int j = 0; j < 4; j++) addToCellBBOX(bbox, cells->lonData[c * 4 + j], cells->latData[c * 4 + j], cells->fillValueLon, cells->fillValueLat, isValid);
+    if (isValid) std::copy(bbox, bbox + 4, &cellBBOX[c * 4]);
+  }
+}
+
+/* Reprojected cell centers of a part of a swath row, neighbouring quads share them */
+class CConvertCurvilinearRow {
+public:
+  CConvertCurvilinearRow() {
+    row = -1;
+    firstCol = 0;
+    lastCol = -1;
+  }
+  int row, firstCol, lastCol;
+  std::vector<double> x, y;
+  std::vector<unsigned char> failed;
+
+  bool covers(int row, int firstCol, int lastCol) const { return this->row == row && this->firstCol <= firstCol && this->lastCol >= lastCol; }
+
+  void project(const CConvertCurvilinearCells &cells, int row, int firstCol, int lastCol, CImageWarper *imageWarper, bool projectionRequired) {
+    this->row = row;
+    this->firstCol = firstCol;
+    this->lastCol = lastCol;
+    size_t numPoints = lastCol - firstCol + 1;
+    x.resize(numPoints);
+    y.resize(numPoints);
+    failed.assign(numPoints, 0);
+    const float *lons = cells.lonData + size_t(row) * cells.numCols + firstCol;
+    const float *lats = cells.latData + size_t(row) * cells.numCols + firstCol;
+    for (size_t j = 0; j < numPoints; j++) {
+      x[j] = lons[j];
+      y[j] = lats[j];
+    }
+    if (projectionRequired) imageWarper->reprojfromLatLon(&x[0], &y[0], numPoints, &failed[0]);
+  }
+};
+
 int CConvertCurvilinear::checkIfIsCurvilinear(CDFObject *cdfObject, CServerParams *, bool &hasLatLonBounds) {
   // Check whether this is really a curvilinear file
   try {
@@ -669,92 +748,130 @@ int CConvertCurvilinear::convertCurvilinearData(CDataSource *dataSource, int mod
         swathMiddleLat->getAttribute("_FillValue")->getData(&fillValueLat, 1);
       } catch (int e) {
       };
-      if (1 == 1) {
-        for (int y = 0; y < numRows - 1; y++) {
-          for (int x = 0; x < numCols - 1; x++) {
-            size_t pSwath = x + y * numCols;
-            // CDBDebug("%d %d %d",x,y,pSwath);
-            double lons[4], lats[4];
-            float vals[4];
-            lons[0] = (float)lonData[pSwath];
-            lons[1] = (float)lonData[pSwath + 1];
-            lons[2] = (float)lonData[pSwath + numCols];
-            lons[3] = (float)lonData[pSwath + numCols + 1];
-
-            lats[0] = (float)latData[pSwath];
-            lats[1] = (float)latData[pSwath + 1];
-            lats[2] = (float)latData[pSwath + numCols];
-            lats[3] = (float)latData[pSwath + numCols + 1];
-
-            vals[0] = swathData[pSwath];
-            vals[1] = swathData[pSwath + 1];
-            vals[2] = swathData[pSwath + numCols];
-            vals[3] = swathData[pSwath + numCols + 1];
-
-            if (drawNearestWithGouraud) {
-              vals[1] = vals[0];
-              vals[2] = vals[0];
-              vals[3] = vals[0];
-            }
+      // Select the quads overlapping the map
+      CConvertCurvilinearCells cells;
+      cells.lonData = lonData;
+      cells.latData = latData;
+      cells.fillValueLon = fillValueLon;
+      cells.fillValueLat = fillValueLat;
+      cells.numRows = numRows;
+      cells.numCols = numCols;
+      int numQuadCols = numCols - 1;
+      int numQuads = numQuadCols > 0 && numRows > 1 ? (numRows - 1) * numQuadCols : 0;
+      std::vector<int> visibleQuads;
+      if (numQuads > 0) {
+        CPolygonCellIndex quadIndex;
+        quadIndex.load(dataSource, "lon_lat_quads", getQuadBBOXes, &cells);
+        double latLonBBOX[4];
+        if (CPolygonCellIndex::getLatLonBBOX(&imageWarper, projectionRequired, dataSource->srvParams->Geo->dfBBOX, latLonBBOX) == 0) {
+          quadIndex.query(latLonBBOX, visibleQuads);
+        } else {
+          visibleQuads.resize(numQuads);
+          for (int q = 0; q < numQuads; q++) visibleQuads[q] = q;
+        }
+      }
+#ifdef CCONVERTCURVILINEAR_DEBUG
+      CDBDebug("Drawing %d of %d quads", (int)visibleQuads.size(), numQuads);
+#endif
 
-            bool tileHasNoData = false;
-            float lonMin, lonMax, lonMiddle = 0;
-            for (int j = 0; j < 4; j++) {
-              float lon = lons[j];
-              if (j == 0) {
-                lonMin = lon;
-                lonMax = lon;
-              } else {
-                if (lon < lonMin) lonMin = lon;
-                if (lon > lonMax) lonMax = lon;
-              }
-              lonMiddle += lon;
-              float lat = lats[j];
-              float val = vals[j];
-              if (val == fill || val == INFINITY || val == NAN || val == -INFINITY || !(val == val)) {
-                tileHasNoData = true;
-                break;
-              }
-              if (lat == fillValueLat || lat == INFINITY || lat == -INFINITY || !(lat == lat)) {
-                tileHasNoData = true;
-                break;
-              }
-              if (lon == fillValueLon || lon == INFINITY || lon == -INFINITY || !(lon == lon)) {
-                tileHasNoData = true;
-                break;
-              }
+      // The visible quads are sorted, so they are handled row by row. The lower centers of a row of quads are the upper centers of the next row.
+      CConvertCurvilinearRow upperRow, lowerRow;
+      size_t k = 0;
+      while (k < visibleQuads.size()) {
+        int y = visibleQuads[k] / numQuadCols;
+        size_t kEnd = k;
+        while (kEnd < visibleQuads.size() && visibleQuads[kEnd] / numQuadCols == y) kEnd++;
+        int firstCol = visibleQuads[k] % numQuadCols;
+        int lastCol = visibleQuads[kEnd - 1] % numQuadCols + 1;
+        if (lowerRow.covers(y, firstCol, lastCol)) {
+          std::swap(upperRow, lowerRow);
+        } else {
+          upperRow.project(cells, y, firstCol, lastCol, &imageWarper, projectionRequired);
+        }
+        lowerRow.project(cells, y + 1, firstCol, lastCol, &imageWarper, projectionRequired);
+
+        for (; k < kEnd; k++) {
+          int x = visibleQuads[k] % numQuadCols;
+          size_t pSwath = x + size_t(y) * numCols;
+          double lons[4], lats[4];
+          float vals[4];
+          lons[0] = (float)lonData[pSwath];
+          lons[1] = (float)lonData[pSwath + 1];
+          lons[2] = (float)lonData[pSwath + numCols];
+          lons[3] = (float)lonData[pSwath + numCols + 1];
+
+          lats[0] = (float)latData[pSwath];
+          lats[1] = (float)latData[pSwath + 1];
+          lats[2] = (float)latData[pSwath + numCols];
+          lats[3] = (float)latData[pSwath + numCols + 1];
+
+          vals[0] = swathData[pSwath];
+          vals[1] = swathData[pSwath + 1];
+          vals[2] = swathData[pSwath + numCols];
+          vals[3] = swathData[pSwath + numCols + 1];
+
+          if (drawNearestWithGouraud) {
+            vals[1] = vals[0];
+            vals[2] = vals[0];
+            vals[3] = vals[0];
+          }
+
+          bool tileHasNoData = false;
+          float lonMin, lonMax, lonMiddle = 0;
+          for (int j = 0; j < 4; j++) {
+            float lon = lons[j];
+            if (j == 0) {
+              lonMin = lon;
+              lonMax = lon;
+            } else {
+              if (lon < lonMin) lonMin = lon;
+              if (lon > lonMax) lonMax = lon;
+            }
+            lonMiddle += lon;
+            float lat = lats[j];
+            float val = vals[j];
+            if (val == fill || val == INFINITY || val == NAN || val == -INFINITY || !(val == val)) {
+              tileHasNoData = true;
+              break;
+            }
+            if (lat == fillValueLat || lat == INFINITY || lat == -INFINITY || !(lat == lat)) {
+              tileHasNoData = true;
+              break;
             }
+            if (lon == fillValueLon || lon == INFINITY || lon == -INFINITY || !(lon == lon)) {
+              tileHasNoData = true;
+              break;
+            }
+          }
+          if (tileHasNoData) continue;
+
+          int dlons[4], dlats[4];
+          bool projectionIsOk = true;
+          if (lonMax - lonMin >= 350) {
+            // Quads crossing the date line are shifted to one side, their centers can not be shared
             lonMiddle /= 4;
-            if (lonMax - lonMin >= 350) {
-              if (lonMiddle > 0) {
-                for (int j = 0; j < 4; j++)
-                  if (lons[j] < lonMiddle) lons[j] += 360;
-              } else {
-                for (int j = 0; j < 4; j++)
-                  if (lons[j] > lonMiddle) lons[j] -= 360;
+            for (int j = 0; j < 4; j++) {
+              if (lonMiddle > 0 && lons[j] < lonMiddle) lons[j] += 360;
+              if (lonMiddle <= 0 && lons[j] > lonMiddle) lons[j] -= 360;
+              if (projectionRequired) {
+                if (imageWarper.reprojfromLatLon(lons[j], lats[j]) != 0) projectionIsOk = false;
               }
+              dlons[j] = int((lons[j] - offsetX) / cellSizeX);
+              dlats[j] = int((lats[j] - offsetY) / cellSizeY);
             }
-            if (tileHasNoData == false) {
-              int dlons[4], dlats[4];
-              bool projectionIsOk = true;
-              for (int j = 0; j < 4; j++) {
-                //               if(tileIsOverDateBorder){
-                //                 lons[j]-=360;
-                //                 if(lons[j]<-280)lons[j]+=360;
-                //               }
-                //
-                if (projectionRequired) {
-                  if (imageWarper.reprojfromLatLon(lons[j], lats[j]) != 0) projectionIsOk = false;
-                }
-
-                dlons[j] = int((lons[j] - offsetX) / cellSizeX);
-                dlats[j] = int((lats[j] - offsetY) / cellSizeY);
-              }
-              if (projectionIsOk) {
-                fillQuadGouraud(sdata, vals, dataSource->dWidth, dataSource->dHeight, dlons, dlats);
-              }
+          } else {
+            // Corner order is upper left, upper right, lower left, lower right
+            const CConvertCurvilinearRow *cornerRows[4] = {&upperRow, &upperRow, &lowerRow, &lowerRow};
+            for (int j = 0; j < 4; j++) {
+              int c = x + (j & 1) - cornerRows[j]->firstCol;
+              if (cornerRows[j]->failed[c]) projectionIsOk = false;
+              dlons[j] = int((cornerRows[j]->x[c] - offsetX) / cellSizeX);
+              dlats[j] = int((cornerRows[j]->y[c] - offsetY) / cellSizeY);
             }
           }
+          if (projectionIsOk) {
+            fillQuadGouraud(sdata, vals, dataSource->dWidth, dataSource->dHeight, dlons, dlats);
+          }
         }
       }
     }
@@ -802,7 +919,33 @@ int CConvertCurvilinear::convertCurvilinearData(CDataSource *dataSource, int mod
       } catch (int e) {
       };
 
-      for (int pSwath = 0; pSwath < numTiles; pSwath++) {
+      // Select the cells overlapping the map
+      CConvertCurvilinearCells cells;
+      cells.lonData = lonData;
+      cells.latData = latData;
+      cells.fillValueLon = fillValueLon;
+      cells.fillValueLat = fillValueLat;
+      cells.numRows = numRows;
+      cells.numCols = numCols;
+      CPolygonCellIndex cellIndex;
+      cellIndex.load(dataSource, "lon_bnds", getBoundsBBOXes, &cells);
+      std::vector<int> visibleCells;
+      double latLonBBOX[4];
+      if (CPolygonCellIndex::getLatLonBBOX(&imageWarper, projectionRequired, dataSource->srvParams->Geo->dfBBOX, latLonBBOX) == 0) {
+        cellIndex.query(latLonBBOX, visibleCells);
+      } else {
+        visibleCells.resize(numTiles);
+        for (int pSwath = 0; pSwath < numTiles; pSwath++) visibleCells[pSwath] = pSwath;
+      }
+#ifdef CCONVERTCURVILINEAR_DEBUG
+      CDBDebug("Drawing %d of %d tiles", (int)visibleCells.size(), numTiles);
+#endif
+
+      // Collect the corners of the tiles to draw, they are reprojected in one batch
+      std::vector<int> tilesToDraw;
+      std::vector<double> cornerX, cornerY;
+      for (size_t k = 0; k < visibleCells.size(); k++) {
+        int pSwath = visibleCells[k];
 
         double lons[4], lats[4];
         float vals[4];
@@ -860,19 +1003,32 @@ int CConvertCurvilinear::convertCurvilinearData(CDataSource *dataSource, int mod
           }
         }
         if (tileHasNoData == false) {
-          int dlons[4], dlats[4];
+          tilesToDraw.push_back(pSwath);
           for (int j = 0; j < 4; j++) {
-            if (projectionRequired)
-              if (imageWarper.reprojfromLatLon(lons[j], lats[j]) != 0) {
-                tileHasNoData = true;
-                break;
-              }
-            dlons[j] = int((lons[j] - offsetX) / cellSizeX);
-            dlats[j] = int((lats[j] - offsetY) / cellSizeY);
+            cornerX.push_back(lons[j]);
+            cornerY.push_back(lats[j]);
           }
-          if (tileHasNoData == false) {
-            fillQuadGouraud(sdata, vals, dataSource->dWidth, dataSource->dHeight, dlons, dlats);
+        }
+      }
+      std::vector<unsigned char> cornerFailed(cornerX.size(), 0);
+      if (projectionRequired && cornerX.size() > 0) imageWarper.reprojfromLatLon(&cornerX[0], &cornerY[0], cornerX.size(), &cornerFailed[0]);
+
+      for (size_t t = 0; t < tilesToDraw.size(); t++) {
+        bool tileHasNoData = false;
+        int dlons[4], dlats[4];
+        float vals[4];
+        for (int j = 0; j < 4; j++) {
+          size_t corner = t * 4 + j;
+          if (cornerFailed[corner]) {
+            tileHasNoData = true;
+            break;
           }
+          dlons[j] = int((cornerX[corner] - offsetX) / cellSizeX);
+          dlats[j] = int((cornerY[corner] - offsetY) / cellSizeY);
+          vals[j] = swathData[tilesToDraw[t]];
+        }
+        if (tileHasNoData == false) {
+          fillQuadGouraud(sdata, vals, dataSource->dWidth, dataSource->dHeight, dlons, dlats);
         }
       }
     }
@@ -31,6 +31,8 @@
 #include "CConvertGeoJSON.h"
 #include "CConvertUGRIDMesh.h"
 #include "CImageWarper.h"
+#include "CPolygonRasterizer.h"
+#include <algorithm>
 #include <values.h>
 #include <string>
 #include <map>
@@ -42,465 +44,58 @@ const char *CConvertGeoJSON::className = "CConvertGeoJSON";
 #define CCONVERTUGRIDMESH_NODATA -32000
 //      #define MEASURETIME 1
 
-void CConvertGeoJSON::drawpoly2(float *imagedata, int w, int h, int polyCorners, float *polyXY, float value) {
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i, j, swap;
-  int IMAGE_TOP = 0;
-  int IMAGE_BOT = h;
-  int IMAGE_LEFT = 0;
-  int IMAGE_RIGHT = w;
-
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    //  Build a list of nodes.
-    nodes = 0;
-    j = polyCorners - 1;
-    for (i = 0; i < polyCorners; i++) {
-      if ((polyXY[i * 2 + 1] < (double)pixelY && polyXY[j * 2 + 1] >= (double)pixelY) || (polyXY[j * 2 + 1] < (double)pixelY && polyXY[i * 2 + 1] >= (double)pixelY)) {
-        nodeX[nodes++] = (int)(polyXY[i * 2] + (pixelY - polyXY[i * 2 + 1]) / (polyXY[j * 2 + 1] - polyXY[i * 2 + 1]) * (polyXY[j * 2] - polyXY[i * 2]));
-      }
-      j = i;
-    }
-
-    //  Sort the nodes, via a simple “Bubble” sort.
-    i = 0;
-    while (i < nodes - 1) {
-      if (nodeX[i] > nodeX[i + 1]) {
-        swap = nodeX[i];
-        nodeX[i] = nodeX[i + 1];
-        nodeX[i + 1] = swap;
-        if (i) i--;
-      } else {
-        i++;
-      }
-    }
-
-    //  Fill the pixels between node pairs.
-    for (i = 0; i < nodes; i += 2) {
-      if (nodeX[i] >= IMAGE_RIGHT) break;
-      if (nodeX[i + 1] > IMAGE_LEFT) {
-        if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-        if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-        for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-          imagedata[int(j) + int(pixelY) * w] = value;
-        }
-      }
-    }
-  }
-}
-
-void CConvertGeoJSON::drawpolyWithHoles(float *imagedata, int w, int h, int polyCorners, float *polyXY, float value, int holes, int *holeCorners, float *holeXY[]) {
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i, j, swap;
-  int IMAGE_TOP = 0;
-  int IMAGE_BOT = h;
-  int IMAGE_LEFT = 0;
-  int IMAGE_RIGHT = w;
-
-  // Allocate  scanline
-  float scanline[w];
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    for (i = 0; i < w; i++) scanline[i] = -9999;
-
-    //  Build a list of nodes.
-    nodes = 0;
-    j = polyCorners - 1;
-    for (i = 0; i < polyCorners; i++) {
-      if ((polyXY[i * 2 + 1] < (double)pixelY && polyXY[j * 2 + 1] >= (double)pixelY) || (polyXY[j * 2 + 1] < (double)pixelY && polyXY[i * 2 + 1] >= (double)pixelY)) {
-        nodeX[nodes++] = (int)(polyXY[i * 2] + (pixelY - polyXY[i * 2 + 1]) / (polyXY[j * 2 + 1] - polyXY[i * 2 + 1]) * (polyXY[j * 2] - polyXY[i * 2]));
-      }
-      j = i;
-    }
-
-    //  Sort the nodes, via a simple “Bubble” sort.
-    i = 0;
-    while (i < nodes - 1) {
-      if (nodeX[i] > nodeX[i + 1]) {
-        swap = nodeX[i];
-        nodeX[i] = nodeX[i + 1];
-        nodeX[i + 1] = swap;
-        if (i) i--;
-      } else {
-        i++;
-      }
-    }
-
-    //  Fill the pixels between node pairs.
-    for (i = 0; i < nodes; i += 2) {
-      if (nodeX[i] >= IMAGE_RIGHT) break;
-      if (nodeX[i + 1] > IMAGE_LEFT) {
-        if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-        if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-        for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-          //                imagedata[int(j)+int(pixelY)*w] = value;
-          scanline[int(j)] = value;
-        }
-      }
-    }
-
-    for (int h = 0; h < holes; h++) {
-      //  Build a list of hole nodes.
-      nodes = 0;
-      j = holeCorners[h] - 1;
-      for (i = 0; i < holeCorners[h]; i++) {
-        if ((holeXY[h][i * 2 + 1] < (double)pixelY && holeXY[h][j * 2 + 1] >= (double)pixelY) || (holeXY[h][j * 2 + 1] < (double)pixelY && holeXY[h][i * 2 + 1] >= (double)pixelY)) {
-          nodeX[nodes++] = (int)(holeXY[h][i * 2] + (pixelY - holeXY[h][i * 2 + 1]) / (holeXY[h][j * 2 + 1] - holeXY[h][i * 2 + 1]) * (holeXY[h][j * 2] - holeXY[h][i * 2]));
-        }
-        j = i;
-      }
-
-      //  Sort the nodes, via a simple “Bubble” sort.
-      i = 0;
-      while (i < nodes - 1) {
-        if (nodeX[i] > nodeX[i + 1]) {
-          swap = nodeX[i];
-          nodeX[i] = nodeX[i + 1];
-          nodeX[i + 1] = swap;
-          if (i) i--;
-        } else {
-          i++;
-        }
-      }
-
-      //  Fill the pixels between node pairs.
-      for (i = 0; i < nodes; i += 2) {
-        if (nodeX[i] >= IMAGE_RIGHT) break;
-        if (nodeX[i + 1] > IMAGE_LEFT) {
-          if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-          if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-          for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-            //                imagedata[int(j)+int(pixelY)*w] = value;
-            scanline[int(j)] = -9999;
-          }
-        }
-      }
-    }
-    int startScanLine = pixelY * w;
-    for (i = 0; i < w; i++) {
-      if (scanline[i] != -9999) {
-        imagedata[i + startScanLine] = scanline[i];
-      }
+static void getPolygonBBOXes(std::vector<float> &cellBBOX, void *userData) {
+  std::vector<Feature *> *features = (std::vector<Feature *> *)userData;
+  cellBBOX.clear();
+  for (std::vector<Feature *>::iterator feature = features->begin(); feature != features->end(); ++feature) {
+    std::vector<Polygon> polygons = (*feature)->getPolygons();
+    for (std::vector<Polygon>::iterator itpoly = polygons.begin(); itpoly != polygons.end(); ++itpoly) {
+      float *lons = itpoly->getLons();
+      float *lats = itpoly->getLats();
+      float bbox[4] = {NAN, NAN, NAN, NAN};
+      for (int j = 0; j < itpoly->getSize(); j++) {
+        if (!(bbox[0] <= lons[j])) bbox[0] = lons[j];
+        if (!(bbox[1] <= lats[j])) bbox[1] = lats[j];
+        if (!(bbox[2] >= lons[j])) bbox[2] = lons[j];
+        if (!(bbox[3] >= lats[j])) bbox[3] = lats[j];
+      }
+      cellBBOX.insert(cellBBOX.end(), bbox, bbox + 4);
     }
   }
 }
 
-void CConvertGeoJSON::drawpolyWithHoles_indexORG(unsigned short int *imagedata, int w, int h, int polyCorners, float *polyXY, unsigned short int value, int holes, int *holeCorners, float *holeXY[]) {
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i, j, swap;
-  int IMAGE_TOP = 0;
-  int IMAGE_BOT = h;
-  int IMAGE_LEFT = 0;
-  int IMAGE_RIGHT = w;
-
-  // Allocate  scanline
-  unsigned short scanline[w];
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    for (i = 0; i < w; i++) scanline[i] = 65535u;
-
-    //  Build a list of nodes.
-    nodes = 0;
-    j = polyCorners - 1;
-    for (i = 0; i < polyCorners; i++) {
-      if ((polyXY[i * 2 + 1] < (double)pixelY && polyXY[j * 2 + 1] >= (double)pixelY) || (polyXY[j * 2 + 1] < (double)pixelY && polyXY[i * 2 + 1] >= (double)pixelY)) {
-        nodeX[nodes++] = (int)(polyXY[i * 2] + (pixelY - polyXY[i * 2 + 1]) / (polyXY[j * 2 + 1] - polyXY[i * 2 + 1]) * (polyXY[j * 2] - polyXY[i * 2]));
-      }
-      j = i;
-    }
-
-    //  Sort the nodes, via a simple “Bubble” sort.
-    i = 0;
-    while (i < nodes - 1) {
-      if (nodeX[i] > nodeX[i + 1]) {
-        swap = nodeX[i];
-        nodeX[i] = nodeX[i + 1];
-        nodeX[i + 1] = swap;
-        if (i) i--;
-      } else {
-        i++;
-      }
-    }
-
-    //  Fill the pixels between node pairs.
-    for (i = 0; i < nodes; i += 2) {
-      if (nodeX[i] >= IMAGE_RIGHT) break;
-      if (nodeX[i + 1] > IMAGE_LEFT) {
-        if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-        if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-        for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-          //                imagedata[int(j)+int(pixelY)*w] = value;
-          scanline[int(j)] = value;
-        }
-      }
-    }
-
-    for (int h = 0; h < holes; h++) {
-      //  Build a list of hole nodes.
-      nodes = 0;
-      j = holeCorners[h] - 1;
-      for (i = 0; i < holeCorners[h]; i++) {
-        if ((holeXY[h][i * 2 + 1] < (double)pixelY && holeXY[h][j * 2 + 1] >= (double)pixelY) || (holeXY[h][j * 2 + 1] < (double)pixelY && holeXY[h][i * 2 + 1] >= (double)pixelY)) {
-          nodeX[nodes++] = (int)(holeXY[h][i * 2] + (pixelY - holeXY[h][i * 2 + 1]) / (holeXY[h][j * 2 + 1] - holeXY[h][i * 2 + 1]) * (holeXY[h][j * 2] - holeXY[h][i * 2]));
-        }
-        j = i;
-      }
-
-      //  Sort the nodes, via a simple “Bubble” sort.
-      i = 0;
-      while (i < nodes - 1) {
-        if (nodeX[i] > nodeX[i + 1]) {
-          swap = nodeX[i];
-          nodeX[i] = nodeX[i + 1];
-          nodeX[i + 1] = swap;
-          if (i) i--;
-        } else {
-          i++;
-        }
-      }
-
-      //  Fill the pixels between node pairs.
-      for (i = 0; i < nodes; i += 2) {
-        if (nodeX[i] >= IMAGE_RIGHT) break;
-        if (nodeX[i + 1] > IMAGE_LEFT) {
-          if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-          if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-          for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-            //                imagedata[int(j)+int(pixelY)*w] = value;
-            scanline[int(j)] = 65535u;
-          }
-        }
-      }
-    }
-    unsigned int startScanLineY = pixelY * w;
-    for (i = 0; i < w; i++) {
-      if (scanline[i] != 65535u) {
-        imagedata[i + startScanLineY] = scanline[i];
-      }
-    }
-  }
-}
-int cntCnt = 0;
-void buildNodeList(int pixelY, int &nodes, int nodeX[], int polyCorners, float *polyXY) {
-  int i, j;
-  int i2, j2;
-  cntCnt++;
-  //  Build a list of nodes.
-  nodes = 0;
-  j = polyCorners - 1;
-  for (i = 0; i < polyCorners; i++) {
-    i2 = i * 2;
-    j2 = j * 2;
-    if ((polyXY[i2 + 1] < (double)pixelY && polyXY[j2 + 1] >= (double)pixelY) || (polyXY[j2 + 1] < (double)pixelY && polyXY[i2 + 1] >= (double)pixelY)) {
-      nodeX[nodes++] = (int)(polyXY[i2] + (pixelY - polyXY[i2 + 1]) / (polyXY[j2 + 1] - polyXY[i2 + 1]) * (polyXY[j2] - polyXY[i2]));
-    }
-    j = i;
-  }
-}
-
-void bubbleSort(int nodes, int nodeX[]) {
-  //  Sort the nodes, via a simple “Bubble” sort.
-  int i, swap;
-  i = 0;
-  while (i < nodes - 1) {
-    if (nodeX[i] > nodeX[i + 1]) {
-      swap = nodeX[i];
-      nodeX[i] = nodeX[i + 1];
-      nodeX[i + 1] = swap;
-      if (i) i--;
+/*
+ * Reprojects a ring in one batch and adds it to the last polygon of the rasterizer, offsetX and offsetY are the center of the first cell.
+ * Vertices are truncated to whole pixels as the original GeoJSON fill did, so the output stays the same. The pixel box of the
+ * vertices which could be projected is returned in pixelBBOX, which is untouched when none could be projected.
+ */
+static void addProjectedRing(CPolygonRasterizer &rasterizer, CImageWarper &imageWarper, bool projectionRequired, float *lons, float *lats, int numPoints, double offsetX, double offsetY, double cellSizeX,
+                             double cellSizeY, int *pixelBBOX) {
+  if (numPoints <= 0) return;
+  std::vector<double> x(lons, lons + numPoints), y(lats, lats + numPoints);
+  std::vector<unsigned char> failed(numPoints, 0);
+  if (projectionRequired) imageWarper.reprojfromLatLon(&x[0], &y[0], numPoints, &failed[0]);
+  std::vector<float> projectedX(numPoints), projectedY(numPoints);
+  for (int j = 0; j < numPoints; j++) {
+    if (!failed[j]) {
+      int dlon = int((x[j] - offsetX) / cellSizeX) + 1;
+      int dlat = int((y[j] - offsetY) / cellSizeY);
+      projectedX[j] = dlon;
+      projectedY[j] = dlat;
+      if (pixelBBOX[0] > pixelBBOX[2]) {
+        pixelBBOX[0] = pixelBBOX[2] = dlon;
+        pixelBBOX[1] = pixelBBOX[3] = dlat;
+      }
+      pixelBBOX[0] = std::min(pixelBBOX[0], dlon);
+      pixelBBOX[1] = std::min(pixelBBOX[1], dlat);
+      pixelBBOX[2] = std::max(pixelBBOX[2], dlon);
+      pixelBBOX[3] = std::max(pixelBBOX[3], dlat);
     } else {
-      i++;
-    }
-  }
-}
-
-static inline void fillLine(int &nodes, int *nodeX, int &IMAGE_LEFT, int &IMAGE_RIGHT, unsigned short int *scanline, unsigned short value) {
-  //  Fill the pixels between node pairs.
-  for (int i = 0; i < nodes; i += 2) {
-    if (nodeX[i] >= IMAGE_RIGHT) break;
-    if (nodeX[i + 1] > IMAGE_LEFT) {
-      if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-      if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-      for (int j = nodeX[i]; j < nodeX[i + 1]; j++) {
-        scanline[j] = value;
-      }
-    }
-  }
-}
-
-void CConvertGeoJSON::drawpolyWithHoles_index(int xMin, int yMin, int xMax, int yMax, unsigned short int *imagedata, int w, int h, int polyCorners, float *polyXY, unsigned short int value, int holes,
-                                              int *holeCorners, float *holeXY[]) {
-  if (xMax < 0 || yMax < 0 || xMin >= w || yMin >= h) return;
-
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i;
-
-  if (xMin < 0) xMin = 0;
-  if (yMin < 5) yMin = 0;
-  if (xMax >= w) xMax = w;
-  if (yMax >= h) yMax = h;
-
-  int IMAGE_TOP = yMin;
-  int IMAGE_BOT = yMax + 1;
-  if (IMAGE_BOT > h) IMAGE_BOT = h;
-  int IMAGE_LEFT = xMin;
-  int IMAGE_RIGHT = xMax;
-  int scanLineWidth = IMAGE_RIGHT - IMAGE_LEFT;
-
-  int cntLines = 0;
-  int cntNodes = 0;
-  int cntHoles = 0;
-  int cntHoleLists = 0;
-  // Allocate  scanline
-  unsigned short scanline[scanLineWidth];
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    cntLines++;
-    for (i = 0; i < scanLineWidth; i++) scanline[i] = 65535u;
-    buildNodeList(pixelY, nodes, nodeX, polyCorners, polyXY);
-    cntNodes += nodes;
-    bubbleSort(nodes, nodeX);
-    // fillLine2(nodes, nodeX, IMAGE_LEFT,IMAGE_RIGHT, scanline, value);
-    for (i = 0; i < nodes; i += 2) {
-      int x1 = nodeX[i] - IMAGE_LEFT;
-      int x2 = nodeX[i + 1] - IMAGE_LEFT;
-      if (x1 < 0) x1 = 0;
-      if (x2 > scanLineWidth) x2 = scanLineWidth;
-      for (int j = x1; j < x2; j++) {
-        scanline[j] = value;
-      }
-    }
-
-    for (int h = 0; h < holes; h++) {
-      buildNodeList(pixelY, nodes, nodeX, holeCorners[h], holeXY[h]);
-      cntHoleLists++;
-      cntHoles += holes;
-      bubbleSort(nodes, nodeX);
-      for (i = 0; i < nodes; i += 2) {
-        int x1 = nodeX[i] - IMAGE_LEFT;
-        int x2 = nodeX[i + 1] - IMAGE_LEFT;
-        if (x1 < 0) x1 = 0;
-        if (x2 > scanLineWidth) x2 = scanLineWidth;
-        for (int j = x1; j < x2; j++) {
-          scanline[j] = 65535u;
-        }
-      }
-    }
-    unsigned int startScanLineY = pixelY * w;
-    for (i = IMAGE_LEFT; i < IMAGE_RIGHT; i++) {
-      if (scanline[i - IMAGE_LEFT] != 65535u) {
-        imagedata[i + startScanLineY] = scanline[i - IMAGE_LEFT];
-      }
-    }
-  }
-
-  //      CDBDebug("drawPoly %d %d %d %d %d", cntLines, cntNodes, cntHoles, cntHoleLists, cntCnt);
-};
-
-void CConvertGeoJSON::drawpoly2_index(unsigned short *imagedata, int w, int h, int polyCorners, float *polyXY, unsigned short value) {
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i, j, swap;
-  int IMAGE_TOP = 0;
-  int IMAGE_BOT = h;
-  int IMAGE_LEFT = 0;
-  int IMAGE_RIGHT = w;
-
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    //  Build a list of nodes.
-    nodes = 0;
-    j = polyCorners - 1;
-    for (i = 0; i < polyCorners; i++) {
-      if ((polyXY[i * 2 + 1] < (double)pixelY && polyXY[j * 2 + 1] >= (double)pixelY) || (polyXY[j * 2 + 1] < (double)pixelY && polyXY[i * 2 + 1] >= (double)pixelY)) {
-        nodeX[nodes++] = (int)(polyXY[i * 2] + (pixelY - polyXY[i * 2 + 1]) / (polyXY[j * 2 + 1] - polyXY[i * 2 + 1]) * (polyXY[j * 2] - polyXY[i * 2]));
-      }
-      j = i;
-    }
-
-    //  Sort the nodes, via a simple “Bubble” sort.
-    i = 0;
-    while (i < nodes - 1) {
-      if (nodeX[i] > nodeX[i + 1]) {
-        swap = nodeX[i];
-        nodeX[i] = nodeX[i + 1];
-        nodeX[i + 1] = swap;
-        if (i) i--;
-      } else {
-        i++;
-      }
-    }
-
-    //  Fill the pixels between node pairs.
-    for (i = 0; i < nodes; i += 2) {
-      if (nodeX[i] >= IMAGE_RIGHT) break;
-      if (nodeX[i + 1] > IMAGE_LEFT) {
-        if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-        if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-        for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-          imagedata[int(j) + int(pixelY) * w] = value;
-        }
-      }
-    }
-  }
-}
-
-void CConvertGeoJSON::drawpoly(float *imagedata, int w, int h, int polyCorners, float *polyX, float *polyY, float value) {
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i, j, swap;
-  int IMAGE_TOP = 0;
-  int IMAGE_BOT = h;
-  int IMAGE_LEFT = 0;
-  int IMAGE_RIGHT = w;
-
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    //  Build a list of nodes.
-    nodes = 0;
-    j = polyCorners - 1;
-    for (i = 0; i < polyCorners; i++) {
-      if ((polyY[i] < (double)pixelY && polyY[j] >= (double)pixelY) || (polyY[j] < (double)pixelY && polyY[i] >= (double)pixelY)) {
-        nodeX[nodes++] = (int)(polyX[i] + (pixelY - polyY[i]) / (polyY[j] - polyY[i]) * (polyX[j] - polyX[i]));
-      }
-      j = i;
-    }
-
-    //  Sort the nodes, via a simple “Bubble” sort.
-    i = 0;
-    while (i < nodes - 1) {
-      if (nodeX[i] > nodeX[i + 1]) {
-        swap = nodeX[i];
-        nodeX[i] = nodeX[i + 1];
-        nodeX[i + 1] = swap;
-        if (i) i--;
-      } else {
-        i++;
-      }
-    }
-
-    //  Fill the pixels between node pairs.
-    for (i = 0; i < nodes; i += 2) {
-      if (nodeX[i] >= IMAGE_RIGHT) break;
-      if (nodeX[i + 1] > IMAGE_LEFT) {
-        if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-        if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-        for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-          imagedata[int(j) + int(pixelY) * w] = value;
-        }
-      }
+      projectedX[j] = CCONVERTUGRIDMESH_NODATA;
+      projectedY[j] = CCONVERTUGRIDMESH_NODATA;
     }
   }
+  rasterizer.addRing(&projectedX[0], &projectedY[0], numPoints);
 }
 
 std::map<std::string, std::vector<Feature *>> CConvertGeoJSON::featureStore;
@@ -1359,125 +954,42 @@ int CConvertGeoJSON::convertGeoJSONData(CDataSource *dataSource, int mode) {
 #endif
     CDBDebug("nrFeatures: %d", features.size());
 
+    // Select the polygons overlapping the map, polygons are numbered in feature order
+    CPolygonCellIndex polygonIndex;
+    polygonIndex.load(dataSource, "geojson_polygons", getPolygonBBOXes, &features);
+    std::vector<unsigned char> polygonIsVisible(polygonIndex.getNumCells(), 1);
+    double latLonBBOX[4];
+    if (CPolygonCellIndex::getLatLonBBOX(&imageWarper, projectionRequired, dataSource->srvParams->Geo->dfBBOX, latLonBBOX) == 0) {
+      std::vector<int> visiblePolygons;
+      polygonIndex.query(latLonBBOX, visiblePolygons);
+      std::fill(polygonIsVisible.begin(), polygonIsVisible.end(), 0);
+      for (size_t j = 0; j < visiblePolygons.size(); j++) polygonIsVisible[visiblePolygons[j]] = 1;
+    }
+
+    CPolygonRasterizer rasterizer;
+    size_t polygonNr = 0;
     int featureIndex = 0;
     typedef std::vector<Feature *>::iterator it_type;
     for (it_type feature = features.begin(); feature != features.end(); ++feature) { // Loop over all features
-      // if(featureIndex!=0)break;
       std::vector<Polygon> polygons = (*feature)->getPolygons();
-      //            CT::string id=(*feature)->getId();
-      //            CDBDebug("feature[%s] %d of %d with %d polygons", id.c_str(), featureIndex, features.size(), polygons.size());
       for (std::vector<Polygon>::iterator itpoly = polygons.begin(); itpoly != polygons.end(); ++itpoly) {
-        float *polyX = itpoly->getLons();
-        float *polyY = itpoly->getLats();
-        int numPoints = itpoly->getSize();
-        float projectedXY[numPoints * 2];
-        float minX = FLT_MAX, minY = FLT_MAX;
-        float maxX = -FLT_MAX, maxY = -FLT_MAX;
-
-        int pxMin, pxMax, pyMin, pyMax, first = 0;
-
-        // CDBDebug("Plotting a polygon of %d points with %d holes [? of %d]", numPoints, itpoly->getHoles().size(), featureIndex);
-        for (int j = 0; j < numPoints; j++) {
-          double tprojectedX = polyX[j];
-          double tprojectedY = polyY[j];
-          int status = 0;
-          if (projectionRequired) status = imageWarper.reprojfromLatLon(tprojectedX, tprojectedY);
-          int dlon, dlat;
-          if (!status) {
-            dlon = int((tprojectedX - offsetX) / cellSizeX) + 1;
-            dlat = int((tprojectedY - offsetY) / cellSizeY);
-
-            if (first == 0) {
-              first = 1;
-              pxMin = dlon;
-              pxMax = dlon;
-              pyMin = dlat;
-              pyMax = dlat;
-            } else {
-              if (dlon < pxMin) pxMin = dlon;
-              if (dlon > pxMax) pxMax = dlon;
-              if (dlat < pyMin) pyMin = dlat;
-              if (dlat > pyMax) pyMax = dlat;
-            }
-
-            minX = MIN(minX, tprojectedX);
-            minY = MIN(minY, tprojectedY);
-            maxX = MAX(maxX, tprojectedX);
-            maxY = MAX(maxY, tprojectedY);
-          } else {
-            dlat = CCONVERTUGRIDMESH_NODATA;
-            dlon = CCONVERTUGRIDMESH_NODATA;
-          }
-          projectedXY[j * 2] = dlon;
-          projectedXY[j * 2 + 1] = dlat;
-        }
-
-        /*              if ((minX>urX)||(maxX<llX)||(maxY<llY)||(minY>urY))
-                      {
-        //                CDBDebug("skip %f,%f,%f,%f for %f,%f,%f,%f", minX,maxX, minY, maxY, llX, urX, urY, llY);
-                      } else
-                      */
-        {
-          {
-
-            //                float tolerance=0.001;
-            //                std::deque <float> polyline(projectedXY,projectedXY+numPoints*2);
-            //                  float *result=new float[polyline.size()];
-
-            //                  float *last = psimpl::simplify_douglas_peucker<2>(
-            //                  polyline.begin(), polyline.end(), tolerance, result);
-
-            std::vector<PointArray> holes = itpoly->getHoles();
-            int nrHoles = holes.size();
-            int holeSize[nrHoles];
-            float *holeX[nrHoles];
-            float *holeY[nrHoles];
-            float *projectedHoleXY[nrHoles];
-            int h = 0;
-            for (std::vector<PointArray>::iterator itholes = holes.begin(); itholes != holes.end(); ++itholes) {
-              //                   CDBDebug("holes[%d]: %d found in %d", 0, itholes->getSize(), featureIndex);
-              holeX[h] = itholes->getLons();
-              holeY[h] = itholes->getLats();
-              holeSize[h] = itholes->getSize();
-              projectedHoleXY[h] = new float[holeSize[h] * 2];
-              for (int j = 0; j < holeSize[h]; j++) {
-                //                      CDBDebug("J: %d", j);
-                double tprojectedX = holeX[h][j];
-                double tprojectedY = holeY[h][j];
-                int holeStatus = 0;
-                if (projectionRequired) holeStatus = imageWarper.reprojfromLatLon(tprojectedX, tprojectedY);
-                int dlon, dlat;
-                if (!holeStatus) {
-                  dlon = int((tprojectedX - offsetX) / cellSizeX) + 1;
-                  dlat = int((tprojectedY - offsetY) / cellSizeY);
-                } else {
-                  dlat = CCONVERTUGRIDMESH_NODATA;
-                  dlon = CCONVERTUGRIDMESH_NODATA;
-                }
-                projectedHoleXY[h][j * 2] = dlon;
-                projectedHoleXY[h][j * 2 + 1] = dlat;
-                //                      CDBDebug("J: %d", j);
-              }
-              h++;
-            }
-
-            {
-
-              //                  CDBDebug("passed %d, %d", featureIndex, nrHoles);
-              //                  int dpCount=(last-result)/sizeof(float)*2;
-              int dpCount = numPoints;
-              drawpolyWithHoles_index(pxMin, pyMin, pxMax, pyMax, sdata, dataSource->dWidth, dataSource->dHeight, dpCount, projectedXY, featureIndex, nrHoles, holeSize, projectedHoleXY);
-              //                  delete[]result;
-
-              for (int h = 0; h < nrHoles; h++) {
-                delete[] projectedHoleXY[h];
-              }
-            }
-          }
+        bool isVisible = polygonNr >= polygonIsVisible.size() || polygonIsVisible[polygonNr];
+        polygonNr++;
+        if (!isVisible) continue;
+        rasterizer.addPolygon(featureIndex);
+        /* Only the outer ring determines which pixels are drawn, an empty box (min > max) means none of its vertices could be projected */
+        int pixelBBOX[4] = {1, 1, 0, 0};
+        addProjectedRing(rasterizer, imageWarper, projectionRequired, itpoly->getLons(), itpoly->getLats(), itpoly->getSize(), offsetX, offsetY, cellSizeX, cellSizeY, pixelBBOX);
+        if (pixelBBOX[0] > pixelBBOX[2]) pixelBBOX[0] = pixelBBOX[1] = pixelBBOX[2] = pixelBBOX[3] = -1;
+        rasterizer.setScanlineFill(pixelBBOX[0], pixelBBOX[1], pixelBBOX[2], pixelBBOX[3]);
+        std::vector<PointArray> holes = itpoly->getHoles();
+        for (std::vector<PointArray>::iterator itholes = holes.begin(); itholes != holes.end(); ++itholes) {
+          int holeBBOX[4] = {1, 1, 0, 0};
+          addProjectedRing(rasterizer, imageWarper, projectionRequired, itholes->getLons(), itholes->getLats(), itholes->getSize(), offsetX, offsetY, cellSizeX, cellSizeY, holeBBOX);
         }
       }
 #ifdef MEASURETIME
-      StopWatch_Stop("Feature drawn %d", featureIndex);
+      StopWatch_Stop("Feature prepared %d", featureIndex);
 #endif
       for (std::map<std::string, FeatureProperty *>::iterator ftit = (*feature)->getFp().begin(); ftit != (*feature)->getFp().end(); ++ftit) {
         if (dataSource->getDataObject(0)->features.count(featureIndex) == 0) {
@@ -1487,6 +999,10 @@ int CConvertGeoJSON::convertGeoJSONData(CDataSource *dataSource, int mode) {
       }
       featureIndex++;
     }
+    rasterizer.fill(sdata, dataSource->dWidth, dataSource->dHeight);
+#ifdef MEASURETIME
+    StopWatch_Stop("Features drawn");
+#endif
 
 #ifdef CCONVERTGEOJSON_DEBUG
     CDBDebug("/convertGEOJSONData");
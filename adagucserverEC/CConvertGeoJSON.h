@@ -45,14 +45,6 @@ private:
   static void getDimensions(CDFObject *cdfObject, json_value &json, bool openAll);
   static void getPolygons(json_value &j);
   static void addCDFInfo(CDFObject *cdfObject, CServerParams *srvParams, BBOX &dfBBOX, std::vector<Feature *> &featureMap, bool openAll);
-  static void drawpoly(float *imagedata, int w, int h, int polyCorners, float *polyX, float *polyY, float value);
-  static void drawpoly2(float *imagedata, int w, int h, int polyCorners, float *polyXY, float value);
-  static void drawpoly2_index(unsigned short *imagedata, int w, int h, int polyCorners, float *polyXY, unsigned short value);
-  static void drawpolyWithHoles(float *imagedata, int w, int h, int polyCorners, float *polyXY, float value, int holes, int *holeCorners, float *holeXY[]);
-  static void drawpolyWithHoles_index(int xMin, int yMin, int xMax, int yMax, unsigned short *imagedata, int w, int h, int polyCorners, float *polyXY, unsigned short int value, int holes,
-                                      int *holeCorners, float *holeXY[]);
-  static void drawpolyWithHoles_indexORG(unsigned short *imagedata, int w, int h, int polyCorners, float *polyXY, unsigned short int value, int holes, int *holeCorners, float *holeXY[]);
-
 public:
   static std::map<std::string, std::vector<Feature *>> featureStore;
   static void clearFeatureStore();
@@ -26,130 +26,36 @@
 #include "CConvertHexagon.h"
 #include "CFillTriangle.h"
 #include "CImageWarper.h"
+#include "CPolygonRasterizer.h"
+#include <float.h>
 
 //#define CCONVERTHEXAGON_DEBUG
 const char *CConvertHexagon::className = "CConvertHexagon";
 
-void line2(float *imagedata, int w, int h, float x1, float y1, float x2, float y2, float value) {
-  int xyIsSwapped = 0;
-  float dx = x2 - x1;
-  float dy = y2 - y1;
-  if (fabs(dx) < fabs(dy)) {
-    std::swap(x1, y1);
-    std::swap(x2, y2);
-    std::swap(dx, dy);
-    xyIsSwapped = 1;
-  }
-  if (x2 < x1) {
-    std::swap(x1, x2);
-    std::swap(y1, y2);
-  }
-  float gradient = dy / dx;
-  float y = y1;
-
-  if (xyIsSwapped == 0) {
-
-    for (int x = int(x1); x < x2; x++) {
-      //         plot(x,int(y),1);
-      if (y >= 0 && y < h && x >= 0 && x < w) imagedata[int(x) + int(y) * w] = value;
-      y += gradient;
-    }
-  } else {
-
-    for (int x = int(x1); x < x2; x++) {
-      if (y >= 0 && y < w && x >= 0 && x < h) imagedata[int(y) + int(x) * w] = value;
-      y += gradient;
-    }
-  }
-}
-
-void drawlines2(float *imagedata, int w, int h, int polyCorners, float *polyX, float *polyY, float value) {
-  for (int j = 0; j < polyCorners - 1; j++) {
-    line2(imagedata, w, h, polyX[j], polyY[j], polyX[j + 1], polyY[j + 1], value);
-  }
-  line2(imagedata, w, h, polyX[polyCorners - 1], polyY[polyCorners - 1], polyX[0], polyY[0], value);
-}
-
-void drawNGon(float *imagedata, int w, int h, int polyCorners, float *polyX, float *polyY, float value) {
-  // float  *data, float  *values, int W,int H, int *xP,int *yP
-
-  int xp[polyCorners];
-  int yp[polyCorners];
-  int centerX = 0;
-  int centerY = 0;
-  for (int i = 0; i < polyCorners; i++) {
-    xp[i] = polyX[i];
-    yp[i] = polyY[i];
-    centerX += xp[i];
-    centerY += yp[i];
-  }
-  centerX /= float(polyCorners);
-  centerY /= float(polyCorners);
-  int txp[3];
-  int typ[3];
-  txp[0] = centerX;
-  typ[0] = centerY;
-  txp[1] = xp[polyCorners - 1];
-  typ[1] = yp[polyCorners - 1];
-  txp[2] = xp[0];
-  typ[2] = yp[0];
-  fillTriangleFlat(imagedata, value, w, h, txp, typ);
-  for (int i = 1; i < polyCorners; i++) {
-
-    txp[1] = xp[i - 1];
-    typ[1] = yp[i - 1];
-    txp[2] = xp[i];
-    typ[2] = yp[i];
-    fillTriangleFlat(imagedata, value, w, h, txp, typ);
-  }
-}
-
-void drawpoly2(float *imagedata, int w, int h, int polyCorners, float *polyX, float *polyY, float value) {
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i, j, swap;
-  int IMAGE_TOP = 0;
-  int IMAGE_BOT = h;
-  int IMAGE_LEFT = 0;
-  int IMAGE_RIGHT = w;
-
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    //  Build a list of nodes.
-    nodes = 0;
-    j = polyCorners - 1;
-    for (i = 0; i < polyCorners; i++) {
-      if ((polyY[i] < (double)pixelY && polyY[j] >= (double)pixelY) || (polyY[j] < (double)pixelY && polyY[i] >= (double)pixelY)) {
-        nodeX[nodes++] = (int)(polyX[i] + (pixelY - polyY[i]) / (polyY[j] - polyY[i]) * (polyX[j] - polyX[i]));
-      }
-      j = i;
-    }
-
-    //  Sort the nodes, via a simple “Bubble” sort.
-    i = 0;
-    while (i < nodes - 1) {
-      if (nodeX[i] > nodeX[i + 1]) {
-        swap = nodeX[i];
-        nodeX[i] = nodeX[i + 1];
-        nodeX[i + 1] = swap;
-        if (i) i--;
-      } else {
-        i++;
-      }
-    }
-
-    //  Fill the pixels between node pairs.
-    for (i = 0; i < nodes; i += 2) {
-      if (nodeX[i] >= IMAGE_RIGHT) break;
-      if (nodeX[i + 1] > IMAGE_LEFT) {
-        if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-        if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-        for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-          imagedata[int(j) + int(pixelY) * w] = value;
-        }
-      }
+class CConvertHexagonCells {
+public:
+  const float *lonData, *latData;
+  float fillValueLon, fillValueLat;
+  int numCells, numVerts;
+};
+
+static void getCellBBOXes(std::vector<float> &cellBBOX, void *userData) {
+  CConvertHexagonCells *cells = (CConvertHexagonCells *)userData;
+  cellBBOX.assign(size_t(cells->numCells) * 4, NAN);
+  for (int c = 0; c < cells->numCells; c++) {
+    const float *lons = &cells->lonData[size_t(c) * cells->numVerts];
+    const float *lats = &cells->latData[size_t(c) * cells->numVerts];
+    float bbox[4] = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    bool isValid = true;
+    for (int j = 0; j < cells->numVerts && isValid; j++) {
+      float lon = lons[j], lat = lats[j];
+      if (lon == cells->fillValueLon || lat == cells->fillValueLat || !(fabs(lon) < INFINITY) || !(fabs(lat) < INFINITY)) isValid = false;
+      bbox[0] = std::min(bbox[0], lon);
+      bbox[1] = std::min(bbox[1], lat);
+      bbox[2] = std::max(bbox[2], lon);
+      bbox[3] = std::max(bbox[3], lat);
     }
+    if (isValid) std::copy(bbox, bbox + 4, &cellBBOX[size_t(c) * 4]);
   }
 }
 
@@ -810,9 +716,35 @@ int CConvertHexagon::convertHexagonData(CDataSource *dataSource, int mode) {
       } catch (int e) {
       };
 
-      for (int pSwath = 0; pSwath < numTiles; pSwath++) {
+      // Select the cells overlapping the map
+      CConvertHexagonCells cells;
+      cells.lonData = lonData;
+      cells.latData = latData;
+      cells.fillValueLon = fillValueLon;
+      cells.fillValueLat = fillValueLat;
+      cells.numCells = numTiles;
+      cells.numVerts = numVerts;
+      CPolygonCellIndex cellIndex;
+      cellIndex.load(dataSource, "bounds_lon_i", getCellBBOXes, &cells);
+      std::vector<int> visibleCells;
+      double latLonBBOX[4];
+      if (CPolygonCellIndex::getLatLonBBOX(&imageWarper, projectionRequired, dataSource->srvParams->Geo->dfBBOX, latLonBBOX) == 0) {
+        cellIndex.query(latLonBBOX, visibleCells);
+      } else {
+        visibleCells.resize(numTiles);
+        for (int pSwath = 0; pSwath < numTiles; pSwath++) visibleCells[pSwath] = pSwath;
+      }
+#ifdef CCONVERTHEXAGON_DEBUG
+      CDBDebug("Drawing %d of %d tiles", (int)visibleCells.size(), numTiles);
+#endif
 
-        float *lons = &lonData[pSwath * numVerts];
+      // Collect the corners of the tiles to draw, they are reprojected in one batch
+      std::vector<int> tilesToDraw;
+      std::vector<double> cornerX, cornerY;
+      std::vector<float> lons(numVerts);
+      for (size_t k = 0; k < visibleCells.size(); k++) {
+        int pSwath = visibleCells[k];
+        std::copy(&lonData[pSwath * numVerts], &lonData[pSwath * numVerts] + numVerts, lons.begin());
         float *lats = &latData[pSwath * numVerts];
         float val = hexagonData[pSwath];
 
@@ -861,36 +793,34 @@ int CConvertHexagon::convertHexagonData(CDataSource *dataSource, int mode) {
           }
         }
         if (tileHasNoData == false) {
-          // CDBDebug(" (%f,%f) (%f,%f) (%f,%f) (%f,%f)",lons[0],lats[0],lons[1],lats[1],lons[2],lats[2],lons[3],lats[3]);
-
-          float flons[numVerts], flats[numVerts];
+          tilesToDraw.push_back(pSwath);
           for (int j = 0; j < numVerts; j++) {
-            //             if(tileIsOverDateBorder){
-            //               lons[j]-=360;
-            //               while(lons[j]<-300)lons[j]+=360;
-            //             }
-            double dflon = lons[j];
-            double dflat = lats[j];
-            if (projectionRequired)
-              if (imageWarper.reprojfromLatLon(dflon, dflat) != 0) {
-                tileHasNoData = true;
-                break;
-              }
-            flons[j] = float((dflon - offsetX) / cellSizeX);
-            flats[j] = float((dflat - offsetY) / cellSizeY);
+            cornerX.push_back(lons[j]);
+            cornerY.push_back(lats[j]);
           }
-          if (tileHasNoData == false) {
-
-            // CDBDebug(" (%d,%d) (%d,%d) (%d,%d) (%d,%d)",dlons[0],dlats[0],dlons[1],dlats[1],dlons[2],dlats[2],dlons[3],dlats[3]);
-
-            // fillQuadGouraud(sdata, vals, dataSource->dWidth,dataSource->dHeight, dlons,dlats);
+        }
+      }
+      std::vector<unsigned char> cornerFailed(cornerX.size(), 0);
+      if (projectionRequired && cornerX.size() > 0) imageWarper.reprojfromLatLon(&cornerX[0], &cornerY[0], cornerX.size(), &cornerFailed[0]);
 
-            // drawpoly2(sdata,dataSource->dWidth,dataSource->dHeight,numVerts,flons,flats,val);
-            drawNGon(sdata, dataSource->dWidth, dataSource->dHeight, numVerts, flons, flats, val);
-            // drawlines2(sdata,dataSource->dWidth,dataSource->dHeight,numVerts,flons,flats,val);
+      CPolygonRasterizer rasterizer;
+      std::vector<float> flons(numVerts), flats(numVerts);
+      for (size_t t = 0; t < tilesToDraw.size(); t++) {
+        bool tileHasNoData = false;
+        for (int j = 0; j < numVerts; j++) {
+          size_t corner = t * numVerts + j;
+          if (cornerFailed[corner]) {
+            tileHasNoData = true;
+            break;
           }
+          flons[j] = float((cornerX[corner] - offsetX) / cellSizeX);
+          flats[j] = float((cornerY[corner] - offsetY) / cellSizeY);
+        }
+        if (tileHasNoData == false) {
+          rasterizer.addConvexPolygon(&flons[0], &flats[0], numVerts, hexagonData[tilesToDraw[t]]);
         }
       }
+      rasterizer.fill(sdata, dataSource->dWidth, dataSource->dHeight);
     }
     imageWarper.closereproj();
   }
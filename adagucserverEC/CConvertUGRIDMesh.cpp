@@ -24,101 +24,34 @@
  ******************************************************************************/
 
 #include "CConvertUGRIDMesh.h"
-#include "CFillTriangle.h"
 #include "CImageWarper.h"
+#include "CPolygonRasterizer.h"
 //#define CCONVERTUGRIDMESH_DEBUG
 const char *CConvertUGRIDMesh::className = "CConvertUGRIDMesh";
 
 #define CCONVERTUGRIDMESH_NODATA -32000
 
-void line(float *imagedata, int w, int h, float x1, float y1, float x2, float y2, float value) {
-  int xyIsSwapped = 0;
-  float dx = x2 - x1;
-  float dy = y2 - y1;
-  if (fabs(dx) < fabs(dy)) {
-    std::swap(x1, y1);
-    std::swap(x2, y2);
-    std::swap(dx, dy);
-    xyIsSwapped = 1;
-  }
-  if (x2 < x1) {
-    std::swap(x1, x2);
-    std::swap(y1, y2);
-  }
-  float gradient = dy / dx;
-  float y = y1;
-
-  if (xyIsSwapped == 0) {
-
-    for (int x = int(x1); x < x2; x++) {
-      //         plot(x,int(y),1);
-      if (y >= 0 && y < h && x >= 0 && x < w) imagedata[int(x) + int(y) * w] = value;
-      y += gradient;
-    }
-  } else {
-
-    for (int x = int(x1); x < x2; x++) {
-      if (y >= 0 && y < w && x >= 0 && x < h) imagedata[int(y) + int(x) * w] = value;
-      y += gradient;
-    }
-  }
-}
-
-void drawlines(float *imagedata, int w, int h, int polyCorners, float *polyX, float *polyY, float value) {
-  for (int j = 0; j < polyCorners - 1; j++) {
-    if ((polyX[j] >= 0 && polyY[j] >= 0 && polyX[j] < w && polyY[j] < h) || (polyX[j + 1] >= 0 && polyY[j + 1] >= 0 && polyX[j + 1] < w && polyY[j + 1] < h)) {
-      if (polyX[j] != CCONVERTUGRIDMESH_NODATA && polyX[j + 1] != CCONVERTUGRIDMESH_NODATA) {
-        line(imagedata, w, h, polyX[j], polyY[j], polyX[j + 1], polyY[j + 1], value);
-      }
-    }
-  }
-}
-
-void drawpoly(float *imagedata, int w, int h, int polyCorners, float *polyX, float *polyY, float value) {
-  //  public-domain code by Darel Rex Finley, 2007
-
-  int nodes, nodeX[polyCorners * 2 + 1], pixelY, i, j, swap;
-  int IMAGE_TOP = 0;
-  int IMAGE_BOT = h;
-  int IMAGE_LEFT = 0;
-  int IMAGE_RIGHT = w;
-
-  //  Loop through the rows of the image.
-  for (pixelY = IMAGE_TOP; pixelY < IMAGE_BOT; pixelY++) {
-
-    //  Build a list of nodes.
-    nodes = 0;
-    j = polyCorners - 1;
-    for (i = 0; i < polyCorners; i++) {
-      if ((polyY[i] < (double)pixelY && polyY[j] >= (double)pixelY) || (polyY[j] < (double)pixelY && polyY[i] >= (double)pixelY)) {
-        nodeX[nodes++] = (int)(polyX[i] + (pixelY - polyY[i]) / (polyY[j] - polyY[i]) * (polyX[j] - polyX[i]));
-      }
-      j = i;
-    }
-
-    //  Sort the nodes, via a simple “Bubble” sort.
-    i = 0;
-    while (i < nodes - 1) {
-      if (nodeX[i] > nodeX[i + 1]) {
-        swap = nodeX[i];
-        nodeX[i] = nodeX[i + 1];
-        nodeX[i + 1] = swap;
-        if (i) i--;
-      } else {
-        i++;
-      }
-    }
-
-    //  Fill the pixels between node pairs.
-    for (i = 0; i < nodes; i += 2) {
-      if (nodeX[i] >= IMAGE_RIGHT) break;
-      if (nodeX[i + 1] > IMAGE_LEFT) {
-        if (nodeX[i] < IMAGE_LEFT) nodeX[i] = IMAGE_LEFT;
-        if (nodeX[i + 1] > IMAGE_RIGHT) nodeX[i + 1] = IMAGE_RIGHT;
-        for (j = nodeX[i]; j < nodeX[i + 1]; j++) {
-          imagedata[int(j) + int(pixelY) * w] = value;
-        }
-      }
+class CConvertUGRIDMeshFaces {
+public:
+  const int *faceNodes;
+  int fillValue;
+  size_t numFaces, maxNodesPerFace, numNodes;
+  const float *lonData, *latData;
+};
+
+static void getFaceBBOXes(std::vector<float> &cellBBOX, void *userData) {
+  CConvertUGRIDMeshFaces *mesh = (CConvertUGRIDMeshFaces *)userData;
+  cellBBOX.assign(mesh->numFaces * 4, NAN);
+  for (size_t f = 0; f < mesh->numFaces; f++) {
+    float *bbox = &cellBBOX[f * 4];
+    for (size_t j = 0; j < mesh->maxNodesPerFace; j++) {
+      int node = mesh->faceNodes[j + f * mesh->maxNodesPerFace];
+      if (node == mesh->fillValue || node < 0 || size_t(node) >= mesh->numNodes) continue;
+      float lon = mesh->lonData[node], lat = mesh->latData[node];
+      if (!(bbox[0] <= lon)) bbox[0] = lon;
+      if (!(bbox[1] <= lat)) bbox[1] = lat;
+      if (!(bbox[2] >= lon)) bbox[2] = lon;
+      if (!(bbox[3] >= lat)) bbox[3] = lat;
     }
   }
 }
@@ -435,38 +368,6 @@ int CConvertUGRIDMesh::convertUGRIDMeshData(CDataSource *dataSource, int mode) {
     }
     // }
     bool projectionRequired = imageWarper.isProjectionRequired();
-    //     int polyCorners = 5;
-    float projectedX[numMeshPoints]; //={10,100,40,110,20,10};
-    float projectedY[numMeshPoints]; //={10,20,40,100,110,10};
-
-#ifdef MEASURETIME
-    StopWatch_Stop("Iterating lat/lon data");
-#endif
-
-    for (size_t j = 0; j < numMeshPoints; j++) {
-
-      double lon = double(lonData[j]), lat = double(latData[j]);
-      double tprojectedX = lon;
-      double tprojectedY = lat;
-      float v = j;
-      int status = 0;
-      if (projectionRequired) status = imageWarper.reprojfromLatLon(tprojectedX, tprojectedY);
-      int dlon, dlat;
-      if (!status) {
-        dlon = int((tprojectedX - offsetX) / cellSizeX);
-        dlat = int((tprojectedY - offsetY) / cellSizeY);
-      } else {
-        dlat = CCONVERTUGRIDMESH_NODATA;
-        dlon = CCONVERTUGRIDMESH_NODATA;
-      }
-      dataObjects[0]->points.push_back(PointDVWithLatLon(dlon, dlat, lon, lat, v));
-      projectedX[j] = dlon;
-      projectedY[j] = dlat;
-    }
-
-#ifdef MEASURETIME
-    StopWatch_Stop("Start reading face nodes");
-#endif
 
     CDF::Variable *Mesh2_face_nodes = cdfObject->getVariable("mesh_face_nodes");
     Mesh2_face_nodes->readData(CDF_INT, false);
@@ -475,8 +376,6 @@ int CConvertUGRIDMesh::convertUGRIDMeshData(CDataSource *dataSource, int mode) {
 
     try {
       Mesh2_face_nodes->getAttribute("_FillValue")->getData(&Mesh2_face_nodesData_Fill, 1);
-      ;
-
     } catch (int e) {
       CDBWarning("Warning: FillValue not defined");
     }
@@ -487,45 +386,88 @@ int CConvertUGRIDMesh::convertUGRIDMeshData(CDataSource *dataSource, int mode) {
     CDBDebug("Num faces: %d", Mesh2_face_nodes->dimensionlinks[0]->getSize());
     CDBDebug("Max face size: %d", MaxNumNodesPerFace);
 
-    float polyX[MaxNumNodesPerFace + 1];
-    float polyY[MaxNumNodesPerFace + 1];
-
-    int numPoints = 0;
-    //     CDBDebug("drawpolys");
-    //     for(size_t f=0;f<nFaces;f++){
-    //       for(size_t j=0;j<MaxNumNodesPerFace;j++){
-    //         int p1 = Mesh2_face_nodesData[j+f*MaxNumNodesPerFace];
-    //         if(p1!=Mesh2_face_nodesData_Fill){
-    //           polyX[numPoints] = projectedX[p1];
-    //           polyY[numPoints++] = projectedY[p1];
-    //         }
-    //       }
-    //       polyX[numPoints] = polyX[0];
-    //       polyY[numPoints++] = polyY[0];
-    //       drawpoly(sdata,dataSource->dWidth,dataSource->dHeight,numPoints,polyX,polyY,f);
-    //       //drawlines(sdata,dataSource->dWidth,dataSource->dHeight,numPoints,polyX,polyY);
-    //       numPoints = 0;
-    //     }
+    // Select the faces overlapping the map, only their nodes are reprojected
+    CConvertUGRIDMeshFaces mesh;
+    mesh.faceNodes = Mesh2_face_nodesData;
+    mesh.fillValue = Mesh2_face_nodesData_Fill;
+    mesh.numFaces = nFaces;
+    mesh.maxNodesPerFace = MaxNumNodesPerFace;
+    mesh.numNodes = numMeshPoints;
+    mesh.lonData = lonData;
+    mesh.latData = latData;
+    CPolygonCellIndex faceIndex;
+    faceIndex.load(dataSource, "mesh_face_nodes", getFaceBBOXes, &mesh);
+    std::vector<int> faces;
+    double latLonBBOX[4];
+    if (CPolygonCellIndex::getLatLonBBOX(&imageWarper, projectionRequired, dataSource->srvParams->Geo->dfBBOX, latLonBBOX) == 0) {
+      faceIndex.query(latLonBBOX, faces);
+    } else {
+      faces.resize(nFaces);
+      for (size_t f = 0; f < nFaces; f++) faces[f] = int(f);
+    }
+    CDBDebug("Drawing %d of %d faces", (int)faces.size(), (int)nFaces);
 
 #ifdef MEASURETIME
-    StopWatch_Stop("drawlines");
+    StopWatch_Stop("Iterating lat/lon data");
 #endif
-    for (size_t f = 0; f < nFaces; f++) {
+
+    std::vector<unsigned char> nodeIsUsed(numMeshPoints, 0);
+    for (size_t k = 0; k < faces.size(); k++) {
       for (size_t j = 0; j < MaxNumNodesPerFace; j++) {
-        int p1 = Mesh2_face_nodesData[j + f * MaxNumNodesPerFace];
+        int p1 = Mesh2_face_nodesData[j + size_t(faces[k]) * MaxNumNodesPerFace];
+        if (p1 != Mesh2_face_nodesData_Fill && p1 >= 0 && size_t(p1) < numMeshPoints) nodeIsUsed[p1] = 1;
+      }
+    }
+    std::vector<int> usedNodes;
+    for (size_t j = 0; j < numMeshPoints; j++) {
+      if (nodeIsUsed[j]) usedNodes.push_back(int(j));
+    }
+    size_t numUsedNodes = usedNodes.size();
+    std::vector<double> nodeX(numUsedNodes), nodeY(numUsedNodes);
+    std::vector<unsigned char> nodeFailed(numUsedNodes, 0);
+    for (size_t k = 0; k < numUsedNodes; k++) {
+      nodeX[k] = double(lonData[usedNodes[k]]);
+      nodeY[k] = double(latData[usedNodes[k]]);
+    }
+    if (projectionRequired && numUsedNodes > 0) imageWarper.reprojfromLatLon(&nodeX[0], &nodeY[0], numUsedNodes, &nodeFailed[0]);
 
-        if (p1 != Mesh2_face_nodesData_Fill) {
+    std::vector<float> projectedX(numMeshPoints, NAN), projectedY(numMeshPoints, NAN);
+    for (size_t k = 0; k < numUsedNodes; k++) {
+      int j = usedNodes[k];
+      int dlon, dlat;
+      if (!nodeFailed[k]) {
+        dlon = int((nodeX[k] - offsetX) / cellSizeX);
+        dlat = int((nodeY[k] - offsetY) / cellSizeY);
+        projectedX[j] = dlon;
+        projectedY[j] = dlat;
+      } else {
+        dlat = CCONVERTUGRIDMESH_NODATA;
+        dlon = CCONVERTUGRIDMESH_NODATA;
+      }
+      double lon = double(lonData[j]), lat = double(latData[j]);
+      float v = j;
+      dataObjects[0]->points.push_back(PointDVWithLatLon(dlon, dlat, lon, lat, v));
+    }
 
+#ifdef MEASURETIME
+    StopWatch_Stop("drawlines");
+#endif
+    CPolygonRasterizer rasterizer;
+    std::vector<float> polyX(MaxNumNodesPerFace), polyY(MaxNumNodesPerFace);
+    for (size_t k = 0; k < faces.size(); k++) {
+      int numPoints = 0;
+      for (size_t j = 0; j < MaxNumNodesPerFace; j++) {
+        int p1 = Mesh2_face_nodesData[j + size_t(faces[k]) * MaxNumNodesPerFace];
+        if (p1 != Mesh2_face_nodesData_Fill && p1 >= 0 && size_t(p1) < numMeshPoints) {
           polyX[numPoints] = projectedX[p1];
           polyY[numPoints++] = projectedY[p1];
         }
       }
-      polyX[numPoints] = polyX[0];
-      polyY[numPoints++] = polyY[0];
-      // drawpoly(sdata,dataSource->dWidth,dataSource->dHeight,numPoints,polyX,polyY,f);
-      drawlines(sdata, dataSource->dWidth, dataSource->dHeight, numPoints, polyX, polyY, 0);
-      numPoints = 0;
+      if (numPoints == 0) continue;
+      rasterizer.addPolygon(0);
+      rasterizer.addRing(&polyX[0], &polyY[0], numPoints);
     }
+    rasterizer.drawOutlines(sdata, dataSource->dWidth, dataSource->dHeight);
 #ifdef MEASURETIME
     StopWatch_Stop("drawlines done");
 #endif
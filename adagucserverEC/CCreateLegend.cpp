@@ -2,6 +2,7 @@
 #include "CCreateLegendRenderDiscreteLegend.cpp"
 #include "CDataReader.h"
 #include "CImageDataWriter.h"
+#include "CLegendCache.h"
 
 const char *CCreateLegend::className = "CCreateLegend";
 
@@ -147,6 +148,37 @@ int CCreateLegend::createLegend(CDataSource *dataSource, CDrawImage *legendImage
    *   if(legendHeight>280)legendHeight=280;
 }*/
 
+  /* Continous and discrete legends only depend on the style, the units and the value range, so they can be reused */
+  CT::string legendCacheKey;
+  bool useLegendCache = (legendType == continous || legendType == discrete) && CLegendCache::isCacheable(legendImage);
+  if (useLegendCache) {
+    /* Numbers are written with all their significant digits, small scales and offsets of autoscaled styles would collide with %f */
+    CT::string renderMethodString;
+    CStyleConfiguration::getRenderMethodAsString(&renderMethodString, styleConfiguration->renderMethod);
+    legendCacheKey.print("legend:%s\nstyle:%s %d %d %s\n", dataSource->getLayerName(), styleConfiguration->styleCompositionName.c_str(), styleConfiguration->styleIndex, styleConfiguration->legendIndex,
+                         renderMethodString.c_str());
+    legendCacheKey.printconcat("intervals:%.9g %.9g %.9g smoothing:%d\n", styleConfiguration->shadeInterval, styleConfiguration->contourIntervalL, styleConfiguration->contourIntervalH,
+                               styleConfiguration->smoothingFilter);
+    legendCacheKey.printconcat("scale:%.9g offset:%.9g log:%.9g\n", styleConfiguration->legendScale, styleConfiguration->legendOffset, styleConfiguration->legendLog);
+    legendCacheKey.printconcat("range:%d %.9g %.9g ticks:%.17g %.17g\n", (int)styleConfiguration->hasLegendValueRange, styleConfiguration->legendLowerRange, styleConfiguration->legendUpperRange,
+                               styleConfiguration->legendTickRound, styleConfiguration->legendTickInterval);
+    legendCacheKey.printconcat("type:%d rotate:%d size:%dx%d scaling:%.17g font:%s %.9g\n", (int)legendType, (int)rotate, legendImage->Geo->dWidth, legendImage->Geo->dHeight, dataSource->getScaling(),
+                               legendImage->getFontLocation() != NULL ? legendImage->getFontLocation() : "", legendImage->getFontSize());
+    legendCacheKey.printconcat("units:%s stretch:%d\n", dataSource->getDataObject(0)->getUnits().c_str(), (int)dataSource->stretchMinMax);
+    /* Discrete legends only show the classes between the minimum and maximum of the data, see renderDiscreteLegend. Autoscaled continous legends depend on them as well. */
+    if ((legendType == discrete && (estimateMinMax || styleConfiguration->legendHasFixedMinMax == false)) || (legendType == continous && estimateMinMax)) {
+      if (dataSource->statistics == NULL) {
+        dataSource->statistics = new CDataSource::Statistics();
+        dataSource->statistics->calculate(dataSource);
+      }
+      legendCacheKey.printconcat("minmax:%.17g %.17g\n", dataSource->statistics->getMinimum(), dataSource->statistics->getMaximum());
+    }
+    if (CLegendCache::get(dataSource->srvParams, legendCacheKey.c_str(), legendImage) == 0) {
+      reader.close();
+      return 0;
+    }
+  }
+
   // Create a legend based on status flags.
   if (legendType == statusflag) {
 #ifdef CIMAGEDATAWRITER_DEBUG
@@ -408,5 +440,8 @@ int CCreateLegend::createLegend(CDataSource *dataSource, CDrawImage *legendImage
     CDBDebug("rotate");
     legendImage->rotate();
   }
+  if (useLegendCache) {
+    CLegendCache::put(dataSource->srvParams, legendCacheKey.c_str(), legendImage);
+  }
   return 0;
 }
@@ -1,8 +1,18 @@
 #include "CCreateScaleBar.h"
-int CCreateScaleBar::createScaleBar(CDrawImage *scaleBarImage, CGeoParams *geoParams, float scaling) {
+#include "CLegendCache.h"
+int CCreateScaleBar::createScaleBar(CDrawImage *scaleBarImage, CGeoParams *geoParams, float scaling, CServerParams *srvParams) {
 
   CCreateScaleBar::Props p = CCreateScaleBar::getScaleBarProperties(geoParams, scaling);
 
+  /* The drawing only depends on the rounded scalebar properties, so most map extents share a scalebar */
+  CT::string scaleBarCacheKey;
+  bool useLegendCache = srvParams != NULL && CLegendCache::isCacheable(scaleBarImage);
+  if (useLegendCache) {
+    scaleBarCacheKey.print("scalebar:%d %g %s size:%dx%d scaling:%f font:%s %f", p.width, p.mapunits, geoParams->CRS.c_str(), scaleBarImage->Geo->dWidth, scaleBarImage->Geo->dHeight, scaling,
+                           scaleBarImage->getFontLocation() != NULL ? scaleBarImage->getFontLocation() : "", scaleBarImage->getFontSize());
+    if (CLegendCache::get(srvParams, scaleBarCacheKey.c_str(), scaleBarImage) == 0) return 0;
+  }
+
   int offsetX = int(3.0f * scaling);
   int scaleBarHeight = int(23.0f * scaling);
 
@@ -54,6 +64,9 @@ int CCreateScaleBar::createScaleBar(CDrawImage *scaleBarImage, CGeoParams *geoPa
 
   scaleBarImage->drawText(offsetX + p.width * 2.0f + 10, scaleBarHeight - (3.0f * scaling), fontFile, fontSize * .7, 0, units.c_str(), 240);
   scaleBarImage->crop(4 * scaling);
+  if (useLegendCache) {
+    CLegendCache::put(srvParams, scaleBarCacheKey.c_str(), scaleBarImage);
+  }
   return 0;
 }
 
@@ -15,9 +15,10 @@ public:
    * @param scaleBarImage The CDrawImage object to write the scalebar to
    * @param geoParams The projection information to create the scalebar from, uses boundingbox and CRS.
    * @param scaling The scaling of the scalebar, 1.0 is natural, 2.0 is twice as big.
+   * @param srvParams Used for the legend cache, the scalebar is taken from there when it has been drawn before.
    * @return 0 on success nonzero on failure.
    */
-  static int createScaleBar(CDrawImage *scaleBarImage, CGeoParams *geoParams, float scaling);
+  static int createScaleBar(CDrawImage *scaleBarImage, CGeoParams *geoParams, float scaling, CServerParams *srvParams);
 
 private:
   class Props {
@@ -4,6 +4,12 @@
 #include "CReporter.h"
 #include "CRequest.h"
 #include "CNetCDFDataWriter.h"
+#include "CReadFile.h"
+#include <algorithm>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 const char *CCreateTiles::className = "CCreateTiles";
 
@@ -257,315 +263,452 @@ int CCreateTiles::createTilesForFile(CDataSource *dataSource, int, CT::string fi
     CDBDebug("Found %s", dataSource->requiredDims[0]->uniqueValues[j].c_str());
   }
 
+  int numWorkers = 0;
+  if (!ts->attr.threads.empty()) {
+    numWorkers = ts->attr.threads.toInt();
+  }
+  if (numWorkers <= 0) {
+    numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (numWorkers <= 0) {
+    numWorkers = 1;
+  }
+
+  int minlevel = 1;
+  if (ts->attr.minlevel.empty() == false) {
+    minlevel = ts->attr.minlevel.toInt();
+    if (minlevel <= 1) minlevel = 1;
+  }
+  int maxlevel = ts->attr.maxlevel.toInt();
+
+  double globalBBOX[4];
+  globalBBOX[0] = tilesetstartx;
+  globalBBOX[2] = tilesetstopx;
+  globalBBOX[1] = tilesetstarty;
+  globalBBOX[3] = tilesetstopy;
+
+  double tilesetWidth = globalBBOX[2] - globalBBOX[0];
+  double tilesetHeight = globalBBOX[3] - globalBBOX[1];
+  int nrTilesX = floor(tilesetWidth / tileBBOXWidth + 0.5);
+  int nrTilesY = floor(tilesetHeight / tileBBOXHeight + 0.5);
+
+  TileSetSettings settings;
+  settings.tileprojection = tileprojection;
+  settings.tilewidthpx = tilewidthpx;
+  settings.tileheightpx = tileheightpx;
+  settings.avgRGBA = tilemode.equals("avg_rgba");
+
   for (size_t dd = 0; dd < dataSource->requiredDims.size(); dd++) {
     for (size_t ddd = 0; ddd < dataSource->requiredDims[dd]->uniqueValues.size(); ddd++) {
       dataSource->requiredDims[dd]->value = dataSource->requiredDims[dd]->uniqueValues[ddd].c_str();
       try {
-
         CT::string dimName = dataSource->cfgLayer->Dimension[dd]->attr.name.c_str();
         tableName =
             dbAdapter->getTableNameForPathFilterAndDimension(dataSource->cfgLayer->FilePath[0]->value.c_str(), dataSource->cfgLayer->FilePath[0]->attr.filter.c_str(), dimName.c_str(), dataSource);
+      } catch (int e) {
+        CDBError("Unable to create tableName from '%s' '%s' ", dataSource->cfgLayer->FilePath[0]->value.c_str(), dataSource->cfgLayer->FilePath[0]->attr.filter.c_str());
+        return 1;
+      }
 
-        double globalBBOX[4];
+      /* Datasource used to name the tiles and to query the tiles of the finer level from the db */
+      CDataSource queryDs;
+      CServerParams querySrvParams;
+      querySrvParams.cfg = dataSource->srvParams->cfg;
+      queryDs.srvParams = &querySrvParams;
+      queryDs.cfgLayer = dataSource->cfgLayer;
+      queryDs.cfg = dataSource->srvParams->cfg;
+      try {
+        CRequest::fillDimValuesForDataSource(&queryDs, dataSource->srvParams);
+      } catch (ServiceExceptionCode e) {
+        CDBError("Exception in setDimValuesForDataSource");
+        return 1;
+      }
+      queryDs.requiredDims[dd]->value = dataSource->requiredDims[dd]->value;
+      queryDs.queryBBOX = 1;
 
-        CDBStore::Store *store = NULL;
+      /* The workers get the dimensions resolved here, they can not query the database over the connection of this process */
+      settings.requiredDims.clear();
+      for (size_t i = 0; i < queryDs.requiredDims.size(); i++) {
+        settings.requiredDims.push_back(*queryDs.requiredDims[i]);
+      }
 
-        globalBBOX[0] = tilesetstartx;
-        globalBBOX[2] = tilesetstopx;
-        globalBBOX[1] = tilesetstarty;
-        globalBBOX[3] = tilesetstopy;
+      CT::string prefix = "";
+      if (ts->attr.prefix.empty() == false) {
+        prefix = ts->attr.prefix + "/";
+      }
+      CT::string timeValue = "1970-01-01T00:00:00Z";
+      for (size_t i = 0; i < queryDs.requiredDims.size(); i++) {
+        if (queryDs.requiredDims[i]->isATimeDimension) {
+          timeValue = queryDs.requiredDims[i]->value;
+          timeValue.replaceSelf(":", "");
+          timeValue.replaceSelf("-", "");
+        }
+      }
 
-        double tilesetWidth = globalBBOX[2] - globalBBOX[0];
-        double tilesetHeight = globalBBOX[3] - globalBBOX[1];
-        int nrTilesX = floor(tilesetWidth / tileBBOXWidth + 0.5);
-        int nrTilesY = floor(tilesetHeight / tileBBOXHeight + 0.5);
+      /* The finest level is derived from the source data, all coarser levels are derived from the level below. */
+      CDBStore::Store *rootStore = NULL;
+      try {
+        rootStore = dbAdapter->getFilesAndIndicesForDimensions(dataSource, 1);
+      } catch (ServiceExceptionCode e) {
+        CDBError("Catched ServiceExceptionCode %d at line %d", e, __LINE__);
+      } catch (int e) {
+        CDBError("Catched integerException %d at line %d", e, __LINE__);
+      }
+      if (rootStore == NULL) {
+        CREPORT_ERROR_NODOC("Found no data!", CReportMessage::Categories::GENERAL);
+        return 1;
+      }
 
-        int minlevel = 1;
-        if (ts->attr.minlevel.empty() == false) {
-          minlevel = ts->attr.minlevel.toInt();
-          if (minlevel <= 1) minlevel = 1;
-        }
-        int maxlevel = ts->attr.maxlevel.toInt();
-        for (int level = maxlevel; level >= minlevel; level--) {
-
-          int numFound = 0;
-          int numCreated = 0;
-
-          int levelInc = pow(2, level - 1);
-          for (int y = 0; y < nrTilesY; y = y + levelInc) {
-            for (int x = 0; x < nrTilesX; x = x + levelInc) {
-              int tilesCreated = 0;
-              CDataSource ds;
-              CServerParams newSrvParams;
-              newSrvParams.cfg = dataSource->srvParams->cfg;
-              ds.srvParams = &newSrvParams;
-              ds.cfgLayer = dataSource->cfgLayer;
-              ds.cfg = dataSource->srvParams->cfg;
-
-              double dfMinX = globalBBOX[0] + tileBBOXWidth * x - tileBBOXWidth / 2;
-              double dfMinY = globalBBOX[1] + tileBBOXHeight * y - tileBBOXHeight / 2;
-              double dfMaxX = globalBBOX[0] + tileBBOXWidth * (x + levelInc) + tileBBOXWidth / 2;
-              double dfMaxY = globalBBOX[1] + tileBBOXHeight * (y + levelInc) + tileBBOXHeight / 2;
+      for (int level = minlevel; level <= maxlevel; level++) {
+        int levelInc = pow(2, level - 1);
+        size_t numSkipped = 0;
+        std::vector<TileJob *> jobs;
+
+        CT::string tileBasePath = ts->attr.tilepath.c_str();
+        tileBasePath.printconcat("/%s/%s/%slevel%0.2d/", tableName.c_str(), timeValue.c_str(), prefix.c_str(), level);
+
+        for (int y = 0; y < nrTilesY; y = y + levelInc) {
+          for (int x = 0; x < nrTilesX; x = x + levelInc) {
+            TileJob *job = new TileJob();
+            job->level = level;
+            job->x = x;
+            job->y = y;
+            job->derivedFromTiles = level != minlevel;
+            job->dfBBOX[0] = globalBBOX[0] + tileBBOXWidth * x;
+            job->dfBBOX[1] = globalBBOX[1] + tileBBOXHeight * y;
+            job->dfBBOX[2] = globalBBOX[0] + tileBBOXWidth * (x + levelInc);
+            job->dfBBOX[3] = globalBBOX[1] + tileBBOXHeight * (y + levelInc);
+            job->tileBasePath = tileBasePath;
+
+            /* Now make the fileNameToWrite */
+            job->fileNameToWrite = tileBasePath;
+            job->fileNameToWrite.printconcat("level[%d]row[%d]_col[%d]", level, x, y);
+            for (size_t i = 0; i < queryDs.requiredDims.size(); i++) {
+              job->fileNameToWrite.printconcat("_%s", queryDs.requiredDims[i]->value.c_str());
+            }
+            job->fileNameToWrite.concat(".nc");
+            job->fileNameToWrite = CDirReader::makeCleanPath(job->fileNameToWrite.c_str());
+
+            if (job->derivedFromTiles) {
+              /* Tiles of the finer level which are completely inside this tile */
+              queryDs.queryLevel = level - 1;
+              queryDs.nativeViewPortBBOX[0] = job->dfBBOX[0] - tileBBOXWidth / 2;
+              queryDs.nativeViewPortBBOX[1] = job->dfBBOX[1] - tileBBOXHeight / 2;
+              queryDs.nativeViewPortBBOX[2] = job->dfBBOX[2] + tileBBOXWidth / 2;
+              queryDs.nativeViewPortBBOX[3] = job->dfBBOX[3] + tileBBOXHeight / 2;
+              CDBStore::Store *store = NULL;
               try {
-                CRequest::fillDimValuesForDataSource(&ds, dataSource->srvParams);
+                store = dbAdapter->getFilesAndIndicesForDimensions(&queryDs, 3000);
               } catch (ServiceExceptionCode e) {
-                CDBError("Exception in setDimValuesForDataSource");
-                return 1;
+                CDBError("Catched ServiceExceptionCode %d at line %d", e, __LINE__);
+              } catch (int e) {
+                CDBError("Catched integerException %d at line %d", e, __LINE__);
               }
-              ds.requiredDims[dd]->value = dataSource->requiredDims[dd]->value;
-
-              CT::string tileBasePath = ts->attr.tilepath.c_str();
-              CT::string prefix = "";
-              if (ts->attr.prefix.empty() == false) {
-                prefix = ts->attr.prefix + "/";
-              }
-              CT::string timeValue = "1970-01-01T00:00:00Z";
-              for (size_t i = 0; i < ds.requiredDims.size(); i++) {
-                if (ds.requiredDims[i]->isATimeDimension) {
-                  timeValue = ds.requiredDims[i]->value;
-                  timeValue.replaceSelf(":", "");
-                  timeValue.replaceSelf("-", "");
-                }
+              if (store != NULL) {
+                addInputsToJob(job, store, queryDs.requiredDims.size());
+                delete store;
               }
+            } else {
+              addInputsToJob(job, rootStore, queryDs.requiredDims.size());
+            }
 
-              tileBasePath.printconcat("/%s/%s/%slevel%0.2d/", tableName.c_str(), timeValue.c_str(), prefix.c_str(), level);
+            /* Nothing to derive this tile from */
+            if (job->inputFiles.size() == 0) {
+              delete job;
+              continue;
+            }
 
-              /* Now make the fileNameToWrite */
-              CT::string fileNameToWrite = tileBasePath;
-              fileNameToWrite.printconcat("level[%d]row[%d]_col[%d]", level, x, y);
-              for (size_t i = 0; i < ds.requiredDims.size(); i++) {
-                fileNameToWrite.printconcat("_%s", ds.requiredDims[i]->value.c_str());
-              }
-              fileNameToWrite.concat(".nc");
-              fileNameToWrite = CDirReader::makeCleanPath(fileNameToWrite.c_str());
+            /* Check if the tile was already done and none of its inputs has changed since */
+            if (dbAdapter->checkIfFileIsInTable(tableName.c_str(), job->fileNameToWrite.c_str()) == 0 && isTileUpToDate(job)) {
+              numSkipped++;
+              delete job;
+              continue;
+            }
+            jobs.push_back(job);
+          }
+        }
 
-              /* Check if the tile was already done */
-              bool isFileInTable = false;
+        if (jobs.size() > 0) {
+          CDBDebug("**** Level %d/%d: creating %d tiles with %d workers, %d tiles are up to date. Dimnr %d/%d dimval %d/%d ***", level, maxlevel, jobs.size(), numWorkers, numSkipped, dd,
+                   dataSource->requiredDims.size(), ddd, dataSource->requiredDims[dd]->uniqueValues.size());
+        }
 
-              int status = dbAdapter->checkIfFileIsInTable(tableName.c_str(), fileNameToWrite.c_str());
-              if (status == 0) {
-                isFileInTable = true;
-              }
+        int status = renderTiles(dataSource, &settings, jobs, numWorkers);
 
-              if (!isFileInTable) {
-                CDirReader::makePublicDirectory(tileBasePath.c_str());
-                ds.srvParams->Geo->CRS = tileprojection;
+        /* Register the written tiles in one go, the next level is queried from these */
+        std::vector<std::string> fileList;
+        for (size_t j = 0; j < jobs.size(); j++) {
+          struct stat tileStat;
+          if (stat(jobs[j]->fileNameToWrite.c_str(), &tileStat) == 0) {
+            fileList.push_back(jobs[j]->fileNameToWrite.c_str());
+          }
+          delete jobs[j];
+        }
+        jobs.clear();
 
-                ds.srvParams->Geo->dfBBOX[0] = dfMinX;
-                ds.srvParams->Geo->dfBBOX[1] = dfMinY;
-                ds.srvParams->Geo->dfBBOX[2] = dfMaxX;
-                ds.srvParams->Geo->dfBBOX[3] = dfMaxY;
+        if (fileList.size() > 0) {
+          CDBDebug("Starting updatedb from createTiles for %d files of level %d", fileList.size(), level);
+          int r = 0;
+          if (CDBFileScanner::DBLoopFiles(dataSource, r, &fileList, CDBFILESCANNER_DONTREMOVEDATAFROMDB | CDBFILESCANNER_UPDATEDB | CDBFILESCANNER_IGNOREFILTER | CDBFILESCANNER_DONOTTILE) != 0) {
+            status = 1;
+          }
+          /* Remove the tiles from the cache we just wrote */
+          for (size_t j = 0; j < fileList.size(); j++) {
+            CDFObjectStore::getCDFObjectStore()->deleteCDFObject(fileList[j].c_str());
+          }
+          CDBDebug("Level %d created %d tiles", level, fileList.size());
+        }
 
-                ds.nativeViewPortBBOX[0] = dfMinX;
-                ds.nativeViewPortBBOX[1] = dfMinY;
-                ds.nativeViewPortBBOX[2] = dfMaxX;
-                ds.nativeViewPortBBOX[3] = dfMaxY;
+        if (status != 0) {
+          CDBError("Status is nonzero");
+          delete rootStore;
+          return 1;
+        }
+      }
+      delete rootStore;
+    }
+  }
+  return 0;
+};
 
-                try {
+void CCreateTiles::addInputsToJob(TileJob *job, CDBStore::Store *store, size_t numDims) {
+  for (size_t k = 0; k < store->getSize(); k++) {
+    CDBStore::Record *record = store->getRecord(k);
+    job->inputFiles.push_back(record->get(0)->c_str());
+    std::vector<CT::string> dimValues;
+    std::vector<int> dimIndices;
+    for (size_t i = 0; i < numDims; i++) {
+      dimValues.push_back(record->get(1 + i * 2)->c_str());
+      dimIndices.push_back(atoi(record->get(2 + i * 2)->c_str()));
+    }
+    job->inputDimValues.push_back(dimValues);
+    job->inputDimIndices.push_back(dimIndices);
+  }
+}
 
-                  bool baseOnRootDataFile = true;
+CT::string CCreateTiles::getInputSignature(TileJob *job) {
+  std::vector<std::string> lines;
+  for (size_t j = 0; j < job->inputFiles.size(); j++) {
+    CT::string line = job->inputFiles[j].c_str();
+    struct stat inputStat;
+    /* Remote inputs like OPeNDAP urls have no modification time, only their name is part of the signature */
+    if (stat(job->inputFiles[j].c_str(), &inputStat) == 0) {
+      line.printconcat(" %ld.%09ld", (long)inputStat.st_mtim.tv_sec, (long)inputStat.st_mtim.tv_nsec);
+    }
+    lines.push_back(line.c_str());
+  }
+  std::sort(lines.begin(), lines.end());
+  CT::string signature;
+  for (size_t j = 0; j < lines.size(); j++) {
+    signature.concat(lines[j].c_str());
+    signature.concat("\n");
+  }
+  return signature;
+}
 
-                  if (baseOnRootDataFile) {
-                    ds.queryBBOX = 0;
-                    ds.queryLevel = 1; // TODO MAKE CONFIGURABLE
-                    store = dbAdapter->getFilesAndIndicesForDimensions(dataSource, 1);
-                  } else {
-                    ds.queryBBOX = 1;
-                    ds.queryLevel = level - 1;
-                    store = dbAdapter->getFilesAndIndicesForDimensions(&ds, 3000);
-                  }
+CT::string CCreateTiles::getInputSignatureFileName(TileJob *job) {
+  CT::string signatureFileName = job->fileNameToWrite;
+  signatureFileName.concat(".inputs");
+  return signatureFileName;
+}
 
-                  if (store != NULL) {
-#ifdef CDBFILESCANNER_DEBUG
-                    CDBDebug("Store size = %d for level %d", store->getSize(), level);
-#endif
-                    if (level == minlevel && store->getSize() == 0) {
-                      delete store;
+bool CCreateTiles::isTileUpToDate(TileJob *job) {
+  struct stat tileStat;
+  if (stat(job->fileNameToWrite.c_str(), &tileStat) != 0) {
+    return false;
+  }
+  /* Tiles without a stored signature are rebuilt, an input file may have been added or removed */
+  CT::string storedSignature;
+  try {
+    storedSignature = CReadFile::open(getInputSignatureFileName(job).c_str());
+  } catch (int e) {
+    return false;
+  }
+  return storedSignature.equals(getInputSignature(job));
+}
 
-#ifdef CDBFILESCANNER_DEBUG
-                      CDBDebug("Finding root, dataSource->requiredDims.size() = %d", dataSource->requiredDims.size());
-#endif
+int CCreateTiles::renderTile(CDataSource *dataSource, TileSetSettings *settings, TileJob *job) {
+  CDataSource ds;
+  CServerParams newSrvParams;
+  newSrvParams.cfg = dataSource->srvParams->cfg;
+  ds.srvParams = &newSrvParams;
+  ds.cfgLayer = dataSource->cfgLayer;
+  ds.cfg = dataSource->srvParams->cfg;
+  for (size_t i = 0; i < settings->requiredDims.size(); i++) {
+    ds.requiredDims.push_back(new COGCDims(settings->requiredDims[i]));
+  }
 
-                      store = dbAdapter->getFilesAndIndicesForDimensions(dataSource, 1);
-                    }
-                    if (store == NULL) {
-                      CREPORT_ERROR_NODOC("Found no data!", CReportMessage::Categories::GENERAL);
-                      return 1;
-                    }
-#ifdef CDBFILESCANNER_DEBUG
-                    CDBDebug("*** Found %d %d:%d / %d:%d= (%f %f %f %f) - (%f,%f)", store->getSize(), x, y, int(nrTilesX), int(nrTilesY), dfMinX, dfMinY, dfMaxX, dfMaxY, dfMaxX - dfMinX,
-                             dfMaxY - dfMinY);
-#endif
-                    if (store->getSize() > 0) {
-                      for (size_t k = 0; k < store->getSize(); k++) {
-                        CDBStore::Record *record = store->getRecord(k);
-#ifdef CDBFILESCANNER_DEBUG
-                        CDBDebug("Adding %s", record->get(0)->c_str());
-#endif
-                        ds.addStep(record->get(0)->c_str(), NULL);
-                        for (size_t i = 0; i < ds.requiredDims.size(); i++) {
-#ifdef CDBFILESCANNER_DEBUG
-                          CDBDebug("%s", ds.requiredDims[i]->netCDFDimName.c_str());
-#endif
-                          CT::string value = record->get(1 + i * 2)->c_str();
-                          ds.getCDFDims()->addDimension(ds.requiredDims[i]->netCDFDimName.c_str(), value.c_str(), atoi(record->get(2 + i * 2)->c_str()));
-                          ds.requiredDims[i]->addValue(value.c_str());
-                        }
-                      }
-                      int status = 0;
-
-                      CNetCDFDataWriter *wcsWriter = new CNetCDFDataWriter();
-                      if (tilemode.equals("avg_rgba")) {
-                        wcsWriter->setInterpolationMode(CNetCDFDataWriter_AVG_RGB);
-                      }
-                      try {
-                        newSrvParams.Geo->dWidth = (tilewidthpx);
-                        newSrvParams.Geo->dHeight = (tileheightpx);
-                        dfMinX = globalBBOX[0] + tileBBOXWidth * x;
-                        dfMinY = globalBBOX[1] + tileBBOXHeight * y;
-                        dfMaxX = globalBBOX[0] + tileBBOXWidth * (x + levelInc);
-                        dfMaxY = globalBBOX[1] + tileBBOXHeight * (y + levelInc);
-
-                        newSrvParams.Geo->dfBBOX[0] = dfMinX;
-                        newSrvParams.Geo->dfBBOX[1] = dfMinY;
-                        newSrvParams.Geo->dfBBOX[2] = dfMaxX;
-                        newSrvParams.Geo->dfBBOX[3] = dfMaxY;
-                        newSrvParams.Format = "adagucnetcdf";
-                        newSrvParams.WCS_GoNative = 0;
-                        newSrvParams.Geo->CRS.copy(&tileprojection);
-                        int ErrorAtLine = 0;
-                        try {
-                          int layerNo = dataSource->datasourceIndex;
-                          if (ds.setCFGLayer(dataSource->srvParams, dataSource->srvParams->configObj->Configuration[0], dataSource->srvParams->cfg->Layer[layerNo], NULL, layerNo) != 0) {
-                            return 1;
-                          }
+  CDirReader::makePublicDirectory(job->tileBasePath.c_str());
 
+  for (size_t k = 0; k < job->inputFiles.size(); k++) {
 #ifdef CDBFILESCANNER_DEBUG
-                          CDBDebug("Checking tile for [%f,%f,%f,%f] with WH [%d,%d]", dfMinX, dfMinY, dfMaxX, dfMaxY, newSrvParams.Geo->dWidth, newSrvParams.Geo->dHeight);
-                          CDBDebug("wcswriter init");
-#endif
-                          status = wcsWriter->init(&newSrvParams, &ds, ds.getNumTimeSteps());
-                          if (status != 0) {
-                            throw(__LINE__);
-                          };
-                          std::vector<CDataSource *> dataSources;
-                          ds.varX->freeData();
-                          ds.varY->freeData();
-
-                          dataSources.push_back(&ds);
-                          int numFailedWarps = 0;
-                          int numDoneWarps = 0;
-
-                          for (size_t k = 0; k < (size_t)dataSources[0]->getNumTimeSteps(); k++) {
-                            for (size_t d = 0; d < dataSources.size(); d++) {
-                              dataSources[d]->setTimeStep(k);
-                            }
-#ifdef CDBFILESCANNER_DEBUG
-                            CDBDebug("wcswriter adddata");
-#endif
-                            numDoneWarps++;
-                            status = wcsWriter->addData(dataSources);
-                            if (status != 0) {
-                              numFailedWarps++;
-                            };
-#ifdef CDBFILESCANNER_DEBUG
-                            CDBDebug("wcswriter adddata done");
+    CDBDebug("Adding %s", job->inputFiles[k].c_str());
 #endif
-                          }
-
-                          if (numDoneWarps != numFailedWarps) {
-                            status = wcsWriter->writeFile(fileNameToWrite.c_str(), level, false);
-                            if (status != 0) {
-                              throw(__LINE__);
-                            };
-                            CDBDebug("Starting updatedb from createTiles for "
-                                     "file %s",
-                                     fileNameToWrite.c_str());
-                            int r = 0;
-                            std::vector<std::string> fileList;
-                            fileList.push_back(fileNameToWrite.c_str());
-                            status = CDBFileScanner::DBLoopFiles(dataSource, r, &fileList,
-                                                                 CDBFILESCANNER_DONTREMOVEDATAFROMDB | CDBFILESCANNER_UPDATEDB | CDBFILESCANNER_IGNOREFILTER | CDBFILESCANNER_DONOTTILE);
-                            if (status != 0) throw(__LINE__);
-                            tilesCreated++;
-                          } else {
-                            status = 0;
-                          }
-
-                          if (!baseOnRootDataFile) {
-                            for (size_t d = 0; d < dataSources.size(); d++) {
-                              for (size_t k = 0; k < (size_t)dataSources[d]->getNumTimeSteps(); k++) {
-                                dataSources[d]->setTimeStep(k);
-                                if (dataSources[d]->queryLevel != 0) {
-                                  /* Remove from the cache the datasources we
-                                   * just read from  */
-                                  CDFObjectStore::getCDFObjectStore()->deleteCDFObject(dataSources[d]->getFileName());
-                                }
-                              }
-                            }
-                          }
-                          /* Remove the datasource from the cache we just wrote
-                           */
-                          CDFObjectStore::getCDFObjectStore()->deleteCDFObject(fileNameToWrite.c_str());
+    ds.addStep(job->inputFiles[k].c_str(), NULL);
+    for (size_t i = 0; i < ds.requiredDims.size(); i++) {
+      ds.getCDFDims()->addDimension(ds.requiredDims[i]->netCDFDimName.c_str(), job->inputDimValues[k][i].c_str(), job->inputDimIndices[k][i]);
+      ds.requiredDims[i]->addValue(job->inputDimValues[k][i].c_str());
+    }
+  }
+
+  int status = 0;
+  bool tileWritten = false;
+  CNetCDFDataWriter *wcsWriter = new CNetCDFDataWriter();
+  if (settings->avgRGBA) {
+    wcsWriter->setInterpolationMode(CNetCDFDataWriter_AVG_RGB);
+  }
+  try {
+    newSrvParams.Geo->dWidth = settings->tilewidthpx;
+    newSrvParams.Geo->dHeight = settings->tileheightpx;
+    newSrvParams.Geo->dfBBOX[0] = job->dfBBOX[0];
+    newSrvParams.Geo->dfBBOX[1] = job->dfBBOX[1];
+    newSrvParams.Geo->dfBBOX[2] = job->dfBBOX[2];
+    newSrvParams.Geo->dfBBOX[3] = job->dfBBOX[3];
+    newSrvParams.Format = "adagucnetcdf";
+    newSrvParams.WCS_GoNative = 0;
+    newSrvParams.Geo->CRS.copy(&settings->tileprojection);
+
+    int layerNo = dataSource->datasourceIndex;
+    if (ds.setCFGLayer(dataSource->srvParams, dataSource->srvParams->configObj->Configuration[0], dataSource->srvParams->cfg->Layer[layerNo], NULL, layerNo) != 0) {
+      throw(__LINE__);
+    }
 
 #ifdef CDBFILESCANNER_DEBUG
-                          CDBDebug("DONE: Open CDFObjects: [%d]", CDFObjectStore::getCDFObjectStore()->getNumberOfOpenObjects());
+    CDBDebug("Checking tile for [%f,%f,%f,%f] with WH [%d,%d]", job->dfBBOX[0], job->dfBBOX[1], job->dfBBOX[2], job->dfBBOX[3], newSrvParams.Geo->dWidth, newSrvParams.Geo->dHeight);
 #endif
-                        } catch (int e) {
-                          CDBError("Error at line %d", e);
-                          ErrorAtLine = e;
-                        }
-                        newSrvParams.cfg = NULL;
-
-                        if (ErrorAtLine != 0) throw(ErrorAtLine);
-                      } catch (int e) {
-                        CDBError("Exception at line %d", e);
-                        status = 1;
-                      }
-                      delete wcsWriter;
-
-                      if (status != 0) {
-                        CDBError("Status is nonzero");
-                        delete store;
-                        store = NULL;
-                        return 1;
-                      }
-                    }
-                    numFound += store->getSize();
-                    if (store->getSize() > 0) {
-                      numCreated++;
-                    }
-                  }
-                  delete store;
-                  store = NULL;
-                } catch (ServiceExceptionCode e) {
-                  CDBError("Catched ServiceExceptionCode %d at line %d", e, __LINE__);
-                } catch (int e) {
-                  CDBError("Catched integerException %d at line %d", e, __LINE__);
-                }
+    status = wcsWriter->init(&newSrvParams, &ds, ds.getNumTimeSteps());
+    if (status != 0) {
+      throw(__LINE__);
+    };
+    std::vector<CDataSource *> dataSources;
+    ds.varX->freeData();
+    ds.varY->freeData();
+
+    dataSources.push_back(&ds);
+    int numFailedWarps = 0;
+    int numDoneWarps = 0;
+
+    for (size_t k = 0; k < (size_t)dataSources[0]->getNumTimeSteps(); k++) {
+      for (size_t d = 0; d < dataSources.size(); d++) {
+        dataSources[d]->setTimeStep(k);
+      }
+      numDoneWarps++;
+      status = wcsWriter->addData(dataSources);
+      if (status != 0) {
+        numFailedWarps++;
+      };
+    }
 
-                delete store;
-                store = NULL;
+    if (numDoneWarps != numFailedWarps) {
+      status = wcsWriter->writeFile(job->fileNameToWrite.c_str(), job->level, false);
+      if (status != 0) {
+        throw(__LINE__);
+      };
+      tileWritten = true;
+      CT::string signature = getInputSignature(job);
+      try {
+        CReadFile::write(getInputSignatureFileName(job).c_str(), signature.c_str(), signature.length());
+      } catch (int e) {
+        CDBWarning("Unable to write input signature for tile %s", job->fileNameToWrite.c_str());
+      }
+    } else {
+      status = 0;
+    }
 
-                if (tilesCreated > 0) {
+    if (job->derivedFromTiles) {
+      /* Remove from the cache the tiles we just read from */
+      for (size_t k = 0; k < job->inputFiles.size(); k++) {
+        CDFObjectStore::getCDFObjectStore()->deleteCDFObject(job->inputFiles[k].c_str());
+      }
+    }
+  } catch (int e) {
+    CDBError("Exception at line %d", e);
+    status = 1;
+  }
+  newSrvParams.cfg = NULL;
+  delete wcsWriter;
 
-                  CDBDebug("**** Percentage done for level: %.1f. Scanning tile "
-                           "dimnr %d/%d dimval %d/%d: Level %d/%d,  ***",
-                           (float(x + y * nrTilesX) / float(nrTilesY * nrTilesX)) * 100, dd, dataSource->requiredDims.size(), ddd, dataSource->requiredDims[dd]->uniqueValues.size(), level, maxlevel);
-                }
-              }
-            }
-          }
-          if (numCreated != 0) {
-            CDBDebug("Level %d Found %d file, created %d tiles", level, numFound, numCreated);
+  if (status != 0) {
+    return 1;
+  }
+  return tileWritten ? 0 : -1;
+}
+
+int CCreateTiles::renderTiles(CDataSource *dataSource, TileSetSettings *settings, std::vector<TileJob *> &jobs, int numWorkers) {
+  if (jobs.size() == 0) return 0;
+  if ((size_t)numWorkers > jobs.size()) {
+    numWorkers = jobs.size();
+  }
+
+  /* The netcdf and hdf5 libraries are not thread safe, tiles are therefore rendered by forked worker processes.
+   * Job numbers are handed out through a pipe, so a worker which is ready immediately picks up the next tile. */
+  int jobPipe[2] = {-1, -1};
+  if (numWorkers > 1 && pipe(jobPipe) != 0) {
+    CDBWarning("Unable to create pipe, rendering tiles in a single process");
+    numWorkers = 1;
+  }
+
+  std::vector<pid_t> workers;
+  if (numWorkers > 1) {
+    /* Prevent buffered output being written by every worker */
+    fflush(NULL);
+    for (int w = 0; w < numWorkers; w++) {
+      pid_t pid = fork();
+      if (pid == -1) {
+        CDBWarning("Unable to start worker %d", w);
+        break;
+      }
+      if (pid == 0) {
+        close(jobPipe[1]);
+        /* Open files are shared with the parent, start with an empty store */
+        CDFObjectStore::getCDFObjectStore()->clear();
+        int workerStatus = 0;
+        int jobNr;
+        while (read(jobPipe[0], &jobNr, sizeof(int)) == sizeof(int)) {
+          if (renderTile(dataSource, settings, jobs[jobNr]) > 0) {
+            workerStatus = 1;
           }
         }
-      } catch (int e) {
+        close(jobPipe[0]);
+        fflush(NULL);
+        /* _exit prevents closing the database connection of the parent */
+        _exit(workerStatus);
+      }
+      workers.push_back(pid);
+    }
+    close(jobPipe[0]);
+  }
 
-        CDBError("Unable to create tableName from '%s' '%s' ", dataSource->cfgLayer->FilePath[0]->value.c_str(), dataSource->cfgLayer->FilePath[0]->attr.filter.c_str());
-        return 1;
+  if (workers.size() == 0) {
+    if (jobPipe[1] != -1) close(jobPipe[1]);
+    int status = 0;
+    for (size_t j = 0; j < jobs.size(); j++) {
+      if (renderTile(dataSource, settings, jobs[j]) > 0) {
+        status = 1;
       }
     }
+    return status;
   }
-  return 0;
-};
+
+  int status = 0;
+  void (*previousHandler)(int) = signal(SIGPIPE, SIG_IGN);
+  for (size_t j = 0; j < jobs.size(); j++) {
+    int jobNr = j;
+    if (write(jobPipe[1], &jobNr, sizeof(int)) != sizeof(int)) {
+      CDBError("Unable to hand out tile %d to the workers", jobNr);
+      status = 1;
+      break;
+    }
+  }
+  close(jobPipe[1]);
+  signal(SIGPIPE, previousHandler);
+
+  for (size_t w = 0; w < workers.size(); w++) {
+    int workerStatus = 0;
+    if (waitpid(workers[w], &workerStatus, 0) == -1 || !WIFEXITED(workerStatus) || WEXITSTATUS(workerStatus) != 0) {
+      CDBError("Tile worker %d failed", workers[w]);
+      status = 1;
+    }
+  }
+  return status;
+}
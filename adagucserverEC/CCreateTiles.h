@@ -28,6 +28,7 @@
 
 #include "CDebugger.h"
 #include "CDataSource.h"
+#include "CDBStore.h"
 
 /**
  * @brief Class with static functions to create tiles for files in the db.
@@ -37,6 +38,87 @@ class CCreateTiles {
 private:
   DEF_ERRORFUNCTION();
 
+  /**
+   * @brief Description of a single tile which needs to be (re)built, including the files it is derived from.
+   */
+  class TileJob {
+  public:
+    int level, x, y;
+    bool derivedFromTiles;
+    double dfBBOX[4];
+    CT::string tileBasePath;
+    CT::string fileNameToWrite;
+    std::vector<CT::string> inputFiles;
+    std::vector<std::vector<CT::string>> inputDimValues;
+    std::vector<std::vector<int>> inputDimIndices;
+  };
+
+  /**
+   * @brief Settings shared by all tiles of a tileset
+   */
+  class TileSetSettings {
+  public:
+    CT::string tileprojection;
+    int tilewidthpx, tileheightpx;
+    bool avgRGBA;
+    /* Dimensions as resolved from the database by the parent process, with the value of the dimension being tiled */
+    std::vector<COGCDims> requiredDims;
+  };
+
+  /**
+   * @brief Fills the input files of a tile job from a store returned by getFilesAndIndicesForDimensions
+   *
+   * @param job
+   * @param store
+   * @param numDims
+   */
+  static void addInputsToJob(TileJob *job, CDBStore::Store *store, size_t numDims);
+
+  /**
+   * @brief Makes a signature of the files a tile is derived from, one line with name and modification time per file
+   *
+   * @param job
+   * @return CT::string the signature, sorted on filename
+   */
+  static CT::string getInputSignature(TileJob *job);
+
+  /**
+   * @brief Returns the name of the file next to the tile in which the input signature is stored
+   *
+   * @param job
+   * @return CT::string
+   */
+  static CT::string getInputSignatureFileName(TileJob *job);
+
+  /**
+   * @brief Checks if the tile exists and was made from exactly the same list of files, with the same modification times
+   *
+   * @param job
+   * @return true when the tile does not need to be rebuilt
+   */
+  static bool isTileUpToDate(TileJob *job);
+
+  /**
+   * @brief Renders a single tile and writes it to disk. Does not touch the database, it runs in forked workers which share the connection of the parent.
+   *
+   * @param dataSource
+   * @param settings
+   * @param job
+   * @return int 0 when the tile was written, -1 when there was no data for this tile, 1 on error
+   */
+  static int renderTile(CDataSource *dataSource, TileSetSettings *settings, TileJob *job);
+
+  /**
+   * @brief Renders a list of tiles using a pool of worker processes. Workers pick the next tile as soon as they are ready.
+   *
+   * @param dataSource
+   * @param settings
+   * @param jobs
+   * @param numWorkers
+   * @return int
+   */
+  static int renderTiles(CDataSource *dataSource, TileSetSettings *settings, std::vector<TileJob *> &jobs, int numWorkers);
+
 public:
   /**
    * @brief Create tiles for all files.
@@ -27,6 +27,7 @@
 #include <set>
 #include "CDebugger.h"
 #include "CTime.h"
+#include "CMetrics.h"
 
 // #define CDBAdapterSQLLite_DEBUG
 
@@ -45,33 +46,7 @@ CDBAdapterSQLLite::CSQLLiteDB::~CSQLLiteDB() {
   zErrMsg = NULL;
 }
 
-std::set<std::string> CDBAdapterSQLLite::CSQLLiteDB::columnSet;
-std::vector<std::string> CDBAdapterSQLLite::CSQLLiteDB::columnNames;
-std::vector<std::string> CDBAdapterSQLLite::CSQLLiteDB::queryValues;
-std::pair<std::set<std::string>::iterator, bool> CDBAdapterSQLLite::CSQLLiteDB::ret;
-
 int CDBAdapterSQLLite::CSQLLiteDB::callbacknoresults(void *, int, char **, char **) { return 0; };
-int CDBAdapterSQLLite::CSQLLiteDB::callback(void *, int argc, char **argv, char **azColName) {
-  int i;
-  // Set column names
-  for (i = 0; i < argc; i++) {
-    ret = columnSet.insert(azColName[i]);
-    if (ret.second == false) {
-      break;
-    }
-    columnNames.push_back(azColName[i]);
-  }
-
-  for (i = 0; i < argc; i++) {
-    if (argv[i] != NULL) {
-      queryValues.push_back(argv[i]);
-    } else {
-      queryValues.push_back("");
-    }
-  }
-
-  return 0;
-}
 
 int CDBAdapterSQLLite::CSQLLiteDB::close() {
   if (db != NULL) {
@@ -139,60 +114,59 @@ int CDBAdapterSQLLite::CSQLLiteDB::checkTable(const char *pszTableName, const ch
 }
 
 CDBStore::Store *CDBAdapterSQLLite::CSQLLiteDB::queryToStore(const char *pszQuery, bool) {
+  CMetrics::Timer timer(CMetrics::PHASE_DB);
 #ifdef CDBAdapterSQLLite_DEBUG
   CDBDebug("queryToStore %s", pszQuery);
 #endif
-  columnSet.clear();
-  queryValues.clear();
-  columnNames.clear();
-  int rc = sqlite3_exec(db, pszQuery, CDBAdapterSQLLite::CSQLLiteDB::callback, 0, &zErrMsg);
-  if (rc != SQLITE_OK) {
-    // CDBError("SQL error: %s\n", zErrMsg);
-    errorMessage = zErrMsg;
-    sqlite3_free(zErrMsg);
-    return NULL;
+  /* The rows are stepped through directly into the column store, the column model is taken from the first statement returning rows */
+  CDBStore::Store *store = NULL;
+  const char *pszTail = pszQuery;
+  while (pszTail != NULL && *pszTail != 0) {
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(db, pszTail, -1, &stmt, &pszTail);
+    if (rc != SQLITE_OK) {
+      errorMessage = sqlite3_errmsg(db);
+      delete store;
+      return NULL;
+    }
+    if (stmt == NULL) continue; /* Whitespace or comment */
+    size_t numCols = sqlite3_column_count(stmt);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      if (store == NULL) {
+        CDBStore::ColumnModel *colModel = new CDBStore::ColumnModel(numCols);
+        for (size_t colNumber = 0; colNumber < numCols; colNumber++) {
+          colModel->setColumn(colNumber, sqlite3_column_name(stmt, colNumber));
+        }
+        store = new CDBStore::Store(colModel);
+      }
+      store->addRow();
+      for (size_t colNumber = 0; colNumber < numCols && colNumber < store->getColumnModel()->getSize(); colNumber++) {
+        const char *value = (const char *)sqlite3_column_text(stmt, colNumber);
+        if (value != NULL) store->setValue(colNumber, value, sqlite3_column_bytes(stmt, colNumber));
+      }
+    }
+    if (rc != SQLITE_DONE) {
+      errorMessage = sqlite3_errmsg(db);
+      sqlite3_finalize(stmt);
+      delete store;
+      return NULL;
+    }
+    sqlite3_finalize(stmt);
   }
 
-  std::set<std::string>::iterator it;
-
-  size_t numCols = columnNames.size();
-#ifdef CDBAdapterSQLLite_DEBUG
-  CDBDebug("Query succeeded:numCols =  %d", numCols);
-#endif
-  if (numCols == 0) {
+  if (store == NULL) {
     return new CDBStore::Store(new CDBStore::ColumnModel(0));
   }
-
-  size_t numRows = queryValues.size() / numCols;
-
 #ifdef CDBAdapterSQLLite_DEBUG
-  CDBDebug("Numcols = %d numRows = %d", numCols, numRows);
+  CDBDebug("Numcols = %d numRows = %d", store->getColumnModel()->getSize(), store->getSize());
 #endif
-
-  CDBStore::ColumnModel *colModel = new CDBStore::ColumnModel(numCols);
-
-  for (size_t colNumber = 0; colNumber < columnNames.size(); colNumber++) {
-    colModel->setColumn(colNumber, columnNames[colNumber].c_str());
-  }
-
-  CDBStore::Store *store = new CDBStore::Store(colModel);
-
-  if (numRows == 0) {
-    return store;
-  }
-
-  for (size_t rowNumber = 0; rowNumber < numRows; rowNumber++) {
-    CDBStore::Record *record = new CDBStore::Record(colModel);
-    for (size_t colNumber = 0; colNumber < numCols; colNumber++) record->push(colNumber, queryValues[colNumber + rowNumber * numCols].c_str());
-    store->push(record);
-  }
-
   return store;
 }
 
 CDBStore::Store *CDBAdapterSQLLite::CSQLLiteDB::queryToStore(const char *pszQuery) { return queryToStore(pszQuery, false); }
 
 int CDBAdapterSQLLite::CSQLLiteDB::query(const char *pszQuery) {
+  CMetrics::Timer timer(CMetrics::PHASE_DB);
 
   int rc = sqlite3_exec(db, pszQuery, CDBAdapterSQLLite::CSQLLiteDB::callbacknoresults, 0, &zErrMsg);
   if (rc != SQLITE_OK) {
@@ -36,12 +36,7 @@ public:
   private:
     sqlite3 *db;
     char *zErrMsg;
-    static int callback(void *NotUsed, int argc, char **argv, char **azColName);
     static int callbacknoresults(void *NotUsed, int argc, char **argv, char **azColName);
-    static std::set<std::string> columnSet;
-    static std::vector<std::string> columnNames;
-    static std::vector<std::string> queryValues;
-    static std::pair<std::set<std::string>::iterator, bool> ret;
     CT::string errorMessage;
 
   public:
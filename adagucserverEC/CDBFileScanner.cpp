@@ -670,6 +670,17 @@ int CDBFileScanner::DBLoopFiles(CDataSource *dataSource, int removeNonExistingFi
 
                     bool dimIsUnique = true;
 
+                    /* Time values are converted in one go, fill values are skipped below */
+                    std::vector<CT::string> isoTimeStrings;
+                    if (isTimeDim[d] && dimVar->getType() != CDF_STRING && dimDim->length > 0) {
+                      std::vector<double> timeValues(dimValues, dimValues + dimDim->length);
+                      for (size_t i = 0; i < timeValues.size(); i++) {
+                        if (timeValues[i] == NC_FILL_DOUBLE) timeValues[i] = 0;
+                      }
+                      isoTimeStrings.resize(dimDim->length);
+                      adagucTime.offsetsToISOStrings(&timeValues[0], timeValues.size(), &isoTimeStrings[0]);
+                    }
+
                     CT::string uniqueKey;
                     for (size_t i = 0; i < dimDim->length; i++) {
 
@@ -715,14 +726,13 @@ int CDBFileScanner::DBLoopFiles(CDataSource *dataSource, int removeNonExistingFi
                             // ADTime->PrintISOTime(ISOTime,ISO8601TIME_LEN,dimValues[i]);status = 0;//TODO make
                             // PrintISOTime return a 0 if succeeded
 
-                            try {
-                              uniqueKey = adagucTime.dateToISOString(adagucTime.getDate(dimValues[i]));
+                            if (isoTimeStrings[i].empty()) {
+                              CDBDebug("Exception occurred during time conversion: %d", CTIME_CONVERSION_ERROR);
+                            } else {
+                              uniqueKey = isoTimeStrings[i];
                               uniqueKey.setSize(19);
                               uniqueKey.concat("Z");
                               dbAdapter->setFileTimeStamp(tableNames[d].c_str(), (*fileList)[j].c_str(), uniqueKey.c_str(), int(i), fileDate.c_str(), &geoOptions);
-
-                            } catch (int e) {
-                              CDBDebug("Exception occurred during time conversion: %d", e);
                             }
                           }
                         }
@@ -26,6 +26,13 @@
 #ifndef CDBSTORE_H
 #define CDBSTORE_H
 
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CTString.h"
+#include "CTime.h"
+
 #define CDB_UNKNOWN_ERROR 0
 #define CDB_UNKNOWN_COLUMNNAME 1
 #define CDB_INDEX_OUT_OF_BOUNDS 2
@@ -53,9 +60,12 @@ public:
       this->size = size;
     }
     ~ColumnModel() { delete[] columnNames; }
+    /**
+     * Returns the index of the column with the given name. Loops over many rows should resolve the index once.
+     */
     size_t getIndex(const char *name) {
       for (size_t j = 0; j < size; j++) {
-        if (columnNames[j].equals(name)) return j;
+        if (strcmp(columnNames[j].c_str(), name) == 0) return j;
       }
       throw(CDB_UNKNOWN_COLUMNNAME);
     }
@@ -97,28 +107,165 @@ public:
     }
   };
 
+  /**
+   * Result of a query. The values are stored row-major, row by row, in one contiguous arena of zero terminated strings, the database adapters
+   * fill it directly with addRow and setValue. Records are only created when they are requested with getRecord, changes made to a record are
+   * not reflected in the values returned by getValue. Numeric and time columns are parsed once into a typed column by getDoubleColumn and
+   * getTimeColumn.
+   */
   class Store {
   private:
-    std::vector<Record *> records;
     ColumnModel *columnModel;
+    size_t numColumns, numRows;
+    std::vector<char> arena;
+    std::vector<size_t> valueOffsets;
+    std::vector<Record *> records;
+    std::vector<std::vector<double> *> doubleColumns, timeColumns;
+
+    /* Reads a fixed number of digits, returns -1 if they are not there */
+    static int parseDigits(const char *&p, int numDigits) {
+      int value = 0;
+      for (int d = 0; d < numDigits; d++, p++) {
+        if (*p < '0' || *p > '9') return -1;
+        value = value * 10 + (*p - '0');
+      }
+      return value;
+    }
+
+    /* Parses YYYY-MM-DD[(T| )HH:MM:SS[.sss]][Z] as seconds since 1970, returns NAN for other values */
+    static double parseTimestamp(const char *value) {
+      const char *p = value;
+      int numbers[6] = {0, 0, 0, 0, 0, 0};
+      numbers[0] = parseDigits(p, 4);
+      if (numbers[0] < 0 || *p++ != '-' || (numbers[1] = parseDigits(p, 2)) < 1 || *p++ != '-' || (numbers[2] = parseDigits(p, 2)) < 1) return NAN;
+      if (*p == 'T' || *p == ' ') {
+        p++;
+        if ((numbers[3] = parseDigits(p, 2)) < 0 || *p++ != ':' || (numbers[4] = parseDigits(p, 2)) < 0 || *p++ != ':' || (numbers[5] = parseDigits(p, 2)) < 0) return NAN;
+      }
+      double fraction = 0;
+      if (*p == '.') fraction = strtod(p, NULL);
+      double days = double(CTime::daysFromCivil(numbers[0], numbers[1], numbers[2]));
+      return days * 86400 + numbers[3] * 3600 + numbers[4] * 60 + numbers[5] + fraction;
+    }
 
   public:
-    Store(ColumnModel *columnModel) { this->columnModel = columnModel; }
+    Store(ColumnModel *columnModel) {
+      this->columnModel = columnModel;
+      numColumns = columnModel->getSize();
+      numRows = 0;
+      /* Offset 0 is the empty string, used for values which are not set */
+      arena.push_back(0);
+    }
     ~Store() {
       for (size_t j = 0; j < records.size(); j++) {
         delete records[j];
       }
       records.clear();
+      for (size_t j = 0; j < doubleColumns.size(); j++) delete doubleColumns[j];
+      for (size_t j = 0; j < timeColumns.size(); j++) delete timeColumns[j];
       delete columnModel;
     }
+
+    /**
+     * Reserves space for the given number of rows and bytes of values, to avoid reallocations while filling
+     */
+    void reserve(size_t rows, size_t bytes) {
+      valueOffsets.reserve(rows * numColumns);
+      arena.reserve(bytes + 1);
+    }
+
+    /**
+     * Adds a row with empty values, fill it with setValue
+     */
+    void addRow() {
+      valueOffsets.resize(valueOffsets.size() + numColumns, 0);
+      numRows++;
+    }
+
+    /**
+     * Sets a value of the last added row
+     */
+    void setValue(size_t col, const char *value, size_t length) {
+      if (numRows == 0 || col >= numColumns) throw(CDB_INDEX_OUT_OF_BOUNDS);
+      if (value == NULL || length == 0) {
+        valueOffsets[(numRows - 1) * numColumns + col] = 0;
+        return;
+      }
+      valueOffsets[(numRows - 1) * numColumns + col] = arena.size();
+      arena.insert(arena.end(), value, value + length);
+      arena.push_back(0);
+    }
+    void setValue(size_t col, const char *value) { setValue(col, value, value == NULL ? 0 : strlen(value)); }
+
+    /**
+     * Returns a value as zero terminated string, the pointer is valid until the next row is added
+     */
+    const char *getValue(size_t row, size_t col) const {
+      if (row >= numRows || col >= numColumns) throw(CDB_INDEX_OUT_OF_BOUNDS);
+      return &arena[valueOffsets[row * numColumns + col]];
+    }
+
+    size_t getColumnIndex(const char *name) { return columnModel->getIndex(name); }
+
+    /**
+     * Returns the values of a column as numbers, parsed once. Values which are not a number are NAN.
+     */
+    const std::vector<double> &getDoubleColumn(size_t col) {
+      if (col >= numColumns) throw(CDB_INDEX_OUT_OF_BOUNDS);
+      doubleColumns.resize(numColumns, NULL);
+      if (doubleColumns[col] == NULL || doubleColumns[col]->size() != numRows) {
+        delete doubleColumns[col];
+        doubleColumns[col] = new std::vector<double>(numRows);
+        for (size_t row = 0; row < numRows; row++) {
+          const char *value = getValue(row, col);
+          char *end = NULL;
+          double d = strtod(value, &end);
+          (*doubleColumns[col])[row] = (end == value) ? NAN : d;
+        }
+      }
+      return *doubleColumns[col];
+    }
+
+    /**
+     * Returns the values of a column of ISO8601 timestamps as seconds since 1970, parsed once. Values which are not a timestamp are NAN.
+     */
+    const std::vector<double> &getTimeColumn(size_t col) {
+      if (col >= numColumns) throw(CDB_INDEX_OUT_OF_BOUNDS);
+      timeColumns.resize(numColumns, NULL);
+      if (timeColumns[col] == NULL || timeColumns[col]->size() != numRows) {
+        delete timeColumns[col];
+        timeColumns[col] = new std::vector<double>(numRows);
+        for (size_t row = 0; row < numRows; row++) (*timeColumns[col])[row] = parseTimestamp(getValue(row, col));
+      }
+      return *timeColumns[col];
+    }
+
     Record *getRecord(size_t rowNumber) {
-      if (rowNumber >= records.size()) throw(CDB_INDEX_OUT_OF_BOUNDS);
+      if (rowNumber >= numRows) throw(CDB_INDEX_OUT_OF_BOUNDS);
+      records.resize(numRows, NULL);
+      if (records[rowNumber] == NULL) {
+        Record *record = new Record(columnModel);
+        for (size_t col = 0; col < numColumns; col++) record->push(col, getValue(rowNumber, col));
+        records[rowNumber] = record;
+      }
       return records[rowNumber];
     }
-    size_t getSize() { return records.size(); }
-    size_t size() { return records.size(); }
-    void push(Record *record) { records.push_back(record); }
-    std::vector<Record *> getRecords() { return records; }
+    size_t getSize() { return numRows; }
+    size_t size() { return numRows; }
+
+    /**
+     * Adds a row with the values of the record, the store takes ownership of the record
+     */
+    void push(Record *record) {
+      addRow();
+      for (size_t col = 0; col < numColumns; col++) setValue(col, record->get(col)->c_str(), record->get(col)->length());
+      records.resize(numRows, NULL);
+      records[numRows - 1] = record;
+    }
+    const std::vector<Record *> &getRecords() {
+      for (size_t j = 0; j < numRows; j++) getRecord(j);
+      return records;
+    }
     ColumnModel *getColumnModel() { return columnModel; }
   };
 };
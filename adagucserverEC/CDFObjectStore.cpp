@@ -37,6 +37,7 @@ const char *CDFObjectStore::className = "CDFObjectStore";
 #include "CConvertTROPOMI.h"
 #include "CDataReader.h"
 #include "CCDFCSVReader.h"
+#include "CMetrics.h"
 //#define CDFOBJECTSTORE_DEBUG
 #define MAX_OPEN_FILES 500
 extern CDFObjectStore cdfObjectStore;
@@ -236,9 +237,11 @@ CDFObject *CDFObjectStore::getCDFObject(CDataSource *dataSource, CServerParams *
 #ifdef CDFOBJECTSTORE_DEBUG
       CDBDebug("Found CDFObject with filename %s", uniqueIDForFile.c_str());
 #endif
+      CMetrics::increment(CMetrics::COUNTER_CDFOBJECTSTORE_HITS);
       return cdfObjects[j];
     }
   }
+  CMetrics::increment(CMetrics::COUNTER_CDFOBJECTSTORE_MISSES);
   if (cdfObjects.size() > MAX_OPEN_FILES) {
     deleteCDFObject(&cdfObjects[0]);
   }
@@ -1,3 +1,4 @@
+#include <vector>
 #include "CDataSource.h"
 
 #ifndef CDPPInterface_H
@@ -8,6 +9,27 @@
 #define CDATAPOSTPROCESSOR_RUNBEFOREREADING 4
 #define CDATAPOSTPROCESSOR_RUNAFTERREADING 8
 
+/**
+ * A single element-wise step of a data postprocessor, used to run a chain of postprocessors in one pass over the grid
+ */
+class CDPPElementOperation {
+public:
+  enum Type { SCALE, BEAUFORT, DBZTORR, CLIPMINMAX };
+  Type type;
+  float factor;          /* SCALE and BEAUFORT: value is multiplied by factor first */
+  double min, max;       /* CLIPMINMAX: the clip range */
+  bool skipNoData;       /* NaN and nodata values are left as they are */
+  bool appliesToPoints;  /* The operation is also applied to the point values of the data object */
+  CDPPElementOperation(Type type, float factor, double min, double max, bool skipNoData, bool appliesToPoints) {
+    this->type = type;
+    this->factor = factor;
+    this->min = min;
+    this->max = max;
+    this->skipNoData = skipNoData;
+    this->appliesToPoints = appliesToPoints;
+  }
+};
+
 class CDPPInterface {
 public:
   virtual ~CDPPInterface() {}
@@ -32,6 +54,13 @@ public:
    * Executes the data postprocessor for a given array
    */
   virtual int execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode, double *data, size_t numItems) = 0;
+
+  /**
+   * Describes the RUNAFTERREADING step as element-wise operations on the float grid of a single data object, so it can be fused with the neighbouring processors.
+   * Metadata changes like units are applied directly, the operations are appended to operations and executed later by the CDPPExecutor.
+   * @returns 0 if the step is described by the appended operations (none means nothing to do), non zero if execute has to be used instead
+   */
+  virtual int getElementOperations(CServerConfig::XMLE_DataPostProc *, CDataSource *, std::vector<CDPPElementOperation> &) { return 1; }
 };
 
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "CDataPostProcessor.h"
 #include "CRequest.h"
 #include "CDataPostProcessor_ClipMinMax.h"
+#include "CParallelFor.h"
+#include "CMetrics.h"
 
 void writeLogFileLocal(const char *msg) {
   char *logfile = getenv("ADAGUC_LOGFILE");
@@ -810,7 +812,87 @@ CDPPExecutor::~CDPPExecutor() {
 
 const CT::PointerList<CDPPInterface *> *CDPPExecutor::getPossibleProcessors() { return dataPostProcessorList; }
 
+#define CDPPEXECUTOR_BLOCKSIZE 16384
+#define CDPPEXECUTOR_MINBLOCKSPERTHREAD 16
+
+class CDPPElementOperationsSettings {
+public:
+  float *data;
+  size_t size;
+  float noDataValue;
+  const std::vector<CDPPElementOperation> *operations;
+};
+
+static bool isFusable(CDataSource *dataSource) {
+  if (dataSource->getNumDataObjects() != 1) return false;
+  CDF::Variable *variable = dataSource->getDataObject(0)->cdfVariable;
+  return variable != NULL && variable->data != NULL && variable->getType() == CDF_FLOAT;
+}
+
+/* Applies the operations to a single value, returns true if the value was changed by one of the operations */
+static inline bool applyElementOperationsToValue(const CDPPElementOperation *operations, size_t numOperations, float noDataValue, float &value) {
+  bool changed = false;
+  for (size_t o = 0; o < numOperations; o++) {
+    const CDPPElementOperation &operation = operations[o];
+    if (operation.skipNoData && (value != value || value == noDataValue)) continue;
+    switch (operation.type) {
+    case CDPPElementOperation::SCALE:
+      value = operation.factor * value;
+      break;
+    case CDPPElementOperation::BEAUFORT:
+      value = CDPPBeaufort::getBeaufort(operation.factor * value);
+      break;
+    case CDPPElementOperation::DBZTORR:
+      value = CDPDBZtoRR::getRR(value);
+      break;
+    case CDPPElementOperation::CLIPMINMAX:
+      if (value < operation.min) value = operation.min;
+      if (value > operation.max) value = operation.max;
+      break;
+    }
+    changed = true;
+  }
+  return changed;
+}
+
+static void applyElementOperationsToBlocks(int start, int end, void *userData) {
+  CDPPElementOperationsSettings *settings = (CDPPElementOperationsSettings *)userData;
+  const CDPPElementOperation *operations = &(*settings->operations)[0];
+  size_t numOperations = settings->operations->size();
+  size_t stop = std::min(settings->size, size_t(end) * CDPPEXECUTOR_BLOCKSIZE);
+  for (size_t j = size_t(start) * CDPPEXECUTOR_BLOCKSIZE; j < stop; j++) {
+    applyElementOperationsToValue(operations, numOperations, settings->noDataValue, settings->data[j]);
+  }
+}
+
+void CDPPExecutor::applyElementOperations(CDataSource *dataSource, const std::vector<CDPPElementOperation> &operations) {
+  CDataSource::DataObject *dataObject = dataSource->getDataObject(0);
+  CDPPElementOperationsSettings settings;
+  settings.data = (float *)dataObject->cdfVariable->data;
+  settings.size = (size_t)dataSource->dHeight * (size_t)dataSource->dWidth;
+  settings.noDataValue = dataObject->dfNodataValue;
+  settings.operations = &operations;
+  CDBDebug("Applying %d fused element operations", (int)operations.size());
+  int numBlocks = int((settings.size + CDPPEXECUTOR_BLOCKSIZE - 1) / CDPPEXECUTOR_BLOCKSIZE);
+  CParallelFor::run(applyElementOperationsToBlocks, &settings, numBlocks, CDPPEXECUTOR_MINBLOCKSPERTHREAD);
+
+  // Convert point data if needed
+  std::vector<CDPPElementOperation> pointOperations;
+  for (size_t o = 0; o < operations.size(); o++) {
+    if (operations[o].appliesToPoints) pointOperations.push_back(operations[o]);
+  }
+  if (pointOperations.size() == 0) return;
+  for (size_t pointNo = 0; pointNo < dataObject->points.size(); pointNo++) {
+    float value = (float)dataObject->points[pointNo].v;
+    if (applyElementOperationsToValue(&pointOperations[0], pointOperations.size(), settings.noDataValue, value)) {
+      dataObject->points[pointNo].v = value;
+    }
+  }
+}
+
 int CDPPExecutor::executeProcessors(CDataSource *dataSource, int mode) {
+  CMetrics::Timer timer(CMetrics::PHASE_POSTPROCESS);
+  std::vector<CDPPElementOperation> pendingOperations;
   for (size_t dpi = 0; dpi < dataSource->cfgLayer->DataPostProc.size(); dpi++) {
     CServerConfig::XMLE_DataPostProc *proc = dataSource->cfgLayer->DataPostProc[dpi];
     for (size_t procId = 0; procId < dataPostProcessorList->size(); procId++) {
@@ -836,6 +918,14 @@ int CDPPExecutor::executeProcessors(CDataSource *dataSource, int mode) {
       /*Will be runned when datasource data been loaded */
       if (mode == CDATAPOSTPROCESSOR_RUNAFTERREADING) {
         if (code & CDATAPOSTPROCESSOR_RUNAFTERREADING) {
+          /* Element-wise processors are collected and executed together in one pass over the grid */
+          if (isFusable(dataSource) && dataPostProcessorList->get(procId)->getElementOperations(proc, dataSource, pendingOperations) == 0) {
+            continue;
+          }
+          if (pendingOperations.size() > 0) {
+            applyElementOperations(dataSource, pendingOperations);
+            pendingOperations.clear();
+          }
           try {
             int status = dataPostProcessorList->get(procId)->execute(proc, dataSource, CDATAPOSTPROCESSOR_RUNAFTERREADING);
             if (status != 0) {
@@ -848,10 +938,14 @@ int CDPPExecutor::executeProcessors(CDataSource *dataSource, int mode) {
       }
     }
   }
+  if (pendingOperations.size() > 0) {
+    applyElementOperations(dataSource, pendingOperations);
+  }
   return 0;
 }
 
 int CDPPExecutor::executeProcessors(CDataSource *dataSource, int mode, double *data, size_t numItems) {
+  CMetrics::Timer timer(CMetrics::PHASE_POSTPROCESS);
   // const CT::PointerList<CDPPInterface*> *availableProcs = getPossibleProcessors();
   // CDBDebug("executeProcessors, found %d",dataSource->cfgLayer->DataPostProc.size());
   for (size_t dpi = 0; dpi < dataSource->cfgLayer->DataPostProc.size(); dpi++) {
@@ -944,6 +1038,20 @@ float CDPPBeaufort::getBeaufort(float speed) {
   //  CDBDebug("bft(%f)=%d", speed, bft);
   return bft;
 }
+int CDPPBeaufort::getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations) {
+  if ((isApplicable(proc, dataSource) & CDATAPOSTPROCESSOR_RUNAFTERREADING) == false || dataSource->getNumDataObjects() != 1) {
+    return 1;
+  }
+  float factor = 1;
+  if (dataSource->getDataObject(0)->getUnits().equals("knot") || dataSource->getDataObject(0)->getUnits().equals("kt")) {
+    factor = 1852. / 3600;
+  }
+  CDBDebug("Applying beaufort for 1 element with factor %f", factor);
+  dataSource->getDataObject(0)->setUnits("bft");
+  operations.push_back(CDPPElementOperation(CDPPElementOperation::BEAUFORT, factor, 0, 0, true, true));
+  return 0;
+}
+
 int CDPPBeaufort::execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode) {
   if ((isApplicable(proc, dataSource) & mode) == false) {
     return -1;
@@ -1079,6 +1187,19 @@ int CDPPToKnots::isApplicable(CServerConfig::XMLE_DataPostProc *proc, CDataSourc
   return CDATAPOSTPROCESSOR_NOTAPPLICABLE;
 }
 
+int CDPPToKnots::getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations) {
+  if ((isApplicable(proc, dataSource) & CDATAPOSTPROCESSOR_RUNAFTERREADING) == false || dataSource->getNumDataObjects() != 1) {
+    return 1;
+  }
+  if (dataSource->getDataObject(0)->getUnits().equals("m/s") || dataSource->getDataObject(0)->getUnits().equals("m s-1")) {
+    float factor = 3600 / 1852.;
+    CDBDebug("Applying toknots for 1 element with factor %f to grid", factor);
+    dataSource->getDataObject(0)->setUnits("kts");
+    operations.push_back(CDPPElementOperation(CDPPElementOperation::SCALE, factor, 0, 0, true, true));
+  }
+  return 0;
+}
+
 int CDPPToKnots::execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode) {
   if ((isApplicable(proc, dataSource) & mode) == false) {
     return -1;
@@ -1236,6 +1357,14 @@ int CDPDBZtoRR::execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dat
   return 0;
 }
 
+int CDPDBZtoRR::getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations) {
+  if ((isApplicable(proc, dataSource) & CDATAPOSTPROCESSOR_RUNAFTERREADING) == false) {
+    return 1;
+  }
+  operations.push_back(CDPPElementOperation(CDPPElementOperation::DBZTORR, 1, 0, 0, true, false));
+  return 0;
+}
+
 int CDPDBZtoRR::execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode) {
   if ((isApplicable(proc, dataSource) & mode) == false) {
     return -1;
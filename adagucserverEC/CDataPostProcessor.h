@@ -165,6 +165,7 @@ public:
 class CDPPExecutor {
 private:
   DEF_ERRORFUNCTION();
+  static void applyElementOperations(CDataSource *dataSource, const std::vector<CDPPElementOperation> &operations);
 
 public:
   CT::PointerList<CDPPInterface *> *dataPostProcessorList;
@@ -181,13 +182,14 @@ public:
 class CDPPBeaufort : public CDPPInterface {
 private:
   DEF_ERRORFUNCTION();
-  float getBeaufort(float speed);
 
 public:
+  static float getBeaufort(float speed);
   virtual const char *getId();
   virtual int isApplicable(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource);
   virtual int execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode);
   virtual int execute(CServerConfig::XMLE_DataPostProc *, CDataSource *, int, double *, size_t) { return 1; } // TODO: Still need to implement
+  virtual int getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations);
 };
 
 /**
@@ -202,6 +204,7 @@ public:
   virtual int isApplicable(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource);
   virtual int execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode);
   virtual int execute(CServerConfig::XMLE_DataPostProc *, CDataSource *, int, double *, size_t) { return 1; } // TODO: Still need to implement
+  virtual int getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations);
 };
 
 /**
@@ -210,13 +213,14 @@ public:
 class CDPDBZtoRR : public CDPPInterface {
 private:
   DEF_ERRORFUNCTION();
-  float getRR(float dbZ);
 
 public:
+  static float getRR(float dbZ);
   virtual const char *getId();
   virtual int isApplicable(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource);
   virtual int execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode);
   virtual int execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode, double *data, size_t numItems);
+  virtual int getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations);
 };
 
 /**
@@ -20,6 +20,36 @@ template <class T> void clipData(T *data, size_t size, double min, double max) {
   }
 }
 
+static void getClipRange(CServerConfig::XMLE_DataPostProc *proc, double &fa, double &fb) {
+  fa = 0;
+  fb = 0;
+  if (proc->attr.a.empty() == false) {
+    CT::string a;
+    a.copy(proc->attr.a.c_str());
+    fa = a.toDouble();
+  }
+  if (proc->attr.b.empty() == false) {
+    CT::string b;
+    b.copy(proc->attr.b.c_str());
+    fb = b.toDouble();
+  }
+}
+
+int CDPPClipMinMax::getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations) {
+  if (isApplicable(proc, dataSource) != CDATAPOSTPROCESSOR_RUNAFTERREADING || dataSource->getNumDataObjects() != 1) {
+    return 1;
+  }
+  /* The fused pass covers the grid of dWidth by dHeight cells, other shapes use execute */
+  if (dataSource->getDataObject(0)->cdfVariable->getSize() != (size_t)dataSource->dHeight * (size_t)dataSource->dWidth) {
+    return 1;
+  }
+  double fa, fb;
+  getClipRange(proc, fa, fb);
+  CDBDebug("Applying clipminmax");
+  operations.push_back(CDPPElementOperation(CDPPElementOperation::CLIPMINMAX, 1, fa, fb, false, false));
+  return 0;
+}
+
 int CDPPClipMinMax::execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int) {
   if (isApplicable(proc, dataSource) != CDATAPOSTPROCESSOR_RUNAFTERREADING) {
     return -1;
@@ -28,17 +58,8 @@ int CDPPClipMinMax::execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource
   for (size_t varNr = 0; varNr < dataSource->getNumDataObjects(); varNr++) {
     const size_t s = dataSource->getDataObject(varNr)->cdfVariable->getSize();
     void *d = dataSource->getDataObject(varNr)->cdfVariable->data;
-    double fa = 0, fb = 0;
-    if (proc->attr.a.empty() == false) {
-      CT::string a;
-      a.copy(proc->attr.a.c_str());
-      fa = a.toDouble();
-    }
-    if (proc->attr.b.empty() == false) {
-      CT::string b;
-      b.copy(proc->attr.b.c_str());
-      fb = b.toDouble();
-    }
+    double fa, fb;
+    getClipRange(proc, fa, fb);
     switch (dataSource->getDataObject(0)->cdfVariable->getType()) {
     case CDF_CHAR:
       clipData((char *)d, s, fa, fb);
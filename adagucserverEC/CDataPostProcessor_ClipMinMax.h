@@ -15,6 +15,7 @@ public:
   virtual int isApplicable(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource);
   virtual int execute(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, int mode);
   virtual int execute(CServerConfig::XMLE_DataPostProc *, CDataSource *, int, double *, size_t) { return 1; } // TODO: Still need to implement
+  virtual int getElementOperations(CServerConfig::XMLE_DataPostProc *proc, CDataSource *dataSource, std::vector<CDPPElementOperation> &operations);
 };
 
 #endif
\ No newline at end of file
@@ -40,6 +40,8 @@
 #include "CReporter.h"
 #include "CCDFHDF5IO.h"
 #include "CDBFileScanner.h"
+#include "CImageWarper.h"
+#include "CMetrics.h"
 const char *CDataReader::className = "CDataReader";
 
 // #define CDATAREADER_DEBUG
@@ -674,6 +676,76 @@ void CDataReader::determineStride2DMap(CDataSource *dataSource) const {
   return;
 }
 
+bool CDataReader::selectOverview(CDataSource *dataSource) const {
+  CGeoParams *geo = dataSource->srvParams->Geo;
+  if (geo == NULL || geo->dWidth <= 0 || geo->dHeight <= 0 || dataSource->dfCellSizeX == 0 || dataSource->dfCellSizeY == 0) return false;
+
+  CImageWarper warper;
+  if (warper.initreproj(dataSource, geo, &dataSource->srvParams->cfg->Projection) != 0) return false;
+
+  /* Edge length of a map pixel in grid cells, sampled over the map, the finest sample counts */
+  double pixelW = (geo->dfBBOX[2] - geo->dfBBOX[0]) / geo->dWidth;
+  double pixelH = (geo->dfBBOX[3] - geo->dfBBOX[1]) / geo->dHeight;
+  double cellSizeX = fabs(dataSource->dfCellSizeX), cellSizeY = fabs(dataSource->dfCellSizeY);
+  double cellsPerPixel = -1;
+  for (int sy = 0; sy < CDATAREADER_OVERVIEW_SAMPLES; sy++) {
+    for (int sx = 0; sx < CDATAREADER_OVERVIEW_SAMPLES; sx++) {
+      double x0 = geo->dfBBOX[0] + (sx + 0.5) * (geo->dfBBOX[2] - geo->dfBBOX[0]) / CDATAREADER_OVERVIEW_SAMPLES;
+      double y0 = geo->dfBBOX[1] + (sy + 0.5) * (geo->dfBBOX[3] - geo->dfBBOX[1]) / CDATAREADER_OVERVIEW_SAMPLES;
+      double x1 = x0 + pixelW, y1 = y0, x2 = x0, y2 = y0 + pixelH;
+      if (warper.reprojpoint(x0, y0) != 0 || warper.reprojpoint(x1, y1) != 0 || warper.reprojpoint(x2, y2) != 0) continue;
+      double edgeX = hypot((x1 - x0) / cellSizeX, (y1 - y0) / cellSizeY);
+      double edgeY = hypot((x2 - x0) / cellSizeX, (y2 - y0) / cellSizeY);
+      double cells = std::min(edgeX, edgeY);
+      if (cells == cells && (cellsPerPixel < 0 || cells < cellsPerPixel)) cellsPerPixel = cells;
+    }
+  }
+  if (cellsPerPixel < 2) return false;
+
+  /* Pick the coarsest overview level of the first variable which is not coarser than a map pixel */
+  size_t numDataObjects = dataSource->getNumDataObjects();
+  std::vector<CDF::Variable *> overviews(numDataObjects, (CDF::Variable *)NULL);
+  double selectedFactor = 1;
+  for (size_t varNr = 0; varNr < numDataObjects; varNr++) {
+    CDF::Variable *var = dataSource->getDataObject(varNr)->cdfVariable;
+    CDF::Attribute *overviewsAttr = var->getAttributeNE(CDATAREADER_OVERVIEWS_ATTR);
+    if (overviewsAttr == NULL) return false;
+    CT::StackList<CT::string> overviewNames = overviewsAttr->toString().splitToStack(" ");
+    for (size_t j = 0; j < overviewNames.size(); j++) {
+      CDF::Variable *overview = dataSource->getDataObject(varNr)->cdfObject->getVariableNE(overviewNames[j].trim().c_str());
+      if (overview == NULL || overview->dimensionlinks.size() != var->dimensionlinks.size()) continue;
+      double factorX = double(var->dimensionlinks[dataSource->dimXIndex]->getSize()) / double(overview->dimensionlinks[dataSource->dimXIndex]->getSize());
+      double factorY = double(var->dimensionlinks[dataSource->dimYIndex]->getSize()) / double(overview->dimensionlinks[dataSource->dimYIndex]->getSize());
+      double factor = std::min(factorX, factorY);
+      if (varNr == 0) {
+        if (factor > selectedFactor && factor <= cellsPerPixel) {
+          selectedFactor = factor;
+          overviews[0] = overview;
+        }
+      } else if (fabs(factor - selectedFactor) < 0.01 * selectedFactor) {
+        overviews[varNr] = overview;
+      }
+    }
+    if (overviews[varNr] == NULL) return false;
+  }
+
+  /* Overviews inherit the attributes they do not define themselves, like scale_factor, _FillValue and grid_mapping */
+  for (size_t varNr = 0; varNr < numDataObjects; varNr++) {
+    CDF::Variable *var = dataSource->getDataObject(varNr)->cdfVariable;
+    CDF::Variable *overview = overviews[varNr];
+    for (size_t j = 0; j < var->attributes.size(); j++) {
+      if (!var->attributes[j]->name.equals(CDATAREADER_OVERVIEWS_ATTR) && overview->getAttributeNE(var->attributes[j]->name.c_str()) == NULL) {
+        overview->addAttribute(new CDF::Attribute(var->attributes[j]));
+      }
+    }
+#ifdef CDATAREADER_DEBUG
+    CDBDebug("Using overview %s with factor %f for %s", overview->name.c_str(), selectedFactor, var->name.c_str());
+#endif
+    dataSource->getDataObject(varNr)->cdfVariable = overview;
+  }
+  return true;
+}
+
 void CDataReader::determineDWidthAndDHeight(CDataSource *dataSource, const bool singleCellMode, const int *gridExtent, int mode) const {
 
   // Determine the width and height based on dimension length and stride.
@@ -748,6 +820,7 @@ pthread_mutex_t CDataReader_open_lock;
 int CDataReader::open(CDataSource *dataSource, int mode, int x, int y) { return open(dataSource, mode, x, y, NULL); }
 int CDataReader::openExtent(CDataSource *dataSource, int mode, int *gridExtent) { return open(dataSource, mode, -1, -1, gridExtent); }
 int CDataReader::open(CDataSource *dataSource, int mode, int x, int y, int *gridExtent) {
+  CMetrics::Timer timer(CMetrics::PHASE_READ);
 
   // Perform some checks on pointers
   if (dataSource == NULL) {
@@ -837,6 +910,18 @@ int CDataReader::open(CDataSource *dataSource, int mode, int x, int y, int *grid
 
   // TODO: Tot hier heb ik gecontroleerd op checker logica.
 
+  /* Zoomed out maps read the coarsest precomputed overview which still has the resolution of the map */
+  bool overviewMode = mode == CNETCDFREADER_MODE_OPEN_ALL || mode == CNETCDFREADER_MODE_OPEN_HEADER || mode == CNETCDFREADER_MODE_OPEN_EXTENT;
+  if (overviewMode && !singleCellMode && dataSource->srvParams->requestType == REQUEST_WMS_GETMAP && dataSource->getDataObject(0)->cdfVariable->getAttributeNE(CDATAREADER_OVERVIEWS_ATTR) != NULL) {
+    if (parseDimensions(dataSource, mode, x, y, NULL) != 0) {
+      CDBError("Unable to parseDimensions");
+      return 1;
+    }
+    dataSource->varX->freeData();
+    dataSource->varY->freeData();
+    if (!dataSource->formatConverterActive) selectOverview(dataSource);
+  }
+
   if (parseDimensions(dataSource, mode, x, y, gridExtent) != 0) {
     CDBError("Unable to parseDimensions");
     return 1;
@@ -43,6 +43,11 @@
 #include "CCache.h"
 
 #include "CAutoConfigure.h"
+
+/* Attribute listing the overview variables of a variable, and the number of samples per axis used to find the map resolution */
+#define CDATAREADER_OVERVIEWS_ATTR "overviews"
+#define CDATAREADER_OVERVIEW_SAMPLES 5
+
 class CDataReader {
 private:
   DEF_ERRORFUNCTION();
@@ -108,6 +113,15 @@ private:
    */
   void determineStride2DMap(CDataSource *dataSource) const;
 
+  /**
+   * Switches the data objects to a precomputed overview when the map is zoomed out far enough. Overviews are variables with the same dimensions
+   * as the variable, but with fewer cells along x and y. The variable lists them in its "overviews" attribute, separated by spaces.
+   * The coarsest overview which still has at least one cell per map pixel is chosen.
+   *
+   * Returns true when the data objects have been switched to an overview.
+   */
+  bool selectOverview(CDataSource *dataSource) const;
+
   /**
    * Determines the width and height based on stride. The width and height can be adjusted by passing a gridExtent.
    * When singleCellMode equals true, the width and height are set to a single cell.
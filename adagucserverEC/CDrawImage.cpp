@@ -57,6 +57,7 @@ CDrawImage::CDrawImage() {
     TTFFontLocation = strdup(fontLoc);
   }
   TTFFontSize = 9;
+  textKerning = false;
 
   BGColorR = 0;
   BGColorG = 0;
@@ -161,6 +162,7 @@ int CDrawImage::createImage(CGeoParams *_Geo) {
     } else {
       cairo = new CCairoPlotter(Geo->dWidth, Geo->dHeight, TTFFontSize, TTFFontLocation, 0, 0, 0, 0);
     }
+    cairo->setKerning(textKerning);
   }
   if (currentGraphicsRenderer == CDRAWIMAGERENDERER_GD) {
     image = gdImageCreate(Geo->dWidth, Geo->dHeight);
@@ -725,6 +727,32 @@ void CDrawImage::setPixelIndexed(int x, int y, int color) {
   }
 }
 
+void CDrawImage::setPixelIndexedSpan(int x, int y, int n, const short *colors) {
+  if (currentGraphicsRenderer == CDRAWIMAGERENDERER_CAIRO) {
+    if (currentLegend == NULL) return;
+    cairo->pixel_span_indexed(x, y, n, colors, currentLegend->CDIred, currentLegend->CDIgreen, currentLegend->CDIblue, currentLegend->CDIalpha);
+  } else {
+    for (int j = 0; j < n; j++) {
+      if (colors[j] >= 0) gdImageSetPixel(image, x + j, y, this->colors[colors[j]]);
+    }
+  }
+}
+
+void CDrawImage::fillPixelIndexedSpan(int x, int y, int n, int color) {
+  if (currentGraphicsRenderer == CDRAWIMAGERENDERER_CAIRO) {
+    if (currentLegend == NULL) return;
+    if (color < 0 || color > 255) return;
+    short alpha = currentLegend->CDIalpha[color];
+    if (alpha == 255) {
+      cairo->pixel_span_opaque(x, y, n, currentLegend->CDIred[color], currentLegend->CDIgreen[color], currentLegend->CDIblue[color]);
+    } else {
+      for (int j = 0; j < n; j++) setPixelIndexed(x + j, y, color);
+    }
+  } else {
+    for (int j = 0; j < n; j++) gdImageSetPixel(image, x + j, y, colors[color]);
+  }
+}
+
 void CDrawImage::getPixelTrueColor(int x, int y, unsigned char &r, unsigned char &g, unsigned char &b, unsigned char &a) {
   if (currentGraphicsRenderer == CDRAWIMAGERENDERER_CAIRO) {
     cairo->getPixel(x, y, r, g, b, a);
@@ -923,6 +951,7 @@ int CDrawImage::drawTextArea(int x, int y, const char *fontfile, float size, flo
   CT::string title = _text;
   int length = title.length();
   CCairoPlotter *ftTitle = new CCairoPlotter(Geo->dWidth, Geo->dHeight, (cairo->getByteBuffer()), size, fontfile);
+  ftTitle->setKerning(textKerning);
   float textY = 0;
   int width = Geo->dWidth - x;
   int widthOfText, heightOfText;
@@ -1072,6 +1101,7 @@ CCairoPlotter *CDrawImage::getCairoPlotter(const char *fontfile, float size, int
   std::map<CT::string, CCairoPlotter *>::iterator myCCairoPlotterIter = myCCairoPlotterMap.find(_key);
   if (myCCairoPlotterIter == myCCairoPlotterMap.end()) {
     CCairoPlotter *cairoPlotter = new CCairoPlotter(w, h, b, size, fontfile);
+    cairoPlotter->setKerning(textKerning);
     myCCairoPlotterMap[_key] = cairoPlotter;
     return cairoPlotter;
   } else {
@@ -1079,6 +1109,14 @@ CCairoPlotter *CDrawImage::getCairoPlotter(const char *fontfile, float size, int
   }
 }
 
+void CDrawImage::setTextKerning(bool enable) {
+  textKerning = enable;
+  if (cairo != NULL) cairo->setKerning(enable);
+  for (std::map<CT::string, CCairoPlotter *>::iterator it = myCCairoPlotterMap.begin(); it != myCCairoPlotterMap.end(); ++it) {
+    it->second->setKerning(enable);
+  }
+}
+
 void CDrawImage::drawCenteredText(int x, int y, const char *fontfile, float size, float angle, const char *text, CColor color) {
 
   if (currentGraphicsRenderer == CDRAWIMAGERENDERER_CAIRO) {
@@ -148,6 +148,7 @@ private:
   CCairoPlotter *cairo;
   const char *TTFFontLocation;
   float TTFFontSize;
+  bool textKerning;
   // char *fontConfig ;
 
   std::map<int, int> myColorMap;
@@ -222,6 +223,17 @@ public:
   void circle(int x, int y, int r, int color, float lineWidth);
   void circle(int x, int y, int r, CColor color, float lineWidth);
   void setPixelIndexed(int x, int y, int color);
+
+  /**
+   * Draws n pixels from (x,y) to the right with colors from the current legend, like setPixelIndexed.
+   * Negative color indices are skipped. Opaque legend colors are written without blending.
+   */
+  void setPixelIndexedSpan(int x, int y, int n, const short *colors);
+
+  /**
+   * Draws n pixels from (x,y) to the right with a single color from the current legend
+   */
+  void fillPixelIndexedSpan(int x, int y, int n, int color);
   void setPixelTrueColor(int x, int y, unsigned int color);
   void setPixelTrueColor(int x, int y, unsigned char r, unsigned char g, unsigned char b);
   void setPixelTrueColor(int x, int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
@@ -262,6 +274,12 @@ public:
 
   void setTTFFontLocation(const char *_TTFFontLocation) { TTFFontLocation = _TTFFontLocation; }
   void setTTFFontSize(float _TTFFontSize) { TTFFontSize = _TTFFontSize; }
+
+  /**
+   * Enables pair kerning from the font for text drawn with the cairo renderer from now on, off by default.
+   * Configured per style with <RenderSettings textkerning="true"/>.
+   */
+  void setTextKerning(bool enable);
   const char *getFontLocation();
   float getFontSize();
 
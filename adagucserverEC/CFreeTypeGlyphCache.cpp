@@ -0,0 +1,134 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CFreeTypeGlyphCache.h"
+#ifdef ADAGUC_USE_CAIRO
+#include <pthread.h>
+#include "CTString.h"
+
+const char *CFreeTypeGlyphCache::className = "CFreeTypeGlyphCache";
+const char *CFreeTypeGlyphCache::Font::className = "CFreeTypeGlyphCache::Font";
+
+static pthread_mutex_t CFreeTypeGlyphCache_lock = PTHREAD_MUTEX_INITIALIZER;
+static FT_Library CFreeTypeGlyphCache_library = NULL;
+static std::map<std::string, CFreeTypeGlyphCache::Font *> CFreeTypeGlyphCache_fonts;
+
+void CFreeTypeGlyphCache::lock() { pthread_mutex_lock(&CFreeTypeGlyphCache_lock); }
+void CFreeTypeGlyphCache::unlock() { pthread_mutex_unlock(&CFreeTypeGlyphCache_lock); }
+
+CFreeTypeGlyphCache::Font::~Font() {
+  for (std::map<unsigned long long, Glyph *>::iterator it = glyphs.begin(); it != glyphs.end(); ++it) delete it->second;
+  FT_Done_Face(face);
+}
+
+FT_UInt CFreeTypeGlyphCache::Font::getGlyphIndex(unsigned long charCode) {
+  std::map<unsigned long, FT_UInt>::iterator it = glyphIndices.find(charCode);
+  if (it != glyphIndices.end()) return it->second;
+  FT_UInt glyphIndex = FT_Get_Char_Index(face, charCode);
+  glyphIndices[charCode] = glyphIndex;
+  return glyphIndex;
+}
+
+const CFreeTypeGlyphCache::Glyph *CFreeTypeGlyphCache::Font::getGlyph(FT_UInt glyphIndex, FT_Pos penX, FT_Pos penY) {
+  /* The bitmap only depends on the subpixel part of the pen position, whole pixels are a plain translation */
+  FT_Pos phaseX = penX & 63;
+  FT_Pos phaseY = penY & 63;
+  unsigned long long key = ((unsigned long long)glyphIndex << 12) | (unsigned long long)(phaseX << 6) | (unsigned long long)phaseY;
+  std::map<unsigned long long, Glyph *>::iterator it = glyphs.find(key);
+  if (it != glyphs.end()) return it->second;
+
+  FT_Vector delta;
+  delta.x = phaseX;
+  delta.y = phaseY;
+  FT_Set_Transform(face, NULL, &delta);
+  int error = FT_Load_Glyph(face, glyphIndex, FT_LOAD_RENDER);
+  if (error) {
+    CDBError("Unable to render glyph %d", glyphIndex);
+    return NULL;
+  }
+  FT_GlyphSlot slot = face->glyph;
+  Glyph *glyph = new Glyph();
+  glyph->left = slot->bitmap_left;
+  glyph->top = slot->bitmap_top;
+  glyph->width = slot->bitmap.width;
+  glyph->rows = slot->bitmap.rows;
+  glyph->advanceX = slot->advance.x;
+  glyph->advanceY = slot->advance.y;
+  /* Copy row by row, FreeType bitmaps can be padded */
+  glyph->bitmap.resize(size_t(glyph->width) * glyph->rows);
+  for (int y = 0; y < glyph->rows; y++) {
+    for (int x = 0; x < glyph->width; x++) {
+      glyph->bitmap[x + y * glyph->width] = slot->bitmap.buffer[x + y * slot->bitmap.pitch];
+    }
+  }
+  glyphs[key] = glyph;
+  return glyph;
+}
+
+FT_Pos CFreeTypeGlyphCache::Font::getKerning(FT_UInt leftGlyphIndex, FT_UInt rightGlyphIndex) {
+  if (!FT_HAS_KERNING(face) || leftGlyphIndex == 0 || rightGlyphIndex == 0) return 0;
+  FT_Vector kerning;
+  if (FT_Get_Kerning(face, leftGlyphIndex, rightGlyphIndex, FT_KERNING_DEFAULT, &kerning) != 0) return 0;
+  return kerning.x;
+}
+
+CFreeTypeGlyphCache::Font *CFreeTypeGlyphCache::getFont(const char *fontLocation, float fontSize) {
+  CT::string key;
+  key.print("%s_%d", fontLocation, int(fontSize * 64));
+  std::map<std::string, Font *>::iterator it = CFreeTypeGlyphCache_fonts.find(key.c_str());
+  if (it != CFreeTypeGlyphCache_fonts.end()) return it->second;
+
+  if (CFreeTypeGlyphCache_library == NULL) {
+    if (FT_Init_FreeType(&CFreeTypeGlyphCache_library) != 0) {
+      CDBError("an error occurred during freetype library initialization");
+      CFreeTypeGlyphCache_library = NULL;
+      return NULL;
+    }
+  }
+  FT_Face face = NULL;
+  int error = FT_New_Face(CFreeTypeGlyphCache_library, fontLocation, 0, &face);
+  if (error == FT_Err_Unknown_File_Format) {
+    CDBError("the font file could be opened and read, but it appears that its font format is unsupported %s", fontLocation);
+    return NULL;
+  } else if (error) {
+    CDBError("Unable to initialize freetype: Could not read fontfile %s", fontLocation);
+    return NULL;
+  }
+  error = FT_Set_Char_Size(face,               /* handle to face object */
+                           0,                  /* char_width in 1/64th of points */
+                           int(fontSize * 64), /* char_height in 1/64th of points */
+                           100,                /* horizontal device resolution */
+                           100);               /* vertical device resolution */
+  if (error) {
+    CDBError("unable to set character size");
+    FT_Done_Face(face);
+    return NULL;
+  }
+  Font *font = new Font(face);
+  CFreeTypeGlyphCache_fonts[key.c_str()] = font;
+  return font;
+}
+
+#endif
@@ -0,0 +1,106 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "Definitions.h"
+#ifdef ADAGUC_USE_CAIRO
+
+#ifndef CFREETYPEGLYPHCACHE_H
+#define CFREETYPEGLYPHCACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "CDebugger.h"
+
+/**
+ * @brief Process wide cache of FreeType faces and rendered glyphs, shared by all CCairoPlotter instances.
+ * Faces are kept per font file and size, glyphs per glyph index and subpixel pen offset, so a cached bitmap is
+ * identical to what FT_Load_Glyph would render at that position. Only upright glyphs are cached.
+ */
+class CFreeTypeGlyphCache {
+private:
+  DEF_ERRORFUNCTION();
+
+public:
+  /**
+   * @brief A rendered glyph, positioned relative to the integer pen position
+   */
+  class Glyph {
+  public:
+    int left, top, width, rows;
+    FT_Pos advanceX, advanceY;
+    std::vector<unsigned char> bitmap;
+  };
+
+  /**
+   * @brief A face at one size with its rendered glyphs
+   */
+  class Font {
+  private:
+    DEF_ERRORFUNCTION();
+    std::map<unsigned long long, Glyph *> glyphs;
+    std::map<unsigned long, FT_UInt> glyphIndices;
+
+  public:
+    FT_Face face;
+    Font(FT_Face face) { this->face = face; }
+    ~Font();
+
+    /**
+     * @brief Returns the glyph index for a character code, the lookups are cached
+     */
+    FT_UInt getGlyphIndex(unsigned long charCode);
+
+    /**
+     * @brief Returns the rendered glyph, or NULL when FreeType fails to render it
+     *
+     * @param glyphIndex Index from getGlyphIndex
+     * @param penX Pen x position in 26.6 format, only the subpixel part is used
+     * @param penY Pen y position in 26.6 format, only the subpixel part is used
+     */
+    const Glyph *getGlyph(FT_UInt glyphIndex, FT_Pos penX, FT_Pos penY);
+
+    /**
+     * @brief Returns the kerning between two glyphs in 26.6 format, zero when the face has no kerning
+     */
+    FT_Pos getKerning(FT_UInt leftGlyphIndex, FT_UInt rightGlyphIndex);
+  };
+
+  /**
+   * @brief Returns the font for a font file and size, loaded on first use. Returns NULL when the font cannot be loaded.
+   */
+  static Font *getFont(const char *fontLocation, float fontSize);
+
+  /**
+   * @brief Locks the cache, FreeType faces are not thread safe. Hold the lock while using a font or its glyphs.
+   */
+  static void lock();
+  static void unlock();
+};
+
+#endif
+#endif
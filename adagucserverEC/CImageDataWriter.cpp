@@ -37,6 +37,7 @@
 #include "CReporter.h"
 #include "CImgWarpHillShaded.h"
 #include "CImgWarpGeneric.h"
+#include "CMetrics.h"
 #ifndef M_PI
 #define M_PI 3.14159265358979323846 // pi
 #endif
@@ -1350,8 +1351,71 @@ std::vector<CImageDataWriter::IndexRange> CImageDataWriter::getIndexRangesForReg
   return ranges;
 }
 
+bool CImageDataWriter::findGridExtent(CDataSource *dataSource, int *gridExtent) {
+  /* Converted formats, longitude swapped grids and autoscaled legends need the whole grid */
+  if (dataSource->formatConverterActive || dataSource->useLonTransformation != -1 || dataSource->swapXYDimensions || dataSource->stretchMinMax) return false;
+  if (dataSource->dWidth <= 0 || dataSource->dHeight <= 0 || dataSource->nativeProj4.empty()) return false;
+  /* Contours, shading and hillshading are cached on the full grid and traced across it, a partial grid would give seams and cache misses */
+  CStyleConfiguration *styleConfiguration = dataSource->getStyle();
+  if (styleConfiguration != NULL && (styleConfiguration->renderMethod & (RM_CONTOUR | RM_SHADED | RM_HILLSHADED))) return false;
+  CDF::Variable *dataSourceVar = dataSource->getDataObject(0)->cdfVariable;
+  CT::string dimensionXName = dataSourceVar->dimensionlinks[dataSource->dimXIndex]->name.c_str();
+  dimensionXName.toLowerCaseSelf();
+  if (dimensionXName.equals("col")) return false;
+
+  CImageWarper warper;
+  if (warper.initreproj(dataSource, srvParam->Geo, &srvParam->cfg->Projection) != 0) return false;
+
+  CGeoParams sourceGeo;
+  sourceGeo.dWidth = dataSource->dWidth;
+  sourceGeo.dHeight = dataSource->dHeight;
+  for (int j = 0; j < 4; j++) sourceGeo.dfBBOX[j] = dataSource->dfBBOX[j];
+  sourceGeo.dfCellSizeX = dataSource->dfCellSizeX;
+  sourceGeo.dfCellSizeY = dataSource->dfCellSizeY;
+  sourceGeo.CRS = dataSource->nativeProj4;
+  int extent[4];
+  GenericDataWarper::findPixelExtent(extent, &sourceGeo, srvParam->Geo, &warper);
+  if (extent[0] == -1) return false;
+
+  /* A pole inside the map is a whole row of a lat/lon grid, findPixelExtent only samples a few of its longitudes */
+  if (CGeoParams::isLonLatProjection(&dataSource->nativeProj4)) {
+    double mapMinX = std::min(srvParam->Geo->dfBBOX[0], srvParam->Geo->dfBBOX[2]), mapMaxX = std::max(srvParam->Geo->dfBBOX[0], srvParam->Geo->dfBBOX[2]);
+    double mapMinY = std::min(srvParam->Geo->dfBBOX[1], srvParam->Geo->dfBBOX[3]), mapMaxY = std::max(srvParam->Geo->dfBBOX[1], srvParam->Geo->dfBBOX[3]);
+    for (int pole = -1; pole <= 1; pole += 2) {
+      double poleX = 0, poleY = 90 * pole;
+      if (warper.reprojfromLatLon(poleX, poleY) != 0 || poleX < mapMinX || poleX > mapMaxX || poleY < mapMinY || poleY > mapMaxY) continue;
+      int poleRow = int(((90 * pole) - dataSource->dfBBOX[3]) / (dataSource->dfBBOX[1] - dataSource->dfBBOX[3]) * dataSource->dHeight);
+      extent[0] = 0;
+      extent[2] = dataSource->dWidth;
+      extent[1] = std::max(0, std::min(extent[1], poleRow));
+      extent[3] = std::min(dataSource->dHeight, std::max(extent[3], poleRow + 1));
+    }
+  }
+
+  /* The extent is sampled, pad it for curved edges in between the samples and for the neighbours used by the bilinear renderer and its smoothing filter */
+  int smoothingPad = styleConfiguration != NULL ? styleConfiguration->smoothingFilter : 0;
+  int padX = (extent[2] - extent[0]) / 16 + 2 + smoothingPad;
+  int padY = (extent[3] - extent[1]) / 16 + 2 + smoothingPad;
+  extent[0] = std::max(0, extent[0] - padX);
+  extent[1] = std::max(0, extent[1] - padY);
+  extent[2] = std::min(dataSource->dWidth, extent[2] + padX);
+  extent[3] = std::min(dataSource->dHeight, extent[3] + padY);
+  if (extent[2] - extent[0] < 2 || extent[3] - extent[1] < 2) return false;
+
+  /* The reader expects indices in the full resolution grid, the header has been read with the stride */
+  size_t fullWidth = dataSourceVar->dimensionlinks[dataSource->dimXIndex]->getSize();
+  size_t fullHeight = dataSourceVar->dimensionlinks[dataSource->dimYIndex]->getSize();
+  int stride = dataSource->stride2DMap;
+  gridExtent[0] = extent[0] * stride;
+  gridExtent[1] = extent[1] * stride;
+  gridExtent[2] = std::min(int(fullWidth), extent[2] * stride);
+  gridExtent[3] = std::min(int(fullHeight), extent[3] * stride);
+  return true;
+}
+
 pthread_mutex_t CImageDataWriter_addData_lock;
 int CImageDataWriter::warpImage(CDataSource *dataSource, CDrawImage *drawImage) {
+  CMetrics::Timer timer(CMetrics::PHASE_WARP);
 
   // Open the data of this dataSource
   int status = 0;
@@ -1365,33 +1429,14 @@ int CImageDataWriter::warpImage(CDataSource *dataSource, CDrawImage *drawImage)
   StopWatch_Stop("Thread[%d]: start Opening grid", dataSource->threadNr);
 #endif
 
-  bool usePixelExtent = false;
-  if (usePixelExtent) {
-
-    status = reader.open(dataSource, CNETCDFREADER_MODE_OPEN_HEADER);
-    CImageWarper warper;
-
-    status = warper.initreproj(dataSource, srvParam->Geo, &srvParam->cfg->Projection);
-    if (status != 0) {
-      CDBError("Unable to initialize projection");
-      return 1;
-    }
-
-    CGeoParams sourceGeo;
-
-    sourceGeo.dWidth = dataSource->dWidth;
-    sourceGeo.dHeight = dataSource->dHeight;
-    sourceGeo.dfBBOX[0] = dataSource->dfBBOX[0];
-    sourceGeo.dfBBOX[1] = dataSource->dfBBOX[1];
-    sourceGeo.dfBBOX[2] = dataSource->dfBBOX[2];
-    sourceGeo.dfBBOX[3] = dataSource->dfBBOX[3];
-    sourceGeo.dfCellSizeX = dataSource->dfCellSizeX;
-    sourceGeo.dfCellSizeY = dataSource->dfCellSizeY;
-    sourceGeo.CRS = dataSource->nativeProj4;
-    int PXExtentBasedOnSource[4];
-    GenericDataWarper::findPixelExtent(PXExtentBasedOnSource, &sourceGeo, srvParam->Geo, &warper);
-
-    status = reader.openExtent(dataSource, CNETCDFREADER_MODE_OPEN_EXTENT, PXExtentBasedOnSource);
+  /* Only read the part of the grid which is visible in the map */
+  status = reader.open(dataSource, CNETCDFREADER_MODE_OPEN_HEADER);
+  int gridExtent[4];
+  if (status == 0 && findGridExtent(dataSource, gridExtent)) {
+#ifdef CIMAGEDATAWRITER_DEBUG
+    CDBDebug("Thread[%d]: Opening extent [%d, %d, %d, %d]", dataSource->threadNr, gridExtent[0], gridExtent[1], gridExtent[2], gridExtent[3]);
+#endif
+    status = reader.openExtent(dataSource, CNETCDFREADER_MODE_OPEN_EXTENT, gridExtent);
   } else {
     status = reader.open(dataSource, CNETCDFREADER_MODE_OPEN_ALL);
   }
@@ -1539,6 +1584,12 @@ int CImageDataWriter::warpImage(CDataSource *dataSource, CDrawImage *drawImage)
       if (drawShaded == true) bilinearSettings.printconcat("drawShaded=true;");
       if (drawContour == true) bilinearSettings.printconcat("drawContour=true;");
       if (drawGridVectors) bilinearSettings.printconcat("drawGridVectors=true;");
+      if (drawContour == true && styleConfiguration->styleConfig != NULL && styleConfiguration->styleConfig->RenderSettings.size() == 1) {
+        if (styleConfiguration->styleConfig->RenderSettings[0]->attr.contourmethod.equals("marchingsquares")) bilinearSettings.printconcat("contourMethod=marchingsquares;");
+      }
+      if (styleConfiguration->styleConfig != NULL && styleConfiguration->styleConfig->RenderSettings.size() == 1) {
+        if (styleConfiguration->styleConfig->RenderSettings[0]->attr.bilinearmethod.equals("affine")) bilinearSettings.printconcat("bilinearMethod=affine;");
+      }
       bilinearSettings.printconcat("smoothingFilter=%d;", styleConfiguration->smoothingFilter);
       if (drawShaded == true || drawContour == true) {
         bilinearSettings.printconcat("shadeInterval=%0.12f;contourBigInterval=%0.12f;contourSmallInterval=%0.12f;", styleConfiguration->shadeInterval, styleConfiguration->contourIntervalH,
@@ -1991,6 +2042,14 @@ int CImageDataWriter::addData(std::vector<CDataSource *> &dataSources) {
       CDBDebug("Start warping");
 #endif
 
+      /* Labels, point values and contour texts of this layer use the kerning setting of its style */
+      bool textKerning = false;
+      CStyleConfiguration *layerStyle = dataSource->getStyle();
+      if (layerStyle != NULL && layerStyle->styleConfig != NULL && layerStyle->styleConfig->RenderSettings.size() == 1) {
+        textKerning = layerStyle->styleConfig->RenderSettings[0]->attr.textkerning.equals("true");
+      }
+      drawImage.setTextKerning(textKerning);
+
       status = warpImage(dataSource, &drawImage);
 
 #ifdef CIMAGEDATAWRITER_DEBUG
@@ -3392,36 +3451,39 @@ int CImageDataWriter::end() {
   // Static image
   // CDBDebug("srvParam->imageFormat = %d",srvParam->imageFormat);
   int status = 1;
-  if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG8) {
-    CDBDebug("Creating 8 bit png with alpha");
-    printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
-    status = drawImage.printImagePng8(true);
-  } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG8_NOALPHA) {
-    CDBDebug("Creating 8 bit png without alpha");
-    printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
-    status = drawImage.printImagePng8(false);
-  } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG24) {
-    CDBDebug("Creating 24 bit png");
-    printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
-    status = drawImage.printImagePng24();
-  } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG32) {
-    CDBDebug("Creating 32 bit png");
-    printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
-    status = drawImage.printImagePng32();
-  } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEWEBP) {
-    CDBDebug("Creating 32 bit webp");
-    printf("%s%c%c\n", "Content-Type:image/webp", 13, 10);
-    status = drawImage.printImageWebP32(srvParam->imageQuality);
-  } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEGIF) {
-    // CDBDebug("LegendGraphic GIF");
-    if (animation == 0) {
-      printf("%s%c%c\n", "Content-Type:image/gif", 13, 10);
+  {
+    CMetrics::Timer timer(CMetrics::PHASE_ENCODE);
+    if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG8) {
+      CDBDebug("Creating 8 bit png with alpha");
+      printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
+      status = drawImage.printImagePng8(true);
+    } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG8_NOALPHA) {
+      CDBDebug("Creating 8 bit png without alpha");
+      printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
+      status = drawImage.printImagePng8(false);
+    } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG24) {
+      CDBDebug("Creating 24 bit png");
+      printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
+      status = drawImage.printImagePng24();
+    } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEPNG32) {
+      CDBDebug("Creating 32 bit png");
+      printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
+      status = drawImage.printImagePng32();
+    } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEWEBP) {
+      CDBDebug("Creating 32 bit webp");
+      printf("%s%c%c\n", "Content-Type:image/webp", 13, 10);
+      status = drawImage.printImageWebP32(srvParam->imageQuality);
+    } else if (srvParam->imageFormat == IMAGEFORMAT_IMAGEGIF) {
+      // CDBDebug("LegendGraphic GIF");
+      if (animation == 0) {
+        printf("%s%c%c\n", "Content-Type:image/gif", 13, 10);
+      }
+      status = drawImage.printImageGif();
+    } else {
+      // CDBDebug("LegendGraphic PNG");
+      printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
+      status = drawImage.printImagePng8(true);
     }
-    status = drawImage.printImageGif();
-  } else {
-    // CDBDebug("LegendGraphic PNG");
-    printf("%s%c%c\n", "Content-Type:image/png", 13, 10);
-    status = drawImage.printImagePng8(true);
   }
 
 #ifdef MEASURETIME
@@ -3701,4 +3763,6 @@ void rotateUvNorth(double &u, double &v, double rlo, double rla, float deltaX, f
   v = vv * magnitude / newMagnitude;
 }
 
-int CImageDataWriter::createScaleBar(CGeoParams *geoParams, CDrawImage *scaleBarImage, float scaling) { return CCreateScaleBar::createScaleBar(scaleBarImage, geoParams, scaling); }
+int CImageDataWriter::createScaleBar(CGeoParams *geoParams, CDrawImage *scaleBarImage, float scaling, CServerParams *srvParams) {
+  return CCreateScaleBar::createScaleBar(scaleBarImage, geoParams, scaling, srvParams);
+}
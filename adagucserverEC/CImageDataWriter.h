@@ -121,6 +121,12 @@ private:
 
   int warpImage(CDataSource *sourceImage, CDrawImage *drawImage);
 
+  /**
+   * @brief Finds the part of the source grid which is needed to draw the map, in grid indices of the full grid (x0, y0, x1, y1)
+   * The header of the dataSource needs to be opened. Returns false when the whole grid needs to be read.
+   */
+  bool findGridExtent(CDataSource *dataSource, int *gridExtent);
+
   CServerParams *srvParam;
 
   enum ImageDataWriterStatus { uninitialized, initialized, finished };
@@ -163,7 +169,7 @@ public:
   static int createLegend(CDataSource *sourceImage, CDrawImage *legendImage);
   static int createLegend(CDataSource *sourceImage, CDrawImage *legendImage, bool rotate);
 
-  static int createScaleBar(CGeoParams *geoParams, CDrawImage *scaleBarImage, float scaling);
+  static int createScaleBar(CGeoParams *geoParams, CDrawImage *scaleBarImage, float scaling, CServerParams *srvParams);
 
   int getFeatureInfo(std::vector<CDataSource *> dataSources, int dataSourceIndex, int dX, int dY);
   int createAnimation();
@@ -26,9 +26,11 @@
 #include "CImageWarper.h"
 #include <iostream>
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <pthread.h>
 const char *CImageWarper::className = "CImageWarper";
 
-extern ProjectionStore projectionStore;
 ProjectionStore projectionStore;
 ProjectionStore *ProjectionStore::getProjectionStore() { return &projectionStore; }
 
@@ -38,10 +40,8 @@ ProjectionStore *ProjectionStore::getProjectionStore() { return &projectionStore
 //   return &imageWarper;
 // }
 
-ProjectionKey::ProjectionKey() {}
-pthread_mutex_t ProjectionKey_ProjectionKey;
+ProjectionKey::ProjectionKey() { next = NULL; }
 ProjectionKey::ProjectionKey(double *_box, double *_dfMaxExtent, CT::string source, CT::string dest) {
-  pthread_mutex_lock(&ProjectionKey_ProjectionKey);
   for (int j = 0; j < 4; j++) {
     bbox[j] = _box[j];
     dfMaxExtent[j] = _dfMaxExtent[j];
@@ -49,27 +49,129 @@ ProjectionKey::ProjectionKey(double *_box, double *_dfMaxExtent, CT::string sour
   sourceCRS = source;
   destinationCRS = dest;
   isSet = false;
-  pthread_mutex_unlock(&ProjectionKey_ProjectionKey);
+  next = NULL;
 }
 
-pthread_mutex_t ProjectionKey_setFoundExtent;
 void ProjectionKey::setFoundExtent(double *_foundExtent) {
-  pthread_mutex_lock(&ProjectionKey_setFoundExtent);
   for (int j = 0; j < 4; j++) {
     foundExtent[j] = _foundExtent[j];
   }
   isSet = true;
-  pthread_mutex_unlock(&ProjectionKey_setFoundExtent);
 }
 
-ProjectionStore::ProjectionStore() {}
+ProjectionStore::ProjectionStore() { head.store(NULL); }
 ProjectionStore::~ProjectionStore() { clear(); }
 
-pthread_mutex_t ProjectionKey_clear;
+const ProjectionKey *ProjectionStore::find(const double *bbox, const char *sourceCRS, const char *destinationCRS) {
+  for (const ProjectionKey *key = head.load(std::memory_order_acquire); key != NULL; key = key->next) {
+    if (key->isSet && key->bbox[0] == bbox[0] && key->bbox[1] == bbox[1] && key->bbox[2] == bbox[2] && key->bbox[3] == bbox[3] && key->destinationCRS.equals(destinationCRS) &&
+        key->sourceCRS.equals(sourceCRS)) {
+      return key;
+    }
+  }
+  return NULL;
+}
+
+void ProjectionStore::add(ProjectionKey *key) {
+  ProjectionKey *currentHead = head.load(std::memory_order_relaxed);
+  do {
+    key->next = currentHead;
+  } while (!head.compare_exchange_weak(currentHead, key, std::memory_order_release, std::memory_order_relaxed));
+}
+
 void ProjectionStore::clear() {
-  pthread_mutex_lock(&ProjectionKey_clear);
-  keys.clear();
-  pthread_mutex_unlock(&ProjectionKey_clear);
+  ProjectionKey *key = head.exchange(NULL);
+  while (key != NULL) {
+    ProjectionKey *next = key->next;
+    delete key;
+    key = next;
+  }
+}
+
+/* Maximum number of proj handles kept per thread, least recently used handles which are not in use by a warper are freed first */
+#define CIMAGEWARPER_MAX_THREAD_PROJECTIONS 16
+
+/*
+  Initialized proj handles are cached per thread, because a proj context and the handles created with it may only be used
+  by one thread at a time. Warpers of the same thread share the handles, so initreproj costs a lookup after the first time.
+*/
+class CImageWarperThreadProjections {
+public:
+  class Projection {
+  public:
+    projPJ projection;
+    int users;
+    unsigned long lastUsed;
+  };
+  projCtx context;
+  unsigned long useCounter;
+  std::unordered_map<std::string, Projection> projections;
+  CImageWarperThreadProjections() {
+    context = pj_ctx_alloc();
+    useCounter = 0;
+  }
+  ~CImageWarperThreadProjections() {
+    for (std::unordered_map<std::string, Projection>::iterator it = projections.begin(); it != projections.end(); ++it) {
+      pj_free(it->second.projection);
+    }
+    pj_ctx_free(context);
+  }
+};
+
+static pthread_key_t CImageWarper_threadProjectionsKey;
+static pthread_once_t CImageWarper_threadProjectionsOnce = PTHREAD_ONCE_INIT;
+
+static void deleteThreadProjections(void *threadProjections) { delete (CImageWarperThreadProjections *)threadProjections; }
+static void createThreadProjectionsKey() { pthread_key_create(&CImageWarper_threadProjectionsKey, deleteThreadProjections); }
+
+static CImageWarperThreadProjections *getThreadProjections() {
+  pthread_once(&CImageWarper_threadProjectionsOnce, createThreadProjectionsKey);
+  CImageWarperThreadProjections *threadProjections = (CImageWarperThreadProjections *)pthread_getspecific(CImageWarper_threadProjectionsKey);
+  if (threadProjections == NULL) {
+    threadProjections = new CImageWarperThreadProjections();
+    pthread_setspecific(CImageWarper_threadProjectionsKey, threadProjections);
+  }
+  return threadProjections;
+}
+
+/* Returns the cached handle for projString of the calling thread, NULL when the projection is invalid. Release it with releaseThreadProjection. */
+static projPJ getThreadProjection(CImageWarperThreadProjections *threadProjections, const char *projString) {
+  std::unordered_map<std::string, CImageWarperThreadProjections::Projection> &projections = threadProjections->projections;
+  std::unordered_map<std::string, CImageWarperThreadProjections::Projection>::iterator it = projections.find(projString);
+  if (it != projections.end()) {
+    it->second.users++;
+    it->second.lastUsed = ++threadProjections->useCounter;
+    return it->second.projection;
+  }
+  projPJ projection = pj_init_plus_ctx(threadProjections->context, projString);
+  if (projection == NULL) return NULL;
+
+  /* Make room by freeing the least recently used handles which no warper uses anymore */
+  while (projections.size() >= CIMAGEWARPER_MAX_THREAD_PROJECTIONS) {
+    std::unordered_map<std::string, CImageWarperThreadProjections::Projection>::iterator oldest = projections.end();
+    for (it = projections.begin(); it != projections.end(); ++it) {
+      if (it->second.users == 0 && (oldest == projections.end() || it->second.lastUsed < oldest->second.lastUsed)) oldest = it;
+    }
+    if (oldest == projections.end()) break;
+    pj_free(oldest->second.projection);
+    projections.erase(oldest);
+  }
+  CImageWarperThreadProjections::Projection &entry = projections[projString];
+  entry.projection = projection;
+  entry.users = 1;
+  entry.lastUsed = ++threadProjections->useCounter;
+  return projection;
+}
+
+/* Marks a handle returned by getThreadProjection as no longer used by the warper, it stays cached until it is evicted */
+static void releaseThreadProjection(CImageWarperThreadProjections *threadProjections, projPJ projection) {
+  std::unordered_map<std::string, CImageWarperThreadProjections::Projection>::iterator it;
+  for (it = threadProjections->projections.begin(); it != threadProjections->projections.end(); ++it) {
+    if (it->second.projection == projection) {
+      it->second.users--;
+      return;
+    }
+  }
 }
 
 void floatToString(char *string, size_t maxlen, int numdigits, float number) {
@@ -107,24 +209,17 @@ void floatToString(char *string, size_t maxlen, float min, float max, float numb
 }
 
 int CImageWarper::closereproj() {
-  if (initialized) {
-    if (sourcepj != NULL) {
-      pj_free(sourcepj);
-      sourcepj = NULL;
-    }
-    if (destpj != NULL) {
-      pj_free(destpj);
-      destpj = NULL;
-    }
-    if (latlonpj != NULL) {
-      pj_free(latlonpj);
-      latlonpj = NULL;
-    }
-    if (proj4Context != NULL) {
-      pj_ctx_free(proj4Context);
-      proj4Context = NULL;
-    }
-  }
+  /* The projections belong to the thread projection cache, they are only released */
+  if (threadProjections != NULL) {
+    if (sourcepj != NULL) releaseThreadProjection(threadProjections, sourcepj);
+    if (destpj != NULL) releaseThreadProjection(threadProjections, destpj);
+    if (latlonpj != NULL) releaseThreadProjection(threadProjections, latlonpj);
+  }
+  threadProjections = NULL;
+  sourcepj = NULL;
+  destpj = NULL;
+  latlonpj = NULL;
+  proj4Context = NULL;
   initialized = false;
   return 0;
 }
@@ -207,6 +302,54 @@ int CImageWarper::reprojfromLatLon(double &dfx, double &dfy) {
   return 0;
 }
 
+#define CIMAGEWARPER_REPROJBATCHSIZE 4096
+
+size_t CImageWarper::reprojfromLatLon(double *dfx, double *dfy, size_t count, unsigned char *failed) {
+  size_t numFailed = 0;
+  double orgX[CIMAGEWARPER_REPROJBATCHSIZE], orgY[CIMAGEWARPER_REPROJBATCHSIZE];
+  for (size_t start = 0; start < count; start += CIMAGEWARPER_REPROJBATCHSIZE) {
+    size_t batchSize = std::min(count - start, (size_t)CIMAGEWARPER_REPROJBATCHSIZE);
+    double *x = dfx + start;
+    double *y = dfy + start;
+    unsigned char *batchFailed = failed + start;
+    for (size_t j = 0; j < batchSize; j++) {
+      orgX[j] = x[j];
+      orgY[j] = y[j];
+      /* pj_transform skips points set to HUGE_VAL */
+      batchFailed[j] = x[j] < -180 || x[j] > 180 || y[j] < -90 || y[j] > 90 || x[j] != x[j] || y[j] != y[j];
+      if (batchFailed[j]) {
+        x[j] = HUGE_VAL;
+        y[j] = HUGE_VAL;
+      } else {
+        x[j] *= DEG_TO_RAD;
+        y[j] *= DEG_TO_RAD;
+      }
+    }
+    if (pj_transform(latlonpj, destpj, batchSize, 1, x, y, NULL) != 0) {
+      /* A failure of the batch does not tell which point failed, redo this batch point by point */
+      for (size_t j = 0; j < batchSize; j++) {
+        x[j] = orgX[j];
+        y[j] = orgY[j];
+        batchFailed[j] = reprojfromLatLon(x[j], y[j]) != 0;
+        if (batchFailed[j]) numFailed++;
+      }
+      continue;
+    }
+    for (size_t j = 0; j < batchSize; j++) {
+      if (batchFailed[j] || x[j] != x[j] || y[j] != y[j] || x[j] == HUGE_VAL || y[j] == HUGE_VAL) {
+        batchFailed[j] = 1;
+        x[j] = 0;
+        y[j] = 0;
+        numFailed++;
+      } else if (destNeedsDegreeRadianConversion) {
+        x[j] /= DEG_TO_RAD;
+        y[j] /= DEG_TO_RAD;
+      }
+    }
+  }
+  return numFailed;
+}
+
 int CImageWarper::reprojModelToLatLon(double &dfx, double &dfy) {
   if (sourceNeedsDegreeRadianConversion) {
     dfx *= DEG_TO_RAD;
@@ -345,14 +488,7 @@ int CImageWarper::initreproj(CDataSource *dataSource, CGeoParams *GeoDest, std::
   return initreproj(dataSource->nativeProj4.c_str(), GeoDest, _prj);
 }
 
-pthread_mutex_t CImageWarper_initreproj;
 int CImageWarper::initreproj(const char *projString, CGeoParams *GeoDest, std::vector<CServerConfig::XMLE_Projection *> *_prj) {
-  pthread_mutex_lock(&CImageWarper_initreproj);
-  int status = _initreprojSynchronized(projString, GeoDest, _prj);
-  pthread_mutex_unlock(&CImageWarper_initreproj);
-  return status;
-}
-int CImageWarper::_initreprojSynchronized(const char *projString, CGeoParams *GeoDest, std::vector<CServerConfig::XMLE_Projection *> *_prj) {
 
   if (projString == NULL) {
     projString = LATLONPROJECTION;
@@ -365,10 +501,10 @@ int CImageWarper::_initreprojSynchronized(const char *projString, CGeoParams *Ge
 
   this->_geoDest = GeoDest;
 
-  if (proj4Context != NULL) {
-    pj_ctx_free(proj4Context);
-  }
-  proj4Context = pj_ctx_alloc();
+  /* Release the projections of a previous initreproj */
+  closereproj();
+  threadProjections = getThreadProjections();
+  proj4Context = threadProjections->context;
 
   CT::string sourceProjectionUndec = projString;
   CT::string sourceProjection = projString;
@@ -379,7 +515,7 @@ int CImageWarper::_initreprojSynchronized(const char *projString, CGeoParams *Ge
 
   //    CDBDebug("sourceProjectionUndec %s, sourceProjection %s",sourceProjection.c_str(),sourceProjectionUndec.c_str());
 
-  if (!(sourcepj = pj_init_plus_ctx(proj4Context, sourceProjection.c_str()))) {
+  if (!(sourcepj = getThreadProjection(threadProjections, sourceProjection.c_str()))) {
     CDBError("SetSourceProjection: Invalid projection: %s", sourceProjection.c_str());
     return 1;
   }
@@ -387,7 +523,7 @@ int CImageWarper::_initreprojSynchronized(const char *projString, CGeoParams *Ge
     CDBError("SetSourceProjection: Invalid projection: %s", sourceProjection.c_str());
     return 1;
   }
-  if (!(latlonpj = pj_init_plus_ctx(proj4Context, LATLONPROJECTION))) {
+  if (!(latlonpj = getThreadProjection(threadProjections, LATLONPROJECTION))) {
     CDBError("SetLatLonProjection: Invalid projection: %s", LATLONPROJECTION);
     return 1;
   }
@@ -397,7 +533,7 @@ int CImageWarper::_initreprojSynchronized(const char *projString, CGeoParams *Ge
     return 1;
   }
 
-  if (!(destpj = pj_init_plus_ctx(proj4Context, destinationCRS.c_str()))) {
+  if (!(destpj = getThreadProjection(threadProjections, destinationCRS.c_str()))) {
     CDBError("SetDestProjection: Invalid projection: %s", destinationCRS.c_str());
     return 1;
   }
@@ -431,15 +567,7 @@ int CImageWarper::_initreprojSynchronized(const char *projString, CGeoParams *Ge
   return 0;
 }
 
-pthread_mutex_t CImageWarper_findExtent;
 int CImageWarper::findExtent(CDataSource *dataSource, double *dfBBOX) {
-  pthread_mutex_lock(&CImageWarper_findExtent);
-  int status = _findExtentSynchronized(dataSource, dfBBOX);
-  pthread_mutex_unlock(&CImageWarper_findExtent);
-  return status;
-}
-
-int CImageWarper::_findExtentSynchronized(CDataSource *dataSource, double *dfBBOX) {
   // Find the outermost corners of the image
 
   // CDBDebug("findExtent for %s",destinationCRS.c_str());
@@ -465,36 +593,14 @@ int CImageWarper::_findExtentSynchronized(CDataSource *dataSource, double *dfBBO
     }
   }
 
-  ProjectionKey pKey(dfBBOX, dfMaxExtent, sourceCRSString, destinationCRS);
-
-  for (size_t j = 0; j < projectionStore.keys.size(); j++) {
-    if (projectionStore.keys[j].isSet == true) {
-      bool match = true;
-      if (!projectionStore.keys[j].destinationCRS.equals(pKey.destinationCRS.c_str())) match = false;
-      // if(!match){CDBDebug("DESTCRS DO NOT MATCH %s",pKey.destinationCRS.c_str());}
-      if (match) {
-        for (int i = 0; i < 4; i++) {
-          if (projectionStore.keys[j].bbox[i] != pKey.bbox[i]) {
-            // CDBDebug("%f != %f",projectionStore.keys[j].bbox[i],pKey.bbox[i]);
-            match = false;
-            break;
-          }
-        }
-        // if(!match){CDBDebug("BBOX DO NOT MATCH");}
-        if (match) {
-          if (!projectionStore.keys[j].sourceCRS.equals(pKey.sourceCRS.c_str())) match = false;
-          // if(!match){CDBDebug("SOURCECRS DO NOT MATCH");}
-          if (match) {
-            for (int i = 0; i < 4; i++) {
-              dfBBOX[i] = projectionStore.keys[j].foundExtent[i];
-            }
-            // CDBDebug("FOUND PROJECTION KEY");
-            return 0;
-          }
-        }
-      }
+  const ProjectionKey *foundKey = projectionStore.find(dfBBOX, sourceCRSString.c_str(), destinationCRS.c_str());
+  if (foundKey != NULL) {
+    for (int i = 0; i < 4; i++) {
+      dfBBOX[i] = foundKey->foundExtent[i];
     }
+    return 0;
   }
+  ProjectionKey *pKey = new ProjectionKey(dfBBOX, dfMaxExtent, sourceCRSString, destinationCRS);
 
   // double tempy;
   double miny1 = dfBBOX[1];
@@ -561,6 +667,7 @@ int CImageWarper::_findExtentSynchronized(CDataSource *dataSource, double *dfBBO
     }
   } catch (...) {
     CDBError("Unable to reproject");
+    delete pKey;
     return 1;
   }
 
@@ -602,8 +709,8 @@ int CImageWarper::_findExtentSynchronized(CDataSource *dataSource, double *dfBBO
     dfBBOX[3] += 1;
   }
 
-  pKey.setFoundExtent(dfBBOX);
-  projectionStore.keys.push_back(pKey);
+  pKey->setFoundExtent(dfBBOX);
+  projectionStore.add(pKey);
 
   // CDBDebug("out: %f %f %f %f",dfBBOX[0],dfBBOX[1],dfBBOX[2],dfBBOX[3]);
   return 0;
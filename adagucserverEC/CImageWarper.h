@@ -31,6 +31,7 @@
 #include "CDrawImage.h"
 #include <proj_api.h>
 #include <math.h>
+#include <atomic>
 #include "CDebugger.h"
 #include "CStopWatch.h"
 
@@ -38,6 +39,7 @@
 void floatToString(char *string, size_t maxlen, float number);
 void floatToString(char *string, size_t maxlen, int numdigits, float number);
 void floatToString(char *string, size_t maxlen, float min, float max, float number);
+class CImageWarperThreadProjections;
 class ProjectionKey {
 public:
   double bbox[4]; // Original boundingbox to look for
@@ -46,17 +48,39 @@ public:
   bool isSet;
   CT::string destinationCRS; // Projection to convert to
   CT::string sourceCRS;      // Projection to convert from
+  ProjectionKey *next;
   ProjectionKey(double *_box, double *_dfMaxExtent, CT::string source, CT::string dest);
   ProjectionKey();
   void setFoundExtent(double *_foundExtent);
 };
 
+/**
+ * @brief Extents found by CImageWarper::findExtent, shared by all warpers. Keys are only added, as a linked list with an atomic
+ * head, so lookups and additions from several threads do not need a lock.
+ */
 class ProjectionStore {
+private:
+  std::atomic<ProjectionKey *> head;
+
 public:
-  std::vector<ProjectionKey> keys;
   ProjectionStore();
   ~ProjectionStore();
   static ProjectionStore *getProjectionStore();
+
+  /**
+   * @brief Looks up the extent found before for this bbox and projections
+   * @return The key with the found extent, NULL when not available
+   */
+  const ProjectionKey *find(const double *bbox, const char *sourceCRS, const char *destinationCRS);
+
+  /**
+   * @brief Adds a key with its found extent set, the store takes ownership
+   */
+  void add(ProjectionKey *key);
+
+  /**
+   * @brief Removes all keys, other threads may not use the store meanwhile
+   */
   void clear();
 };
 
@@ -75,8 +99,6 @@ private:
   //     int _decodeCRS(CT::string *CRS);
   std::vector<CServerConfig::XMLE_Projection *> *prj;
   bool initialized;
-  int _findExtentSynchronized(CDataSource *dataSource, double *dfBBOX);
-  int _initreprojSynchronized(const char *projString, CGeoParams *GeoDest, std::vector<CServerConfig::XMLE_Projection *> *_prj);
 
 public:
   bool destNeedsDegreeRadianConversion, sourceNeedsDegreeRadianConversion, requireReprojection;
@@ -87,18 +109,15 @@ public:
     latlonpj = NULL;
     initialized = false;
     proj4Context = NULL;
+    threadProjections = NULL;
   }
   ~CImageWarper() {
-    if (initialized == true) {
-      closereproj();
-      prj = NULL;
-      sourcepj = NULL;
-      destpj = NULL;
-      latlonpj = NULL;
-      initialized = false;
-      proj4Context = NULL;
-    }
+    /* Also releases the projections of an initreproj which failed halfway */
+    closereproj();
+    prj = NULL;
   }
+  /* The projections are owned by the projection cache of the thread which called initreproj, see getThreadProjection */
+  CImageWarperThreadProjections *threadProjections;
   projPJ sourcepj, destpj, latlonpj;
   projCtx proj4Context;
   CT::string getDestProjString() { return destinationCRS; }
@@ -121,6 +140,13 @@ public:
   int reprojModelFromLatLon(double &dfx, double &dfy);
   void reprojBBOX(double *df4PixelExtent);
   int reprojfromLatLon(double &dfx, double &dfy);
+
+  /**
+   * Reprojects arrays of lon/lat coordinates to the destination projection, in batches instead of one call per point.
+   * Coordinates which can not be reprojected are set to 0 and flagged in failed, like reprojfromLatLon does.
+   * @return The number of coordinates which failed
+   */
+  size_t reprojfromLatLon(double *dfx, double *dfy, size_t count, unsigned char *failed);
   int reprojToLatLon(double &dfx, double &dfy);
   // int decodeCRS(CT::string *outputCRS, CT::string *inputCRS);
   int decodeCRS(CT::string *outputCRS, CT::string *inputCRS, std::vector<CServerConfig::XMLE_Projection *> *prj);
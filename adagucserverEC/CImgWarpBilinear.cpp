@@ -25,9 +25,18 @@
 
 #include "CImgWarpBilinear.h"
 #include "CImageDataWriter.h"
+#include "CColorIndexMapper.h"
+#include "CAffineResampler.h"
+#include "CParallelFor.h"
+#include "CMetrics.h"
 
 #include <gd.h>
+#include <algorithm>
 #include <set>
+
+/* Upper limit of the contour line cache in the TempDir, the oldest entries are removed first */
+#define CIMGWARPBILINEAR_MAX_CONTOUR_CACHE_BYTES (size_t(256) * 1024 * 1024)
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846 // pi
 #endif
@@ -41,12 +50,39 @@
 #endif
 
 #include "CImgRenderFieldVectors.h"
+#include "CSmoothingFilter.h"
 
 const char *CImgWarpBilinear::className = "CImgWarpBilinear";
 void CImgWarpBilinear::render(CImageWarper *warper, CDataSource *sourceImage, CDrawImage *drawImage) {
 #ifdef CImgWarpBilinear_DEBUG
   CDBDebug("Render");
 #endif
+  if (!sourceImage->getDataObject(0)->hasNodataValue) {
+/* When the datasource has no nodata value, assign -9999.0f */
+#ifdef CImgWarpBilinear_DEBUG
+    CDBDebug("Source image has no NoDataValue, assigning -9999.0f");
+#endif
+    sourceImage->getDataObject(0)->dfNodataValue = -9999.0f;
+    sourceImage->getDataObject(0)->hasNodataValue = true;
+  } else {
+    /* Create a real nodata value instead of a nanf. */
+
+    if (!(sourceImage->getDataObject(0)->dfNodataValue == sourceImage->getDataObject(0)->dfNodataValue)) {
+#ifdef CImgWarpBilinear_DEBUG
+      CDBDebug("Source image has no nodata value NaNf, changing this to -9999.0f");
+#endif
+      sourceImage->getDataObject(0)->dfNodataValue = -9999.0f;
+    }
+  }
+  // Get the nodatavalue
+  float fNodataValue = sourceImage->getDataObject(0)->dfNodataValue;
+
+  // Same projection, a plain map and bilinearmethod="affine" configured: interpolate the image rows straight from the grid, without projecting every grid point
+  if (useAffineResampling && warper->isProjectionRequired() == false && drawMap == true && enableShade == false && enableContour == false && enableVector == false && enableBarb == false && drawGridVectors == false) {
+    renderAffine(sourceImage, drawImage, fNodataValue);
+    return;
+  }
+
   int dImageWidth = drawImage->Geo->dWidth + 1;
   int dImageHeight = drawImage->Geo->dHeight + 1;
 
@@ -179,25 +215,6 @@ void CImgWarpBilinear::render(CImageWarper *warper, CDataSource *sourceImage, CD
     valObj[dNr].valueData = new float[dImageWidth * dImageHeight];
   }
 
-  if (!sourceImage->getDataObject(0)->hasNodataValue) {
-/* When the datasource has no nodata value, assign -9999.0f */
-#ifdef CImgWarpBilinear_DEBUG
-    CDBDebug("Source image has no NoDataValue, assigning -9999.0f");
-#endif
-    sourceImage->getDataObject(0)->dfNodataValue = -9999.0f;
-    sourceImage->getDataObject(0)->hasNodataValue = true;
-  } else {
-    /* Create a real nodata value instead of a nanf. */
-
-    if (!(sourceImage->getDataObject(0)->dfNodataValue == sourceImage->getDataObject(0)->dfNodataValue)) {
-#ifdef CImgWarpBilinear_DEBUG
-      CDBDebug("Source image has no nodata value NaNf, changing this to -9999.0f");
-#endif
-      sourceImage->getDataObject(0)->dfNodataValue = -9999.0f;
-    }
-  }
-  // Get the nodatavalue
-  float fNodataValue = sourceImage->getDataObject(0)->dfNodataValue;
 
 // Reproject all the points
 #ifdef CImgWarpBilinear_DEBUG
@@ -304,6 +321,9 @@ void CImgWarpBilinear::render(CImageWarper *warper, CDataSource *sourceImage, CD
 #endif
     smoothData(fpValues, fNodataValue, smoothingFilter, dPixelDestW + 1, dPixelDestH + 1);
 
+    // Contour lines traced on the source grid do not need the raster, it is only needed for maps, shading and vectors
+    if (traceContoursOnGrid && !drawMap && !enableShade && !enableVector && !enableBarb && !drawGridVectors) continue;
+
     // Draw the obtained raster by using triangle tesselation (eg gouraud shading)
     int xP[4], yP[4];
     float vP[4];
@@ -386,10 +406,13 @@ void CImgWarpBilinear::render(CImageWarper *warper, CDataSource *sourceImage, CD
   float *valueData = valObj[0].valueData;
   // Draw bilinear, simple variable
   if (drawMap == true && enableShade == false && enableVector == false && enableBarb == false) {
+    CMetrics::Timer timer(CMetrics::PHASE_COLOUR);
+    CColorIndexMapper colorIndexMapper;
+    colorIndexMapper.init(sourceImage);
+    std::vector<short> colorIndices(dImageWidth);
     for (int y = 0; y < dImageHeight; y++) {
-      for (int x = 0; x < dImageWidth; x++) {
-        setValuePixel(sourceImage, drawImage, x, y, valueData[x + y * dImageWidth]);
-      }
+      colorIndexMapper.mapRow(valueData + size_t(y) * dImageWidth, dImageWidth, &colorIndices[0]);
+      drawImage->setPixelIndexedSpan(0, y, dImageWidth, &colorIndices[0]);
     }
   }
 
@@ -399,9 +422,15 @@ void CImgWarpBilinear::render(CImageWarper *warper, CDataSource *sourceImage, CD
       renderBarbsAndVectors(warper, sourceImage, drawImage, enableShade, enableContour, enableBarb, drawMap, enableVector, drawGridVectors, dPixelExtent, uValueData, vValueData, dpDestX, dpDestY);
 
   // Make Contour if desired
-  // drawContour(valueData,fNodataValue,500,5000,drawImage);
   if (enableContour || enableShade) {
-    drawContour(valueData, fNodataValue, shadeInterval, sourceImage, drawImage, enableContour, enableShade, enableContour);
+    bool drawLines = enableContour && !traceContoursOnGrid;
+    drawContour(valueData, fNodataValue, shadeInterval, sourceImage, drawImage, drawLines, enableShade, drawLines);
+  }
+  if (enableContour && traceContoursOnGrid && contourDefinitions.size() > 0) {
+    std::vector<CContourLine> lines;
+    getContourLines(sourceImage, fNodataValue, lines);
+    double gridToSource[4] = {dfSourceOrigX + hCellSizeX, dfSourceOrigY + hCellSizeY, dfSourcedExtW, dfSourcedExtH};
+    drawContourLines(warper, sourceImage, drawImage, lines, gridToSource);
   }
 
   /*
@@ -560,63 +589,64 @@ unsigned short CImgWarpBilinear::checkIfContourRequired(float *val) {
   return 0;
 }
 
-void CImgWarpBilinear::smoothData(float *valueData, float fNodataValue, int smoothWindow, int W, int H) {
+class CImgWarpBilinearAffineRows {
+public:
+  CAffineResampler *resampler;
+  CColorIndexMapper *colorIndexMapper;
+  CDrawImage *drawImage;
+  const float *grid;
+  int gridWidth;
+  float fNodataValue;
+};
+
+static void drawAffineRows(int start, int end, void *userData) {
+  CImgWarpBilinearAffineRows *settings = (CImgWarpBilinearAffineRows *)userData;
+  CAffineResampler *resampler = settings->resampler;
+  std::vector<float> values(resampler->width);
+  std::vector<short> colorIndices(resampler->width);
+  for (int y = start; y < end; y++) {
+    int row0, row1;
+    float weightY;
+    if (!resampler->getBilinearRows(y, row0, row1, weightY)) continue;
+    resampler->gatherBilinear(settings->grid + size_t(row0) * settings->gridWidth, settings->grid + size_t(row1) * settings->gridWidth, weightY, settings->fNodataValue, &values[0]);
+    settings->colorIndexMapper->mapRow(&values[0], resampler->width, &colorIndices[0]);
+    settings->drawImage->setPixelIndexedSpan(0, y, resampler->width, &colorIndices[0]);
+  }
+}
+
+void CImgWarpBilinear::renderAffine(CDataSource *sourceImage, CDrawImage *drawImage, float fNodataValue) {
+  int gridWidth = sourceImage->dWidth;
+  int gridHeight = sourceImage->dHeight;
+  size_t gridSize = size_t(gridWidth) * gridHeight;
+  CDF::Variable *variable = sourceImage->getDataObject(0)->cdfVariable;
+  float *grid = new float[gridSize];
+  CDF::DataCopier::copy(grid, CDF_FLOAT, variable->data, variable->getType(), 0, 0, gridSize);
+  for (size_t j = 0; j < gridSize; j++) {
+    if (!(grid[j] == grid[j])) grid[j] = fNodataValue;
+  }
+  smoothData(grid, fNodataValue, smoothingFilter, gridWidth, gridHeight);
+
+  CMetrics::Timer timer(CMetrics::PHASE_COLOUR);
+  CAffineResampler resampler;
+  resampler.init(sourceImage, drawImage->Geo);
+  CColorIndexMapper colorIndexMapper;
+  colorIndexMapper.init(sourceImage);
+  CImgWarpBilinearAffineRows settings;
+  settings.resampler = &resampler;
+  settings.colorIndexMapper = &colorIndexMapper;
+  settings.drawImage = drawImage;
+  settings.grid = grid;
+  settings.gridWidth = gridWidth;
+  settings.fNodataValue = fNodataValue;
+  CParallelFor::run(drawAffineRows, &settings, drawImage->Geo->dHeight, 64);
+  delete[] grid;
+}
 
-// SmootH!
+void CImgWarpBilinear::smoothData(float *valueData, float fNodataValue, int smoothWindow, int W, int H) {
 #ifdef CImgWarpBilinear_TIME
   StopWatch_Stop("[SmoothData]");
 #endif
-  if (smoothWindow == 0) return; // No smoothing.
-  size_t drawImageSize = W * H;
-  float *valueData2 = new float[W * H];
-  int smw = smoothWindow;
-  // Create distance window;
-  float distanceWindow[(smw + 1) * 2 * (smw + 1) * 2];
-  float distanceAmmount = 0;
-  int dWinP = 0;
-  for (int y1 = -smw; y1 < smw + 1; y1++) {
-    for (int x1 = -smw; x1 < smw + 1; x1++) {
-      float d = sqrt(x1 * x1 + y1 * y1);
-      // d=d*8;
-
-      d = 1 / (d + 1);
-      // d=1;
-      distanceWindow[dWinP++] = d;
-      distanceAmmount += d;
-    }
-  }
-
-  float d;
-  for (int y = 0; y < H; y++) {
-    for (int x = 0; x < W; x++) {
-      size_t p = size_t(x + y * W);
-      if (valueData[p] != fNodataValue) {
-        dWinP = 0;
-        distanceAmmount = 0;
-        valueData2[p] = 0;
-        for (int y1 = -smw; y1 < smw + 1; y1++) {
-          size_t yp = y1 * W;
-          for (int x1 = -smw; x1 < smw + 1; x1++) {
-            if (x1 + x < W && y1 + y < H && x1 + x >= 0 && y1 + y >= 0) {
-              float val = valueData[p + x1 + yp];
-              if (val != fNodataValue) {
-                d = distanceWindow[dWinP];
-                distanceAmmount += d;
-                valueData2[p] += val * d;
-              }
-            }
-            dWinP++;
-          }
-        }
-        if (distanceAmmount > 0) valueData2[p] /= distanceAmmount;
-      } else
-        valueData2[p] = fNodataValue;
-    }
-  }
-  for (size_t p = 0; p < drawImageSize; p++) {
-    valueData[p] = valueData2[p];
-  }
-  delete[] valueData2;
+  CSmoothingFilter::smooth(valueData, fNodataValue, smoothWindow, W, H);
 #ifdef CImgWarpBilinear_TIME
   StopWatch_Stop("[/SmoothData]");
 #endif
@@ -649,6 +679,12 @@ int CImgWarpBilinear::set(const char *pszSettings) {
         if (values[1].equals("true")) enableVector = true;
         if (values[1].equals("false")) enableVector = false;
       }
+      if (values[0].equals("contourMethod")) {
+        traceContoursOnGrid = values[1].equals("marchingsquares");
+      }
+      if (values[0].equals("bilinearMethod")) {
+        useAffineResampling = values[1].equals("affine");
+      }
       if (values[0].equals("drawBarb")) {
         if (values[1].equals("true")) enableBarb = true;
         if (values[1].equals("false")) enableBarb = false;
@@ -971,6 +1007,240 @@ void CImgWarpBilinear::traverseLine(CDrawImage *drawImage, DISTANCEFIELDTYPE *di
   drawImage->endLine();
 }
 
+/* FNV-1a hash, used to keep the contour settings part of the cache key short */
+static unsigned int hashContourSettings(const char *settings) {
+  unsigned int hash = 2166136261u;
+  for (const char *c = settings; *c != 0; c++) {
+    hash ^= (unsigned char)(*c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+#define CIMGWARPBILINEAR_MAX_CONTOURLEVELS 10000
+
+void CImgWarpBilinear::getContourLines(CDataSource *dataSource, float fNodataValue, std::vector<CContourLine> &lines) {
+#ifdef CImgWarpBilinear_TIME
+  StopWatch_Stop("[getContourLines]");
+#endif
+  // The lines are traced on the full grid, independent of the requested map, so every tile and zoom level shares them
+  int gridW = dataSource->dWidth;
+  int gridH = dataSource->dHeight;
+  size_t gridStride = gridW + 1;
+
+  // Describe everything the lines depend on, except the data itself
+  CT::string settings;
+  settings.print("%d_%d_%d", smoothingFilter, gridW, gridH);
+  for (size_t j = 0; j < contourDefinitions.size(); j++) {
+    settings.printconcat("_%.9g", contourDefinitions[j].continuousInterval);
+    for (size_t i = 0; i < contourDefinitions[j].definedIntervals.size(); i++) {
+      settings.printconcat(",%.9g", contourDefinitions[j].definedIntervals[i]);
+    }
+  }
+
+  CT::string cacheDir;
+  CT::string fileDate;
+  const char *fileName = dataSource->getFileName();
+  if (dataSource->srvParams->cfg->TempDir.size() > 0 && fileName != NULL && CDirReader::getFileDate(&fileDate, fileName) == 0) {
+    cacheDir = dataSource->srvParams->cfg->TempDir[0]->attr.value.c_str();
+  }
+
+  CCache cache;
+  if (cacheDir.length() > 0) {
+    CT::string key = "contourlines/";
+    key.concat(fileName);
+    key.printconcat("/%s_%s", dataSource->getLayerName(), dataSource->getDataObject(0)->cdfVariable->name.c_str());
+    CCDFDims *cdfDims = dataSource->getCDFDims();
+    for (size_t j = 0; j < cdfDims->getNumDimensions(); j++) {
+      key.printconcat("_%s%d", cdfDims->getDimensionName(j), (int)cdfDims->getDimensionIndex(j));
+    }
+    key.printconcat("_%08x", hashContourSettings(settings.c_str()));
+    cache.checkCacheSystemReady(cacheDir.c_str(), key.c_str(), fileName, "CImgWarpBilinear::getContourLines");
+    if (cache.cacheIsAvailable()) {
+      if (CMarchingSquares::readLines(cache.getCacheFileNameToRead(), lines) == 0) {
+        CCache::countLookup(true);
+#ifdef CImgWarpBilinear_TIME
+        StopWatch_Stop("[/getContourLines] %d lines from cache", (int)lines.size());
+#endif
+        return;
+      }
+    }
+    CCache::countLookup(false);
+  }
+
+  // Copy the grid with one extra column, which is the first column again for grids spanning the globe
+  float *gridValues = new float[gridStride * gridH];
+  CDF::Variable *variable = dataSource->getDataObject(0)->cdfVariable;
+  for (int y = 0; y < gridH; y++) {
+    float *row = gridValues + y * gridStride;
+    CDF::DataCopier::copy(row, CDF_FLOAT, variable->data, variable->getType(), 0, size_t(y) * gridW, gridW);
+    row[gridW] = row[0];
+  }
+  for (size_t j = 0; j < gridStride * gridH; j++) {
+    if (!(gridValues[j] == gridValues[j])) gridValues[j] = fNodataValue;
+  }
+  smoothData(gridValues, fNodataValue, smoothingFilter, gridStride, gridH);
+  double dfSourceExtW = dataSource->dfBBOX[2] - dataSource->dfBBOX[0];
+  if (dataSource->nativeProj4.indexOf("longlat") != -1 && fabs(fabs(dfSourceExtW) - 360) < fabs(dfSourceExtW / gridW)) {
+    gridW = gridW + 1;
+  }
+
+  // Find the range of the data, needed for continuous intervals
+  float minValue = 0, maxValue = 0;
+  bool hasValues = false;
+  for (int y = 0; y < gridH; y++) {
+    for (int x = 0; x < gridW; x++) {
+      float v = gridValues[x + y * gridStride];
+      if (v == fNodataValue || !(v == v)) continue;
+      if (!hasValues || v < minValue) minValue = v;
+      if (!hasValues || v > maxValue) maxValue = v;
+      hasValues = true;
+    }
+  }
+
+  if (hasValues) {
+    for (size_t j = 0; j < contourDefinitions.size(); j++) {
+      std::vector<float> isoValues;
+      if (contourDefinitions[j].definedIntervals.size() > 0) {
+        isoValues = contourDefinitions[j].definedIntervals;
+      } else {
+        float contourinterval = contourDefinitions[j].continuousInterval;
+        if (contourinterval <= 0) continue;
+        double first = ceil(minValue / contourinterval);
+        double last = floor(maxValue / contourinterval);
+        if (last - first >= CIMGWARPBILINEAR_MAX_CONTOURLEVELS) {
+          CDBWarning("Too many contour levels (%d) for interval %f, skipping", int(last - first), contourinterval);
+          continue;
+        }
+        for (double c = first; c <= last; c++) {
+          isoValues.push_back(c * contourinterval);
+        }
+      }
+      std::sort(isoValues.begin(), isoValues.end());
+      CMarchingSquares::traceIsoLines(gridValues, gridW, gridH, gridStride, fNodataValue, isoValues, j, lines);
+    }
+  }
+  delete[] gridValues;
+
+  if (cache.saveCacheFile()) {
+    if (cache.claimCacheFile() == 0) {
+      if (CMarchingSquares::writeLines(cache.getCacheFileNameToWrite(), lines) == 0) {
+        cache.releaseCacheFile();
+        CCache::limitCacheSize(cacheDir.c_str(), "contourlines", CIMGWARPBILINEAR_MAX_CONTOUR_CACHE_BYTES);
+      } else {
+        cache.removeClaimedCachefile();
+      }
+    }
+  }
+#ifdef CImgWarpBilinear_TIME
+  StopWatch_Stop("[/getContourLines] %d lines traced", (int)lines.size());
+#endif
+}
+
+void CImgWarpBilinear::drawContourLines(CImageWarper *warper, CDataSource *dataSource, CDrawImage *drawImage, std::vector<CContourLine> &lines, double *gridToSource) {
+  double scaling = dataSource->getContourScaling();
+  float fontSize = dataSource->srvParams->cfg->WMS[0]->ContourFont[0]->attr.size.toDouble();
+  const char *fontLocation = dataSource->srvParams->cfg->WMS[0]->ContourFont[0]->attr.location.c_str();
+
+  int dImageWidth = drawImage->Geo->dWidth + 1;
+  int dImageHeight = drawImage->Geo->dHeight + 1;
+  double dfDestExtW = drawImage->Geo->dfBBOX[2] - drawImage->Geo->dfBBOX[0];
+  double dfDestExtH = drawImage->Geo->dfBBOX[1] - drawImage->Geo->dfBBOX[3];
+  double dfDestOrigX = drawImage->Geo->dfBBOX[0];
+  double dfDestOrigY = drawImage->Geo->dfBBOX[3];
+
+  std::vector<Point> textLocations;
+  std::vector<double> px, py;
+  for (size_t j = 0; j < contourDefinitions.size(); j++) {
+    for (size_t l = 0; l < lines.size(); l++) {
+      CContourLine &line = lines[l];
+      if (line.contourDefinitionIndex != int(j)) continue;
+      px.clear();
+      py.clear();
+      double minX = 0, maxX = 0, minY = 0, maxY = 0;
+      size_t numPoints = line.x.size();
+      for (size_t p = 0; p <= numPoints; p++) {
+        bool validPoint = false;
+        double x = 0, y = 0;
+        if (p < numPoints) {
+          x = gridToSource[0] + line.x[p] * gridToSource[2];
+          y = gridToSource[1] + line.y[p] * gridToSource[3];
+          if (warper->reprojpoint_inv(x, y) == 0) {
+            x = ((x - dfDestOrigX) / dfDestExtW) * dImageWidth;
+            y = ((y - dfDestOrigY) / dfDestExtH) * dImageHeight;
+            validPoint = x == x && y == y;
+          }
+        }
+        // Lines jumping across the image are wrapping around the globe
+        bool breakLine = !validPoint || (px.size() > 0 && fabs(x - px.back()) > dImageWidth / 4);
+        if (breakLine) {
+          if (px.size() > 1 && maxX >= 0 && minX < dImageWidth && maxY >= 0 && minY < dImageHeight) {
+            drawContourLinePart(drawImage, &contourDefinitions[j], line.value, px, py, &textLocations, scaling, fontLocation, fontSize);
+          }
+          px.clear();
+          py.clear();
+        }
+        if (!validPoint) continue;
+        if (px.size() == 0) {
+          minX = maxX = x;
+          minY = maxY = y;
+        }
+        if (x < minX) minX = x;
+        if (x > maxX) maxX = x;
+        if (y < minY) minY = y;
+        if (y > maxY) maxY = y;
+        px.push_back(x);
+        py.push_back(y);
+      }
+    }
+  }
+}
+
+void CImgWarpBilinear::drawContourLinePart(CDrawImage *drawImage, ContourDefinition *contourDefinition, float value, std::vector<double> &px, std::vector<double> &py,
+                                           std::vector<Point> *textLocations, double scaling, const char *fontLocation, float fontSize) {
+  size_t numPoints = px.size();
+  bool doDrawText = !contourDefinition->textFormat.empty();
+  double labelDistance = 250 * scaling; /* Distance along the line between two labels */
+  double labelGap = 25 * scaling;       /* Length of the gap in the line where the label is written */
+  float scaledLineWidth = contourDefinition->lineWidth * scaling;
+
+  /* Cumulative length of the line in pixels */
+  std::vector<double> length(numPoints, 0);
+  for (size_t j = 1; j < numPoints; j++) {
+    double dx = px[j] - px[j - 1];
+    double dy = py[j] - py[j - 1];
+    length[j] = length[j - 1] + sqrt(dx * dx + dy * dy);
+  }
+  double totalLength = length[numPoints - 1];
+
+  double nextLabelAt = 0;
+  size_t gapEnd = 0;
+  drawImage->moveTo(px[0], py[0]);
+  for (size_t j = 1; j < numPoints; j++) {
+    if (j <= gapEnd) {
+      if (j == gapEnd) drawImage->moveTo(px[j], py[j]);
+      continue;
+    }
+    size_t start = j - 1;
+    if (doDrawText && length[start] >= nextLabelAt && totalLength - length[start] > labelGap) {
+      nextLabelAt = length[start] + labelDistance;
+      if (IsTextTooClose(textLocations, int(px[start]), int(py[start])) == false) {
+        size_t end = start + 1;
+        while (end < numPoints - 1 && length[end] - length[start] < labelGap) end++;
+        textLocations->push_back(Point(int(px[start]), int(py[start])));
+        drawImage->endLine();
+        drawTextForContourLines(drawImage, contourDefinition, int(px[start]), int(py[start]), int(px[end]), int(py[end]), textLocations, value, contourDefinition->textcolor, fontLocation,
+                                fontSize * scaling);
+        gapEnd = end;
+        if (j == gapEnd) drawImage->moveTo(px[j], py[j]);
+        continue;
+      }
+    }
+    drawImage->lineTo(px[j], py[j], scaledLineWidth, contourDefinition->linecolor);
+  }
+  drawImage->endLine();
+}
+
 void CImgWarpBilinear::drawContour(float *valueData, float fNodataValue, float interval, CDataSource *dataSource, CDrawImage *drawImage, bool drawLine, bool drawShade, bool drawText) {
   CStyleConfiguration *styleConfiguration = dataSource->getStyle(); // TODO SLOW
   // When using min/max stretching, the shadeclasses need to be extended according to its shade interval
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include "CFillTriangle.h"
 #include "CImageWarperRenderInterface.h"
+#include "CMarchingSquares.h"
 
 class CalculatedWindVector {
 public:
@@ -145,7 +146,7 @@ public:
 #define DISTANCEFIELDTYPE unsigned int
 class CImgWarpBilinear : public CImageWarperRenderInterface {
 private:
-  bool drawMap, enableContour, enableVector, enableBarb, enableShade, drawGridVectors;
+  bool drawMap, enableContour, enableVector, enableBarb, enableShade, drawGridVectors, traceContoursOnGrid, useAffineResampling;
   float shadeInterval;
   int smoothingFilter;
 
@@ -162,6 +163,33 @@ private:
   void traverseLine(CDrawImage *drawImage, DISTANCEFIELDTYPE *distance, float *valueField, int lineX, int lineY, int dImageWidth, int dImageHeight, float lineWidth, CColor lineColor, CColor textColor,
                     ContourDefinition *contourDefinition, DISTANCEFIELDTYPE lineMask, bool drawText, std::vector<Point> *textLocations, double scaling, const char *fontLocation, float fontSize);
 
+  /**
+   * Traces the contour lines of all contourDefinitions on the smoothed full source grid, or reads them from the cache when available.
+   * Used when contourmethod="marchingsquares" is set in the RenderSettings of the style.
+   * The cache is kept per file, variable, dimension indices, grid size and contour settings in the TempDir, so all tiles of a map share it.
+   * @param lines The resulting lines in grid coordinates
+   */
+  void getContourLines(CDataSource *dataSource, float fNodataValue, std::vector<CContourLine> &lines);
+
+  /**
+   * Reprojects the contour lines from grid coordinates to image pixels and strokes them, including labels.
+   * @param gridToSource Origin X, origin Y, cellsize X and cellsize Y to convert grid coordinates to source coordinates
+   */
+  void drawContourLines(CImageWarper *warper, CDataSource *dataSource, CDrawImage *drawImage, std::vector<CContourLine> &lines, double *gridToSource);
+
+  /**
+   * Strokes a single continuous part of a contour line in image pixels, leaves gaps for the labels
+   */
+  void drawContourLinePart(CDrawImage *drawImage, ContourDefinition *contourDefinition, float value, std::vector<double> &px, std::vector<double> &py, std::vector<Point> *textLocations, double scaling,
+                           const char *fontLocation, float fontSize);
+
+  /**
+   * Draws the map when the grid and the image are in the same projection. Each image row is interpolated from two grid rows,
+   * instead of projecting every grid point and filling triangles. Enabled with <RenderSettings bilinearmethod="affine"/>,
+   * the interpolation is between cell centers and differs slightly from the triangles.
+   */
+  void renderAffine(CDataSource *dataSource, CDrawImage *drawImage, float fNodataValue);
+
 public:
   CImgWarpBilinear() {
     drawMap = false;
@@ -171,6 +199,8 @@ public:
     enableShade = false;
     smoothingFilter = 1;
     drawGridVectors = false;
+    traceContoursOnGrid = false;
+    useAffineResampling = false;
   }
   ~CImgWarpBilinear() {
     for (size_t j = 0; j < minimaPoints.size(); j++) delete minimaPoints[j];
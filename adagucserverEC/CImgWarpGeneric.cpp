@@ -25,6 +25,8 @@
 
 #include "CImgWarpGeneric.h"
 #include "CImageDataWriter.h"
+#include "CColorIndexMapper.h"
+#include "CMetrics.h"
 #include "CGenericDataWarper.h"
 
 const char *CImgWarpGeneric::className = "CImgWarpGeneric";
@@ -102,20 +104,13 @@ void CImgWarpGeneric::render(CImageWarper *warper, CDataSource *dataSource, CDra
     break;
   }
 
+  CMetrics::Timer timer(CMetrics::PHASE_COLOUR);
+  CColorIndexMapper colorIndexMapper;
+  colorIndexMapper.init(styleConfiguration, true, (float)settings.dfNodataValue, false);
+  std::vector<short> colorIndices(settings.width);
   for (int y = 0; y < (int)settings.height; y = y + 1) {
-    for (int x = 0; x < (int)settings.width; x = x + 1) {
-      float val = settings.dataField[x + y * settings.width];
-      if (val != (float)settings.dfNodataValue && val == val) {
-        if (styleConfiguration->legendLog != 0) val = log10(val + .000001) / log10(styleConfiguration->legendLog);
-        val *= styleConfiguration->legendScale;
-        val += styleConfiguration->legendOffset;
-        if (val >= 239)
-          val = 239;
-        else if (val < 0)
-          val = 0;
-        drawImage->setPixelIndexed(x, y, (unsigned char)val);
-      }
-    }
+    colorIndexMapper.mapRow(settings.dataField + size_t(y) * settings.width, settings.width, &colorIndices[0]);
+    drawImage->setPixelIndexedSpan(0, y, settings.width, &colorIndices[0]);
   }
   delete[] settings.dataField;
   // CDBDebug("render done");
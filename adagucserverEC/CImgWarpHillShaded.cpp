@@ -29,10 +29,203 @@
 
 const char *CImgWarpHillShaded::className = "CImgWarpHillShaded";
 
+#define CIMGWARPHILLSHADED_MIN_ROWS_PER_THREAD 32
+/* Shade maps of files which are not requested anymore are removed when all shade maps together exceed this size */
+#define CIMGWARPHILLSHADED_MAX_CACHE_BYTES (size_t(1024) * 1024 * 1024)
+
+static inline int wrapIndex(int i, int n) { return i < 0 ? i + n : (i >= n ? i - n : i); }
+
+/* Sum of the 3x3 window around each cell, the grid wraps around at the edges */
+void CImgWarpHillShaded::boxSumRows(int start, int end, void *userData) {
+  ShadeJob *job = (ShadeJob *)userData;
+  int W = job->sourceWidth;
+  int H = job->sourceHeight;
+  for (int y = start; y < end; y++) {
+    const float *rows[3];
+    for (int wy = -1; wy < 2; wy++) rows[wy + 1] = job->elevation + size_t(wrapIndex(y + wy, H)) * W;
+    float *boxSum = job->boxSum + size_t(y) * W;
+    for (int x = 0; x < W; x++) {
+      int x0 = wrapIndex(x - 1, W);
+      int x2 = wrapIndex(x + 1, W);
+      boxSum[x] = rows[0][x0] + rows[0][x] + rows[0][x2] + rows[1][x0] + rows[1][x] + rows[1][x2] + rows[2][x0] + rows[2][x] + rows[2][x2];
+    }
+  }
+}
+
+/*
+ * The normal of the surface through (x,y), (x+1,y) and (x,y+1) is (-dzx, -dzy, 1).
+ * Its dot product with the normalized light source (-1,-1,-1) is stored in the shade map.
+ */
+void CImgWarpHillShaded::shadeMapRows(int start, int end, void *userData) {
+  ShadeJob *job = (ShadeJob *)userData;
+  int W = job->sourceWidth;
+  int H = job->sourceHeight;
+  const float lightFactor = 1 / sqrt(3.0f);
+  for (int y = start; y < end; y++) {
+    const float *row = job->boxSum + size_t(y) * W;
+    const float *nextRow = job->boxSum + size_t(wrapIndex(y + 1, H)) * W;
+    float *shadeMap = job->shadeMap + size_t(y) * W;
+    for (int x = 0; x < W; x++) {
+      float dzx = row[wrapIndex(x + 1, W)] - row[x];
+      float dzy = nextRow[x] - row[x];
+      shadeMap[x] = (dzx + dzy - 1) * lightFactor / sqrt(dzx * dzx + dzy * dzy + 1);
+    }
+  }
+}
+
+void CImgWarpHillShaded::computeShadeMapFromElevation(ShadeJob *job) {
+  CParallelFor::run(boxSumRows, job, job->sourceHeight, CIMGWARPHILLSHADED_MIN_ROWS_PER_THREAD);
+  CParallelFor::run(shadeMapRows, job, job->sourceHeight, CIMGWARPHILLSHADED_MIN_ROWS_PER_THREAD);
+}
+
+/* Interpolates the shade map for each destination pixel and converts it to a legend color index */
+void CImgWarpHillShaded::shadeRows(int start, int end, void *userData) {
+  ShadeJob *job = (ShadeJob *)userData;
+  Settings *settings = job->settings;
+  CStyleConfiguration *styleConfiguration = job->styleConfiguration;
+  int W = job->sourceWidth;
+  int H = job->sourceHeight;
+  const float *shadeMap = job->shadeMap;
+  for (int y = start; y < end; y++) {
+    size_t rowStart = size_t(y) * settings->width;
+    const int *cellX = settings->cellX + rowStart;
+    const int *cellY = settings->cellY + rowStart;
+    const float *cellDx = settings->cellDx + rowStart;
+    const float *cellDy = settings->cellDy + rowStart;
+    unsigned char *colorIndex = job->colorIndex + rowStart;
+    for (int x = 0; x < settings->width; x++) {
+      int cx = cellX[x];
+      if (cx < 0) continue;
+      int cy = cellY[x];
+      int cx1 = cx + 1 == W ? 0 : cx + 1;
+      int cy1 = cy + 1 == H ? 0 : cy + 1;
+      float c00 = shadeMap[cx + size_t(cy) * W];
+      float c10 = shadeMap[cx1 + size_t(cy) * W];
+      float c01 = shadeMap[cx + size_t(cy1) * W];
+      float c11 = shadeMap[cx1 + size_t(cy1) * W];
+      float dx = cellDx[x];
+      float dy = cellDy[x];
+      float gx1 = (1 - dx) * c00 + dx * c10;
+      float gx2 = (1 - dx) * c01 + dx * c11;
+      float val = (((1 - dy) * gx1 + dy * gx2) + 1) / 1.816486;
+      if (styleConfiguration->legendLog != 0) val = log10(val + .000001) / log10(styleConfiguration->legendLog);
+      val *= styleConfiguration->legendScale;
+      val += styleConfiguration->legendOffset;
+      if (val >= 239)
+        val = 239;
+      else if (val < 0)
+        val = 0;
+      colorIndex[x] = (unsigned char)val;
+    }
+  }
+}
+
+float *CImgWarpHillShaded::getShadeMap(CDataSource *dataSource) {
+  int W = dataSource->dWidth;
+  int H = dataSource->dHeight;
+  size_t size = size_t(W) * H;
+
+  CT::string cacheDir;
+  CT::string fileDate;
+  const char *fileName = dataSource->getFileName();
+  if (dataSource->srvParams->cfg->TempDir.size() > 0 && fileName != NULL && CDirReader::getFileDate(&fileDate, fileName) == 0) {
+    cacheDir = dataSource->srvParams->cfg->TempDir[0]->attr.value.c_str();
+  }
+
+  CCache cache;
+  if (cacheDir.length() > 0) {
+    CT::string key = "hillshade/";
+    key.concat(fileName);
+    key.printconcat("/%s", dataSource->getDataObject(0)->cdfVariable->name.c_str());
+    CCDFDims *cdfDims = dataSource->getCDFDims();
+    for (size_t j = 0; j < cdfDims->getNumDimensions(); j++) {
+      key.printconcat("_%s%d", cdfDims->getDimensionName(j), (int)cdfDims->getDimensionIndex(j));
+    }
+    // The shade map only depends on the source grid, it is shared by all map requests and tiles
+    key.printconcat("_%dx%d", W, H);
+    cache.checkCacheSystemReady(cacheDir.c_str(), key.c_str(), fileName, "CImgWarpHillShaded::getShadeMap");
+    if (cache.cacheIsAvailable()) {
+      FILE *pFile = fopen(cache.getCacheFileNameToRead(), "rb");
+      if (pFile != NULL) {
+        float *shadeMap = new float[size];
+        size_t bytesRead = fread(shadeMap, sizeof(float), size, pFile);
+        fclose(pFile);
+        if (bytesRead == size) {
+          CCache::countLookup(true);
+          return shadeMap;
+        }
+        CDBWarning("Unable to read shade map from cache %s", cache.getCacheFileNameToRead());
+        delete[] shadeMap;
+      }
+    }
+    CCache::countLookup(false);
+  }
+
+  ShadeJob job;
+  job.sourceData = dataSource->getDataObject(0)->cdfVariable->data;
+  job.sourceWidth = W;
+  job.sourceHeight = H;
+  job.elevation = new float[size];
+  job.boxSum = new float[size];
+  job.shadeMap = new float[size];
+  switch (dataSource->getDataObject(0)->cdfVariable->getType()) {
+  case CDF_CHAR:
+  case CDF_BYTE:
+    computeShadeMap<char>(&job);
+    break;
+  case CDF_UBYTE:
+    computeShadeMap<unsigned char>(&job);
+    break;
+  case CDF_SHORT:
+    computeShadeMap<short>(&job);
+    break;
+  case CDF_USHORT:
+    computeShadeMap<ushort>(&job);
+    break;
+  case CDF_INT:
+    computeShadeMap<int>(&job);
+    break;
+  case CDF_UINT:
+    computeShadeMap<uint>(&job);
+    break;
+  case CDF_FLOAT:
+    computeShadeMap<float>(&job);
+    break;
+  case CDF_DOUBLE:
+    computeShadeMap<double>(&job);
+    break;
+  default:
+    CDBError("Unsupported data type for hillshading");
+    delete[] job.shadeMap;
+    job.shadeMap = NULL;
+    break;
+  }
+  delete[] job.elevation;
+  delete[] job.boxSum;
+
+  if (job.shadeMap != NULL && cache.saveCacheFile()) {
+    if (cache.claimCacheFile() == 0) {
+      FILE *pFile = fopen(cache.getCacheFileNameToWrite(), "wb");
+      size_t bytesWritten = 0;
+      if (pFile != NULL) {
+        bytesWritten = fwrite(job.shadeMap, sizeof(float), size, pFile);
+        fclose(pFile);
+      }
+      if (bytesWritten == size) {
+        cache.releaseCacheFile();
+        CCache::limitCacheSize(cacheDir.c_str(), "hillshade", CIMGWARPHILLSHADED_MAX_CACHE_BYTES);
+      } else {
+        CDBWarning("Unable to write shade map to cache");
+        cache.removeClaimedCachefile();
+      }
+    }
+  }
+  return job.shadeMap;
+}
+
 void CImgWarpHillShaded::render(CImageWarper *warper, CDataSource *dataSource, CDrawImage *drawImage) {
   // CDBDebug("render");
 
-  CT::string color;
   void *sourceData;
 
   CStyleConfiguration *styleConfiguration = dataSource->getStyle();
@@ -50,12 +243,15 @@ void CImgWarpHillShaded::render(CImageWarper *warper, CDataSource *dataSource, C
   settings.width = drawImage->Geo->dWidth;
   settings.height = drawImage->Geo->dHeight;
 
-  settings.dataField = new float[settings.width * settings.height];
-  for (int y = 0; y < settings.height; y++) {
-    for (int x = 0; x < settings.width; x++) {
-      settings.dataField[x + y * settings.width] = (float)settings.dfNodataValue;
-    }
-  }
+  float *shadeMap = getShadeMap(dataSource);
+  if (shadeMap == NULL) return;
+
+  size_t numPixels = size_t(settings.width) * settings.height;
+  settings.cellX = new int[numPixels];
+  settings.cellY = new int[numPixels];
+  settings.cellDx = new float[numPixels];
+  settings.cellDy = new float[numPixels];
+  for (size_t p = 0; p < numPixels; p++) settings.cellX[p] = -1;
 
   CDFType dataType = dataSource->getDataObject(0)->cdfVariable->getType();
   sourceData = dataSource->getDataObject(0)->cdfVariable->data;
@@ -101,22 +297,29 @@ void CImgWarpHillShaded::render(CImageWarper *warper, CDataSource *dataSource, C
     break;
   }
 
-  for (int y = 0; y < (int)settings.height; y = y + 1) {
-    for (int x = 0; x < (int)settings.width; x = x + 1) {
-      float val = settings.dataField[x + y * settings.width];
-      if (val != (float)settings.dfNodataValue && val == val) {
-        if (styleConfiguration->legendLog != 0) val = log10(val + .000001) / log10(styleConfiguration->legendLog);
-        val *= styleConfiguration->legendScale;
-        val += styleConfiguration->legendOffset;
-        if (val >= 239)
-          val = 239;
-        else if (val < 0)
-          val = 0;
-        drawImage->setPixelIndexed(x, y, (unsigned char)val);
-      }
+  ShadeJob job;
+  job.shadeMap = shadeMap;
+  job.sourceWidth = dataSource->dWidth;
+  job.sourceHeight = dataSource->dHeight;
+  job.settings = &settings;
+  job.styleConfiguration = styleConfiguration;
+  job.colorIndex = new unsigned char[numPixels];
+  CParallelFor::run(shadeRows, &job, settings.height, CIMGWARPHILLSHADED_MIN_ROWS_PER_THREAD);
+
+  std::vector<short> colorIndices(settings.width);
+  for (int y = 0; y < settings.height; y++) {
+    for (int x = 0; x < settings.width; x++) {
+      size_t p = x + y * settings.width;
+      colorIndices[x] = settings.cellX[p] >= 0 ? job.colorIndex[p] : -1;
     }
+    drawImage->setPixelIndexedSpan(0, y, settings.width, &colorIndices[0]);
   }
-  delete[] settings.dataField;
+  delete[] job.colorIndex;
+  delete[] settings.cellX;
+  delete[] settings.cellY;
+  delete[] settings.cellDx;
+  delete[] settings.cellDy;
+  delete[] shadeMap;
   // CDBDebug("render done");
   return;
 }
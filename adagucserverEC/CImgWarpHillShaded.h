@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include "CImageWarperRenderInterface.h"
 #include "CGenericDataWarper.h"
+#include "CParallelFor.h"
 #include "utils.h"
 
 class Vector {
@@ -64,13 +65,30 @@ private:
     double legendLowerRange;
     double legendUpperRange;
     bool hasNodataValue;
-    float *dataField;
     int width, height;
+    /* Source cell and position within the cell for each destination pixel, cellX is -1 when the pixel is not drawn */
+    int *cellX, *cellY;
+    float *cellDx, *cellDy;
+  };
+
+  /**
+   * Settings for computing the shade map and for shading the destination rows
+   */
+  class ShadeJob {
+  public:
+    const void *sourceData;
+    float *elevation;
+    float *boxSum;
+    float *shadeMap;
+    int sourceWidth, sourceHeight;
+    Settings *settings;
+    CStyleConfiguration *styleConfiguration;
+    unsigned char *colorIndex;
   };
 
   template <class T> static void drawFunction(int x, int y, T val, void *_settings, void *g) {
     Settings *drawSettings = static_cast<Settings *>(_settings);
-    if (x < 0 || y < 0 || x > drawSettings->width || y > drawSettings->height) return;
+    if (x < 0 || y < 0 || x >= drawSettings->width || y >= drawSettings->height) return;
     GenericDataWarper *genericDataWarper = static_cast<GenericDataWarper *>(g);
     bool isNodata = false;
     if (drawSettings->hasNodataValue) {
@@ -81,60 +99,41 @@ private:
       if (drawSettings->legendValueRange)
         if (val < drawSettings->legendLowerRange || val > drawSettings->legendUpperRange) isNodata = true;
     if (!isNodata) {
-      T *sourceData = (T *)genericDataWarper->sourceData;
-      size_t sourceDataPX = genericDataWarper->sourceDataPX;
-      size_t sourceDataPY = genericDataWarper->sourceDataPY;
-      size_t sourceDataWidth = genericDataWarper->sourceDataWidth;
-      size_t sourceDataHeight = genericDataWarper->sourceDataHeight;
-
-      if (sourceDataPY > sourceDataHeight - 1) return;
-      if (sourceDataPX > sourceDataWidth - 1) return;
-
-      float values[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+      if (genericDataWarper->sourceDataPY > genericDataWarper->sourceDataHeight - 1) return;
+      if (genericDataWarper->sourceDataPX > genericDataWarper->sourceDataWidth - 1) return;
+      size_t p = x + y * drawSettings->width;
+      drawSettings->cellX[p] = genericDataWarper->sourceDataPX;
+      drawSettings->cellY[p] = genericDataWarper->sourceDataPY;
+      drawSettings->cellDx[p] = genericDataWarper->tileDx;
+      drawSettings->cellDy[p] = genericDataWarper->tileDy;
+    }
+  };
 
-      /* TODO make window size configurable */
-      for (int wy = -1; wy < 2; wy++) {
-        for (int wx = -1; wx < 2; wx++) {
-          values[0][0] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 0 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 0, sourceDataHeight) * sourceDataWidth];
-          values[1][0] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 1 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 0, sourceDataHeight) * sourceDataWidth];
-          values[2][0] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 2 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 0, sourceDataHeight) * sourceDataWidth];
-          values[0][1] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 0 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 1, sourceDataHeight) * sourceDataWidth];
-          values[1][1] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 1 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 1, sourceDataHeight) * sourceDataWidth];
-          values[2][1] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 2 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 1, sourceDataHeight) * sourceDataWidth];
-          values[0][2] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 0 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 2, sourceDataHeight) * sourceDataWidth];
-          values[1][2] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 1 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 2, sourceDataHeight) * sourceDataWidth];
-          values[2][2] += (float)((T *)sourceData)[mfast_mod(sourceDataPX + 2 + wx, sourceDataWidth) + mfast_mod(sourceDataPY + wy + 2, sourceDataHeight) * sourceDataWidth];
-        }
-      }
+  /* Converts rows of the source grid to float */
+  template <class T> static void elevationRows(int start, int end, void *userData) {
+    ShadeJob *job = (ShadeJob *)userData;
+    const T *sourceData = (const T *)job->sourceData;
+    size_t W = job->sourceWidth;
+    for (size_t p = start * W; p < end * W; p++) {
+      job->elevation[p] = (float)sourceData[p];
+    }
+  }
+  static void boxSumRows(int start, int end, void *userData);
+  static void shadeMapRows(int start, int end, void *userData);
+  static void shadeRows(int start, int end, void *userData);
 
-      Vector v00 = Vector((float)(sourceDataPX + 0), (float)sourceDataPY + 0, values[0][0]);
-      Vector v10 = Vector((float)(sourceDataPX + 1), (float)sourceDataPY + 0, values[1][0]);
-      Vector v20 = Vector((float)(sourceDataPX + 2), (float)sourceDataPY + 0, values[2][0]);
-      Vector v01 = Vector((float)(sourceDataPX + 0), (float)sourceDataPY + 1, values[0][1]);
-      Vector v11 = Vector((float)(sourceDataPX + 1), (float)sourceDataPY + 1, values[1][1]);
-      Vector v21 = Vector((float)(sourceDataPX + 2), (float)sourceDataPY + 1, values[2][1]);
-      Vector v02 = Vector((float)(sourceDataPX + 0), (float)sourceDataPY + 2, values[0][2]);
-      Vector v12 = Vector((float)(sourceDataPX + 1), (float)sourceDataPY + 2, values[1][2]);
+  /**
+   * Returns the shade map for the source grid: per source cell the normal of the terrain dotted with the light source.
+   * The map is read from the TempDir cache when available, otherwise computed and stored in the cache.
+   * Returns NULL on failure, the caller should delete[] the result.
+   */
+  float *getShadeMap(CDataSource *dataSource);
 
-      if (x >= 0 && y >= 0 && x < (int)drawSettings->width && y < (int)drawSettings->height) {
-        Vector normal00 = CrossProduct(v10 - v00, v01 - v00).normalize();
-        Vector normal10 = CrossProduct(v20 - v10, v11 - v10).normalize();
-        Vector normal01 = CrossProduct(v11 - v01, v02 - v01).normalize();
-        Vector normal11 = CrossProduct(v21 - v11, v12 - v11).normalize();
-        Vector lightSource = (Vector(-1, -1, -1)).normalize(); /* TODO make light source configurable */
-        float c00 = DotProduct(lightSource, normal00);
-        float c10 = DotProduct(lightSource, normal10);
-        float c01 = DotProduct(lightSource, normal01);
-        float c11 = DotProduct(lightSource, normal11);
-        float dx = genericDataWarper->tileDx;
-        float dy = genericDataWarper->tileDy;
-        float gx1 = (1 - dx) * c00 + dx * c10;
-        float gx2 = (1 - dx) * c01 + dx * c11;
-        float bilValue = (1 - dy) * gx1 + dy * gx2;
-        drawSettings->dataField[x + y * drawSettings->width] = (bilValue + 1) / 1.816486;
-      }
-    }
-  };
+  template <class T> static void computeShadeMap(ShadeJob *job) {
+    CParallelFor::run(elevationRows<T>, job, job->sourceHeight, 64);
+    computeShadeMapFromElevation(job);
+  }
+  static void computeShadeMapFromElevation(ShadeJob *job);
 
 public:
   CImgWarpHillShaded() {}
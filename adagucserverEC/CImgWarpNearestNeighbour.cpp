@@ -265,9 +265,7 @@ void CImgWarpNearestNeighbour::drawTriangle(CDrawImage *drawImage, int *xP, int
       if (x1 < W && x2 > 0) {
         short sx = (x1 < 0) ? 0 : x1;
         short ex = (x2 > W) ? W : x2; //<0?0:x2;
-        for (short x = sx; x < ex; x++) {
-          drawImage->setPixelIndexed(x, y, value);
-        }
+        drawImage->fillPixelIndexedSpan(sx, y, ex - sx, value);
       }
     }
   }
@@ -295,9 +293,7 @@ void CImgWarpNearestNeighbour::drawTriangle(CDrawImage *drawImage, int *xP, int
       if (x1 < W && x2 > 0) {
         short sx = (x1 < 0) ? 0 : x1;
         short ex = (x2 > W) ? W : x2; //<0?0:x2;
-        for (short x = sx; x < ex; x++) {
-          drawImage->setPixelIndexed(x, y, value);
-        }
+        drawImage->fillPixelIndexedSpan(sx, y, ex - sx, value);
       }
     }
   }
@@ -26,10 +26,14 @@
 #ifndef CIMGWARPNEARESTNEIGHBOUR_H
 #define CIMGWARPNEARESTNEIGHBOUR_H
 #include <float.h>
+#include "CMetrics.h"
 #include <pthread.h>
 #include "CImageWarperRenderInterface.h"
 #include "CGenericDataWarper.h"
 #include "CAreaMapper.h"
+#include "CAdaptiveTiles.h"
+#include "CParallelFor.h"
+#include "CAffineResampler.h"
 
 /**
  *  This is the main class of this file. It renders the sourcedata on the destination image using nearest neighbour interpolation.
@@ -46,111 +50,26 @@ private:
   int set(const char *) { return 0; }
   int status;
 
-  int internalWidth;
-  int internalHeight;
-
-  // This class represents settings/properties for each separate tile
+  // The tiles to draw and the renderer to draw them with
   class DrawTileSettings {
   public:
-    int id;
-    double y_corners[4], x_corners[4];
-    int tile_offset_x, tile_offset_y;
+    CAdaptiveTile *tiles;
     CAreaMapper *drawTile;
   };
-  // This class represents which bunch of tiles needs to be drawn by which thread.
-  class DrawMultipleTileSettings {
-  public:
-    DrawTileSettings *ct;
-    int numberOfTiles, startTile, endTile;
-  };
-  // This method draws th bunch of selected tiles with the proper renderer.
-  // This method can be called by a thread.
-  static void *drawTiles(void *arg) {
-    DrawMultipleTileSettings *dmf = (DrawMultipleTileSettings *)arg;
-    for (int j = dmf->startTile; j < dmf->endTile && j < dmf->numberOfTiles; j++) {
-      DrawTileSettings *ct = &dmf->ct[j];
+  // Draws the tiles [start, end), called by CParallelFor from several threads.
+  static void drawTiles(int start, int end, void *userData) {
+    DrawTileSettings *settings = (DrawTileSettings *)userData;
+    for (int j = start; j < end; j++) {
+      CAdaptiveTile *tile = &settings->tiles[j];
 #ifdef CIMGWARPNEARESTNEIGHBOUR_DEBUG
 // CDBDebug("Drawing tile %d",j);
 #endif
-      if (ct->id >= 0) {
-#ifdef CIMGWARPNEARESTNEIGHBOUR_DEBUG
-// CDBDebug("Drawing tile id %d",ct->id);
-#endif
-        // int status =
-        ct->drawTile->drawTile(ct->x_corners, ct->y_corners, ct->tile_offset_x, ct->tile_offset_y);
-        /*if(status!=0){
-          CDBError("Unable to draw tile at line %d",status);
-        }*/
-      }
-    }
-    return arg;
-  }
-  // Reproject the corners of the tiles
-  double y_corners[4], x_corners[4];
-  double dfMaskBBOX[4];
-  int reproj(CImageWarper *warper, CDataSource *, CGeoParams *GeoDest, double dfx, double dfy, double x_div, double y_div) {
-    double psx[4];
-    double psy[4];
-    double dfTiledBBOX[4];
-    double dfTileW = (GeoDest->dfBBOX[2] - GeoDest->dfBBOX[0]) / double(x_div);
-    double dfTileH = (GeoDest->dfBBOX[3] - GeoDest->dfBBOX[1]) / double(y_div);
-
-    dfTiledBBOX[0] = GeoDest->dfBBOX[0] + dfTileW * dfx;
-    dfTiledBBOX[1] = GeoDest->dfBBOX[1] + dfTileH * dfy;
-    dfTiledBBOX[2] = dfTiledBBOX[0] + (dfTileW);
-    dfTiledBBOX[3] = dfTiledBBOX[1] + (dfTileH);
-    double dfSourceBBOX[4];
-    for (int k = 0; k < 4; k++) dfSourceBBOX[k] = dfMaskBBOX[k];
-    if (dfMaskBBOX[3] < dfMaskBBOX[1]) {
-      dfSourceBBOX[1] = dfMaskBBOX[3];
-      dfSourceBBOX[3] = dfMaskBBOX[1];
-    }
-    if ((dfTiledBBOX[0] > dfSourceBBOX[0] - dfTileW && dfTiledBBOX[0] < dfSourceBBOX[2] + dfTileW) && (dfTiledBBOX[2] > dfSourceBBOX[0] - dfTileW && dfTiledBBOX[2] < dfSourceBBOX[2] + dfTileW) &&
-        (dfTiledBBOX[1] > dfSourceBBOX[1] - dfTileH && dfTiledBBOX[1] < dfSourceBBOX[3] + dfTileH) && (dfTiledBBOX[3] > dfSourceBBOX[1] - dfTileH && dfTiledBBOX[3] < dfSourceBBOX[3] + dfTileH)) {
-    } else {
-      return 1;
+      settings->drawTile->drawTile(tile->x_corners, tile->y_corners, tile->offsetX, tile->offsetY, tile->width, tile->height);
     }
-    psx[0] = dfTiledBBOX[2];
-    psx[1] = dfTiledBBOX[2];
-    psx[2] = dfTiledBBOX[0];
-    psx[3] = dfTiledBBOX[0];
-    psy[0] = dfTiledBBOX[1];
-    psy[1] = dfTiledBBOX[3];
-    psy[2] = dfTiledBBOX[3];
-    psy[3] = dfTiledBBOX[1];
-    if (warper->isProjectionRequired()) {
-      if (warper->destNeedsDegreeRadianConversion) {
-        for (int j = 0; j < 4; j++) {
-          psx[j] *= DEG_TO_RAD;
-          psy[j] *= DEG_TO_RAD;
-        }
-      }
-      if (pj_transform(warper->destpj, warper->sourcepj, 4, 0, psx, psy, NULL)) {
-        CDBDebug("Unable to do pj_transform");
-      }
-      if (warper->sourceNeedsDegreeRadianConversion) {
-        for (int j = 0; j < 4; j++) {
-          psx[j] /= DEG_TO_RAD;
-          psy[j] /= DEG_TO_RAD;
-        }
-      }
-    }
-    x_corners[0] = psx[1];
-    y_corners[0] = psy[1];
-
-    x_corners[1] = psx[0];
-    y_corners[1] = psy[0];
-
-    x_corners[2] = psx[3];
-    y_corners[2] = psy[3];
-
-    x_corners[3] = psx[2];
-    y_corners[3] = psy[2];
-
-    return 0;
   }
 
   template <class T> void _plot(CImageWarper *, CDataSource *dataSource, CDrawImage *drawImage) {
+    CMetrics::Timer timer(CMetrics::PHASE_COLOUR);
     CStyleConfiguration *styleConfiguration = dataSource->getStyle();
     double dfNodataValue = dataSource->getDataObject(0)->dfNodataValue;
     double legendValueRange = styleConfiguration->hasLegendValueRange;
@@ -232,8 +151,10 @@ private:
     }
 
     if (shade == false) {
+      std::vector<short> colorIndices(drawImage->Geo->dWidth);
       for (int y = 0; y < drawImage->Geo->dHeight; y++) {
         for (int x = 0; x < drawImage->Geo->dWidth; x++) {
+          colorIndices[x] = -1;
           T val = data[x + y * drawImage->Geo->dWidth];
 
           bool isNodata = false;
@@ -258,9 +179,10 @@ private:
             else if (pcolorind <= 0)
               pcolorind = 0;
 
-            drawImage->setPixelIndexed(x, (drawImage->Geo->dHeight - 1) - y, pcolorind);
+            colorIndices[x] = pcolorind;
           }
         }
+        drawImage->setPixelIndexedSpan(0, (drawImage->Geo->dHeight - 1) - y, drawImage->Geo->dWidth, &colorIndices[0]);
       }
     }
   }
@@ -329,6 +251,91 @@ private:
     }
   };
 
+  static void initSettings(Settings &settings, CDataSource *dataSource, CDrawImage *drawImage) {
+    CStyleConfiguration *styleConfiguration = dataSource->getStyle();
+    settings.dfNodataValue = dataSource->getDataObject(0)->dfNodataValue;
+    settings.legendValueRange = styleConfiguration->hasLegendValueRange;
+    settings.legendLowerRange = styleConfiguration->legendLowerRange;
+    settings.legendUpperRange = styleConfiguration->legendUpperRange;
+    settings.hasNodataValue = dataSource->getDataObject(0)->hasNodataValue;
+    settings.nodataValue = (float)settings.dfNodataValue;
+
+    settings.legendLog = styleConfiguration->legendLog;
+    if (settings.legendLog > 0) {
+      settings.legendLogAsLog = log10(settings.legendLog);
+    } else {
+      settings.legendLogAsLog = 0;
+    }
+    settings.legendScale = styleConfiguration->legendScale;
+    settings.legendOffset = styleConfiguration->legendOffset;
+    settings.drawImage = drawImage;
+  }
+
+  // Maps a row of values to legend color indices like drawFunction does, -1 for nodata
+  template <class T> static void mapRow(const T *values, int n, short *colorIndices, Settings *settings) {
+    T nodataValue = (T)settings->dfNodataValue;
+    for (int x = 0; x < n; x++) {
+      T val = values[x];
+      colorIndices[x] = -1;
+      if (settings->hasNodataValue && val == nodataValue) continue;
+      if (!(val == val)) continue;
+      if (settings->legendValueRange && (val < settings->legendLowerRange || val > settings->legendUpperRange)) continue;
+      if (settings->legendLog != 0) {
+        if (val > 0) {
+          val = (T)(log10(val) / settings->legendLogAsLog);
+        } else
+          val = (T)(-settings->legendOffset);
+      }
+      int pcolorind = (int)(val * settings->legendScale + settings->legendOffset);
+      if (pcolorind >= 239)
+        pcolorind = 239;
+      else if (pcolorind <= 0)
+        pcolorind = 0;
+      colorIndices[x] = pcolorind;
+    }
+  }
+
+  class AffineSettings {
+  public:
+    CAffineResampler *resampler;
+    Settings *settings;
+    const void *data;
+    int sourceWidth;
+  };
+
+  // Draws the image rows [start, end) when the grid and the image are in the same projection, called by CParallelFor
+  template <class T> static void drawAffineRows(int start, int end, void *userData) {
+    AffineSettings *affine = (AffineSettings *)userData;
+    CAffineResampler *resampler = affine->resampler;
+    const T *data = (const T *)affine->data;
+    std::vector<T> values(resampler->width);
+    std::vector<short> colorIndices(resampler->width);
+    for (int y = start; y < end; y++) {
+      int row = resampler->getNearestRow(y);
+      if (row < 0) continue;
+      resampler->gatherNearest(data + size_t(row) * affine->sourceWidth, T(0), &values[0]);
+      mapRow(&values[0], resampler->width, &colorIndices[0], affine->settings);
+      // Pixels outside the grid are not drawn, also when the data has no nodata value
+      const int *columns = &resampler->columns[0];
+      for (int x = 0; x < resampler->width; x++) {
+        if (columns[x] < 0) colorIndices[x] = -1;
+      }
+      affine->settings->drawImage->setPixelIndexedSpan(0, y, resampler->width, &colorIndices[0]);
+    }
+  }
+
+  template <class T> void _plotAffine(CAffineResampler *resampler, CDataSource *dataSource, CDrawImage *drawImage) {
+    CMetrics::Timer timer(CMetrics::PHASE_COLOUR);
+    Settings settings;
+    initSettings(settings, dataSource, drawImage);
+    AffineSettings affine;
+    affine.resampler = resampler;
+    affine.settings = &settings;
+    affine.data = dataSource->getDataObject(0)->cdfVariable->data;
+    affine.sourceWidth = dataSource->dWidth;
+    CParallelFor::run(drawAffineRows<T>, &affine, resampler->height, 64);
+  }
+
   pthread_mutex_t CImgWarpNearestNeighbour_render_lock;
 
   // Setup projection and all other settings for the tiles to draw
@@ -424,25 +431,10 @@ private:
     if (renderSettings == 2) {
       usePrecise = true;
     }
+
     if (usePrecise) {
       Settings settings;
-
-      settings.dfNodataValue = dataSource->getDataObject(0)->dfNodataValue;
-      settings.legendValueRange = styleConfiguration->hasLegendValueRange;
-      settings.legendLowerRange = styleConfiguration->legendLowerRange;
-      settings.legendUpperRange = styleConfiguration->legendUpperRange;
-      settings.hasNodataValue = dataSource->getDataObject(0)->hasNodataValue;
-      settings.nodataValue = (float)settings.dfNodataValue;
-
-      settings.legendLog = styleConfiguration->legendLog;
-      if (settings.legendLog > 0) {
-        settings.legendLogAsLog = log10(settings.legendLog);
-      } else {
-        settings.legendLogAsLog = 0;
-      }
-      settings.legendScale = styleConfiguration->legendScale;
-      settings.legendOffset = styleConfiguration->legendOffset;
-      settings.drawImage = drawImage;
+      initSettings(settings, dataSource, drawImage);
 
       if (styleConfiguration->renderMethod & RM_AVG_RGBA) {
 
@@ -532,54 +524,11 @@ private:
       return;
     }
 
-    // This enables if tiles are divided allong threads.
-    int numThreads = 4;
-    // Threading is not needed when only one thread is specified.
-    bool useThreading = true;
-    if (numThreads == 1) useThreading = false;
-
+    double dfMaskBBOX[4];
     warper->findExtent(dataSource, dfMaskBBOX);
 
-    int tile_width = 16;
-    int tile_height = 16;
-    int x_div = 1;
-    int y_div = 1;
-    if (warper->isProjectionRequired() == false) {
-      // CDBDebug("No reprojection required");
-      tile_height = drawImage->Geo->dHeight;
-      tile_width = drawImage->Geo->dWidth;
-      // When we are drawing just one tile, threading is not needed
-      useThreading = false;
-    } else {
-      x_div = int((float(drawImage->Geo->dWidth) / tile_width)) + 1;
-      y_div = int((float(drawImage->Geo->dHeight) / tile_height)) + 1;
-    }
-    internalWidth = tile_width * x_div;
-    internalHeight = tile_height * y_div;
-
-    // New geo location needs to be extended based on new width and height
-    CGeoParams internalGeo;
-    internalGeo.copy(drawImage->Geo);
-
-    internalGeo.dfBBOX[2] = ((drawImage->Geo->dfBBOX[2] - drawImage->Geo->dfBBOX[0]) / double(drawImage->Geo->dWidth)) * double(internalWidth) + drawImage->Geo->dfBBOX[0];
-    internalGeo.dfBBOX[1] = ((drawImage->Geo->dfBBOX[1] - drawImage->Geo->dfBBOX[3]) / double(drawImage->Geo->dHeight)) * double(internalHeight) + drawImage->Geo->dfBBOX[3];
-    // internalGeo->dfBBOX[3]
-
-    // int tile_width=int((double(drawImage->Geo->dWidth)/double(x_div))+0.5);
-    // int tile_height=int((double(drawImage->Geo->dHeight)/double(y_div))+0.5);
-
-    // Setup the renderer to draw the tiles with.We do not keep the calculated results for CDF_CHAR (faster)
-    CAreaMapper *drawTileClass = NULL;
-    if (dataSource->getDataObject(0)->cdfVariable->getType() == CDF_CHAR || dataSource->getDataObject(0)->cdfVariable->getType() == CDF_BYTE ||
-        dataSource->getDataObject(0)->cdfVariable->getType() == CDF_UBYTE) {
-      drawTileClass = new CAreaMapper(); // Do not keep the calculated results for CDF_CHAR
-
-    } else {
-      // drawTileClass = new CDrawTileObjByteCache();  //keep the calculated results
-      drawTileClass = new CAreaMapper(); // Do not keep the calculated results for CDF_CHAR
-    }
-    // drawTileClass = new CDrawTileObjByteCache();           //Do not keep the calculated results for CDF_CHAR
-    // drawTileClass = new CDrawTileObj();  //keep the calculated results
+    // Setup the renderer to draw the tiles with.
+    CAreaMapper *drawTileClass = new CAreaMapper();
 
     // Reproj back and forth datasource boundingbox
     double y1 = dataSource->dfBBOX[1];
@@ -611,92 +560,57 @@ private:
       }
     }
 
-    drawTileClass->init(dataSource, drawImage, tile_width, tile_height);
+    drawTileClass->init(dataSource, drawImage);
+
+    // Only the corners of the tiles are projected, see CAdaptiveTiles for the tile sizes.
+    std::vector<CAdaptiveTile> tiles;
+    CAdaptiveTiles::makeTiles(warper, dataSource, drawImage->Geo, dfMaskBBOX, tiles);
 
 #ifdef CIMGWARPNEARESTNEIGHBOUR_DEBUG
-    CDBDebug("x_div, y_div:  %d %d", x_div, y_div);
-    CDBDebug("tile_width, tile_height:  %d %d", tile_width, tile_height);
-    CDBDebug("internalWidth, internalHeight:  %d %d", internalWidth, internalHeight);
+    CDBDebug("Number of tiles:  %d", (int)tiles.size());
     CDBDebug("datasource:  %f %f %f %f", dataSource->dfBBOX[0], dataSource->dfBBOX[1], dataSource->dfBBOX[2], dataSource->dfBBOX[3]);
-    CDBDebug("destination: %f %f %f %f", internalGeo.dfBBOX[0], internalGeo.dfBBOX[1], internalGeo.dfBBOX[2], internalGeo.dfBBOX[3]);
+    CDBDebug("destination: %f %f %f %f", drawImage->Geo->dfBBOX[0], drawImage->Geo->dfBBOX[1], drawImage->Geo->dfBBOX[2], drawImage->Geo->dfBBOX[3]);
 #endif
 
-    int numberOfTiles = x_div * y_div;
-    DrawTileSettings *drawTileSettings = new DrawTileSettings[numberOfTiles];
-    DrawTileSettings *curTileSettings;
-    for (int x = 0; x < x_div; x++) {
-      for (int y = 0; y < y_div; y++) {
-        status = reproj(warper, dataSource, &internalGeo, x, (y_div - 1) - y, x_div, y_div);
-        int tileId = x + y * x_div;
-        curTileSettings = &drawTileSettings[tileId];
-        curTileSettings->id = tileId;
-        if (status != 0) curTileSettings->id = (-tileId) - 1; // This one does not need to be done.
-        for (int j = 0; j < 4; j++) {
-          curTileSettings->x_corners[j] = x_corners[j];
-          curTileSettings->y_corners[j] = y_corners[j];
-        }
-        // Some safety checks when odd files come out of the projection algorithm
-        if ((x_corners[0] >= DBL_MAX || x_corners[0] <= -DBL_MAX) && x_div == 1 && x_div == 1) {
-          curTileSettings->x_corners[0] = internalGeo.dfBBOX[2];
-          curTileSettings->x_corners[1] = internalGeo.dfBBOX[2];
-          curTileSettings->x_corners[2] = internalGeo.dfBBOX[0];
-          curTileSettings->x_corners[3] = internalGeo.dfBBOX[0];
-          curTileSettings->y_corners[0] = internalGeo.dfBBOX[3];
-          curTileSettings->y_corners[1] = internalGeo.dfBBOX[1];
-          curTileSettings->y_corners[2] = internalGeo.dfBBOX[1];
-          curTileSettings->y_corners[3] = internalGeo.dfBBOX[3];
-        }
-        curTileSettings->tile_offset_x = int(x * tile_width);
-        curTileSettings->tile_offset_y = int(y * tile_height);
-        curTileSettings->drawTile = drawTileClass;
+    // Same projection and one tile covering the image: image pixels map to grid cells by scaling and an offset, resample whole rows
+    // The debug outline of the tiles is only drawn by CAreaMapper
+    bool tileDebug = dataSource->cfgLayer->TileSettings.size() == 1 && dataSource->cfgLayer->TileSettings[0]->attr.debug.equals("true");
+    CAffineResampler resampler;
+    if (warper->isProjectionRequired() == false && tiles.size() == 1 && tileDebug == false &&
+        resampler.initNearest(dataSource->dfBBOX, dataSource->dWidth, dataSource->dHeight, tiles[0].x_corners, tiles[0].y_corners, tiles[0].width, tiles[0].height)) {
+#ifdef CIMGWARPNEARESTNEIGHBOUR_DEBUG
+      CDBDebug("No reprojection required: using _plotAffine");
+#endif
+      delete drawTileClass;
+      switch (dataSource->getDataObject(0)->cdfVariable->getType()) {
+      case CDF_CHAR:
+      case CDF_BYTE:
+        return _plotAffine<char>(&resampler, dataSource, drawImage);
+      case CDF_UBYTE:
+        return _plotAffine<unsigned char>(&resampler, dataSource, drawImage);
+      case CDF_SHORT:
+        return _plotAffine<short>(&resampler, dataSource, drawImage);
+      case CDF_USHORT:
+        return _plotAffine<ushort>(&resampler, dataSource, drawImage);
+      case CDF_INT:
+        return _plotAffine<int>(&resampler, dataSource, drawImage);
+      case CDF_UINT:
+        return _plotAffine<uint>(&resampler, dataSource, drawImage);
+      case CDF_FLOAT:
+        return _plotAffine<float>(&resampler, dataSource, drawImage);
+      case CDF_DOUBLE:
+        return _plotAffine<double>(&resampler, dataSource, drawImage);
       }
+      return;
     }
 
-    if (useThreading == false) {
-      DrawMultipleTileSettings dmf;
-      dmf.ct = drawTileSettings;
-      dmf.numberOfTiles = numberOfTiles;
-      dmf.startTile = 0;
-      dmf.endTile = numberOfTiles;
-      drawTiles(&dmf);
-    }
-
-    if (useThreading == true) {
-      int errcode;
-      pthread_t threads[numThreads];
-      DrawMultipleTileSettings dmf[numThreads];
-      int tileBlockSize = numberOfTiles / numThreads;
-      // Divide the tiles over the threads, and start the thread.
-      for (int j = 0; j < numThreads; j++) {
-        dmf[j].ct = drawTileSettings;
-        dmf[j].numberOfTiles = numberOfTiles;
-        dmf[j].startTile = tileBlockSize * j;
-        ;
-        dmf[j].endTile = tileBlockSize * (j + 1);
-
-        // Make sure that all blocks are processed
-        if (j == numThreads - 1) dmf[j].endTile = numberOfTiles;
-
-        // CDBDebug("%d - start %d stop %d",j,dmf[j].startTile,dmf[j].endTile);
-        DrawMultipleTileSettings *t_dmf = &dmf[j];
-        errcode = pthread_create(&threads[j], NULL, drawTiles, t_dmf);
-        if (errcode) {
-          CDBError("pthread_create");
-          return;
-        }
-      }
-      // reap the threads as they exit
-      for (int worker = 0; worker < numThreads; worker++) {
-        int *status; // TODO fix somehow the return status of the threads.
-        // wait for thread to terminate
-        errcode = pthread_join(threads[worker], (void **)&status);
-        if (errcode) {
-          CDBError("pthread_join");
-          return;
-        }
-      }
+    // Tiles with nodata are cheap, so threads take a few tiles at a time instead of a fixed share.
+    if (tiles.size() > 0) {
+      DrawTileSettings settings;
+      settings.tiles = &tiles[0];
+      settings.drawTile = drawTileClass;
+      CParallelFor::runDynamic(drawTiles, &settings, int(tiles.size()), 4, CAdaptiveTiles::getNumThreads(dataSource));
     }
-    delete[] drawTileSettings;
     delete drawTileClass;
   }
 };
@@ -25,15 +25,14 @@
 
 //#define CIMGWARPNEARESTRGBA_DEBUG
 #include "CImgWarpNearestRGBA.h"
+#include "CParallelFor.h"
 const char *CImgWarpNearestRGBA::className = "CImgWarpNearestRGBA";
 const char *CDrawTileObjBGRA::className = "CDrawTileObjBGRA";
 #define CIMGWARPNEARESTRGBA_USEDRAWIMAGE
 
-void CDrawTileObjBGRA::init(CDataSource *dataSource, CDrawImage *drawImage, int tileWidth, int tileHeight) {
+void CDrawTileObjBGRA::init(CDataSource *dataSource, CDrawImage *drawImage) {
   this->dataSource = dataSource;
   this->drawImage = drawImage;
-  dfTileWidth = tileWidth;
-  dfTileHeight = tileHeight;
   for (int k = 0; k < 4; k++) {
     dfSourceBBOX[k] = dataSource->dfBBOX[k];
     dfImageBBOX[k] = dataSource->dfBBOX[k];
@@ -68,7 +67,9 @@ void CDrawTileObjBGRA::init(CDataSource *dataSource, CDrawImage *drawImage, int
   legendOffset = styleConfiguration->legendOffset;
 }
 
-int CDrawTileObjBGRA::drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY, bool debug) {
+int CDrawTileObjBGRA::drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY, int tileWidth, int tileHeight, bool debug) {
+  double dfTileWidth = tileWidth;
+  double dfTileHeight = tileHeight;
   uint *data = (uint *)dataSource->getDataObject(0)->cdfVariable->data;
 #ifndef CIMGWARPNEARESTRGBA_USEDRAWIMAGE
   uint *imageData = (uint *)drawImage->getCanvasMemory();
@@ -211,86 +212,15 @@ int CDrawTileObjBGRA::drawTile(double *x_corners, double *y_corners, int &dDestX
   return 0;
 }
 
-void *CImgWarpNearestRGBA::drawTiles(void *arg) {
-  DrawMultipleTileSettings *dmf = (DrawMultipleTileSettings *)arg;
-  for (int j = dmf->startTile; j < dmf->endTile && j < dmf->numberOfTiles; j++) {
-    DrawTileSettings *ct = &dmf->ct[j];
+void CImgWarpNearestRGBA::drawTiles(int start, int end, void *userData) {
+  DrawTileSettings *settings = (DrawTileSettings *)userData;
+  for (int j = start; j < end; j++) {
+    CAdaptiveTile *tile = &settings->tiles[j];
 #ifdef CIMGWARPNEARESTRGBA_DEBUG
     CDBDebug("Drawing tile %d", j);
 #endif
-    if (ct->id >= 0) {
-#ifdef CIMGWARPNEARESTRGBA_DEBUG
-      CDBDebug("Drawing tile id %d", ct->id);
-#endif
-      // int status =
-      ct->drawTile->drawTile(ct->x_corners, ct->y_corners, ct->tile_offset_x, ct->tile_offset_y, ct->debug);
-      /*if(status!=0){
-        CDBError("Unable to draw tile at line %d",status);
-      }*/
-    }
-  }
-  return arg;
-}
-
-int CImgWarpNearestRGBA::reproj(CImageWarper *warper, CDataSource *, CGeoParams *GeoDest, double dfx, double dfy, double x_div, double y_div) {
-  double psx[4];
-  double psy[4];
-  double dfTiledBBOX[4];
-  double dfTileW = (GeoDest->dfBBOX[2] - GeoDest->dfBBOX[0]) / double(x_div);
-  double dfTileH = (GeoDest->dfBBOX[3] - GeoDest->dfBBOX[1]) / double(y_div);
-
-  dfTiledBBOX[0] = GeoDest->dfBBOX[0] + dfTileW * dfx;
-  dfTiledBBOX[1] = GeoDest->dfBBOX[1] + dfTileH * dfy;
-  dfTiledBBOX[2] = dfTiledBBOX[0] + (dfTileW);
-  dfTiledBBOX[3] = dfTiledBBOX[1] + (dfTileH);
-  double dfSourceBBOX[4];
-  for (int k = 0; k < 4; k++) dfSourceBBOX[k] = dfMaskBBOX[k];
-  if (dfMaskBBOX[3] < dfMaskBBOX[1]) {
-    dfSourceBBOX[1] = dfMaskBBOX[3];
-    dfSourceBBOX[3] = dfMaskBBOX[1];
-  }
-  if ((dfTiledBBOX[0] > dfSourceBBOX[0] - dfTileW && dfTiledBBOX[0] < dfSourceBBOX[2] + dfTileW) && (dfTiledBBOX[2] > dfSourceBBOX[0] - dfTileW && dfTiledBBOX[2] < dfSourceBBOX[2] + dfTileW) &&
-      (dfTiledBBOX[1] > dfSourceBBOX[1] - dfTileH && dfTiledBBOX[1] < dfSourceBBOX[3] + dfTileH) && (dfTiledBBOX[3] > dfSourceBBOX[1] - dfTileH && dfTiledBBOX[3] < dfSourceBBOX[3] + dfTileH))
-    ;
-  else
-    return 1;
-  psx[0] = dfTiledBBOX[2];
-  psx[1] = dfTiledBBOX[2];
-  psx[2] = dfTiledBBOX[0];
-  psx[3] = dfTiledBBOX[0];
-  psy[0] = dfTiledBBOX[1];
-  psy[1] = dfTiledBBOX[3];
-  psy[2] = dfTiledBBOX[3];
-  psy[3] = dfTiledBBOX[1];
-  if (warper->isProjectionRequired()) {
-    //     CT::string destinationCRS;
-    //     warper->decodeCRS(&destinationCRS,&GeoDest->CRS);
-    if (warper->destNeedsDegreeRadianConversion) {
-      for (int j = 0; j < 4; j++) {
-        psx[j] *= DEG_TO_RAD;
-        psy[j] *= DEG_TO_RAD;
-      }
-    }
-    pj_transform(warper->destpj, warper->sourcepj, 4, 0, psx, psy, NULL);
-    if (warper->sourceNeedsDegreeRadianConversion) {
-      for (int j = 0; j < 4; j++) {
-        psx[j] /= DEG_TO_RAD;
-        psy[j] /= DEG_TO_RAD;
-      }
-    }
+    settings->drawTile->drawTile(tile->x_corners, tile->y_corners, tile->offsetX, tile->offsetY, tile->width, tile->height, settings->debug);
   }
-  x_corners[0] = psx[1];
-  y_corners[0] = psy[1];
-
-  x_corners[1] = psx[0];
-  y_corners[1] = psy[0];
-
-  x_corners[2] = psx[3];
-  y_corners[2] = psy[3];
-
-  x_corners[3] = psx[2];
-  y_corners[3] = psy[2];
-  return 0;
 }
 
 void CImgWarpNearestRGBA::render(CImageWarper *warper, CDataSource *dataSource, CDrawImage *drawImage) {
@@ -304,58 +234,22 @@ void CImgWarpNearestRGBA::render(CImageWarper *warper, CDataSource *dataSource,
     imageData[j]=0;
   }*/
   // CDBDebug("Render");
-  // This enables if tiles are divided allong threads.
-  int numThreads = 4;
-  // Threading is not needed when only one thread is specified.
-  bool useThreading = true;
-  if (numThreads == 1) useThreading = false;
-
+  double dfMaskBBOX[4];
   warper->findExtent(dataSource, dfMaskBBOX);
-  int tile_width = 16;
-  int tile_height = 16;
-  int x_div = 1;
-  int y_div = 1;
-  if (warper->isProjectionRequired() == false) {
-    // CDBDebug("No reprojection required");
-    tile_height = drawImage->Geo->dHeight;
-    tile_width = drawImage->Geo->dWidth;
-    // When we are drawing just one tile, threading is not needed
-    useThreading = false;
-  } else {
-    x_div = int((float(drawImage->Geo->dWidth) / tile_width)) + 1;
-    y_div = int((float(drawImage->Geo->dHeight) / tile_height)) + 1;
-  }
-  int internalWidth = tile_width * x_div;
-  int internalHeight = tile_height * y_div;
-
-  // New geo location needs to be extended based on new width and height
-  CGeoParams internalGeo;
-  internalGeo.copy(drawImage->Geo);
-
-  internalGeo.dfBBOX[2] = ((drawImage->Geo->dfBBOX[2] - drawImage->Geo->dfBBOX[0]) / double(drawImage->Geo->dWidth)) * double(internalWidth) + drawImage->Geo->dfBBOX[0];
-  internalGeo.dfBBOX[1] = ((drawImage->Geo->dfBBOX[1] - drawImage->Geo->dfBBOX[3]) / double(drawImage->Geo->dHeight)) * double(internalHeight) + drawImage->Geo->dfBBOX[3];
 
-  // Setup the renderer to draw the tiles with.We do not keep the calculated results for CDF_CHAR (faster)
-  CDrawTileObjBGRA *drawTileClass = NULL;
-  if (dataSource->getDataObject(0)->cdfVariable->getType() == CDF_CHAR || dataSource->getDataObject(0)->cdfVariable->getType() == CDF_BYTE ||
-      dataSource->getDataObject(0)->cdfVariable->getType() == CDF_UBYTE) {
-    drawTileClass = new CDrawTileObjBGRA(); // Do not keep the calculated results for CDF_CHAR
+  // Setup the renderer to draw the tiles with.
+  CDrawTileObjBGRA *drawTileClass = new CDrawTileObjBGRA();
+  drawTileClass->init(dataSource, drawImage);
 
-  } else {
-    // drawTileClass = new CDrawTileObjBGRAByteCache();  //keep the calculated results
-    drawTileClass = new CDrawTileObjBGRA(); // Do not keep the calculated results for CDF_CHAR
-  }
-  // drawTileClass = new CDrawTileObjBGRAByteCache();           //Do not keep the calculated results for CDF_CHAR
-  // drawTileClass = new CDrawTileObjBGRA();  //keep the calculated results
-  drawTileClass->init(dataSource, drawImage, (int)tile_width, (int)tile_height);
+  // Only the corners of the tiles are projected, see CAdaptiveTiles for the tile sizes.
+  std::vector<CAdaptiveTile> tiles;
+  CAdaptiveTiles::makeTiles(warper, dataSource, drawImage->Geo, dfMaskBBOX, tiles);
 
 #ifdef CIMGWARPNEARESTRGBA_DEBUG
-  CDBDebug("x_div, y_div:  %d %d", x_div, y_div);
+  CDBDebug("Number of tiles:  %d", (int)tiles.size());
   CDBDebug("datasource:  %f %f %f %f", dataSource->dfBBOX[0], dataSource->dfBBOX[1], dataSource->dfBBOX[2], dataSource->dfBBOX[3]);
-  CDBDebug("destination: %f %f %f %f", internalGeo.dfBBOX[0], internalGeo.dfBBOX[1], internalGeo.dfBBOX[2], internalGeo.dfBBOX[3]);
+  CDBDebug("destination: %f %f %f %f", drawImage->Geo->dfBBOX[0], drawImage->Geo->dfBBOX[1], drawImage->Geo->dfBBOX[2], drawImage->Geo->dfBBOX[3]);
 #endif
-  int numberOfTiles = x_div * y_div;
-  DrawTileSettings *drawTileSettings = new DrawTileSettings[numberOfTiles];
   bool debug = false;
 
   if (dataSource->cfgLayer->TileSettings.size() == 1) {
@@ -363,80 +257,14 @@ void CImgWarpNearestRGBA::render(CImageWarper *warper, CDataSource *dataSource,
       debug = true;
     }
   }
-  DrawTileSettings *curTileSettings;
-  for (int x = 0; x < x_div; x++) {
-    for (int y = 0; y < y_div; y++) {
-      status = reproj(warper, dataSource, &internalGeo, x, (y_div - 1) - y, x_div, y_div);
-      int tileId = x + y * x_div;
-      curTileSettings = &drawTileSettings[tileId];
-      curTileSettings->debug = debug;
-      curTileSettings->id = tileId;
-      if (status != 0) curTileSettings->id = (-tileId) - 1; // This one does not need to be done.
-      for (int j = 0; j < 4; j++) {
-        curTileSettings->x_corners[j] = x_corners[j];
-        curTileSettings->y_corners[j] = y_corners[j];
-      }
-      // Some safety checks when odd files come out of the projection algorithm
-      if ((x_corners[0] >= DBL_MAX || x_corners[0] <= -DBL_MAX) && x_div == 1 && x_div == 1) {
-        curTileSettings->x_corners[0] = internalGeo.dfBBOX[2];
-        curTileSettings->x_corners[1] = internalGeo.dfBBOX[2];
-        curTileSettings->x_corners[2] = internalGeo.dfBBOX[0];
-        curTileSettings->x_corners[3] = internalGeo.dfBBOX[0];
-        curTileSettings->y_corners[0] = internalGeo.dfBBOX[3];
-        curTileSettings->y_corners[1] = internalGeo.dfBBOX[1];
-        curTileSettings->y_corners[2] = internalGeo.dfBBOX[1];
-        curTileSettings->y_corners[3] = internalGeo.dfBBOX[3];
-      }
-      curTileSettings->tile_offset_x = int(x * tile_width);
-      curTileSettings->tile_offset_y = int(y * tile_height);
-      curTileSettings->drawTile = drawTileClass;
-    }
-  }
 
-  if (useThreading == false) {
-    DrawMultipleTileSettings dmf;
-    dmf.ct = drawTileSettings;
-    dmf.numberOfTiles = numberOfTiles;
-    dmf.startTile = 0;
-    dmf.endTile = numberOfTiles;
-    drawTiles(&dmf);
-  }
-
-  if (useThreading == true) {
-    int errcode;
-    pthread_t threads[numThreads];
-    DrawMultipleTileSettings dmf[numThreads];
-    int tileBlockSize = numberOfTiles / numThreads;
-    // Divide the tiles over the threads, and start the thread.
-    for (int j = 0; j < numThreads; j++) {
-      dmf[j].ct = drawTileSettings;
-      dmf[j].numberOfTiles = numberOfTiles;
-      dmf[j].startTile = tileBlockSize * j;
-      ;
-      dmf[j].endTile = tileBlockSize * (j + 1);
-
-      // Make sure that all blocks are processed
-      if (j == numThreads - 1) dmf[j].endTile = numberOfTiles;
-
-      // CDBDebug("%d - start %d stop %d",j,dmf[j].startTile,dmf[j].endTile);
-      DrawMultipleTileSettings *t_dmf = &dmf[j];
-      errcode = pthread_create(&threads[j], NULL, drawTiles, t_dmf);
-      if (errcode) {
-        CDBError("pthread_create");
-        return;
-      }
-    }
-    // reap the threads as they exit
-    for (int worker = 0; worker < numThreads; worker++) {
-      int *status; // TODO fix somehow the return status of the threads.
-      // wait for thread to terminate
-      errcode = pthread_join(threads[worker], (void **)&status);
-      if (errcode) {
-        CDBError("pthread_join");
-        return;
-      }
-    }
+  // Tiles with nodata are cheap, so threads take a few tiles at a time instead of a fixed share.
+  if (tiles.size() > 0) {
+    DrawTileSettings settings;
+    settings.tiles = &tiles[0];
+    settings.drawTile = drawTileClass;
+    settings.debug = debug;
+    CParallelFor::runDynamic(drawTiles, &settings, int(tiles.size()), 4, CAdaptiveTiles::getNumThreads(dataSource));
   }
-  delete[] drawTileSettings;
   delete drawTileClass;
 }
@@ -28,6 +28,7 @@
 #include <float.h>
 #include <pthread.h>
 #include "CImageWarperRenderInterface.h"
+#include "CAdaptiveTiles.h"
 
 /**
  *  This tile just runs over the datasource field, and calculates the destination pixel color over and over again when it is requested twice.
@@ -38,7 +39,6 @@ private:
   DEF_ERRORFUNCTION();
 
 public:
-  double dfTileWidth, dfTileHeight;
   double dfSourceBBOX[4];
   double dfImageBBOX[4];
   double dfNodataValue;
@@ -52,8 +52,8 @@ public:
   CDataSource *dataSource;
   CDrawImage *drawImage;
   // size_t prev_imgpointer;
-  void init(CDataSource *dataSource, CDrawImage *drawImage, int tileWidth, int tileHeight);
-  int drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY, bool debug);
+  void init(CDataSource *dataSource, CDrawImage *drawImage);
+  int drawTile(double *x_corners, double *y_corners, int &dDestX, int &dDestY, int tileWidth, int tileHeight, bool debug);
   void pixel_blend(int x, int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
 };
 
@@ -68,29 +68,15 @@ private:
   int set(const char *) { return 0; }
   int status;
 
-  // This class represents settings/properties for each separate tile
+  // The tiles to draw and the renderer to draw them with
   class DrawTileSettings {
   public:
-    int id;
-    double y_corners[4], x_corners[4];
-    int tile_offset_x, tile_offset_y;
+    CAdaptiveTile *tiles;
     CDrawTileObjBGRA *drawTile;
     bool debug;
   };
-  // This class represents which bunch of tiles needs to be drawn by which thread.
-  class DrawMultipleTileSettings {
-  public:
-    DrawTileSettings *ct;
-    int numberOfTiles, startTile, endTile;
-  };
-  // This method draws th bunch of selected tiles with the proper renderer.
-  // This method can be called by a thread.
-  static void *drawTiles(void *arg);
-
-  // Reproject the corners of the tiles
-  double y_corners[4], x_corners[4];
-  double dfMaskBBOX[4];
-  int reproj(CImageWarper *warper, CDataSource *dataSource, CGeoParams *GeoDest, double dfx, double dfy, double x_div, double y_div);
+  // Draws the tiles [start, end), called by CParallelFor from several threads.
+  static void drawTiles(int start, int end, void *userData);
 
   // Setup projection and all other settings for the tiles to draw
   void render(CImageWarper *warper, CDataSource *dataSource, CDrawImage *drawImage);
@@ -0,0 +1,164 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CLegendCache.h"
+#include <map>
+#include <string>
+#include <string.h>
+#include <pthread.h>
+#include "CCache.h"
+#include "CResponseCache.h"
+
+const char *CLegendCache::className = "CLegendCache";
+
+#define CLEGENDCACHE_FILEID "ALG1"
+#define CLEGENDCACHE_MAXMEMORYENTRIES 64
+
+class CLegendCacheEntry {
+public:
+  int width, height;
+  std::vector<unsigned char> pixels;
+};
+
+static std::map<std::string, CLegendCacheEntry> legendCacheEntries;
+static pthread_mutex_t CLegendCache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The key with the configuration state, hashed to a name which can be used as file name */
+CT::string CLegendCache::makeCacheKey(CServerParams *srvParams, const char *key) {
+  CT::string fullKey = key;
+  fullKey.concat("\n");
+  CResponseCache::appendConfigState(srvParams, fullKey);
+  CT::string cacheKey = "legends/";
+  cacheKey.concat(CResponseCache::hashKey(fullKey.c_str()).c_str());
+  return cacheKey;
+}
+
+bool CLegendCache::isCacheable(CDrawImage *image) { return image->getRenderer() == CDRAWIMAGERENDERER_CAIRO && image->getCanvasMemory() != NULL; }
+
+int CLegendCache::readImage(const char *fileName, int &width, int &height, std::vector<unsigned char> &pixels) {
+  FILE *pFile = fopen(fileName, "rb");
+  if (pFile == NULL) return 1;
+  char fileId[4];
+  bool ok = fread(fileId, 1, 4, pFile) == 4 && strncmp(fileId, CLEGENDCACHE_FILEID, 4) == 0;
+  ok = ok && fread(&width, sizeof(int), 1, pFile) == 1;
+  ok = ok && fread(&height, sizeof(int), 1, pFile) == 1;
+  ok = ok && width > 0 && height > 0;
+  if (ok) {
+    pixels.resize(size_t(width) * height * 4);
+    ok = fread(&pixels[0], 1, pixels.size(), pFile) == pixels.size();
+  }
+  fclose(pFile);
+  return ok ? 0 : 2;
+}
+
+int CLegendCache::writeImage(const char *fileName, int width, int height, const unsigned char *pixels) {
+  FILE *pFile = fopen(fileName, "wb");
+  if (pFile == NULL) return 1;
+  size_t size = size_t(width) * height * 4;
+  bool ok = fwrite(CLEGENDCACHE_FILEID, 1, 4, pFile) == 4;
+  ok = ok && fwrite(&width, sizeof(int), 1, pFile) == 1;
+  ok = ok && fwrite(&height, sizeof(int), 1, pFile) == 1;
+  ok = ok && fwrite(pixels, 1, size, pFile) == size;
+  fclose(pFile);
+  return ok ? 0 : 2;
+}
+
+void CLegendCache::setImage(CDrawImage *image, int width, int height, const unsigned char *pixels) {
+  /* Recreate the image with the same settings and palette, like CDrawImage::rotate does */
+  CDrawImage temp;
+  temp.createImage(image, width, height);
+  image->destroyImage();
+  image->createImage(&temp, width, height);
+  temp.destroyImage();
+  memcpy(image->getCanvasMemory(), pixels, size_t(width) * height * 4);
+}
+
+int CLegendCache::get(CServerParams *srvParams, const char *key, CDrawImage *image) {
+  if (!isCacheable(image)) return 1;
+  CT::string cacheKey = makeCacheKey(srvParams, key);
+
+  pthread_mutex_lock(&CLegendCache_lock);
+  std::map<std::string, CLegendCacheEntry>::iterator it = legendCacheEntries.find(cacheKey.c_str());
+  if (it != legendCacheEntries.end()) {
+    setImage(image, it->second.width, it->second.height, &it->second.pixels[0]);
+    pthread_mutex_unlock(&CLegendCache_lock);
+    return 0;
+  }
+  pthread_mutex_unlock(&CLegendCache_lock);
+
+  CT::StackList<CT::string> configFiles = srvParams->configFileName.splitToStack(",");
+  if (srvParams->cfg->TempDir.size() == 0 || srvParams->cfg->TempDir[0]->attr.value.empty() || configFiles.size() == 0) return 1;
+  CCache cache;
+  cache.checkCacheSystemReady(srvParams->cfg->TempDir[0]->attr.value.c_str(), cacheKey.c_str(), configFiles[0].c_str(), "CLegendCache::get");
+  if (!cache.cacheIsAvailable()) {
+    CCache::countLookup(false);
+    return 1;
+  }
+  CLegendCacheEntry entry;
+  if (readImage(cache.getCacheFileNameToRead(), entry.width, entry.height, entry.pixels) != 0) {
+    CDBWarning("Unable to read legend from cache %s", cache.getCacheFileNameToRead());
+    CCache::countLookup(false);
+    return 1;
+  }
+  CCache::countLookup(true);
+  setImage(image, entry.width, entry.height, &entry.pixels[0]);
+
+  pthread_mutex_lock(&CLegendCache_lock);
+  if (legendCacheEntries.size() < CLEGENDCACHE_MAXMEMORYENTRIES) {
+    legendCacheEntries[cacheKey.c_str()] = entry;
+  }
+  pthread_mutex_unlock(&CLegendCache_lock);
+  return 0;
+}
+
+void CLegendCache::put(CServerParams *srvParams, const char *key, CDrawImage *image) {
+  if (!isCacheable(image)) return;
+  CT::string cacheKey = makeCacheKey(srvParams, key);
+  int width = image->Geo->dWidth;
+  int height = image->Geo->dHeight;
+  const unsigned char *pixels = image->getCanvasMemory();
+
+  pthread_mutex_lock(&CLegendCache_lock);
+  if (legendCacheEntries.size() < CLEGENDCACHE_MAXMEMORYENTRIES) {
+    CLegendCacheEntry &entry = legendCacheEntries[cacheKey.c_str()];
+    entry.width = width;
+    entry.height = height;
+    entry.pixels.assign(pixels, pixels + size_t(width) * height * 4);
+  }
+  pthread_mutex_unlock(&CLegendCache_lock);
+
+  CT::StackList<CT::string> configFiles = srvParams->configFileName.splitToStack(",");
+  if (srvParams->cfg->TempDir.size() == 0 || srvParams->cfg->TempDir[0]->attr.value.empty() || configFiles.size() == 0) return;
+  CCache cache;
+  cache.checkCacheSystemReady(srvParams->cfg->TempDir[0]->attr.value.c_str(), cacheKey.c_str(), configFiles[0].c_str(), "CLegendCache::put");
+  if (cache.saveCacheFile() && cache.claimCacheFile() == 0) {
+    if (writeImage(cache.getCacheFileNameToWrite(), width, height, pixels) == 0) {
+      cache.releaseCacheFile();
+    } else {
+      CDBWarning("Unable to write legend to cache");
+      cache.removeClaimedCachefile();
+    }
+  }
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CLEGENDCACHE_H
+#define CLEGENDCACHE_H
+
+#include "CServerParams.h"
+#include "CDrawImage.h"
+#include "CDebugger.h"
+
+/**
+ * @brief Keeps rendered legends and scalebars as ARGB buffers, in memory for the current process and on disk below the TempDir
+ * for the next requests. Only images drawn with the cairo renderer are cached.
+ *
+ * The key is built by the caller from everything which determines the drawing. The state of the configuration files is
+ * appended by the cache, so editing a style invalidates its legends.
+ */
+class CLegendCache {
+private:
+  DEF_ERRORFUNCTION();
+  static CT::string makeCacheKey(CServerParams *srvParams, const char *key);
+  static int readImage(const char *fileName, int &width, int &height, std::vector<unsigned char> &pixels);
+  static int writeImage(const char *fileName, int width, int height, const unsigned char *pixels);
+  static void setImage(CDrawImage *image, int width, int height, const unsigned char *pixels);
+
+public:
+  /**
+   * @brief Returns true when image can be cached, it needs to use the cairo renderer
+   */
+  static bool isCacheable(CDrawImage *image);
+
+  /**
+   * @brief Replaces image by the cached image for key, the size of image changes to the size of the cached image.
+   *
+   * @return Zero when the image was found in the cache
+   */
+  static int get(CServerParams *srvParams, const char *key, CDrawImage *image);
+
+  /**
+   * @brief Stores image under key
+   */
+  static void put(CServerParams *srvParams, const char *key, CDrawImage *image);
+};
+
+#endif
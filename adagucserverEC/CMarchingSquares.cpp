@@ -0,0 +1,249 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CMarchingSquares.h"
+#include <algorithm>
+#include <unordered_map>
+#include <stdio.h>
+#include <string.h>
+
+const char *CMarchingSquares::className = "CMarchingSquares";
+
+#define CMARCHINGSQUARES_FILEID "ACL1"
+
+/*
+  Segments per cell case as pairs of edges, 0=top, 1=right, 2=bottom, 3=left.
+  Case bits: 1=top left, 2=top right, 4=bottom right, 8=bottom left corner is above the iso value.
+  Saddle cases 5 and 10 use the table of the other saddle when the cell center is above the iso value.
+*/
+static const int segmentTable[16][4] = {{-1, -1, -1, -1}, {3, 0, -1, -1}, {0, 1, -1, -1}, {3, 1, -1, -1}, {1, 2, -1, -1}, {3, 0, 1, 2}, {0, 2, -1, -1}, {3, 2, -1, -1},
+                                        {2, 3, -1, -1},   {0, 2, -1, -1}, {0, 1, 2, 3},   {1, 2, -1, -1}, {3, 1, -1, -1}, {0, 1, -1, -1}, {3, 0, -1, -1}, {-1, -1, -1, -1}};
+
+class CMarchingSquaresEdge {
+public:
+  CMarchingSquaresEdge() {
+    seg[0] = -1;
+    seg[1] = -1;
+    x = 0;
+    y = 0;
+  }
+  int seg[2];
+  float x, y;
+};
+
+class CMarchingSquaresSegment {
+public:
+  CMarchingSquaresSegment(size_t a, size_t b, size_t level) {
+    this->a = a;
+    this->b = b;
+    this->level = level;
+  }
+  size_t a, b, level;
+};
+
+static inline bool isNodata(float v, float fNodataValue) { return v == fNodataValue || !(v == v); }
+
+/* Continues a polyline from edge startEdge, coming from segment startSeg, and appends the visited edges */
+static void walkLine(std::vector<CMarchingSquaresSegment> &segments, std::vector<bool> &used, std::unordered_map<size_t, CMarchingSquaresEdge> &edges, int startSeg, size_t startEdge,
+                     std::vector<size_t> &result) {
+  int currentSeg = startSeg;
+  size_t currentEdge = startEdge;
+  while (true) {
+    CMarchingSquaresEdge &edge = edges[currentEdge];
+    int nextSeg = edge.seg[0] == currentSeg ? edge.seg[1] : edge.seg[0];
+    if (nextSeg < 0 || used[nextSeg]) return;
+    used[nextSeg] = true;
+    currentEdge = segments[nextSeg].a == currentEdge ? segments[nextSeg].b : segments[nextSeg].a;
+    currentSeg = nextSeg;
+    result.push_back(currentEdge);
+  }
+}
+
+void CMarchingSquares::traceIsoLines(const float *grid, int W, int H, size_t stride, float fNodataValue, const std::vector<float> &isoValues, int contourDefinitionIndex, std::vector<CContourLine> &lines) {
+  size_t numLevels = isoValues.size();
+  if (numLevels == 0 || W < 2 || H < 2) return;
+
+  std::vector<CMarchingSquaresSegment> segments;
+  std::unordered_map<size_t, CMarchingSquaresEdge> edges;
+
+  for (int y = 0; y < H - 1; y++) {
+    for (int x = 0; x < W - 1; x++) {
+      size_t p = size_t(x) + size_t(y) * stride;
+      float v00 = grid[p];
+      float v10 = grid[p + 1];
+      float v01 = grid[p + stride];
+      float v11 = grid[p + stride + 1];
+      if (isNodata(v00, fNodataValue) || isNodata(v10, fNodataValue) || isNodata(v01, fNodataValue) || isNodata(v11, fNodataValue)) continue;
+
+      float min = std::min(std::min(v00, v10), std::min(v01, v11));
+      float max = std::max(std::max(v00, v10), std::max(v01, v11));
+
+      /* Only the levels with min < c <= max cross this cell */
+      std::vector<float>::const_iterator it = std::upper_bound(isoValues.begin(), isoValues.end(), min);
+      for (; it != isoValues.end() && *it <= max; ++it) {
+        float c = *it;
+        size_t level = it - isoValues.begin();
+        int cellCase = (v00 >= c ? 1 : 0) | (v10 >= c ? 2 : 0) | (v11 >= c ? 4 : 0) | (v01 >= c ? 8 : 0);
+        if (cellCase == 5 || cellCase == 10) {
+          if ((v00 + v10 + v01 + v11) / 4 >= c) cellCase = 15 - cellCase;
+        }
+        const int *table = segmentTable[cellCase];
+        for (int s = 0; s < 4 && table[s] != -1; s += 2) {
+          size_t edgeIds[2];
+          for (int e = 0; e < 2; e++) {
+            size_t edgeId;
+            float ex, ey;
+            switch (table[s + e]) {
+            case 0:
+              edgeId = 2 * p;
+              ex = x + (c - v00) / (v10 - v00);
+              ey = y;
+              break;
+            case 1:
+              edgeId = 2 * (p + 1) + 1;
+              ex = x + 1;
+              ey = y + (c - v10) / (v11 - v10);
+              break;
+            case 2:
+              edgeId = 2 * (p + stride);
+              ex = x + (c - v01) / (v11 - v01);
+              ey = y + 1;
+              break;
+            default:
+              edgeId = 2 * p + 1;
+              ex = x;
+              ey = y + (c - v00) / (v01 - v00);
+              break;
+            }
+            edgeId = edgeId * numLevels + level;
+            CMarchingSquaresEdge &edge = edges[edgeId];
+            edge.x = ex;
+            edge.y = ey;
+            if (edge.seg[0] == -1) {
+              edge.seg[0] = int(segments.size());
+            } else {
+              edge.seg[1] = int(segments.size());
+            }
+            edgeIds[e] = edgeId;
+          }
+          segments.push_back(CMarchingSquaresSegment(edgeIds[0], edgeIds[1], level));
+        }
+      }
+    }
+  }
+
+  /* Join the segments into polylines */
+  std::vector<bool> used(segments.size(), false);
+  std::vector<size_t> forward, backward;
+  for (size_t s = 0; s < segments.size(); s++) {
+    if (used[s]) continue;
+    used[s] = true;
+    forward.clear();
+    backward.clear();
+    forward.push_back(segments[s].a);
+    forward.push_back(segments[s].b);
+    walkLine(segments, used, edges, int(s), segments[s].b, forward);
+    walkLine(segments, used, edges, int(s), segments[s].a, backward);
+
+    lines.push_back(CContourLine());
+    CContourLine &line = lines.back();
+    line.contourDefinitionIndex = contourDefinitionIndex;
+    line.value = isoValues[segments[s].level];
+    size_t numPoints = backward.size() + forward.size();
+    line.x.reserve(numPoints);
+    line.y.reserve(numPoints);
+    for (size_t j = backward.size(); j > 0; j--) {
+      CMarchingSquaresEdge &edge = edges[backward[j - 1]];
+      line.x.push_back(edge.x);
+      line.y.push_back(edge.y);
+    }
+    for (size_t j = 0; j < forward.size(); j++) {
+      CMarchingSquaresEdge &edge = edges[forward[j]];
+      line.x.push_back(edge.x);
+      line.y.push_back(edge.y);
+    }
+  }
+}
+
+int CMarchingSquares::writeLines(const char *fileName, const std::vector<CContourLine> &lines) {
+  FILE *pFile = fopen(fileName, "wb");
+  if (pFile == NULL) {
+    CDBError("Unable to open %s for writing", fileName);
+    return 1;
+  }
+  bool ok = fwrite(CMARCHINGSQUARES_FILEID, 1, 4, pFile) == 4;
+  size_t numLines = lines.size();
+  ok = ok && fwrite(&numLines, sizeof(size_t), 1, pFile) == 1;
+  for (size_t j = 0; j < numLines && ok; j++) {
+    const CContourLine &line = lines[j];
+    size_t numPoints = line.x.size();
+    ok = ok && fwrite(&line.contourDefinitionIndex, sizeof(int), 1, pFile) == 1;
+    ok = ok && fwrite(&line.value, sizeof(float), 1, pFile) == 1;
+    ok = ok && fwrite(&numPoints, sizeof(size_t), 1, pFile) == 1;
+    if (numPoints > 0) {
+      ok = ok && fwrite(&line.x[0], sizeof(float), numPoints, pFile) == numPoints;
+      ok = ok && fwrite(&line.y[0], sizeof(float), numPoints, pFile) == numPoints;
+    }
+  }
+  fclose(pFile);
+  if (!ok) {
+    CDBError("Unable to write to %s", fileName);
+    return 2;
+  }
+  return 0;
+}
+
+int CMarchingSquares::readLines(const char *fileName, std::vector<CContourLine> &lines) {
+  FILE *pFile = fopen(fileName, "rb");
+  if (pFile == NULL) {
+    CDBError("Unable to open %s for reading", fileName);
+    return 1;
+  }
+  char fileId[4];
+  size_t numLines = 0;
+  bool ok = fread(fileId, 1, 4, pFile) == 4 && strncmp(fileId, CMARCHINGSQUARES_FILEID, 4) == 0;
+  ok = ok && fread(&numLines, sizeof(size_t), 1, pFile) == 1;
+  for (size_t j = 0; j < numLines && ok; j++) {
+    lines.push_back(CContourLine());
+    CContourLine &line = lines.back();
+    size_t numPoints = 0;
+    ok = ok && fread(&line.contourDefinitionIndex, sizeof(int), 1, pFile) == 1;
+    ok = ok && fread(&line.value, sizeof(float), 1, pFile) == 1;
+    ok = ok && fread(&numPoints, sizeof(size_t), 1, pFile) == 1;
+    if (ok && numPoints > 0) {
+      line.x.resize(numPoints);
+      line.y.resize(numPoints);
+      ok = fread(&line.x[0], sizeof(float), numPoints, pFile) == numPoints;
+      ok = ok && fread(&line.y[0], sizeof(float), numPoints, pFile) == numPoints;
+    }
+  }
+  fclose(pFile);
+  if (!ok) {
+    CDBError("Unable to read contour lines from %s", fileName);
+    lines.clear();
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CMARCHINGSQUARES_H
+#define CMARCHINGSQUARES_H
+
+#include <vector>
+#include "CDebugger.h"
+
+/**
+ * @brief A single isoline, the vertices are in grid coordinates (column, row) of the field it was traced on.
+ * Closed lines have an identical first and last vertex.
+ */
+class CContourLine {
+public:
+  int contourDefinitionIndex;
+  float value;
+  std::vector<float> x, y;
+};
+
+/**
+ * @brief Traces isolines on a regular grid with the marching squares algorithm and joins the cell segments into polylines.
+ */
+class CMarchingSquares {
+private:
+  DEF_ERRORFUNCTION();
+
+public:
+  /**
+   * @brief Traces the isolines for the given values. Cells with a nodata or NaN corner are skipped.
+   *
+   * @param grid The field, row major
+   * @param W Width of the field
+   * @param H Height of the field
+   * @param stride Number of values between two rows, at least W
+   * @param fNodataValue The nodata value of the field
+   * @param isoValues The values to trace, need to be sorted ascending
+   * @param contourDefinitionIndex Copied into every resulting line
+   * @param lines Resulting lines are appended to this vector
+   */
+  static void traceIsoLines(const float *grid, int W, int H, size_t stride, float fNodataValue, const std::vector<float> &isoValues, int contourDefinitionIndex, std::vector<CContourLine> &lines);
+
+  /**
+   * @brief Writes lines to a binary file
+   *
+   * @return Zero on success
+   */
+  static int writeLines(const char *fileName, const std::vector<CContourLine> &lines);
+
+  /**
+   * @brief Reads lines written by writeLines
+   *
+   * @return Zero on success
+   */
+  static int readLines(const char *fileName, std::vector<CContourLine> &lines);
+};
+
+#endif
@@ -0,0 +1,220 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "COpenDAPEncoder.h"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+const char *COpenDAPStreamWriter::className = "COpenDAPStreamWriter";
+
+/* The byte swap loops below work on plain arrays, so the compiler can vectorize them. The host is assumed to be little endian. */
+static void swap16To32(const uint16_t *src, size_t count, char *dst) {
+  for (size_t j = 0; j < count; j++) {
+    uint32_t w = __builtin_bswap32(uint32_t(src[j]));
+    memcpy(dst + j * 4, &w, 4);
+  }
+}
+
+static void swap32(const uint32_t *src, size_t count, char *dst) {
+  for (size_t j = 0; j < count; j++) {
+    uint32_t w = __builtin_bswap32(src[j]);
+    memcpy(dst + j * 4, &w, 4);
+  }
+}
+
+static void swap64(const uint64_t *src, size_t count, char *dst) {
+  for (size_t j = 0; j < count; j++) {
+    uint64_t w = __builtin_bswap64(src[j]);
+    memcpy(dst + j * 8, &w, 8);
+  }
+}
+
+void COpenDAPEncoder::appendXDR(const void *data, CDFType type, size_t start, size_t count, std::vector<char> &out) {
+  size_t offset = out.size();
+  switch (type) {
+  case CDF_BYTE:
+  case CDF_UBYTE:
+  case CDF_CHAR:
+    out.resize(offset + count);
+    memcpy(&out[offset], (const char *)data + start, count);
+    break;
+  case CDF_SHORT:
+  case CDF_USHORT:
+    out.resize(offset + count * 4);
+    swap16To32((const uint16_t *)data + start, count, &out[offset]);
+    break;
+  case CDF_INT:
+  case CDF_UINT:
+  case CDF_FLOAT:
+    out.resize(offset + count * 4);
+    swap32((const uint32_t *)data + start, count, &out[offset]);
+    break;
+  case CDF_DOUBLE:
+    out.resize(offset + count * 8);
+    swap64((const uint64_t *)data + start, count, &out[offset]);
+    break;
+  default:
+    break;
+  }
+}
+
+template <typename T> static void appendJSONIntegers(const T *data, size_t count, bool &valuesWritten, std::vector<char> &out) {
+  for (size_t j = 0; j < count; j++) {
+    if (valuesWritten) {
+      out.push_back(',');
+      out.push_back(' ');
+    }
+    valuesWritten = true;
+    COpenDAPEncoder::appendJSONInteger((long long)data[j], out);
+  }
+}
+
+template <typename T> static void appendJSONDoubles(const T *data, size_t count, bool &valuesWritten, std::vector<char> &out) {
+  for (size_t j = 0; j < count; j++) {
+    if (valuesWritten) {
+      out.push_back(',');
+      out.push_back(' ');
+    }
+    valuesWritten = true;
+    COpenDAPEncoder::appendJSONDouble((double)data[j], out);
+  }
+}
+
+void COpenDAPEncoder::appendJSON(const void *data, CDFType type, size_t start, size_t count, bool &valuesWritten, std::vector<char> &out) {
+  switch (type) {
+  case CDF_BYTE:
+  case CDF_CHAR:
+    appendJSONIntegers((const signed char *)data + start, count, valuesWritten, out);
+    break;
+  case CDF_UBYTE:
+    appendJSONIntegers((const unsigned char *)data + start, count, valuesWritten, out);
+    break;
+  case CDF_SHORT:
+    appendJSONIntegers((const short *)data + start, count, valuesWritten, out);
+    break;
+  case CDF_USHORT:
+    appendJSONIntegers((const unsigned short *)data + start, count, valuesWritten, out);
+    break;
+  case CDF_INT:
+    appendJSONIntegers((const int *)data + start, count, valuesWritten, out);
+    break;
+  case CDF_UINT:
+    appendJSONIntegers((const unsigned int *)data + start, count, valuesWritten, out);
+    break;
+  case CDF_FLOAT:
+    appendJSONDoubles((const float *)data + start, count, valuesWritten, out);
+    break;
+  case CDF_DOUBLE:
+    appendJSONDoubles((const double *)data + start, count, valuesWritten, out);
+    break;
+  default:
+    break;
+  }
+}
+
+void COpenDAPEncoder::appendJSONInteger(long long v, std::vector<char> &out) {
+  char digits[24];
+  int n = 0;
+  unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+  do {
+    digits[n++] = char('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (v < 0) out.push_back('-');
+  while (n > 0) out.push_back(digits[--n]);
+}
+
+void COpenDAPEncoder::appendJSONDouble(double v, std::vector<char> &out) {
+  /*
+    Fixed point with six decimals via integers. The product v * 1e6 can be off by a fraction of its last bit, so values
+    which are close to a rounding boundary, large or not finite are left to snprintf to stay identical to "%f".
+  */
+  double a = fabs(v);
+  if (a < 1e6) {
+    double scaled = a * 1e6;
+    double rounded = floor(scaled + 0.5);
+    if (fabs(scaled - floor(scaled) - 0.5) > 1e-3) {
+      unsigned long long i = (unsigned long long)rounded;
+      if (signbit(v)) out.push_back('-');
+      appendJSONInteger((long long)(i / 1000000), out);
+      unsigned long long fraction = i % 1000000;
+      char decimals[7];
+      decimals[0] = '.';
+      for (int j = 6; j > 0; j--) {
+        decimals[j] = char('0' + fraction % 10);
+        fraction /= 10;
+      }
+      out.insert(out.end(), decimals, decimals + 7);
+      return;
+    }
+  }
+  char buffer[512];
+  int n = snprintf(buffer, sizeof(buffer), "%f", v);
+  if (n > 0) out.insert(out.end(), buffer, buffer + (n < int(sizeof(buffer)) ? n : int(sizeof(buffer)) - 1));
+}
+
+COpenDAPStreamWriter::COpenDAPStreamWriter(FILE *stream) {
+  this->stream = stream;
+  busy = false;
+  status = 0;
+}
+
+COpenDAPStreamWriter::~COpenDAPStreamWriter() { wait(); }
+
+void *COpenDAPStreamWriter::writePending(void *arg) {
+  COpenDAPStreamWriter *writer = (COpenDAPStreamWriter *)arg;
+  if (writer->pending.size() > 0 && fwrite(&writer->pending[0], 1, writer->pending.size(), writer->stream) != writer->pending.size()) {
+    writer->status = 1;
+  }
+  return NULL;
+}
+
+int COpenDAPStreamWriter::wait() {
+  if (busy) {
+    busy = false;
+    if (pthread_join(thread, NULL) != 0) {
+      CDBError("pthread_join");
+      status = 1;
+    }
+  }
+  return status;
+}
+
+int COpenDAPStreamWriter::writeAsync(std::vector<char> &buffer) {
+  if (wait() != 0) {
+    CDBError("Unable to write to the output stream");
+    return status;
+  }
+  pending.swap(buffer);
+  buffer.clear();
+  if (pthread_create(&thread, NULL, writePending, this) == 0) {
+    busy = true;
+  } else {
+    CDBWarning("pthread_create failed, writing in calling thread");
+    writePending(this);
+  }
+  return 0;
+}
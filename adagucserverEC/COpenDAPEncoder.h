@@ -0,0 +1,103 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef COPENDAPENCODER_H
+#define COPENDAPENCODER_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <vector>
+#include "CCDFTypes.h"
+#include "CDebugger.h"
+
+/**
+ * @brief Encodes blocks of variable data for the OpenDAP endpoint, as big endian XDR or as JSON numbers.
+ */
+class COpenDAPEncoder {
+public:
+  /**
+   * @brief Appends the values [start, start + count) of data as XDR. Shorts are widened to four bytes, bytes are not padded.
+   *
+   * @param data The variable data
+   * @param type Type of the data, only the numeric types up to CDF_UINT are encoded
+   * @param start Index of the first value
+   * @param count Number of values
+   * @param out The encoded bytes are appended to this buffer
+   */
+  static void appendXDR(const void *data, CDFType type, size_t start, size_t count, std::vector<char> &out);
+
+  /**
+   * @brief Appends the values [start, start + count) of data as comma separated JSON numbers, doubles are formatted like printf "%f".
+   *
+   * @param valuesWritten When true a separator is written before the first value, set to true when something was appended
+   */
+  static void appendJSON(const void *data, CDFType type, size_t start, size_t count, bool &valuesWritten, std::vector<char> &out);
+
+  /**
+   * @brief Appends the decimal representation of v
+   */
+  static void appendJSONInteger(long long v, std::vector<char> &out);
+
+  /**
+   * @brief Appends v formatted like printf "%f"
+   */
+  static void appendJSONDouble(double v, std::vector<char> &out);
+};
+
+/**
+ * @brief Writes buffers to a stream from a separate thread, so the next buffer can be read and encoded in the meantime.
+ * The caller must not use the stream itself until wait has returned.
+ */
+class COpenDAPStreamWriter {
+private:
+  DEF_ERRORFUNCTION();
+  FILE *stream;
+  pthread_t thread;
+  bool busy;
+  int status;
+  std::vector<char> pending;
+  static void *writePending(void *arg);
+
+public:
+  COpenDAPStreamWriter(FILE *stream);
+  ~COpenDAPStreamWriter();
+
+  /**
+   * @brief Waits for the previous buffer and starts writing buffer in the background. The contents of buffer are swapped
+   * with the already written buffer, so on return buffer is empty and its memory can be reused.
+   *
+   * @return Zero on success, nonzero when writing the previous buffer failed
+   */
+  int writeAsync(std::vector<char> &buffer);
+
+  /**
+   * @brief Waits until the buffer being written is done
+   *
+   * @return Zero on success, nonzero when a write failed
+   */
+  int wait();
+};
+
+#endif
@@ -181,54 +181,37 @@ CT::string COpenDAPHandler::createDDSHeader(CT::string layerName, CDFObject *cdf
   return output;
 }
 
-int bytesWritten = 0;
-void COpenDAPHandler::writeInt(int &v) {
-  if (jsonWriter) {
-    if (!jsonValuesWritten) {
-      jsonValuesWritten = true;
-      fprintf(opendapoutstream, "%d", v);
-    } else {
-      fprintf(opendapoutstream, ", %d", v);
-    }
-    return;
+/* Number of values encoded per block before the block is written to the output stream */
+#define COPENDAPHANDLER_BLOCKSIZE 65536
+
+int COpenDAPHandler::writeBlock(std::vector<char> &block) {
+  if (block.size() > 0 && fwrite(&block[0], 1, block.size(), opendapoutstream) != block.size()) {
+    CDBError("Unable to write to the output stream");
+    block.clear();
+    return 1;
   }
-  unsigned char c1 = ((unsigned char)v);
-  unsigned char c2 = ((unsigned char)(v >> 8));
-  unsigned char c3 = ((unsigned char)(v >> 16));
-  unsigned char c4 = ((unsigned char)(v >> 24));
-  ;
-  //   c1 = 48;
-  //   c2=49 ;
-  //   c3 = 50;
-  //   c4 = 51;
-  fwrite(&c4, 1, 1, opendapoutstream);
-  fwrite(&c3, 1, 1, opendapoutstream);
-  fwrite(&c2, 1, 1, opendapoutstream);
-  fwrite(&c1, 1, 1, opendapoutstream);
-  bytesWritten += 4;
+  block.clear();
+  return 0;
 }
 
-void COpenDAPHandler::writeDouble(double &v) {
+void COpenDAPHandler::appendValue(const void *value, CDFType type, std::vector<char> &block) {
   if (jsonWriter) {
-    if (!jsonValuesWritten) {
-      jsonValuesWritten = true;
-      fprintf(opendapoutstream, "%f", v);
-    } else {
-      fprintf(opendapoutstream, ", %f", v);
-    }
-    return;
+    COpenDAPEncoder::appendJSON(value, type, 0, 1, jsonValuesWritten, block);
+  } else {
+    COpenDAPEncoder::appendXDR(value, type, 0, 1, block);
   }
-  unsigned char const *p = reinterpret_cast<unsigned char const *>(&v);
-  fwrite(&p[7], 1, 1, opendapoutstream);
-  fwrite(&p[6], 1, 1, opendapoutstream);
-  fwrite(&p[5], 1, 1, opendapoutstream);
-  fwrite(&p[4], 1, 1, opendapoutstream);
-  fwrite(&p[3], 1, 1, opendapoutstream);
-  fwrite(&p[2], 1, 1, opendapoutstream);
-  fwrite(&p[1], 1, 1, opendapoutstream);
-  fwrite(&p[0], 1, 1, opendapoutstream);
-
-  bytesWritten += 8;
+}
+
+void COpenDAPHandler::writeInt(int &v) {
+  std::vector<char> block;
+  appendValue(&v, CDF_INT, block);
+  writeBlock(block);
+}
+
+void COpenDAPHandler::writeDouble(double &v) {
+  std::vector<char> block;
+  appendValue(&v, CDF_DOUBLE, block);
+  writeBlock(block);
 }
 
 int COpenDAPHandler::putVariableDataSize(CDF::Variable *v) {
@@ -247,132 +230,9 @@ int COpenDAPHandler::putVariableDataSize(CDF::Variable *v) {
   return 0;
 }
 
-// int tdata = 48;
-int COpenDAPHandler::putVariableData(CDF::Variable *v, CDFType type) {
-  int written = 0;
-  size_t typeSize = CDF::getTypeSize(type);
-
+int COpenDAPHandler::encodeVariableData(CDF::Variable *v, CDFType type, std::vector<char> &block, bool writeBlocks) {
   size_t varSize = v->getSize();
 
-  if (jsonWriter) {
-    {
-      switch (type) {
-      case CDF_BYTE:
-        for (size_t d = 0; d < varSize; d++) {
-          int a = (int)((char *)v->data)[d];
-          writeInt(a);
-        }
-        break;
-      case CDF_UBYTE:
-        for (size_t d = 0; d < varSize; d++) {
-          int a = (unsigned int)((unsigned char *)v->data)[d];
-          writeInt(a);
-        }
-        break;
-      case CDF_SHORT:
-        for (size_t d = 0; d < varSize; d++) {
-          int a = (int)((short *)v->data)[d];
-          writeInt(a);
-        }
-        break;
-      case CDF_USHORT:
-        for (size_t d = 0; d < varSize; d++) {
-          int a = (unsigned int)((unsigned short *)v->data)[d];
-          writeInt(a);
-        }
-        break;
-      case CDF_INT:
-        for (size_t d = 0; d < varSize; d++) {
-          int a = (int)((int *)v->data)[d];
-          writeInt(a);
-        }
-        break;
-      case CDF_UINT:
-        for (size_t d = 0; d < varSize; d++) {
-          int a = (unsigned int)((unsigned int *)v->data)[d];
-          writeInt(a);
-        }
-        break;
-      case CDF_FLOAT:
-        for (size_t d = 0; d < varSize; d++) {
-          double a = (double)((float *)v->data)[d];
-          writeDouble(a);
-        }
-        break;
-      case CDF_DOUBLE:
-        for (size_t d = 0; d < varSize; d++) {
-          double a = (double)((double *)v->data)[d];
-          writeDouble(a);
-        }
-        break;
-      case CDF_CHAR: {
-        if (v->dimensionlinks.size() == 2) {
-          /* Support strings, often they have two dimensionions indicating the number of strings and the string length */
-          for (size_t d = 0; d < v->dimensionlinks[0]->getSize(); d++) {
-            size_t stringLength = v->dimensionlinks[1]->getSize();
-            if (d > 0) fprintf(opendapoutstream, ", ");
-            fprintf(opendapoutstream, "\"%s\"", (CT::string((const char *)v->data + d * stringLength, stringLength)).c_str());
-          }
-        } else {
-          for (size_t d = 0; d < varSize; d++) {
-            int a = (unsigned int)((char *)v->data)[d];
-            writeInt(a);
-          }
-        }
-      } break;
-      case CDF_STRING:
-        if (type == CDF_STRING)
-          for (size_t d = 0; d < varSize; d++) {
-            const char **data = (const char **)v->data;
-            for (size_t d = 0; d < varSize; d++) {
-              if (d > 0) fprintf(opendapoutstream, ", ");
-              int l = int(strlen(data[d]));
-              if (l < 0) {
-                CDBError("String too large");
-                return 1;
-              }
-              for (int e = 0; e < l; e++) {
-                putc(data[d][e], opendapoutstream);
-              }
-            }
-          }
-        break;
-      default:
-        fprintf(opendapoutstream, " ? ");
-        break;
-      }
-    }
-    return 0;
-  }
-  // CDBDebug("name:%s typeSize:%d varSize:%d",v->name.c_str(),typeSize,varSize);
-  if (type == CDF_BYTE || type == CDF_UBYTE || type == CDF_CHAR || type == CDF_INT || type == CDF_UINT || type == CDF_FLOAT || type == CDF_DOUBLE) {
-    unsigned char *data = (unsigned char *)v->data;
-    for (size_t d = 0; d < varSize; d++) {
-      for (size_t e = 0; e < typeSize; e++) {
-        putc(data[d * typeSize + (typeSize - 1) - e], opendapoutstream);
-      }
-      bytesWritten += typeSize;
-      written += typeSize;
-    }
-  }
-
-  if (type == CDF_SHORT || type == CDF_USHORT) {
-    unsigned char *data = (unsigned char *)v->data;
-
-    for (size_t d = 0; d < varSize; d++) {
-      putc(0, opendapoutstream);
-      putc(0, opendapoutstream);
-      bytesWritten += 2;
-      written += 2;
-      for (size_t e = 0; e < typeSize; e++) {
-        putc(data[d * typeSize + (typeSize - 1) - e], opendapoutstream);
-      }
-      bytesWritten += typeSize;
-      written += typeSize;
-    }
-  }
-
-  // Strings need to be '0' terminated.
   if (type == CDF_STRING) {
     const char **data = (const char **)v->data;
     for (size_t d = 0; d < varSize; d++) {
@@ -381,35 +241,62 @@ int COpenDAPHandler::putVariableData(CDF::Variable *v, CDFType type) {
         CDBError("String too large");
         return 1;
       }
-      writeInt(l);
-      for (int e = 0; e < l; e++) {
-        // CDBDebug("%s",data[d][e]);
-        putc(data[d][e], opendapoutstream);
-        written++;
-        bytesWritten++;
+      if (jsonWriter) {
+        if (d > 0) block.insert(block.end(), ", ", ", " + 2);
+      } else {
+        COpenDAPEncoder::appendXDR(&l, CDF_INT, 0, 1, block);
       }
+      block.insert(block.end(), data[d], data[d] + l);
+      // Strings need to be padded to sequences of four.
+      if (!jsonWriter) block.resize(block.size() + (4 - l % 4) % 4, 0);
+    }
+    return 0;
+  }
 
-      // Padding bytes to sequences of four.
-      while (int(written / 4) * 4 != written) {
-        putc(0, opendapoutstream);
-        written++;
-        bytesWritten++;
-      }
+  if (jsonWriter && type == CDF_CHAR && v->dimensionlinks.size() == 2) {
+    /* Support strings, often they have two dimensionions indicating the number of strings and the string length */
+    size_t stringLength = v->dimensionlinks[1]->getSize();
+    for (size_t d = 0; d < v->dimensionlinks[0]->getSize(); d++) {
+      CT::string value((const char *)v->data + d * stringLength, stringLength);
+      const char *chars = value.c_str();
+      if (d > 0) block.insert(block.end(), ", ", ", " + 2);
+      block.push_back('"');
+      block.insert(block.end(), chars, chars + strlen(chars));
+      block.push_back('"');
     }
+    return 0;
   }
 
-  // Bytes need to be padded to words of four bytes
-  if ((type == CDF_BYTE || type == CDF_CHAR || type == CDF_UBYTE)) {
-    // Padding bytes to sequences of four.
-    while (int(written / 4) * 4 != written) {
-      CDBDebug("Padding");
-      putc(48, opendapoutstream);
-      written++;
-      bytesWritten++;
+  if (type != CDF_BYTE && type != CDF_UBYTE && type != CDF_CHAR && type != CDF_SHORT && type != CDF_USHORT && type != CDF_INT && type != CDF_UINT && type != CDF_FLOAT &&
+      type != CDF_DOUBLE) {
+    if (jsonWriter) block.insert(block.end(), " ? ", " ? " + 3);
+    return 0;
+  }
+
+  for (size_t start = 0; start < varSize; start += COPENDAPHANDLER_BLOCKSIZE) {
+    size_t count = std::min(size_t(COPENDAPHANDLER_BLOCKSIZE), varSize - start);
+    if (jsonWriter) {
+      COpenDAPEncoder::appendJSON(v->data, type, start, count, jsonValuesWritten, block);
+    } else {
+      COpenDAPEncoder::appendXDR(v->data, type, start, count, block);
     }
+    if (writeBlocks && writeBlock(block) != 0) return 1;
+  }
+
+  // Bytes need to be padded to words of four bytes
+  if (!jsonWriter && (type == CDF_BYTE || type == CDF_CHAR || type == CDF_UBYTE)) {
+    block.resize(block.size() + (4 - varSize % 4) % 4, 48);
   }
   return 0;
 }
+
+int COpenDAPHandler::putVariableData(CDF::Variable *v, CDFType type) {
+  std::vector<char> block;
+  int status = encodeVariableData(v, type, block, true);
+  if (status == 0) status = writeBlock(block);
+  return status;
+}
+
 int COpenDAPHandler::handleOpenDAPRequest(const char *path, const char *_query, CServerParams *srvParam) {
 
 #ifdef COPENDAPHANDLER_DEBUG
@@ -973,6 +860,9 @@ int COpenDAPHandler::handleOpenDAPRequest(const char *path, const char *_query,
 #endif
                       }
 
+                      /* While a file's data is written by the stream writer, the hyperslab of the next file is read and encoded */
+                      COpenDAPStreamWriter streamWriter(opendapoutstream);
+                      std::vector<char> block;
                       for (size_t storeIndex = 0; storeIndex < store->size(); storeIndex++) {
 
                         if (readFromDB) {
@@ -983,7 +873,7 @@ int COpenDAPHandler::handleOpenDAPRequest(const char *path, const char *_query,
 // CDBDebug("Convert value %f",value);
 #endif
                           double value = time.dateToOffset(time.freeDateStringToDate(dimValue.c_str()));
-                          writeDouble(value);
+                          appendValue(&value, CDF_DOUBLE, block);
                         }
 
                         if (readFromDB == false) {
@@ -1007,9 +897,12 @@ int COpenDAPHandler::handleOpenDAPRequest(const char *path, const char *_query,
                           CDBDebug("Read %d elements with type %s with element size %d", variableToRead->getSize(), CDF::getCDFDataTypeName(type).c_str(), CDF::getTypeSize(type));
 #endif
 
-                          putVariableData(variableToRead, type);
+                          encodeVariableData(variableToRead, type, block, false);
+                          if (streamWriter.writeAsync(block) != 0) break;
                         }
                       }
+                      streamWriter.writeAsync(block);
+                      streamWriter.wait();
                     } else {
 
                       CDBDebug("Create missing data");
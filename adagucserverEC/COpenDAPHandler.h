@@ -14,6 +14,7 @@
 #include "CXMLParser.h"
 #include "CTime.h"
 #include "CDebugger.h"
+#include "COpenDAPEncoder.h"
 
 class COpenDAPHandler {
 private:
@@ -42,6 +43,12 @@ private:
   CT::string VarInfoToString(std::vector<VarInfo> selectedVariables);
   int putVariableDataSize(CDF::Variable *v);
   int putVariableData(CDF::Variable *v, CDFType type);
+  /**
+   * Appends the encoded data of v to block. With writeBlocks the block is written to the output stream every COPENDAPHANDLER_BLOCKSIZE values.
+   */
+  int encodeVariableData(CDF::Variable *v, CDFType type, std::vector<char> &block, bool writeBlocks);
+  int writeBlock(std::vector<char> &block);
+  void appendValue(const void *value, CDFType type, std::vector<char> &block);
   CT::string createDDSHeader(CT::string layerName, CDFObject *cdfObject, std::vector<VarInfo> selectedVariables);
   int getDimSize(CDataSource *dataSource, const char *name);
   FILE *opendapoutstream;
@@ -24,6 +24,7 @@
  ******************************************************************************/
 #ifdef ADAGUC_USE_POSTGRESQL
 #include "CPGSQLDB.h"
+#include "CMetrics.h"
 const char *CPGSQLDB::className = "CPGSQLDB";
 void CPGSQLDB::clearResult() {
   if (result != NULL) PQclear(result);
@@ -124,6 +125,7 @@ int CPGSQLDB::checkTable(const char *pszTableName, const char *pszColumns) {
 }
 
 int CPGSQLDB::query(const char *pszQuery) {
+  CMetrics::Timer timer(CMetrics::PHASE_DB);
   LastErrorMsg[0] = '\0';
   if (dConnected == 0) {
     CDBError("query: Not connected to DB");
@@ -174,6 +176,7 @@ int CPGSQLDB::query(const char *pszQuery) {
 // }
 
 CDBStore::Store *CPGSQLDB::queryToStore(const char *pszQuery, bool throwException) {
+  CMetrics::Timer timer(CMetrics::PHASE_DB);
   // CDBDebug("query_select %s",pszQuery);
   LastErrorMsg[0] = '\0';
 
@@ -215,10 +218,14 @@ CDBStore::Store *CPGSQLDB::queryToStore(const char *pszQuery, bool throwExceptio
 
   CDBStore::Store *store = new CDBStore::Store(colModel);
 
+  size_t numBytes = 0;
   for (size_t rowNumber = 0; rowNumber < numRows; rowNumber++) {
-    CDBStore::Record *record = new CDBStore::Record(colModel);
-    for (size_t colNumber = 0; colNumber < numCols; colNumber++) record->push(colNumber, PQgetvalue(result, rowNumber, colNumber));
-    store->push(record);
+    for (size_t colNumber = 0; colNumber < numCols; colNumber++) numBytes += PQgetlength(result, rowNumber, colNumber) + 1;
+  }
+  store->reserve(numRows, numBytes);
+  for (size_t rowNumber = 0; rowNumber < numRows; rowNumber++) {
+    store->addRow();
+    for (size_t colNumber = 0; colNumber < numCols; colNumber++) store->setValue(colNumber, PQgetvalue(result, rowNumber, colNumber), PQgetlength(result, rowNumber, colNumber));
   }
 
   clearResult();
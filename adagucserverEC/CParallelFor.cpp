@@ -0,0 +1,138 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CParallelFor.h"
+#include <atomic>
+#include <pthread.h>
+#include <unistd.h>
+
+const char *CParallelFor::className = "CParallelFor";
+
+#define CPARALLELFOR_MAX_THREADS 16
+
+class CParallelForPart {
+public:
+  CParallelFor::RangeFunction function;
+  void *userData;
+  int start, end;
+};
+
+static void *runParallelForPart(void *arg) {
+  CParallelForPart *part = (CParallelForPart *)arg;
+  part->function(part->start, part->end, part->userData);
+  return NULL;
+}
+
+class CParallelForQueue {
+public:
+  CParallelFor::RangeFunction function;
+  void *userData;
+  int count, chunkSize;
+  std::atomic<int> next;
+};
+
+static void *runParallelForQueue(void *arg) {
+  CParallelForQueue *queue = (CParallelForQueue *)arg;
+  while (true) {
+    int start = queue->next.fetch_add(queue->chunkSize);
+    if (start >= queue->count) break;
+    int end = start + queue->chunkSize;
+    if (end > queue->count) end = queue->count;
+    queue->function(start, end, queue->userData);
+  }
+  return NULL;
+}
+
+int CParallelFor::getNumThreads(int count, int minItemsPerThread) {
+  int numThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+  if (numThreads > CPARALLELFOR_MAX_THREADS) numThreads = CPARALLELFOR_MAX_THREADS;
+  if (minItemsPerThread > 0 && numThreads > count / minItemsPerThread) numThreads = count / minItemsPerThread;
+  if (numThreads < 1) numThreads = 1;
+  return numThreads;
+}
+
+void CParallelFor::run(RangeFunction function, void *userData, int count, int minItemsPerThread) {
+  if (count <= 0) return;
+  int numThreads = getNumThreads(count, minItemsPerThread);
+  if (numThreads == 1) {
+    function(0, count, userData);
+    return;
+  }
+  pthread_t threads[numThreads];
+  bool started[numThreads];
+  CParallelForPart parts[numThreads];
+  int blockSize = count / numThreads;
+  for (int j = 0; j < numThreads; j++) {
+    parts[j].function = function;
+    parts[j].userData = userData;
+    parts[j].start = blockSize * j;
+    parts[j].end = j == numThreads - 1 ? count : blockSize * (j + 1);
+    started[j] = pthread_create(&threads[j], NULL, runParallelForPart, &parts[j]) == 0;
+    if (!started[j]) {
+      CDBWarning("pthread_create failed, running part in calling thread");
+      function(parts[j].start, parts[j].end, userData);
+    }
+  }
+  for (int j = 0; j < numThreads; j++) {
+    if (started[j] && pthread_join(threads[j], NULL) != 0) {
+      CDBError("pthread_join");
+    }
+  }
+}
+
+void CParallelFor::runDynamic(RangeFunction function, void *userData, int count, int chunkSize, int numThreads) {
+  if (count <= 0) return;
+  if (chunkSize < 1) chunkSize = 1;
+  int numChunks = (count + chunkSize - 1) / chunkSize;
+  if (numThreads <= 0) numThreads = getNumThreads(numChunks, 1);
+  if (numThreads > CPARALLELFOR_MAX_THREADS) numThreads = CPARALLELFOR_MAX_THREADS;
+  if (numThreads > numChunks) numThreads = numChunks;
+  CParallelForQueue queue;
+  queue.function = function;
+  queue.userData = userData;
+  queue.count = count;
+  queue.chunkSize = chunkSize;
+  queue.next = 0;
+  if (numThreads <= 1) {
+    runParallelForQueue(&queue);
+    return;
+  }
+  /* The calling thread is one of the workers */
+  int numStarted = 0;
+  pthread_t threads[numThreads - 1];
+  for (int j = 0; j < numThreads - 1; j++) {
+    if (pthread_create(&threads[j], NULL, runParallelForQueue, &queue) != 0) {
+      CDBWarning("pthread_create failed, continuing with %d threads", j + 1);
+      break;
+    }
+    numStarted++;
+  }
+  runParallelForQueue(&queue);
+  for (int j = 0; j < numStarted; j++) {
+    if (pthread_join(threads[j], NULL) != 0) {
+      CDBError("pthread_join");
+    }
+  }
+}
@@ -0,0 +1,75 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CPARALLELFOR_H
+#define CPARALLELFOR_H
+
+#include "CDebugger.h"
+
+/**
+ * @brief Divides a range of rows, columns or tiles over pthreads. Only for pure computations, the netcdf and hdf5 libraries are not thread safe.
+ */
+class CParallelFor {
+private:
+  DEF_ERRORFUNCTION();
+
+public:
+  /**
+   * @brief Function which processes the part [start, end) of the range
+   */
+  typedef void (*RangeFunction)(int start, int end, void *userData);
+
+  /**
+   * @brief Returns the number of threads to use for count items, at least one.
+   *
+   * @param count Number of items in the range
+   * @param minItemsPerThread Minimum number of items a thread should handle, to keep the thread overhead low
+   */
+  static int getNumThreads(int count, int minItemsPerThread);
+
+  /**
+   * @brief Runs function over the range [0, count) and returns when all parts are done.
+   *
+   * @param function The function to run
+   * @param userData Passed to the function
+   * @param count Number of items in the range
+   * @param minItemsPerThread Minimum number of items a thread should handle
+   */
+  static void run(RangeFunction function, void *userData, int count, int minItemsPerThread);
+
+  /**
+   * @brief Runs function over the range [0, count), threads take the next chunk of chunkSize items when they are done with their previous one.
+   * Use this when the cost per item differs a lot, so cheap items do not leave threads idle.
+   *
+   * @param function The function to run
+   * @param userData Passed to the function
+   * @param count Number of items in the range
+   * @param chunkSize Number of items taken at once
+   * @param numThreads Number of threads to use, zero or less to choose it from the number of processors. At most 16 threads are used
+   */
+  static void runDynamic(RangeFunction function, void *userData, int count, int chunkSize, int numThreads);
+};
+
+#endif
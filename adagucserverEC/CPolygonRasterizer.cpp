@@ -0,0 +1,578 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CPolygonRasterizer.h"
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include "CDataSource.h"
+#include "CImageWarper.h"
+#include "CCache.h"
+#include "CDirReader.h"
+#include "CParallelFor.h"
+
+const char *CPolygonCellIndex::className = "CPolygonCellIndex";
+const char *CPolygonRasterizer::className = "CPolygonRasterizer";
+
+#define CPOLYGONCELLINDEX_FILEID "ACI1"
+#define CPOLYGONCELLINDEX_MAXBINS 1024
+/* Cells covering more bins than this, like cells crossing the date line, are kept in a separate list which is always checked */
+#define CPOLYGONCELLINDEX_MAXBINSPERCELL 64
+#define CPOLYGONCELLINDEX_NUMSAMPLES 16
+
+#define CPOLYGONRASTERIZER_MAXCONVEXVERTICES 32
+#define CPOLYGONRASTERIZER_MINROWSPERTHREAD 32
+
+CPolygonCellIndex::CPolygonCellIndex() {
+  binsX = 0;
+  binsY = 0;
+  for (int j = 0; j < 4; j++) extent[j] = 0;
+}
+
+static inline bool isValidCellBBOX(const float *bbox) { return bbox[0] == bbox[0] && bbox[1] == bbox[1] && bbox[2] == bbox[2] && bbox[3] == bbox[3]; }
+
+static inline int getBin(double value, double min, double max, int numBins) {
+  int bin = int((value - min) / (max - min) * numBins);
+  if (bin < 0) return 0;
+  if (bin >= numBins) return numBins - 1;
+  return bin;
+}
+
+void CPolygonCellIndex::build(const std::vector<float> &bboxes) {
+  cellBBOX = bboxes;
+  binStart.clear();
+  binCells.clear();
+  size_t numCells = getNumCells();
+  size_t numValid = 0;
+  extent[0] = DBL_MAX;
+  extent[1] = DBL_MAX;
+  extent[2] = -DBL_MAX;
+  extent[3] = -DBL_MAX;
+  for (size_t c = 0; c < numCells; c++) {
+    const float *bbox = &cellBBOX[c * 4];
+    if (!isValidCellBBOX(bbox)) continue;
+    numValid++;
+    extent[0] = std::min(extent[0], (double)bbox[0]);
+    extent[1] = std::min(extent[1], (double)bbox[1]);
+    extent[2] = std::max(extent[2], (double)bbox[2]);
+    extent[3] = std::max(extent[3], (double)bbox[3]);
+  }
+  if (numValid == 0) {
+    binsX = 0;
+    binsY = 0;
+    return;
+  }
+  if (extent[2] <= extent[0]) extent[2] = extent[0] + 1;
+  if (extent[3] <= extent[1]) extent[3] = extent[1] + 1;
+  binsX = std::max(1, std::min(CPOLYGONCELLINDEX_MAXBINS, int(sqrt(double(numValid) / 4))));
+  binsY = binsX;
+  int numBins = binsX * binsY;
+
+  /* The last bin holds the large cells */
+  std::vector<int> binCount(numBins + 1, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      binStart.resize(numBins + 2);
+      binStart[0] = 0;
+      for (int b = 0; b <= numBins; b++) binStart[b + 1] = binStart[b] + binCount[b];
+      binCells.resize(binStart[numBins + 1]);
+      std::fill(binCount.begin(), binCount.end(), 0);
+    }
+    for (size_t c = 0; c < numCells; c++) {
+      const float *bbox = &cellBBOX[c * 4];
+      if (!isValidCellBBOX(bbox)) continue;
+      int x0 = getBin(bbox[0], extent[0], extent[2], binsX), x1 = getBin(bbox[2], extent[0], extent[2], binsX);
+      int y0 = getBin(bbox[1], extent[1], extent[3], binsY), y1 = getBin(bbox[3], extent[1], extent[3], binsY);
+      if ((x1 - x0 + 1) * (y1 - y0 + 1) > CPOLYGONCELLINDEX_MAXBINSPERCELL) {
+        if (pass == 1) binCells[binStart[numBins] + binCount[numBins]] = int(c);
+        binCount[numBins]++;
+        continue;
+      }
+      for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+          int b = x + y * binsX;
+          if (pass == 1) binCells[binStart[b] + binCount[b]] = int(c);
+          binCount[b]++;
+        }
+      }
+    }
+  }
+}
+
+void CPolygonCellIndex::query(const double *latLonBBOX, std::vector<int> &cells) const {
+  cells.clear();
+  if (binsX == 0 || binsY == 0) return;
+  int numBins = binsX * binsY;
+  std::vector<int> candidates(binCells.begin() + binStart[numBins], binCells.begin() + binStart[numBins + 1]);
+  if (!(latLonBBOX[2] < extent[0] || latLonBBOX[0] > extent[2] || latLonBBOX[3] < extent[1] || latLonBBOX[1] > extent[3])) {
+    int x0 = getBin(latLonBBOX[0], extent[0], extent[2], binsX), x1 = getBin(latLonBBOX[2], extent[0], extent[2], binsX);
+    int y0 = getBin(latLonBBOX[1], extent[1], extent[3], binsY), y1 = getBin(latLonBBOX[3], extent[1], extent[3], binsY);
+    for (int y = y0; y <= y1; y++) {
+      for (int x = x0; x <= x1; x++) {
+        int b = x + y * binsX;
+        candidates.insert(candidates.end(), binCells.begin() + binStart[b], binCells.begin() + binStart[b + 1]);
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+  for (size_t j = 0; j < candidates.size(); j++) {
+    const float *bbox = &cellBBOX[size_t(candidates[j]) * 4];
+    if (bbox[2] < latLonBBOX[0] || bbox[0] > latLonBBOX[2] || bbox[3] < latLonBBOX[1] || bbox[1] > latLonBBOX[3]) continue;
+    cells.push_back(candidates[j]);
+  }
+}
+
+int CPolygonCellIndex::write(const char *fileName) const {
+  FILE *pFile = fopen(fileName, "wb");
+  if (pFile == NULL) {
+    CDBError("Unable to open %s for writing", fileName);
+    return 1;
+  }
+  size_t sizes[3] = {cellBBOX.size(), binStart.size(), binCells.size()};
+  bool ok = fwrite(CPOLYGONCELLINDEX_FILEID, 1, 4, pFile) == 4;
+  ok = ok && fwrite(&binsX, sizeof(int), 1, pFile) == 1;
+  ok = ok && fwrite(&binsY, sizeof(int), 1, pFile) == 1;
+  ok = ok && fwrite(extent, sizeof(double), 4, pFile) == 4;
+  ok = ok && fwrite(sizes, sizeof(size_t), 3, pFile) == 3;
+  if (sizes[0] > 0) ok = ok && fwrite(&cellBBOX[0], sizeof(float), sizes[0], pFile) == sizes[0];
+  if (sizes[1] > 0) ok = ok && fwrite(&binStart[0], sizeof(int), sizes[1], pFile) == sizes[1];
+  if (sizes[2] > 0) ok = ok && fwrite(&binCells[0], sizeof(int), sizes[2], pFile) == sizes[2];
+  fclose(pFile);
+  if (!ok) {
+    CDBError("Unable to write to %s", fileName);
+    return 2;
+  }
+  return 0;
+}
+
+int CPolygonCellIndex::read(const char *fileName) {
+  FILE *pFile = fopen(fileName, "rb");
+  if (pFile == NULL) {
+    CDBError("Unable to open %s for reading", fileName);
+    return 1;
+  }
+  char fileId[4];
+  size_t sizes[3];
+  bool ok = fread(fileId, 1, 4, pFile) == 4 && strncmp(fileId, CPOLYGONCELLINDEX_FILEID, 4) == 0;
+  ok = ok && fread(&binsX, sizeof(int), 1, pFile) == 1;
+  ok = ok && fread(&binsY, sizeof(int), 1, pFile) == 1;
+  ok = ok && fread(extent, sizeof(double), 4, pFile) == 4;
+  ok = ok && fread(sizes, sizeof(size_t), 3, pFile) == 3;
+  ok = ok && sizes[1] == (binsX > 0 ? size_t(binsX) * binsY + 2 : 0);
+  if (ok) {
+    cellBBOX.resize(sizes[0]);
+    binStart.resize(sizes[1]);
+    binCells.resize(sizes[2]);
+    if (sizes[0] > 0) ok = ok && fread(&cellBBOX[0], sizeof(float), sizes[0], pFile) == sizes[0];
+    if (sizes[1] > 0) ok = ok && fread(&binStart[0], sizeof(int), sizes[1], pFile) == sizes[1];
+    if (sizes[2] > 0) ok = ok && fread(&binCells[0], sizeof(int), sizes[2], pFile) == sizes[2];
+  }
+  fclose(pFile);
+  if (!ok) {
+    CDBError("Unable to read cell index from %s", fileName);
+    binsX = 0;
+    binsY = 0;
+    cellBBOX.clear();
+    binStart.clear();
+    binCells.clear();
+    return 2;
+  }
+  return 0;
+}
+
+void CPolygonCellIndex::load(CDataSource *dataSource, const char *name, CellBBOXFunction function, void *userData) {
+  CT::string cacheDir;
+  CT::string fileDate;
+  const char *fileName = dataSource->getFileName();
+  if (dataSource->srvParams->cfg->TempDir.size() > 0 && fileName != NULL && CDirReader::getFileDate(&fileDate, fileName) == 0) {
+    cacheDir = dataSource->srvParams->cfg->TempDir[0]->attr.value.c_str();
+  }
+
+  CCache cache;
+  if (cacheDir.length() > 0) {
+    CT::string key = "cellindex/";
+    key.concat(fileName);
+    key.printconcat("/%s", name);
+    cache.checkCacheSystemReady(cacheDir.c_str(), key.c_str(), fileName, "CPolygonCellIndex::load");
+    if (cache.cacheIsAvailable()) {
+      if (read(cache.getCacheFileNameToRead()) == 0) {
+        CCache::countLookup(true);
+        return;
+      }
+      CDBWarning("Unable to read cell index from cache %s", cache.getCacheFileNameToRead());
+    }
+    CCache::countLookup(false);
+  }
+
+  std::vector<float> bboxes;
+  function(bboxes, userData);
+  build(bboxes);
+
+  if (cache.saveCacheFile()) {
+    if (cache.claimCacheFile() == 0) {
+      if (write(cache.getCacheFileNameToWrite()) == 0) {
+        cache.releaseCacheFile();
+      } else {
+        cache.removeClaimedCachefile();
+      }
+    }
+  }
+}
+
+int CPolygonCellIndex::getLatLonBBOX(CImageWarper *imageWarper, bool projectionRequired, const double *mapBBOX, double *latLonBBOX) {
+  if (!projectionRequired) {
+    latLonBBOX[0] = std::min(mapBBOX[0], mapBBOX[2]);
+    latLonBBOX[1] = std::min(mapBBOX[1], mapBBOX[3]);
+    latLonBBOX[2] = std::max(mapBBOX[0], mapBBOX[2]);
+    latLonBBOX[3] = std::max(mapBBOX[1], mapBBOX[3]);
+    return 0;
+  }
+  /* Sample the map on a regular grid, the boundary alone misses the inside of curved projections */
+  double minLon = DBL_MAX, minLat = DBL_MAX, maxLon = -DBL_MAX, maxLat = -DBL_MAX;
+  for (int y = 0; y <= CPOLYGONCELLINDEX_NUMSAMPLES; y++) {
+    for (int x = 0; x <= CPOLYGONCELLINDEX_NUMSAMPLES; x++) {
+      double lon = mapBBOX[0] + (mapBBOX[2] - mapBBOX[0]) * x / CPOLYGONCELLINDEX_NUMSAMPLES;
+      double lat = mapBBOX[1] + (mapBBOX[3] - mapBBOX[1]) * y / CPOLYGONCELLINDEX_NUMSAMPLES;
+      if (imageWarper->reprojToLatLon(lon, lat) != 0 || lon != lon || lat != lat) return 1;
+      minLon = std::min(minLon, lon);
+      minLat = std::min(minLat, lat);
+      maxLon = std::max(maxLon, lon);
+      maxLat = std::max(maxLat, lat);
+    }
+  }
+  /* Cells can bulge out between the samples */
+  double marginLon = (maxLon - minLon) / CPOLYGONCELLINDEX_NUMSAMPLES;
+  double marginLat = (maxLat - minLat) / CPOLYGONCELLINDEX_NUMSAMPLES;
+  minLon -= marginLon;
+  maxLon += marginLon;
+  minLat -= marginLat;
+  maxLat += marginLat;
+
+  /* A pole inside the map covers all longitudes */
+  for (int pole = -1; pole <= 1; pole += 2) {
+    double x = 0, y = 90 * pole;
+    if (imageWarper->reprojfromLatLon(x, y) != 0) continue;
+    if (x >= std::min(mapBBOX[0], mapBBOX[2]) && x <= std::max(mapBBOX[0], mapBBOX[2]) && y >= std::min(mapBBOX[1], mapBBOX[3]) && y <= std::max(mapBBOX[1], mapBBOX[3])) {
+      minLon = -180;
+      maxLon = 180;
+      if (pole < 0) minLat = -90;
+      if (pole > 0) maxLat = 90;
+    }
+  }
+  latLonBBOX[0] = minLon;
+  latLonBBOX[1] = minLat;
+  latLonBBOX[2] = maxLon;
+  latLonBBOX[3] = maxLat;
+  return 0;
+}
+
+CPolygonRasterizer::CPolygonRasterizer() { clear(); }
+
+void CPolygonRasterizer::clear() {
+  vertexX.clear();
+  vertexY.clear();
+  ringStart.clear();
+  ringStart.push_back(0);
+  polygons.clear();
+}
+
+void CPolygonRasterizer::addPolygon(double value) {
+  Polygon polygon;
+  polygon.firstRing = int(ringStart.size()) - 1;
+  polygon.numRings = 0;
+  polygon.value = value;
+  polygon.minX = FLT_MAX;
+  polygon.minY = FLT_MAX;
+  polygon.maxX = -FLT_MAX;
+  polygon.maxY = -FLT_MAX;
+  polygon.convex = false;
+  polygon.hasNaN = false;
+  polygon.scanlineFill = false;
+  polygons.push_back(polygon);
+}
+
+void CPolygonRasterizer::addRing(const float *x, const float *y, int numVertices) {
+  if (polygons.size() == 0 || numVertices <= 0) return;
+  Polygon &polygon = polygons.back();
+  for (int j = 0; j < numVertices; j++) {
+    vertexX.push_back(x[j]);
+    vertexY.push_back(y[j]);
+    if (x[j] != x[j] || y[j] != y[j]) {
+      polygon.hasNaN = true;
+      continue;
+    }
+    polygon.minX = std::min(polygon.minX, x[j]);
+    polygon.minY = std::min(polygon.minY, y[j]);
+    polygon.maxX = std::max(polygon.maxX, x[j]);
+    polygon.maxY = std::max(polygon.maxY, y[j]);
+  }
+  ringStart.push_back(int(vertexX.size()));
+  polygon.numRings++;
+}
+
+void CPolygonRasterizer::addRing(const float *xy, int numVertices) {
+  std::vector<float> x(numVertices), y(numVertices);
+  for (int j = 0; j < numVertices; j++) {
+    x[j] = xy[j * 2];
+    y[j] = xy[j * 2 + 1];
+  }
+  if (numVertices > 0) addRing(&x[0], &y[0], numVertices);
+}
+
+void CPolygonRasterizer::setScanlineFill(int xMin, int yMin, int xMax, int yMax) {
+  if (polygons.size() == 0) return;
+  Polygon &polygon = polygons.back();
+  polygon.scanlineFill = true;
+  polygon.clipBox[0] = xMin;
+  polygon.clipBox[1] = yMin;
+  polygon.clipBox[2] = xMax;
+  polygon.clipBox[3] = yMax;
+}
+
+void CPolygonRasterizer::addConvexPolygon(const float *x, const float *y, int numVertices, double value) {
+  addPolygon(value);
+  addRing(x, y, numVertices);
+  polygons.back().convex = numVertices <= CPOLYGONRASTERIZER_MAXCONVEXVERTICES;
+}
+
+/* Returns the first pixel index with its center at or after coordinate, clamped to [0, size] */
+static inline int firstPixelFrom(float coordinate, int size) {
+  float pixel = ceilf(coordinate - 0.5f);
+  if (!(pixel > 0)) return 0;
+  if (pixel > size) return size;
+  return int(pixel);
+}
+
+template <class T> class CPolygonRasterizer::Job {
+public:
+  const CPolygonRasterizer *rasterizer;
+  T *grid;
+  int W, H;
+};
+
+template <class T>
+void CPolygonRasterizer::fillPolygon(const Polygon &polygon, T *grid, int W, int rowStart, int rowEnd, std::vector<float> &crossings, std::vector<unsigned char> &mask) const {
+  T value = (T)polygon.value;
+  int xStart = firstPixelFrom(polygon.minX, W);
+  int xEnd = firstPixelFrom(polygon.maxX, W);
+  if (xStart >= xEnd) return;
+  int firstVertex = ringStart[polygon.firstRing];
+
+  if (polygon.convex) {
+    /* Edge functions: a pixel is inside when its center is on the inner side of every edge */
+    int n = ringStart[polygon.firstRing + 1] - firstVertex;
+    const float *vx = &vertexX[firstVertex];
+    const float *vy = &vertexY[firstVertex];
+    float area = 0;
+    for (int i = 0, j = n - 1; i < n; j = i++) area += vx[j] * vy[i] - vx[i] * vy[j];
+    if (area == 0) return;
+    float orientation = area > 0 ? 1 : -1;
+    float edgeA[CPOLYGONRASTERIZER_MAXCONVEXVERTICES], edgeB[CPOLYGONRASTERIZER_MAXCONVEXVERTICES], edgeC[CPOLYGONRASTERIZER_MAXCONVEXVERTICES];
+    for (int i = 0, j = n - 1; i < n; j = i++) {
+      /* E(px,py) = A*px + B*py + C */
+      edgeA[i] = -(vy[i] - vy[j]) * orientation;
+      edgeB[i] = (vx[i] - vx[j]) * orientation;
+      edgeC[i] = -(edgeA[i] * vx[j] + edgeB[i] * vy[j]);
+    }
+    int width = xEnd - xStart;
+    if ((int)mask.size() < width) mask.resize(width);
+    unsigned char *inside = &mask[0];
+    for (int y = rowStart; y < rowEnd; y++) {
+      float py = y + 0.5f;
+      for (int x = 0; x < width; x++) inside[x] = 1;
+      for (int e = 0; e < n; e++) {
+        float a = edgeA[e];
+        float rowC = edgeB[e] * py + edgeC[e] + a * (xStart + 0.5f);
+        for (int x = 0; x < width; x++) inside[x] &= (a * x + rowC >= 0);
+      }
+      T *row = grid + size_t(y) * W + xStart;
+      for (int x = 0; x < width; x++) {
+        if (inside[x]) row[x] = value;
+      }
+    }
+    return;
+  }
+
+  /* Scanline crossings with the even-odd rule */
+  for (int y = rowStart; y < rowEnd; y++) {
+    float py = y + 0.5f;
+    crossings.clear();
+    for (int r = polygon.firstRing; r < polygon.firstRing + polygon.numRings; r++) {
+      int start = ringStart[r], end = ringStart[r + 1];
+      for (int i = start, j = end - 1; i < end; j = i++) {
+        float yi = vertexY[i], yj = vertexY[j];
+        if ((yi <= py) != (yj <= py)) {
+          crossings.push_back(vertexX[i] + (py - yi) / (yj - yi) * (vertexX[j] - vertexX[i]));
+        }
+      }
+    }
+    std::sort(crossings.begin(), crossings.end());
+    T *row = grid + size_t(y) * W;
+    for (size_t c = 0; c + 1 < crossings.size(); c += 2) {
+      int x1 = firstPixelFrom(crossings[c], W);
+      int x2 = firstPixelFrom(crossings[c + 1], W);
+      for (int x = x1; x < x2; x++) row[x] = value;
+    }
+  }
+}
+
+template <class T>
+void CPolygonRasterizer::fillPolygonScanline(const Polygon &polygon, T *grid, int W, int H, int rowStart, int rowEnd, std::vector<int> &nodes, std::vector<unsigned char> &mask) const {
+  int xMin = polygon.clipBox[0], yMin = polygon.clipBox[1], xMax = polygon.clipBox[2], yMax = polygon.clipBox[3];
+  if (xMax < 0 || yMax < 0 || xMin >= W || yMin >= H) return;
+  /* The original fill started at the first row for polygons near the top, keep that */
+  if (xMin < 0) xMin = 0;
+  if (yMin < 5) yMin = 0;
+  if (xMax >= W) xMax = W;
+  int rowBottom = std::min(yMax + 1, H);
+  int width = xMax - xMin;
+  if (width <= 0) return;
+  if ((int)mask.size() < width) mask.resize(width);
+  unsigned char *inside = &mask[0];
+  T value = (T)polygon.value;
+  for (int y = std::max(rowStart, yMin); y < std::min(rowEnd, rowBottom); y++) {
+    for (int x = 0; x < width; x++) inside[x] = 0;
+    for (int r = polygon.firstRing; r < polygon.firstRing + polygon.numRings; r++) {
+      int start = ringStart[r], end = ringStart[r + 1];
+      nodes.clear();
+      for (int i = start, j = end - 1; i < end; j = i++) {
+        float yi = vertexY[i], yj = vertexY[j];
+        if ((yi < (double)y && yj >= (double)y) || (yj < (double)y && yi >= (double)y)) {
+          nodes.push_back((int)(vertexX[i] + (y - yi) / (yj - yi) * (vertexX[j] - vertexX[i])));
+        }
+      }
+      std::sort(nodes.begin(), nodes.end());
+      unsigned char isInside = r == polygon.firstRing ? 1 : 0;
+      for (size_t n = 0; n + 1 < nodes.size(); n += 2) {
+        int x1 = std::max(nodes[n] - xMin, 0);
+        int x2 = std::min(nodes[n + 1] - xMin, width);
+        for (int x = x1; x < x2; x++) inside[x] = isInside;
+      }
+    }
+    T *row = grid + size_t(y) * W + xMin;
+    for (int x = 0; x < width; x++) {
+      if (inside[x]) row[x] = value;
+    }
+  }
+}
+
+template <class T> void CPolygonRasterizer::fillRows(int start, int end, void *userData) {
+  Job<T> *job = (Job<T> *)userData;
+  const CPolygonRasterizer *rasterizer = job->rasterizer;
+  std::vector<float> crossings;
+  std::vector<unsigned char> mask;
+  std::vector<int> nodes;
+  for (size_t p = 0; p < rasterizer->polygons.size(); p++) {
+    const Polygon &polygon = rasterizer->polygons[p];
+    if (polygon.numRings == 0) continue;
+    if (polygon.scanlineFill) {
+      rasterizer->fillPolygonScanline(polygon, job->grid, job->W, job->H, start, end, nodes, mask);
+      continue;
+    }
+    if (polygon.hasNaN) continue;
+    int rowStart = std::max(start, firstPixelFrom(polygon.minY, job->H));
+    int rowEnd = std::min(end, firstPixelFrom(polygon.maxY, job->H));
+    if (rowStart >= rowEnd) continue;
+    rasterizer->fillPolygon(polygon, job->grid, job->W, rowStart, rowEnd, crossings, mask);
+  }
+}
+
+template <class T> void CPolygonRasterizer::fill(T *grid, int W, int H) {
+  Job<T> job;
+  job.rasterizer = this;
+  job.grid = grid;
+  job.W = W;
+  job.H = H;
+  CParallelFor::run(fillRows<T>, &job, H, CPOLYGONRASTERIZER_MINROWSPERTHREAD);
+}
+
+void CPolygonRasterizer::fill(float *grid, int W, int H) { fill<float>(grid, W, H); }
+
+void CPolygonRasterizer::fill(unsigned short *grid, int W, int H) { fill<unsigned short>(grid, W, H); }
+
+/* Draws a line, only pixels in rows [rowStart, rowEnd) are written */
+static void drawLine(float *grid, int W, int rowStart, int rowEnd, float x1, float y1, float x2, float y2, float value) {
+  bool xyIsSwapped = false;
+  float dx = x2 - x1;
+  float dy = y2 - y1;
+  if (fabs(dx) < fabs(dy)) {
+    std::swap(x1, y1);
+    std::swap(x2, y2);
+    std::swap(dx, dy);
+    xyIsSwapped = true;
+  }
+  if (x2 < x1) {
+    std::swap(x1, x2);
+    std::swap(y1, y2);
+  }
+  float gradient = dy / dx;
+  float y = y1;
+  if (!xyIsSwapped) {
+    for (int x = int(x1); x < x2; x++) {
+      if (y >= rowStart && y < rowEnd && x >= 0 && x < W) grid[x + size_t(y) * W] = value;
+      y += gradient;
+    }
+  } else {
+    for (int x = int(x1); x < x2; x++) {
+      if (y >= 0 && y < W && x >= rowStart && x < rowEnd) grid[int(y) + size_t(x) * W] = value;
+      y += gradient;
+    }
+  }
+}
+
+void CPolygonRasterizer::drawOutlineRows(int start, int end, void *userData) {
+  Job<float> *job = (Job<float> *)userData;
+  const CPolygonRasterizer *rasterizer = job->rasterizer;
+  int W = job->W, H = job->H;
+  for (size_t p = 0; p < rasterizer->polygons.size(); p++) {
+    const Polygon &polygon = rasterizer->polygons[p];
+    if (polygon.maxY < start || polygon.minY >= end || polygon.maxX < 0 || polygon.minX >= W) continue;
+    float value = (float)polygon.value;
+    for (int r = polygon.firstRing; r < polygon.firstRing + polygon.numRings; r++) {
+      int ringEnd = rasterizer->ringStart[r + 1];
+      for (int i = rasterizer->ringStart[r], j = ringEnd - 1; i < ringEnd; j = i++) {
+        float xj = rasterizer->vertexX[j], yj = rasterizer->vertexY[j];
+        float xi = rasterizer->vertexX[i], yi = rasterizer->vertexY[i];
+        if (xi != xi || yi != yi || xj != xj || yj != yj) continue;
+        bool jIsInside = xj >= 0 && yj >= 0 && xj < W && yj < H;
+        bool iIsInside = xi >= 0 && yi >= 0 && xi < W && yi < H;
+        if (!jIsInside && !iIsInside) continue;
+        drawLine(job->grid, W, start, end, xj, yj, xi, yi, value);
+      }
+    }
+  }
+}
+
+void CPolygonRasterizer::drawOutlines(float *grid, int W, int H) {
+  Job<float> job;
+  job.rasterizer = this;
+  job.grid = grid;
+  job.W = W;
+  job.H = H;
+  CParallelFor::run(drawOutlineRows, &job, H, CPOLYGONRASTERIZER_MINROWSPERTHREAD);
+}
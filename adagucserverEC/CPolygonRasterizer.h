@@ -0,0 +1,176 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CPOLYGONRASTERIZER_H
+#define CPOLYGONRASTERIZER_H
+
+#include <vector>
+#include "CDebugger.h"
+
+class CDataSource;
+class CImageWarper;
+
+/**
+ * @brief Index of the lon/lat bounding boxes of the cells or polygons of a file, used to skip cells outside the requested BBOX.
+ * Cells are binned in a regular lon/lat grid, a query returns the cells overlapping a lon/lat box in ascending order.
+ */
+class CPolygonCellIndex {
+private:
+  DEF_ERRORFUNCTION();
+  int binsX, binsY;
+  double extent[4];
+  std::vector<float> cellBBOX;
+  std::vector<int> binStart, binCells;
+
+public:
+  /**
+   * @brief Fills cellBBOX with minLon, minLat, maxLon, maxLat for every cell. Cells without a valid position get NaN.
+   */
+  typedef void (*CellBBOXFunction)(std::vector<float> &cellBBOX, void *userData);
+
+  CPolygonCellIndex();
+
+  /**
+   * @brief Builds the index from 4 values per cell, see CellBBOXFunction
+   */
+  void build(const std::vector<float> &cellBBOX);
+
+  /**
+   * @brief Reads the index from the TempDir cache of the datasource, or builds it with function and stores it in the cache.
+   *
+   * @param dataSource The datasource, its file name is part of the cache key
+   * @param name Name of the cells, part of the cache key
+   * @param function Calculates the cell bounding boxes when the index is not in the cache
+   * @param userData Passed to function
+   */
+  void load(CDataSource *dataSource, const char *name, CellBBOXFunction function, void *userData);
+
+  /**
+   * @brief Returns the cells overlapping the lon/lat box in ascending order
+   *
+   * @param latLonBBOX minLon, minLat, maxLon, maxLat
+   * @param cells The result
+   */
+  void query(const double *latLonBBOX, std::vector<int> &cells) const;
+
+  size_t getNumCells() const { return cellBBOX.size() / 4; }
+
+  /**
+   * @return Zero on success
+   */
+  int write(const char *fileName) const;
+
+  /**
+   * @return Zero on success
+   */
+  int read(const char *fileName);
+
+  /**
+   * @brief Calculates the lon/lat box covering the BBOX of the map, by sampling the map in the lon/lat projection.
+   *
+   * @param imageWarper Warper from lon/lat to the map projection, only used when projectionRequired is set
+   * @param projectionRequired False when the map is in lon/lat
+   * @param mapBBOX The BBOX of the map, in the map projection
+   * @param latLonBBOX The result
+   * @return Zero on success, non zero if the box can not be determined and all cells need to be drawn
+   */
+  static int getLatLonBBOX(CImageWarper *imageWarper, bool projectionRequired, const double *mapBBOX, double *latLonBBOX);
+};
+
+/**
+ * @brief Rasterizes polygons in grid coordinates into a field, shared by the mesh, hexagon and GeoJSON converters.
+ * Polygons are collected first and drawn in the order they were added. The field is divided over threads by bands of rows,
+ * every thread draws the polygons overlapping its band, so the result does not depend on the number of threads.
+ * A pixel is inside when its center is inside the polygon, polygons with holes and multiple rings use the even-odd rule.
+ */
+class CPolygonRasterizer {
+private:
+  DEF_ERRORFUNCTION();
+  class Polygon {
+  public:
+    int firstRing, numRings;
+    double value;
+    float minX, minY, maxX, maxY;
+    bool convex, hasNaN, scanlineFill;
+    int clipBox[4];
+  };
+  std::vector<float> vertexX, vertexY;
+  std::vector<int> ringStart;
+  std::vector<Polygon> polygons;
+
+  template <class T> class Job;
+  template <class T> static void fillRows(int start, int end, void *userData);
+  static void drawOutlineRows(int start, int end, void *userData);
+  template <class T> void fillPolygon(const Polygon &polygon, T *grid, int W, int rowStart, int rowEnd, std::vector<float> &crossings, std::vector<unsigned char> &mask) const;
+  template <class T> void fillPolygonScanline(const Polygon &polygon, T *grid, int W, int H, int rowStart, int rowEnd, std::vector<int> &nodes, std::vector<unsigned char> &mask) const;
+  template <class T> void fill(T *grid, int W, int H);
+
+public:
+  CPolygonRasterizer();
+
+  void clear();
+
+  /**
+   * @brief Starts a new polygon, add its rings with addRing
+   */
+  void addPolygon(double value);
+
+  /**
+   * @brief Adds a ring to the last polygon, the ring is closed automatically
+   */
+  void addRing(const float *x, const float *y, int numVertices);
+
+  /**
+   * @brief Adds a ring with interleaved x,y coordinates to the last polygon
+   */
+  void addRing(const float *xy, int numVertices);
+
+  /**
+   * @brief Fills the last polygon as the scanline fill of the original GeoJSON converter, which keeps GeoJSON output unchanged.
+   * Vertices are expected to be whole pixel indices. Rows are sampled at their top edge, crossings are truncated to integers,
+   * the first ring is filled and the other rings are cut out of it. Only rows [yMin, yMax] and columns [xMin, xMax) are drawn.
+   */
+  void setScanlineFill(int xMin, int yMin, int xMax, int yMax);
+
+  /**
+   * @brief Adds a single ring polygon which is known to be convex, it is filled with edge functions instead of scanline crossings
+   */
+  void addConvexPolygon(const float *x, const float *y, int numVertices, double value);
+
+  size_t getNumPolygons() const { return polygons.size(); }
+
+  /**
+   * @brief Fills all polygons into grid
+   */
+  void fill(float *grid, int W, int H);
+  void fill(unsigned short *grid, int W, int H);
+
+  /**
+   * @brief Draws the edges of all polygons into grid. Edges with a NaN vertex and edges with both vertices outside the grid are skipped.
+   */
+  void drawOutlines(float *grid, int W, int H);
+};
+
+#endif
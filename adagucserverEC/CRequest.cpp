@@ -37,6 +37,9 @@
 #include "CSLD.h"
 #include "CHandleMetadata.h"
 #include "CCreateTiles.h"
+#include "CAsyncLogger.h"
+#include "CResponseCache.h"
+#include "CMetrics.h"
 const char *CRequest::className = "CRequest";
 int CRequest::CGI = 0;
 
@@ -72,6 +75,7 @@ void writeLogFile3(const char *msg) {
 }
 
 int CRequest::setConfigFile(const char *pszConfigFile) {
+  CMetrics::Timer timer(CMetrics::PHASE_CONFIG);
   if (pszConfigFile == NULL) {
     CDBError("No config file set");
     return 1;
@@ -191,6 +195,11 @@ int CRequest::setConfigFile(const char *pszConfigFile) {
       }
     }
 
+    /* Maximum netcdf chunk cache per variable in megabytes */
+    if (srvParam->cfg->ChunkCache.size() > 0 && !srvParam->cfg->ChunkCache[0]->attr.maxsize.empty()) {
+      CDFNetCDFReader::setChunkCacheLimit(size_t(srvParam->cfg->ChunkCache[0]->attr.maxsize.toInt()) * 1024 * 1024);
+    }
+
   } else {
     srvParam->cfg = NULL;
     CDBError("Invalid XML file %s", pszConfigFile);
@@ -349,8 +358,7 @@ int CRequest::generateGetReferenceTimesDoc(CT::string *result, CDataSource *data
       }
       first = false;
       result->concat("\"");
-      CT::string ymd;
-      ymd = store->getRecord(k)->get(0);
+      CT::string ymd = store->getValue(k, 0);
       ymd.setChar(10, 'T');
       // 01234567890123456789
       // YYYY-MM-DDTHH:MM:SSZ
@@ -1466,22 +1474,26 @@ int CRequest::queryDimValuesForDataSource(CDataSource *dataSource, CServerParams
       throw InvalidDimensionValue;
     }
 
+    /* The dim array indices are parsed once per column instead of once per step */
+    std::vector<const std::vector<double> *> dimIndices;
+    for (size_t i = 0; i < dataSource->requiredDims.size(); i++) dimIndices.push_back(&store->getDoubleColumn(2 + i * 2));
     for (size_t k = 0; k < store->getSize(); k++) {
-      CDBStore::Record *record = store->getRecord(k);
       // CDBDebug("Addstep");
-      dataSource->addStep(record->get(0)->c_str(), NULL);
+      dataSource->addStep(store->getValue(k, 0), NULL);
 #ifdef CREQUEST_DEBUG
-      CDBDebug("Step %d: [%s]", k, record->get(0)->c_str());
+      CDBDebug("Step %d: [%s]", k, store->getValue(k, 0));
 #endif
       // For each timesteps a new set of dimensions is added with corresponding dim array indices.
       for (size_t i = 0; i < dataSource->requiredDims.size(); i++) {
-        CT::string value = record->get(1 + i * 2)->c_str();
-        dataSource->getCDFDims()->addDimension(dataSource->requiredDims[i]->netCDFDimName.c_str(), value.c_str(), atoi(record->get(2 + i * 2)->c_str()));
+        const char *value = store->getValue(k, 1 + i * 2);
+        double dimIndex = (*dimIndices[i])[k];
+        int index = isnan(dimIndex) ? 0 : int(dimIndex);
+        dataSource->getCDFDims()->addDimension(dataSource->requiredDims[i]->netCDFDimName.c_str(), value, index);
 #ifdef CREQUEST_DEBUG
         CDBDebug("queryDimValuesForDataSource dataSource->queryBBOX %s for step %d/%d", dataSource->layerName.c_str(), dataSource->getCurrentTimeStep(), dataSource->getNumTimeSteps());
-        CDBDebug("  [%s][%d] = [%s]", dataSource->requiredDims[i]->netCDFDimName.c_str(), atoi(record->get(2 + i * 2)->c_str()), value.c_str());
+        CDBDebug("  [%s][%d] = [%s]", dataSource->requiredDims[i]->netCDFDimName.c_str(), index, value);
 #endif
-        dataSource->requiredDims[i]->addValue(value.c_str());
+        dataSource->requiredDims[i]->addValue(value);
         // dataSource->requiredDims[i]->allValues.push_back(sDims[l].c_str());
       }
     }
@@ -1528,6 +1540,13 @@ int CRequest::process_all_layers() {
       return 1;
     }
 
+    CT::string requestedLayers;
+    for (size_t j = 0; j < srvParam->WMSLayers->count; j++) {
+      if (j > 0) requestedLayers.concat(",");
+      requestedLayers.concat(srvParam->WMSLayers[j].c_str());
+    }
+    CAsyncLogger::setLayer(requestedLayers.c_str());
+
     // dataSources = new CDataSource[srvParam->WMSLayers->count];
     // Now set the properties of these sourceimages
     CT::string layerName;
@@ -1769,6 +1788,12 @@ int CRequest::process_all_layers() {
     }
   }
 
+  /* Identical GetMap and GetLegendGraphic requests on unchanged files are served from the response cache */
+  CResponseCache responseCache;
+  if (responseCache.init(srvParam, dataSources) == 0 && responseCache.serve() == 0) {
+    return 0;
+  }
+
   int j = 0;
 
   /**************************************/
@@ -2059,7 +2084,7 @@ int CRequest::process_all_layers() {
           scaleBarImage.createImage(&imageDataWriter.drawImage, 200 * scaling, 30 * scaling);
 
           // scaleBarImage.rectangle(0,0,scaleBarImage.Geo->dWidth,scaleBarImage.Geo->dHeight,CColor(0,0,0,0),CColor(0,0,0,255));
-          status = imageDataWriter.createScaleBar(dataSources[0]->srvParams->Geo, &scaleBarImage, scaling);
+          status = imageDataWriter.createScaleBar(dataSources[0]->srvParams->Geo, &scaleBarImage, scaling, srvParam);
           if (status != 0) throw(__LINE__);
           int posX = padding * scaling; // imageDataWriter.drawImage.Geo->dWidth-(scaleBarImage.Geo->dWidth+padding);
           int posY = imageDataWriter.drawImage.Geo->dHeight - (scaleBarImage.Geo->dHeight + padding * scaling);
@@ -2070,7 +2095,10 @@ int CRequest::process_all_layers() {
 
         if (srvParam->showNorthArrow) {
         }
+        CMetrics::printHeader();
+        responseCache.beginCapture();
         status = imageDataWriter.end();
+        responseCache.endCapture(status == 0);
         if (status != 0) throw(__LINE__);
         fclose(stdout);
       }
@@ -2146,6 +2174,7 @@ int CRequest::process_all_layers() {
         if (status != 0) throw(__LINE__);
         status = imageDataWriter.getFeatureInfo(dataSources, 0, int(srvParam->dX), int(srvParam->dY));
         if (status != 0) throw(__LINE__);
+        CMetrics::printHeader();
         status = imageDataWriter.end();
         if (status != 0) throw(__LINE__);
       }
@@ -2159,7 +2188,10 @@ int CRequest::process_all_layers() {
         CDBDebug("creatinglegend %dx%d %d", srvParam->Geo->dWidth, srvParam->Geo->dHeight, rotate);
         status = imageDataWriter.createLegend(dataSources[j], &imageDataWriter.drawImage, rotate);
         if (status != 0) throw(__LINE__);
+        CMetrics::printHeader();
+        responseCache.beginCapture();
         status = imageDataWriter.end();
+        responseCache.endCapture(status == 0);
         if (status != 0) throw(__LINE__);
       }
 
@@ -3239,7 +3271,7 @@ int CRequest::process_querystring() {
       drawImage.createImage(300, 30);
       drawImage.create685Palette();
       try {
-        CCreateScaleBar::createScaleBar(&drawImage, srvParam->Geo, 1);
+        CCreateScaleBar::createScaleBar(&drawImage, srvParam->Geo, 1, srvParam);
       } catch (int e) {
         CDBError("Exception %d", e);
         return 1;
@@ -0,0 +1,315 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CResponseCache.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include "CDirReader.h"
+#include "CServerError.h"
+#include "CMetrics.h"
+
+const char *CResponseCache::className = "CResponseCache";
+
+#define CRESPONSECACHE_FILEID "ACR1"
+#define CRESPONSECACHE_NUMSHARDS 256
+#define CRESPONSECACHE_DEFAULTMAXSIZE_MB 1024
+#define CRESPONSECACHE_STALETMP_SECONDS 300
+
+class CResponseCacheEntry {
+public:
+  CT::string fileName;
+  time_t lastUsed;
+  size_t size;
+  bool operator<(const CResponseCacheEntry &other) const { return lastUsed < other.lastUsed; }
+};
+
+static unsigned long long fnv1a64(const char *data, size_t length, unsigned long long hash) {
+  for (size_t j = 0; j < length; j++) {
+    hash ^= (unsigned char)data[j];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+CResponseCache::CResponseCache() {
+  maxSize = 0;
+  headerSize = 0;
+  savedStdout = -1;
+  enabled = false;
+}
+
+CResponseCache::~CResponseCache() {
+  if (savedStdout != -1) {
+    endCapture(false);
+  }
+}
+
+void CResponseCache::appendFileState(CT::string &key, const char *fileName) {
+  struct stat fileStat;
+  if (stat(fileName, &fileStat) != 0) {
+    key.printconcat("file:%s missing\n", fileName);
+    return;
+  }
+  key.printconcat("file:%s %llu %lld.%09ld %llu\n", fileName, (unsigned long long)fileStat.st_size, (long long)fileStat.st_mtim.tv_sec, (long)fileStat.st_mtim.tv_nsec,
+                  (unsigned long long)fileStat.st_ino);
+}
+
+void CResponseCache::appendConfigState(CServerParams *srvParam, CT::string &key) {
+  CT::StackList<CT::string> configFiles = srvParam->configFileName.splitToStack(",");
+  for (size_t j = 0; j < configFiles.size(); j++) {
+    appendFileState(key, configFiles[j].c_str());
+  }
+  for (size_t j = 0; j < srvParam->cfg->Include.size(); j++) {
+    appendFileState(key, srvParam->cfg->Include[j]->attr.location.c_str());
+  }
+  if (!srvParam->datasetLocation.empty()) {
+    CT::string datasetName = srvParam->datasetLocation.c_str();
+    datasetName.replaceSelf(":", "_");
+    datasetName.replaceSelf("/", "_");
+    for (size_t j = 0; j < srvParam->cfg->Dataset.size(); j++) {
+      CT::string datasetFile;
+      datasetFile.print("%s/%s.xml", srvParam->cfg->Dataset[j]->attr.location.c_str(), datasetName.c_str());
+      appendFileState(key, datasetFile.c_str());
+    }
+  }
+}
+
+CT::string CResponseCache::hashKey(const char *key) {
+  size_t length = strlen(key);
+  unsigned long long hash1 = fnv1a64(key, length, 14695981039346656037ULL);
+  unsigned long long hash2 = fnv1a64(key, length, hash1 ^ 0x9e3779b97f4a7c15ULL);
+  CT::string hash;
+  hash.print("%016llx%016llx", hash1, hash2);
+  return hash;
+}
+
+int CResponseCache::init(CServerParams *srvParam, std::vector<CDataSource *> &dataSources) {
+  enabled = false;
+  if (srvParam->cfg->ResponseCache.size() == 0 || !srvParam->cfg->ResponseCache[0]->attr.enabled.equals("true")) return 1;
+  if (srvParam->requestType != REQUEST_WMS_GETMAP && srvParam->requestType != REQUEST_WMS_GETLEGENDGRAPHIC) return 1;
+  if (srvParam->cfg->TempDir.size() == 0 || srvParam->cfg->TempDir[0]->attr.value.empty()) return 1;
+  const char *pszQueryString = getenv("QUERY_STRING");
+  if (pszQueryString == NULL || dataSources.size() == 0) return 1;
+
+  maxSize = size_t(CRESPONSECACHE_DEFAULTMAXSIZE_MB) * 1024 * 1024;
+  if (!srvParam->cfg->ResponseCache[0]->attr.maxsize.empty()) {
+    int maxSizeMB = srvParam->cfg->ResponseCache[0]->attr.maxsize.toInt();
+    if (maxSizeMB <= 0) return 1;
+    maxSize = size_t(maxSizeMB) * 1024 * 1024;
+  }
+
+  /* Parameters are sorted with uppercase names, so that equivalent requests share the key */
+  CT::string queryString = pszQueryString;
+  queryString.decodeURLSelf();
+  std::vector<std::string> parameters;
+  CT::StackList<CT::string> items = queryString.splitToStack("&");
+  for (size_t j = 0; j < items.size(); j++) {
+    if (items[j].empty()) continue;
+    int equalPos = items[j].indexOf("=");
+    CT::string name = equalPos == -1 ? items[j] : items[j].substring(0, equalPos);
+    name.trimSelf();
+    name.toUpperCaseSelf();
+    /* SLD refers to external resources which are not tracked */
+    if (name.indexOf("SLD") == 0) return 1;
+    CT::string value = equalPos == -1 ? CT::string("") : CT::string(items[j].c_str() + equalPos + 1);
+    parameters.push_back(std::string(name.c_str()) + "=" + value.c_str());
+  }
+  std::sort(parameters.begin(), parameters.end());
+
+  key = "request:";
+  for (size_t j = 0; j < parameters.size(); j++) {
+    key.concat(parameters[j].c_str());
+    key.concat("&");
+  }
+  key.concat("\n");
+
+  /* Styles, legends and layers come from the configuration */
+  appendConfigState(srvParam, key);
+
+  /* The files and dimension indices selected for this request */
+  for (size_t d = 0; d < dataSources.size(); d++) {
+    CDataSource *dataSource = dataSources[d];
+    if (dataSource->dLayerType == CConfigReaderLayerTypeCascaded) return 1;
+    key.printconcat("layer:%s\n", dataSource->getLayerName());
+    for (size_t k = 0; k < dataSource->timeSteps.size(); k++) {
+      CDataSource::TimeStep *timeStep = dataSource->timeSteps[k];
+      if (!timeStep->fileName.empty()) {
+        appendFileState(key, timeStep->fileName.c_str());
+      }
+      for (size_t i = 0; i < timeStep->dims.getNumDimensions(); i++) {
+        key.printconcat("dim:%s=%lu\n", timeStep->dims.getDimensionName(i), (unsigned long)timeStep->dims.getDimensionIndex(i));
+      }
+    }
+  }
+
+  CT::string hash = hashKey(key.c_str());
+
+  shardDirectory.print("%s/adaguc/responses/%s", srvParam->cfg->TempDir[0]->attr.value.c_str(), hash.substring(0, 2).c_str());
+  entryFile.print("%s/%s", shardDirectory.c_str(), hash.c_str());
+  enabled = true;
+  return 0;
+}
+
+int CResponseCache::copyToStdout(int fd) {
+  char buffer[65536];
+  ssize_t bytesRead;
+  while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
+    if (fwrite(buffer, 1, bytesRead, stdout) != size_t(bytesRead)) return 1;
+  }
+  return bytesRead < 0 ? 1 : 0;
+}
+
+int CResponseCache::serve() {
+  if (!enabled) return 1;
+  int fd = open(entryFile.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return 1;
+
+  /* The key is stored in the entry, a hash collision is a miss */
+  char fileId[4];
+  size_t keyLength = 0;
+  bool matches = read(fd, fileId, 4) == 4 && strncmp(fileId, CRESPONSECACHE_FILEID, 4) == 0;
+  matches = matches && read(fd, &keyLength, sizeof(size_t)) == sizeof(size_t) && keyLength == key.length();
+  if (matches) {
+    char *storedKey = new char[keyLength];
+    matches = read(fd, storedKey, keyLength) == ssize_t(keyLength) && memcmp(storedKey, key.c_str(), keyLength) == 0;
+    delete[] storedKey;
+  }
+  if (!matches) {
+    close(fd);
+    return 1;
+  }
+  CMetrics::printHeader();
+  int status = copyToStdout(fd);
+  close(fd);
+  fflush(stdout);
+  if (status != 0) {
+    CDBError("Unable to write cached response %s", entryFile.c_str());
+    return status;
+  }
+  /* Mark as recently used for eviction */
+  utime(entryFile.c_str(), NULL);
+  CDBDebug("Served response from cache %s", entryFile.c_str());
+  return 0;
+}
+
+void CResponseCache::beginCapture() {
+  if (!enabled || savedStdout != -1) return;
+  CDirReader::makePublicDirectory(shardDirectory.c_str());
+  captureFile.print("%s_%d_tmp", entryFile.c_str(), int(getpid()));
+  int fd = open(captureFile.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    CDBWarning("Unable to create %s, response is not cached", captureFile.c_str());
+    return;
+  }
+  size_t keyLength = key.length();
+  headerSize = 4 + sizeof(size_t) + keyLength;
+  bool ok = write(fd, CRESPONSECACHE_FILEID, 4) == 4 && write(fd, &keyLength, sizeof(size_t)) == sizeof(size_t) && write(fd, key.c_str(), keyLength) == ssize_t(keyLength);
+
+  fflush(stdout);
+  savedStdout = ok ? dup(STDOUT_FILENO) : -1;
+  if (savedStdout == -1 || dup2(fd, STDOUT_FILENO) == -1) {
+    CDBWarning("Unable to redirect output to %s, response is not cached", captureFile.c_str());
+    if (savedStdout != -1) close(savedStdout);
+    savedStdout = -1;
+    close(fd);
+    remove(captureFile.c_str());
+    return;
+  }
+  close(fd);
+}
+
+void CResponseCache::endCapture(bool store) {
+  if (savedStdout == -1) return;
+  fflush(stdout);
+  int fd = open(captureFile.c_str(), O_RDONLY | O_CLOEXEC);
+  dup2(savedStdout, STDOUT_FILENO);
+  close(savedStdout);
+  savedStdout = -1;
+  if (fd < 0) {
+    CDBError("Unable to read captured response %s", captureFile.c_str());
+    remove(captureFile.c_str());
+    return;
+  }
+
+  /* The response is always written, it is only kept when rendering succeeded */
+  lseek(fd, headerSize, SEEK_SET);
+  int status = copyToStdout(fd);
+  close(fd);
+  fflush(stdout);
+  if (status != 0 || !store || errorsOccured()) {
+    remove(captureFile.c_str());
+    return;
+  }
+  if (rename(captureFile.c_str(), entryFile.c_str()) != 0) {
+    CDBWarning("Unable to store response in %s", entryFile.c_str());
+    remove(captureFile.c_str());
+    return;
+  }
+  evictShard();
+}
+
+void CResponseCache::evictShard() {
+  DIR *dir = opendir(shardDirectory.c_str());
+  if (dir == NULL) return;
+  std::vector<CResponseCacheEntry> entries;
+  size_t totalSize = 0;
+  time_t now = time(NULL);
+  struct dirent *dirEntry;
+  while ((dirEntry = readdir(dir)) != NULL) {
+    if (dirEntry->d_name[0] == '.') continue;
+    CT::string fileName;
+    fileName.print("%s/%s", shardDirectory.c_str(), dirEntry->d_name);
+    struct stat fileStat;
+    if (stat(fileName.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) continue;
+    if (fileName.endsWith("_tmp")) {
+      /* Leftovers of killed processes */
+      if (now - fileStat.st_mtime > CRESPONSECACHE_STALETMP_SECONDS) remove(fileName.c_str());
+      continue;
+    }
+    CResponseCacheEntry entry;
+    entry.fileName = fileName;
+    entry.lastUsed = fileStat.st_mtime;
+    entry.size = fileStat.st_size;
+    totalSize += entry.size;
+    entries.push_back(entry);
+  }
+  closedir(dir);
+
+  size_t shardMaxSize = maxSize / CRESPONSECACHE_NUMSHARDS;
+  if (totalSize <= shardMaxSize) return;
+  std::sort(entries.begin(), entries.end());
+  for (size_t j = 0; j < entries.size() && totalSize > shardMaxSize; j++) {
+    if (remove(entries[j].fileName.c_str()) == 0) {
+      totalSize -= entries[j].size;
+    }
+  }
+}
@@ -0,0 +1,102 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CRESPONSECACHE_H
+#define CRESPONSECACHE_H
+
+#include <vector>
+#include "CServerParams.h"
+#include "CDataSource.h"
+
+/**
+ * @brief Stores rendered GetMap and GetLegendGraphic responses on disk and serves them for identical requests.
+ *
+ * Configured with <ResponseCache enabled="true" maxsize="1024"/>, maxsize in megabytes. The key is the normalized query
+ * string plus the configuration files and the files with their dimension indices as selected for the request, with size
+ * and modification time. A file which is changed by the scanner therefore leads to another key. Entries are stored in
+ * 256 shard directories below the TempDir, each shard removes its least recently used entries when it exceeds its share of maxsize.
+ */
+class CResponseCache {
+private:
+  DEF_ERRORFUNCTION();
+  CT::string key;
+  CT::string shardDirectory;
+  CT::string entryFile;
+  CT::string captureFile;
+  size_t maxSize;
+  size_t headerSize;
+  int savedStdout;
+  bool enabled;
+
+  static int copyToStdout(int fd);
+  void evictShard();
+
+public:
+  /**
+   * @brief Appends the name, size and modification time of a file to key, so that a changed file leads to another key
+   */
+  static void appendFileState(CT::string &key, const char *fileName);
+
+  /**
+   * @brief Appends the state of the configuration files, the includes and the dataset configuration of a DATASET request to key
+   */
+  static void appendConfigState(CServerParams *srvParam, CT::string &key);
+
+  /**
+   * @brief Hashes key to 32 hexadecimal characters, which can be used as file name
+   */
+  static CT::string hashKey(const char *key);
+
+  CResponseCache();
+  ~CResponseCache();
+
+  /**
+   * @brief Builds the key for the request, the dimensions of the datasources need to be set.
+   *
+   * @return Zero when the response can be cached
+   */
+  int init(CServerParams *srvParam, std::vector<CDataSource *> &dataSources);
+
+  /**
+   * @brief Writes the cached response to stdout
+   *
+   * @return Zero when the response was served from the cache
+   */
+  int serve();
+
+  /**
+   * @brief Redirects stdout to a new cache entry, does nothing when the cache was not initialized
+   */
+  void beginCapture();
+
+  /**
+   * @brief Restores stdout and writes the captured response to it
+   *
+   * @param store Keep the captured response as cache entry
+   */
+  void endCapture(bool store);
+};
+
+#endif
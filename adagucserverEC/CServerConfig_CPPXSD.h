@@ -131,6 +131,37 @@ public:
     }
   };
 
+  class XMLE_ResponseCache : public CXMLObjectInterface {
+  public:
+    class Cattr {
+    public:
+      CT::string enabled, maxsize;
+    } attr;
+    void addAttribute(const char *attrname, const char *attrvalue) {
+      if (equals("enabled", 7, attrname)) {
+        attr.enabled.copy(attrvalue);
+        return;
+      } else if (equals("maxsize", 7, attrname)) {
+        attr.maxsize.copy(attrvalue);
+        return;
+      }
+    }
+  };
+
+  class XMLE_ChunkCache : public CXMLObjectInterface {
+  public:
+    class Cattr {
+    public:
+      CT::string maxsize;
+    } attr;
+    void addAttribute(const char *attrname, const char *attrvalue) {
+      if (equals("maxsize", 7, attrname)) {
+        attr.maxsize.copy(attrvalue);
+        return;
+      }
+    }
+  };
+
   class XMLE_Thinning : public CXMLObjectInterface {
   public:
     class Cattr {
@@ -718,7 +749,7 @@ public:
   public:
     class Cattr {
     public:
-      CT::string settings, striding, renderer, scalewidth, scalecontours;
+      CT::string settings, striding, renderer, scalewidth, scalecontours, numthreads, contourmethod, tiling, bilinearmethod, textkerning;
     } attr;
     void addAttribute(const char *name, const char *value) {
       if (equals("settings", 8, name)) {
@@ -736,6 +767,21 @@ public:
       } else if (equals("scalecontours", 13, name)) {
         attr.scalecontours.copy(value);
         return;
+      } else if (equals("numthreads", 10, name)) {
+        attr.numthreads.copy(value);
+        return;
+      } else if (equals("contourmethod", 13, name)) {
+        attr.contourmethod.copy(value);
+        return;
+      } else if (equals("tiling", 6, name)) {
+        attr.tiling.copy(value);
+        return;
+      } else if (equals("bilinearmethod", 14, name)) {
+        attr.bilinearmethod.copy(value);
+        return;
+      } else if (equals("textkerning", 11, name)) {
+        attr.textkerning.copy(value);
+        return;
       }
     }
   };
@@ -1780,6 +1826,8 @@ public:
     std::vector<XMLE_Dataset *> Dataset;
     std::vector<XMLE_Include *> Include;
     std::vector<XMLE_Logging *> Logging;
+    std::vector<XMLE_ResponseCache *> ResponseCache;
+    std::vector<XMLE_ChunkCache *> ChunkCache;
 
     ~XMLE_Configuration() {
       XMLE_DELOBJ(Legend);
@@ -1798,6 +1846,8 @@ public:
       XMLE_DELOBJ(Dataset);
       XMLE_DELOBJ(Include);
       XMLE_DELOBJ(Logging);
+      XMLE_DELOBJ(ResponseCache);
+      XMLE_DELOBJ(ChunkCache);
     }
     void addElement(CXMLObjectInterface *baseClass, int rc, const char *name, const char *value) {
       CXMLSerializerInterface *base = (CXMLSerializerInterface *)baseClass;
@@ -1838,6 +1888,10 @@ public:
           XMLE_ADDOBJ(Include);
         } else if (equals("Logging", 7, name)) {
           XMLE_ADDOBJ(Logging);
+        } else if (equals("ResponseCache", 13, name)) {
+          XMLE_ADDOBJ(ResponseCache);
+        } else if (equals("ChunkCache", 10, name)) {
+          XMLE_ADDOBJ(ChunkCache);
         }
       }
       if (pt2Class != NULL) pt2Class->addElement(baseClass, rc - pt2Class->level, name, value);
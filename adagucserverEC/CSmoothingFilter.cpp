@@ -0,0 +1,152 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CSmoothingFilter.h"
+#include "CParallelFor.h"
+#include <vector>
+
+const char *CSmoothingFilter::className = "CSmoothingFilter";
+
+/* Minimum number of rows or columns handled by a single thread */
+#define CSMOOTHINGFILTER_MIN_LINES_PER_THREAD 64
+
+void CSmoothingFilter::boxRows(int start, int end, void *userData) {
+  Job *job = (Job *)userData;
+  int W = job->W;
+  int r = job->radius;
+  for (int y = start; y < end; y++) {
+    size_t row = size_t(y) * W;
+    const float *num = job->num + row;
+    const float *den = job->den + row;
+    float *tmpNum = job->tmpNum + row;
+    float *tmpDen = job->tmpDen + row;
+    double sumNum = 0, sumDen = 0;
+    for (int x = 0; x <= r && x < W; x++) {
+      sumNum += num[x];
+      sumDen += den[x];
+    }
+    for (int x = 0; x < W; x++) {
+      tmpNum[x] = sumNum;
+      tmpDen[x] = sumDen;
+      int add = x + r + 1;
+      int remove = x - r;
+      if (add < W) {
+        sumNum += num[add];
+        sumDen += den[add];
+      }
+      if (remove >= 0) {
+        sumNum -= num[remove];
+        sumDen -= den[remove];
+      }
+    }
+  }
+}
+
+void CSmoothingFilter::boxColumns(int start, int end, void *userData) {
+  Job *job = (Job *)userData;
+  size_t W = job->W;
+  int H = job->H;
+  int r = job->radius;
+  int numColumns = end - start;
+  /* Running sums for a strip of columns, the inner loops run over contiguous memory and are vectorized by the compiler */
+  std::vector<double> sumNum(numColumns, 0), sumDen(numColumns, 0);
+  double *sn = &sumNum[0];
+  double *sd = &sumDen[0];
+  const float *tmpNum = job->tmpNum + start;
+  const float *tmpDen = job->tmpDen + start;
+  float *num = job->num + start;
+  float *den = job->den + start;
+  for (int y = 0; y <= r && y < H; y++) {
+    for (int x = 0; x < numColumns; x++) {
+      sn[x] += tmpNum[y * W + x];
+      sd[x] += tmpDen[y * W + x];
+    }
+  }
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < numColumns; x++) {
+      num[y * W + x] = sn[x];
+      den[y * W + x] = sd[x];
+    }
+    int add = y + r + 1;
+    int remove = y - r;
+    if (add < H) {
+      for (int x = 0; x < numColumns; x++) {
+        sn[x] += tmpNum[add * W + x];
+        sd[x] += tmpDen[add * W + x];
+      }
+    }
+    if (remove >= 0) {
+      for (int x = 0; x < numColumns; x++) {
+        sn[x] -= tmpNum[remove * W + x];
+        sd[x] -= tmpDen[remove * W + x];
+      }
+    }
+  }
+}
+
+void CSmoothingFilter::smooth(float *valueData, float fNodataValue, int smoothWindow, int W, int H) {
+  if (smoothWindow <= 0 || W <= 0 || H <= 0) return;
+  size_t size = size_t(W) * H;
+  float *num = new float[size];
+  float *den = new float[size];
+  float *tmpNum = new float[size];
+  float *tmpDen = new float[size];
+  for (size_t p = 0; p < size; p++) {
+    float v = valueData[p];
+    bool isValid = v != fNodataValue && v == v;
+    num[p] = isValid ? v : 0;
+    den[p] = isValid ? 1 : 0;
+  }
+
+  Job settings;
+  settings.num = num;
+  settings.den = den;
+  settings.tmpNum = tmpNum;
+  settings.tmpDen = tmpDen;
+  settings.W = W;
+  settings.H = H;
+
+  /* Two box filters give a tent kernel reaching smoothWindow cells, like the tapered window used before */
+  int radii[2] = {(smoothWindow + 1) / 2, smoothWindow / 2};
+  for (int j = 0; j < 2; j++) {
+    if (radii[j] == 0) continue;
+    settings.radius = radii[j];
+    CParallelFor::run(boxRows, &settings, H, CSMOOTHINGFILTER_MIN_LINES_PER_THREAD);
+    CParallelFor::run(boxColumns, &settings, W, CSMOOTHINGFILTER_MIN_LINES_PER_THREAD);
+  }
+
+  for (size_t p = 0; p < size; p++) {
+    float v = valueData[p];
+    if (v != fNodataValue && v == v && den[p] > 0) {
+      valueData[p] = num[p] / den[p];
+    } else {
+      valueData[p] = fNodataValue;
+    }
+  }
+  delete[] num;
+  delete[] den;
+  delete[] tmpNum;
+  delete[] tmpDen;
+}
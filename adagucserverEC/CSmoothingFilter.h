@@ -0,0 +1,62 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CSMOOTHINGFILTER_H
+#define CSMOOTHINGFILTER_H
+
+#include "CDebugger.h"
+
+/**
+ * @brief Nodata aware smoothing of float fields, used by the contour and shading renderers.
+ *
+ * The filter is a tent kernel built from two separable box filters. Box filters are computed with running sums, which makes
+ * the costs independent of the window size. Values and valid counts are filtered with the same kernel, so nodata cells do
+ * not contribute and the result is normalized by the weights of the valid cells only. Nodata cells stay nodata.
+ */
+class CSmoothingFilter {
+private:
+  DEF_ERRORFUNCTION();
+  class Job {
+  public:
+    float *num, *den, *tmpNum, *tmpDen;
+    int W, H, radius;
+  };
+  static void boxRows(int start, int end, void *userData);
+  static void boxColumns(int start, int end, void *userData);
+
+public:
+  /**
+   * @brief Smooths the field in place
+   *
+   * @param valueData The field, W*H values, row major
+   * @param fNodataValue Nodata value, NaN is treated as nodata as well
+   * @param smoothWindow Radius of the window in cells, zero means no smoothing
+   * @param W Width of the field
+   * @param H Height of the field
+   */
+  static void smooth(float *valueData, float fNodataValue, int smoothWindow, int W, int H);
+};
+
+#endif
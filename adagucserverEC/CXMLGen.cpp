@@ -382,25 +382,23 @@ int CXMLGen::getDimsForLayer(WMSLayer *myWMSLayer) {
 
                 try {
 
+                  /* The time column is parsed once, values which are not a timestamp give no time resolution */
+                  const std::vector<double> &times = store->getTimeColumn(store->getColumnIndex("time"));
                   for (size_t j = 0; j < store->size(); j++) {
-                    store->getRecord(j)->get("time")->setChar(10, 'T');
-                    const char *isotime = store->getRecord(j)->get("time")->c_str();
-#ifdef CXMLGEN_DEBUG
-                    //                    CDBDebug("isotime = %s",isotime);
-#endif
-                    CT::string year, month, day, hour, minute, second;
-                    year.copy(isotime + 0, 4);
-                    tms[j].tm_year = year.toInt() - 1900;
-                    month.copy(isotime + 5, 2);
-                    tms[j].tm_mon = month.toInt() - 1;
-                    day.copy(isotime + 8, 2);
-                    tms[j].tm_mday = day.toInt();
-                    hour.copy(isotime + 11, 2);
-                    tms[j].tm_hour = hour.toInt();
-                    minute.copy(isotime + 14, 2);
-                    tms[j].tm_min = minute.toInt();
-                    second.copy(isotime + 17, 2);
-                    tms[j].tm_sec = second.toInt();
+                    if (isnan(times[j])) {
+                      CDBDebug("Unable to determine time resolution, [%s] is not a timestamp", store->getValue(j, store->getColumnIndex("time")));
+                      throw(__LINE__);
+                    }
+                    double seconds = floor(times[j]);
+                    long long days = (long long)floor(seconds / 86400);
+                    int year, month, day, secondOfDay = int(seconds - double(days) * 86400);
+                    CTime::civilFromDays(days, year, month, day);
+                    tms[j].tm_year = year - 1900;
+                    tms[j].tm_mon = month - 1;
+                    tms[j].tm_mday = day;
+                    tms[j].tm_hour = secondOfDay / 3600;
+                    tms[j].tm_min = (secondOfDay / 60) % 60;
+                    tms[j].tm_sec = secondOfDay % 60;
                   }
                   size_t nrTimes = store->size() - 1;
                   bool isConst = true;
@@ -555,32 +553,39 @@ int CXMLGen::getDimsForLayer(WMSLayer *myWMSLayer) {
             dim->hasMultipleValues = 1;
             if (isTimeDim == true) {
               dim->units.copy("ISO8601");
-              for (size_t j = 0; j < values->getSize(); j++) {
+            }
+
+            /* Values are read from the columns of the store directly, time values are formatted on the fly */
+            size_t numValues = values->getSize();
+            CT::string value, firstValue, lastValue;
+            dim->values.copy("");
+            for (size_t j = 0; j < numValues; j++) {
+              value.copy(values->getValue(j, 0));
+              if (isTimeDim == true) {
                 // 2011-01-01T22:00:01Z
                 // 01234567890123456789
-                values->getRecord(j)->get(0)->setChar(10, 'T');
-                if (values->getRecord(j)->get(0)->length() == 19) {
-                  values->getRecord(j)->get(0)->printconcat("Z");
+                value.setChar(10, 'T');
+                if (value.length() == 19) {
+                  value.concat("Z");
                 }
               }
-              dim->units.copy("ISO8601");
+              if (j > 0) dim->values.concat(",");
+              dim->values.concat(&value);
+              if (j == 0) firstValue.copy(&value);
+              if (j == numValues - 1) lastValue.copy(&value);
             }
+
             const char *pszDefaultV = myWMSLayer->dataSource->cfgLayer->Dimension[i]->attr.defaultV.c_str();
             CT::string defaultV;
             if (pszDefaultV != NULL) defaultV = pszDefaultV;
 
             if (defaultV.length() == 0 || defaultV.equals("max", 3)) {
-              dim->defaultValue.copy(values->getRecord(values->getSize() - 1)->get(0)->c_str());
+              dim->defaultValue.copy(&lastValue);
             } else if (defaultV.equals("min", 3)) {
-              dim->defaultValue.copy(values->getRecord(0)->get(0)->c_str());
+              dim->defaultValue.copy(&firstValue);
             } else {
               dim->defaultValue.copy(&defaultV);
             }
-
-            dim->values.copy(values->getRecord(0)->get(0));
-            for (size_t j = 1; j < values->getSize(); j++) {
-              dim->values.printconcat(",%s", values->getRecord(j)->get(0)->c_str());
-            }
           }
         }
         delete values;
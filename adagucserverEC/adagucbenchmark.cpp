@@ -0,0 +1,451 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "CRequest.h"
+#include "CServerError.h"
+#include "CMetrics.h"
+
+#define VERSION "ADAGUC benchmark 1.0"
+
+DEF_ERRORMAIN()
+
+/*
+  Replays a corpus of WMS query strings against a configuration and reports latency percentiles, throughput and the time spent per phase as JSON.
+
+  inprocess: every request runs CRequest in a forked copy of this process, phase timings and counters are taken from CMetrics.
+  cgi: every request executes the adagucserver binary like a webserver would, phase timings and counters are read from
+  the Server-Timing header. This header is written before the image is encoded, so the encode phase is always zero in this mode.
+
+  Each worker is a separate process because the netCDF and HDF5 libraries are not thread safe.
+*/
+
+class BenchmarkSettings {
+public:
+  CT::string configFile, corpusFile, serverBinary, outputFile, mode;
+  int workers, iterations, warmup;
+  std::vector<CT::string> corpus;
+};
+
+/* One measured request, sent from the worker processes to the main process through a pipe */
+class BenchmarkResult {
+public:
+  int requestIndex;
+  int status;
+  long long bytes;
+  double latency;
+  double phases[CMetrics::NUM_PHASES];
+  long long counters[CMetrics::NUM_COUNTERS];
+};
+
+void benchmarkLogFunction(const char *msg) { fprintf(stderr, "%s", msg); }
+
+void benchmarkLogFunctionNothing(const char *) {}
+
+void benchmarkErrorFunction(const char *msg) {
+  printerror(msg);
+  fprintf(stderr, "%s", msg);
+}
+
+static double getTimeInSeconds() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return double(now.tv_sec) + double(now.tv_nsec) * 1e-9;
+}
+
+int readCorpus(BenchmarkSettings &settings) {
+  FILE *pFile = fopen(settings.corpusFile.c_str(), "r");
+  if (pFile == NULL) {
+    CDBError("Unable to open corpus %s", settings.corpusFile.c_str());
+    return 1;
+  }
+  char line[8192];
+  while (fgets(line, sizeof(line), pFile) != NULL) {
+    line[strcspn(line, "\r\n")] = 0;
+    CT::string query = line;
+    query.trimSelf();
+    if (query.length() == 0 || query.charAt(0) == '#') continue;
+    settings.corpus.push_back(query);
+  }
+  fclose(pFile);
+  if (settings.corpus.size() == 0) {
+    CDBError("Corpus %s contains no requests", settings.corpusFile.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+/* Reads the phases and counters from the Server-Timing header at the start of the response */
+static void readServerTimingHeader(const char *outputFile, BenchmarkResult &result) {
+  FILE *pFile = fopen(outputFile, "r");
+  if (pFile == NULL) return;
+  char line[4096];
+  while (fgets(line, sizeof(line), pFile) != NULL) {
+    if (line[0] == '\r' || line[0] == '\n') break;
+    if (strncmp(line, "Server-Timing: ", 15) != 0) continue;
+    CT::string header = line + 15;
+    header.trimSelf();
+    CT::StackList<CT::string> entries = header.splitToStack(",");
+    for (size_t e = 0; e < entries.size(); e++) {
+      CT::StackList<CT::string> parts = entries[e].splitToStack(";");
+      if (parts.size() != 2) continue;
+      CT::string name = parts[0], value = parts[1];
+      name.trimSelf();
+      for (int j = 0; j < CMetrics::NUM_PHASES; j++) {
+        if (name.equals(CMetrics::getPhaseName(j)) && value.indexOf("dur=") == 0) result.phases[j] = value.substring(4, value.length()).toDouble() / 1000;
+      }
+      for (int j = 0; j < CMetrics::NUM_COUNTERS; j++) {
+        if (name.equals(CMetrics::getCounterName(j)) && value.indexOf("desc=\"") == 0) result.counters[j] = atoll(value.c_str() + 6);
+      }
+    }
+    break;
+  }
+  fclose(pFile);
+}
+
+/* Runs the request in a child process, the response is written to outputFile */
+BenchmarkResult runSingleRequest(BenchmarkSettings &settings, int requestIndex, const char *outputFile) {
+  BenchmarkResult result;
+  memset(&result, 0, sizeof(BenchmarkResult));
+  result.requestIndex = requestIndex;
+  result.status = 1;
+  bool inProcess = settings.mode.equals("inprocess");
+
+  int resultPipe[2] = {-1, -1};
+  if (inProcess && pipe(resultPipe) != 0) {
+    CDBError("Unable to create pipe");
+    return result;
+  }
+
+  double start = getTimeInSeconds();
+  pid_t pid = fork();
+  if (pid == 0) {
+    setenv("QUERY_STRING", settings.corpus[requestIndex].c_str(), 1);
+    setenv("ADAGUC_CONFIG", settings.configFile.c_str(), 1);
+    setenv("ADAGUC_METRICS_HEADER", "true", 1);
+    int fd = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1) _exit(126);
+    close(fd);
+    if (!inProcess) {
+      execl(settings.serverBinary.c_str(), settings.serverBinary.c_str(), (char *)NULL);
+      _exit(127);
+    }
+    close(resultPipe[0]);
+    setErrorFunction(benchmarkErrorFunction);
+    setWarningFunction(benchmarkLogFunctionNothing);
+    setDebugFunction(benchmarkLogFunctionNothing);
+    CMetrics::reset();
+    int status;
+    {
+      CRequest request;
+      status = request.setConfigFile(settings.configFile.c_str());
+      if (status == 0) status = request.runRequest();
+    }
+    readyerror();
+    result.status = status;
+    for (int j = 0; j < CMetrics::NUM_PHASES; j++) result.phases[j] = CMetrics::getPhaseTime(j);
+    for (int j = 0; j < CMetrics::NUM_COUNTERS; j++) result.counters[j] = CMetrics::getCounter(j);
+    (void)!write(resultPipe[1], &result, sizeof(BenchmarkResult));
+    fflush(NULL);
+    _exit(status == 0 ? 0 : 1);
+  }
+  if (pid == -1) {
+    CDBError("Unable to fork");
+    if (inProcess) {
+      close(resultPipe[0]);
+      close(resultPipe[1]);
+    }
+    return result;
+  }
+
+  if (inProcess) {
+    close(resultPipe[1]);
+    if (read(resultPipe[0], &result, sizeof(BenchmarkResult)) != sizeof(BenchmarkResult)) {
+      memset(result.phases, 0, sizeof(result.phases));
+      memset(result.counters, 0, sizeof(result.counters));
+    }
+    close(resultPipe[0]);
+  }
+  int waitStatus = 0;
+  waitpid(pid, &waitStatus, 0);
+  result.latency = getTimeInSeconds() - start;
+  result.requestIndex = requestIndex;
+  result.status = WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : 128 + WTERMSIG(waitStatus);
+
+  struct stat fileStat;
+  if (stat(outputFile, &fileStat) == 0) result.bytes = fileStat.st_size;
+  if (!inProcess) readServerTimingHeader(outputFile, result);
+  return result;
+}
+
+/* Worker number workerNr handles every settings.workers-th request of the schedule */
+void runWorker(BenchmarkSettings &settings, int workerNr, int resultFd) {
+  CT::string outputFile;
+  outputFile.print("%s/adagucbenchmark_%d_%d.out", getenv("ADAGUC_TMP"), (int)getpid(), workerNr);
+  size_t numJobs = settings.corpus.size() * settings.iterations;
+  for (size_t job = workerNr; job < numJobs; job += settings.workers) {
+    BenchmarkResult result = runSingleRequest(settings, int(job % settings.corpus.size()), outputFile.c_str());
+    if (write(resultFd, &result, sizeof(BenchmarkResult)) != sizeof(BenchmarkResult)) break;
+  }
+  unlink(outputFile.c_str());
+}
+
+static double getPercentile(const std::vector<double> &sorted, double percentile) {
+  if (sorted.size() == 0) return 0;
+  size_t index = size_t(ceil(percentile / 100. * sorted.size()));
+  if (index > 0) index--;
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static CT::string escapeJSON(const char *value) {
+  CT::string escaped;
+  for (const char *c = value; *c != 0; c++) {
+    if (*c == '"' || *c == '\\') {
+      escaped.printconcat("\\%c", *c);
+    } else if ((unsigned char)*c < 0x20) {
+      escaped.printconcat("\\u%04x", (unsigned char)*c);
+    } else {
+      escaped.concat(c, 1);
+    }
+  }
+  return escaped;
+}
+
+/* Latency statistics and mean phase times in milliseconds and mean counters of the given results as JSON object members */
+static CT::string getStatisticsJSON(const std::vector<const BenchmarkResult *> &results) {
+  std::vector<double> latencies;
+  double sum = 0, phaseSums[CMetrics::NUM_PHASES] = {0}, counterSums[CMetrics::NUM_COUNTERS] = {0};
+  long long bytes = 0;
+  int failures = 0;
+  for (size_t j = 0; j < results.size(); j++) {
+    latencies.push_back(results[j]->latency * 1000);
+    sum += results[j]->latency * 1000;
+    bytes += results[j]->bytes;
+    if (results[j]->status != 0) failures++;
+    for (int p = 0; p < CMetrics::NUM_PHASES; p++) phaseSums[p] += results[j]->phases[p] * 1000;
+    for (int c = 0; c < CMetrics::NUM_COUNTERS; c++) counterSums[c] += results[j]->counters[c];
+  }
+  std::sort(latencies.begin(), latencies.end());
+  size_t n = results.size();
+  CT::string json;
+  json.print("\"count\": %d, \"failures\": %d, \"meanBytes\": %lld, \"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f", (int)n, failures, n > 0 ? bytes / (long long)n : 0LL,
+             n > 0 ? sum / n : 0., n > 0 ? latencies[0] : 0., getPercentile(latencies, 50), getPercentile(latencies, 99), n > 0 ? latencies[n - 1] : 0.);
+  json.concat(", \"phases\": {");
+  for (int p = 0; p < CMetrics::NUM_PHASES; p++) {
+    json.printconcat("%s\"%s\": %.3f", p > 0 ? ", " : "", CMetrics::getPhaseName(p), n > 0 ? phaseSums[p] / n : 0.);
+  }
+  json.concat("}, \"counters\": {");
+  for (int c = 0; c < CMetrics::NUM_COUNTERS; c++) {
+    json.printconcat("%s\"%s\": %.1f", c > 0 ? ", " : "", CMetrics::getCounterName(c), n > 0 ? counterSums[c] / n : 0.);
+  }
+  json.concat("}");
+  return json;
+}
+
+int writeReport(BenchmarkSettings &settings, std::vector<BenchmarkResult> &results, double wallTime) {
+  std::vector<const BenchmarkResult *> all;
+  std::vector<std::vector<const BenchmarkResult *>> perRequest(settings.corpus.size());
+  for (size_t j = 0; j < results.size(); j++) {
+    all.push_back(&results[j]);
+    perRequest[results[j].requestIndex].push_back(&results[j]);
+  }
+
+  CT::string json;
+  json.print("{\n  \"version\": \"%s\",\n  \"mode\": \"%s\",\n  \"config\": \"%s\",\n  \"corpus\": \"%s\",\n", VERSION, settings.mode.c_str(), escapeJSON(settings.configFile.c_str()).c_str(),
+             escapeJSON(settings.corpusFile.c_str()).c_str());
+  json.printconcat("  \"workers\": %d,\n  \"iterations\": %d,\n  \"warmup\": %d,\n  \"wallTime\": %.3f,\n  \"throughput\": %.3f,\n", settings.workers, settings.iterations, settings.warmup, wallTime,
+                   wallTime > 0 ? results.size() / wallTime : 0.);
+  json.printconcat("  \"total\": {%s},\n  \"requests\": [\n", getStatisticsJSON(all).c_str());
+  for (size_t j = 0; j < perRequest.size(); j++) {
+    json.printconcat("    {\"query\": \"%s\", %s}%s\n", escapeJSON(settings.corpus[j].c_str()).c_str(), getStatisticsJSON(perRequest[j]).c_str(), j + 1 < perRequest.size() ? "," : "");
+  }
+  json.concat("  ]\n}\n");
+
+  FILE *pFile = stdout;
+  if (settings.outputFile.length() > 0) {
+    pFile = fopen(settings.outputFile.c_str(), "w");
+    if (pFile == NULL) {
+      CDBError("Unable to write %s", settings.outputFile.c_str());
+      return 1;
+    }
+  }
+  fputs(json.c_str(), pFile);
+  if (pFile != stdout) fclose(pFile);
+  return 0;
+}
+
+int runBenchmark(BenchmarkSettings &settings) {
+  /* Warmup runs fill the disk caches and the OS page cache, their results are discarded */
+  CT::string warmupFile;
+  warmupFile.print("%s/adagucbenchmark_%d_warmup.out", getenv("ADAGUC_TMP"), (int)getpid());
+  for (int iteration = 0; iteration < settings.warmup; iteration++) {
+    for (size_t j = 0; j < settings.corpus.size(); j++) {
+      BenchmarkResult result = runSingleRequest(settings, int(j), warmupFile.c_str());
+      if (result.status != 0) {
+        CDBWarning("Warmup of request %d failed with status %d", (int)j, result.status);
+      }
+    }
+  }
+  unlink(warmupFile.c_str());
+
+  std::vector<pid_t> workerPids;
+  std::vector<int> resultFds;
+  double start = getTimeInSeconds();
+  for (int workerNr = 0; workerNr < settings.workers; workerNr++) {
+    int resultPipe[2];
+    if (pipe(resultPipe) != 0) {
+      CDBError("Unable to create pipe");
+      break;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(resultPipe[0]);
+      for (size_t j = 0; j < resultFds.size(); j++) close(resultFds[j]);
+      runWorker(settings, workerNr, resultPipe[1]);
+      close(resultPipe[1]);
+      _exit(0);
+    }
+    close(resultPipe[1]);
+    if (pid == -1) {
+      CDBError("Unable to fork worker %d", workerNr);
+      close(resultPipe[0]);
+      break;
+    }
+    workerPids.push_back(pid);
+    resultFds.push_back(resultPipe[0]);
+  }
+  if ((int)workerPids.size() != settings.workers) settings.workers = workerPids.size();
+
+  /* Results are collected from all workers as they arrive, so no worker ever blocks on a full pipe */
+  std::vector<BenchmarkResult> results;
+  std::vector<pollfd> pollFds(resultFds.size());
+  for (size_t j = 0; j < resultFds.size(); j++) {
+    pollFds[j].fd = resultFds[j];
+    pollFds[j].events = POLLIN;
+  }
+  size_t numOpen = pollFds.size();
+  while (numOpen > 0) {
+    if (poll(&pollFds[0], pollFds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      CDBError("Unable to poll the workers");
+      break;
+    }
+    for (size_t j = 0; j < pollFds.size(); j++) {
+      if (pollFds[j].fd < 0 || pollFds[j].revents == 0) continue;
+      BenchmarkResult result;
+      if (read(pollFds[j].fd, &result, sizeof(BenchmarkResult)) == sizeof(BenchmarkResult)) {
+        results.push_back(result);
+      } else {
+        close(pollFds[j].fd);
+        pollFds[j].fd = -1;
+        numOpen--;
+      }
+    }
+  }
+  for (size_t j = 0; j < workerPids.size(); j++) waitpid(workerPids[j], NULL, 0);
+  double wallTime = getTimeInSeconds() - start;
+
+  if (results.size() == 0) {
+    CDBError("No requests were measured");
+    return 1;
+  }
+  return writeReport(settings, results, wallTime);
+}
+
+void printUsage() {
+  fprintf(stderr, "%s\n", VERSION);
+  fprintf(stderr, "Usage: adagucbenchmark --config <config.xml> --corpus <file> [--mode inprocess|cgi] [--server <adagucserver binary>]\n");
+  fprintf(stderr, "                       [--workers N] [--iterations N] [--warmup N] [--output <results.json>]\n");
+  fprintf(stderr, "The corpus contains one query string per line, lines starting with # are skipped.\n");
+}
+
+int main(int argc, char **argv) {
+  /* Stdout is reserved for the JSON report */
+  setErrorFunction(benchmarkLogFunction);
+  setWarningFunction(benchmarkLogFunction);
+  setDebugFunction(benchmarkLogFunction);
+
+  BenchmarkSettings settings;
+  settings.mode = "inprocess";
+  settings.workers = 1;
+  settings.iterations = 10;
+  settings.warmup = 1;
+
+  static struct option long_options[] = {{"config", required_argument, 0, 0},     {"corpus", required_argument, 0, 0},  {"mode", required_argument, 0, 0},
+                                         {"server", required_argument, 0, 0},     {"workers", required_argument, 0, 0}, {"iterations", required_argument, 0, 0},
+                                         {"warmup", required_argument, 0, 0},     {"output", required_argument, 0, 0},  {0, 0, 0, 0}};
+  while (true) {
+    int opt_idx = 0;
+    int opt = getopt_long(argc, argv, "", long_options, &opt_idx);
+    if (opt == -1) break;
+    if (opt != 0) {
+      printUsage();
+      return 1;
+    }
+    CT::string name = long_options[opt_idx].name;
+    if (name.equals("config")) settings.configFile = optarg;
+    if (name.equals("corpus")) settings.corpusFile = optarg;
+    if (name.equals("mode")) settings.mode = optarg;
+    if (name.equals("server")) settings.serverBinary = optarg;
+    if (name.equals("workers")) settings.workers = atoi(optarg);
+    if (name.equals("iterations")) settings.iterations = atoi(optarg);
+    if (name.equals("warmup")) settings.warmup = atoi(optarg);
+    if (name.equals("output")) settings.outputFile = optarg;
+  }
+
+  if (settings.configFile.empty() || settings.corpusFile.empty() || settings.workers < 1 || settings.iterations < 1 || settings.warmup < 0) {
+    printUsage();
+    return 1;
+  }
+  if (!settings.mode.equals("inprocess") && !settings.mode.equals("cgi")) {
+    CDBError("Unknown mode %s, use inprocess or cgi", settings.mode.c_str());
+    return 1;
+  }
+  if (settings.mode.equals("cgi") && settings.serverBinary.empty()) {
+    CDBError("The cgi mode needs the adagucserver binary, set it with --server");
+    return 1;
+  }
+
+  if (getenv("ADAGUC_PATH") == NULL) {
+    CDBError("ADAGUC_PATH environment variable is not set");
+    return 1;
+  }
+  if (getenv("ADAGUC_TMP") == NULL) setenv("ADAGUC_TMP", "/tmp/", 1);
+
+  if (readCorpus(settings) != 0) return 1;
+  CDBDebug("Running %d requests %d times with %d workers in %s mode", (int)settings.corpus.size(), settings.iterations, settings.workers, settings.mode.c_str());
+  return runBenchmark(settings);
+}
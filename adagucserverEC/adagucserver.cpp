@@ -26,6 +26,8 @@
 #include "adagucserver.h"
 #include "CReporter.h"
 #include "CReportWriter.h"
+#include "CAsyncLogger.h"
+#include "CMetrics.h"
 #include <getopt.h>
 #include "CDebugger_H.h"
 
@@ -37,39 +39,25 @@ FILE *pLogDebugFile = NULL;
 enum LogBufferMode { LogBufferMode_TRUE, LogBufferMode_FALSE, LogBufferMode_DISABLELOGGING };
 LogBufferMode logMode = LogBufferMode::LogBufferMode_FALSE;
 
-void writeLogFile(const char *msg) {
+/* Lines are queued and written to pLogDebugFile by the CAsyncLogger thread */
+void writeLogFile(const char *msg, CAsyncLogger::Level level) {
   if (logMode == LogBufferMode_DISABLELOGGING) return;
-  if (pLogDebugFile != NULL) {
-    if (logMode == LogBufferMode_FALSE) {
-      setvbuf(pLogDebugFile, NULL, _IONBF, 0);
-    }
-    fputs(msg, pLogDebugFile);
-    if (strncmp(msg, "[D:", 3) == 0 || strncmp(msg, "[W:", 3) == 0 || strncmp(msg, "[E:", 3) == 0) {
-      time_t myTime = time(NULL);
-      tm *myUsableTime = localtime(&myTime);
-      char szTemp[128];
-      snprintf(szTemp, 127, "%.4d-%.2d-%.2dT%.2d:%.2d:%.2dZ ", myUsableTime->tm_year + 1900, myUsableTime->tm_mon + 1, myUsableTime->tm_mday, myUsableTime->tm_hour, myUsableTime->tm_min,
-               myUsableTime->tm_sec);
-      fputs(szTemp, pLogDebugFile);
-    }
-  }
+  CAsyncLogger::write(msg, level);
 }
 
-void writeErrorFile(const char *msg) { writeLogFile(msg); }
-
 /* Called by CDebugger */
 void serverDebugFunction(const char *msg) {
-  writeLogFile(msg);
+  writeLogFile(msg, CAsyncLogger::LEVEL_DEBUG);
   printdebug(msg, 1);
 }
 /* Called by CDebugger */
 void serverErrorFunction(const char *msg) {
-  writeErrorFile(msg);
+  writeLogFile(msg, CAsyncLogger::LEVEL_ERROR);
   printerror(msg);
 }
 /* Called by CDebugger */
 void serverWarningFunction(const char *msg) {
-  writeLogFile(msg);
+  writeLogFile(msg, CAsyncLogger::LEVEL_WARNING);
   printdebug(msg, 1);
 }
 
@@ -86,6 +74,7 @@ int setCRequestConfigFromEnvironment(CRequest *request) {
     /* Check logging level */
     if (request->getServerParams()->isDebugLoggingEnabled() == false) {
       setDebugFunction(serverLogFunctionNothing);
+      setDebugSampling(0);
     }
 
     return status;
@@ -96,6 +85,20 @@ int setCRequestConfigFromEnvironment(CRequest *request) {
   return 0;
 }
 
+/* Writes the metrics of the request as a log line, which is written even when debug logging is disabled, and adds them to ADAGUC_METRICS_FILE */
+void reportRequestMetrics() {
+  CT::string prefix, line;
+  prefix.print("[D:%03d:pid%lu: adagucserver.cpp main] ", logMessageNumber, logProcessIdentifier);
+  line.print("metrics %s\n", CMetrics::getJSON().c_str());
+  writeLogFile(prefix.c_str(), CAsyncLogger::LEVEL_DEBUG);
+  writeLogFile(line.c_str(), CAsyncLogger::LEVEL_DEBUG);
+
+  const char *ADAGUC_METRICS_FILE = getenv("ADAGUC_METRICS_FILE");
+  if (ADAGUC_METRICS_FILE != NULL && CMetrics::addToPrometheusFile(ADAGUC_METRICS_FILE) != 0) {
+    CDBWarning("Unable to update metrics file %s", ADAGUC_METRICS_FILE);
+  }
+}
+
 /* Start handling the OGC request */
 int runRequest() {
   CRequest request;
@@ -254,9 +257,11 @@ int _main(int argc, char **argv, char **) {
   StopWatch_Start();
 #endif
 
+  CMetrics::reset();
   status = runRequest();
   /* Display errors if any */
   readyerror();
+  reportRequestMetrics();
 #ifdef MEASURETIME
   StopWatch_Stop("Ready!!!");
 #endif
@@ -275,8 +280,8 @@ int main(int argc, char **argv, char **envp) {
   }
 
   /* Check if we enable logbuffer:
-    - true means unbuffered output with live logging but means a slower service
-    - false means buffered logging
+    - false means the log is flushed each time the log thread has written all pending lines, gives live logging
+    - true means buffered logging
     - nologging means no logging at all
   */
   const char *ADAGUC_ENABLELOGBUFFER = getenv("ADAGUC_ENABLELOGBUFFER");
@@ -290,6 +295,38 @@ int main(int argc, char **argv, char **envp) {
     }
   }
 
+  /* Only keep every Nth debug or warning message, 0 disables them. Errors are always logged. */
+  const char *ADAGUC_LOGSAMPLING_DEBUG = getenv("ADAGUC_LOGSAMPLING_DEBUG");
+  if (ADAGUC_LOGSAMPLING_DEBUG != NULL) {
+    setDebugSampling(CT::string(ADAGUC_LOGSAMPLING_DEBUG).toInt());
+  }
+  const char *ADAGUC_LOGSAMPLING_WARNING = getenv("ADAGUC_LOGSAMPLING_WARNING");
+  if (ADAGUC_LOGSAMPLING_WARNING != NULL) {
+    setWarningSampling(CT::string(ADAGUC_LOGSAMPLING_WARNING).toInt());
+  }
+  if (logMode == LogBufferMode_DISABLELOGGING) {
+    setDebugSampling(0);
+    setWarningSampling(0);
+  }
+
+  /* Start the log thread, ADAGUC_LOGFORMAT=json writes one JSON object per line */
+  if (pLogDebugFile != NULL && logMode != LogBufferMode_DISABLELOGGING) {
+    const char *ADAGUC_LOGFORMAT = getenv("ADAGUC_LOGFORMAT");
+    CAsyncLogger::Format logFormat = CAsyncLogger::FORMAT_TEXT;
+    if (ADAGUC_LOGFORMAT != NULL && CT::string(ADAGUC_LOGFORMAT).equalsIgnoreCase("json")) {
+      logFormat = CAsyncLogger::FORMAT_JSON;
+    }
+    if (CAsyncLogger::start(pLogDebugFile, logMode == LogBufferMode_FALSE, logFormat) != 0) {
+      fprintf(stderr, "Unable to start log thread, logging synchronously\n");
+    }
+  }
+
+  /* ADAGUC_METRICS_HEADER=true adds a Server-Timing header with the phase timings and counters to WMS responses */
+  const char *ADAGUC_METRICS_HEADER = getenv("ADAGUC_METRICS_HEADER");
+  if (ADAGUC_METRICS_HEADER != NULL && CT::string(ADAGUC_METRICS_HEADER).equalsIgnoreCase("true")) {
+    CMetrics::setHeaderEnabled(true);
+  }
+
   /* Check if ADAGUC_PATH is set, if not set it here */
   const char *ADAGUC_PATH = getenv("ADAGUC_PATH");
   if (ADAGUC_PATH == NULL) {
@@ -327,6 +364,8 @@ int main(int argc, char **argv, char **envp) {
     if (status == 0) status = 1; /* Indicates that we have a memory leak */
   }
 
+  CAsyncLogger::stop();
+
   if (pLogDebugFile != NULL) {
     fclose(pLogDebugFile);
     pLogDebugFile = NULL;
@@ -2,6 +2,10 @@
 #include <iterator>
 #include <algorithm>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <netcdf.h>
 #include "CCDFDataModel.h"
 #include "CCDFNetCDFIO.h"
@@ -9,44 +13,194 @@
 #include "CDirReader.h"
 #include "CTime.h"
 
-#define VERSION "ADAGUC aggregator 1.6"
+#define VERSION "ADAGUC aggregator 1.7"
+
+/* Chunk cache used for reading the input files, only one input file is open at a time */
+#define AGGREGATE_TIME_CHUNK_CACHE_SIZE (32 * 1024 * 1024)
+#define AGGREGATE_TIME_CHUNK_CACHE_NELEMS 1009
+#define AGGREGATE_TIME_CHUNK_CACHE_PREEMPTION 0.75
+
+/* Number of threads and number of files ahead of the aggregation which are read into the page cache */
+#define AGGREGATE_TIME_PREFETCH_THREADS 2
+#define AGGREGATE_TIME_PREFETCH_FILES 4
+#define AGGREGATE_TIME_PREFETCH_BLOCKSIZE (4 * 1024 * 1024)
+
+/* Output chunking: spatial tiles of at most this size, and as many time steps per chunk as fit in the time chunk buffer */
+#define AGGREGATE_TIME_SPATIAL_CHUNK 128
+#define AGGREGATE_TIME_MAX_TIME_CHUNK 64
+#define AGGREGATE_TIME_BUFFER_SIZE (512 * 1024 * 1024)
+
+/* Time values in seconds closer than this are the same time step */
+#define AGGREGATE_TIME_EPSILON 0.001
 
 DEF_ERRORMAIN()
 
 class NCFileObject {
 public:
-  NCFileObject(const char *filename) {
+  NCFileObject(const char *fullName) {
     cdfObject = NULL;
     cdfReader = NULL;
+    this->fullName = fullName;
+    baseName = CT::string(fullName).basename();
+  }
+  ~NCFileObject() { close(); }
+
+  /* Opens the file, at most one file is open at a time */
+  int open() {
+    close();
     cdfObject = new CDFObject();
-    CT::string f = filename;
-    if (f.endsWith(".h5")) {
+    if (fullName.endsWith(".h5")) {
       cdfReader = new CDFHDF5Reader();
       ((CDFHDF5Reader *)cdfReader)->enableKNMIHDF5toCFConversion();
     } else {
       cdfReader = new CDFNetCDFReader();
     }
     cdfObject->attachCDFReader(cdfReader);
-    keep = true;
+    return cdfObject->open(fullName.c_str());
   }
-  ~NCFileObject() {
+
+  void close() {
+    if (cdfObject != NULL) cdfObject->close();
     delete cdfObject;
     cdfObject = NULL;
     delete cdfReader;
     cdfReader = NULL;
   }
-  bool keep;
+
   CDFObject *cdfObject;
   CDFReader *cdfReader;
   CT::string fullName;
   CT::string baseName;
   double timeValue;
+  std::vector<double> timeValues;
   static bool sortFunction(NCFileObject *i, NCFileObject *j) { return (i->timeValue < j->timeValue); }
 };
 
-void progress(const char *message, float percentage) { printf("{\"message\":%s,\"percentage\":\"%d\"}\n", message, (int)(percentage)); }
+/* A time step of one of the input files */
+class InputStep {
+public:
+  InputStep(size_t fileIndex, size_t timeIndex, double timeValue) {
+    this->fileIndex = fileIndex;
+    this->timeIndex = timeIndex;
+    this->timeValue = timeValue;
+  }
+  size_t fileIndex;
+  size_t timeIndex;
+  double timeValue;
+  static bool sortFunction(const InputStep &i, const InputStep &j) { return (i.timeValue < j.timeValue); }
+};
 
-void progresswrite(const char *message, float percentage) { progress(message, percentage / 2. + 50); }
+/*
+  Reads the files just ahead of the one being aggregated into the page cache. NetCDF is not thread safe, so these threads only read raw bytes
+  and the actual decoding stays on the main thread.
+*/
+class FilePrefetcher {
+private:
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+  std::vector<pthread_t> threads;
+  std::vector<CT::string> fileNames;
+  size_t nextFile, currentFile, windowSize;
+  bool stopped;
+
+  static void *prefetchThread(void *arg) {
+    FilePrefetcher *prefetcher = (FilePrefetcher *)arg;
+    while (true) {
+      pthread_mutex_lock(&prefetcher->mutex);
+      while (!prefetcher->stopped && (prefetcher->nextFile >= prefetcher->fileNames.size() || prefetcher->nextFile >= prefetcher->currentFile + prefetcher->windowSize)) {
+        pthread_cond_wait(&prefetcher->condition, &prefetcher->mutex);
+      }
+      if (prefetcher->stopped) {
+        pthread_mutex_unlock(&prefetcher->mutex);
+        break;
+      }
+      CT::string fileName = prefetcher->fileNames[prefetcher->nextFile++];
+      pthread_mutex_unlock(&prefetcher->mutex);
+      prefetcher->warm(fileName.c_str());
+    }
+    return NULL;
+  }
+
+  bool isStopped() {
+    pthread_mutex_lock(&mutex);
+    bool result = stopped;
+    pthread_mutex_unlock(&mutex);
+    return result;
+  }
+
+  void warm(const char *fileName) {
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    std::vector<char> block(AGGREGATE_TIME_PREFETCH_BLOCKSIZE);
+    off_t offset = 0;
+    ssize_t bytesRead;
+    while (!isStopped() && (bytesRead = pread(fd, &block[0], block.size(), offset)) > 0) {
+      offset += bytesRead;
+    }
+    ::close(fd);
+  }
+
+public:
+  FilePrefetcher() {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&condition, NULL);
+    nextFile = 0;
+    currentFile = 0;
+    windowSize = AGGREGATE_TIME_PREFETCH_FILES;
+    stopped = false;
+  }
+  ~FilePrefetcher() {
+    stop();
+    pthread_cond_destroy(&condition);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  void start(const std::vector<CT::string> &fileNames, size_t numThreads) {
+    this->fileNames = fileNames;
+    for (size_t j = 0; j < numThreads; j++) {
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, prefetchThread, this) == 0) threads.push_back(thread);
+    }
+  }
+
+  /* Moves the prefetch window, files before this index are not prefetched anymore */
+  void setCurrentFile(size_t index) {
+    pthread_mutex_lock(&mutex);
+    currentFile = index;
+    if (nextFile < currentFile + 1) nextFile = currentFile + 1;
+    pthread_cond_broadcast(&condition);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void stop() {
+    pthread_mutex_lock(&mutex);
+    stopped = true;
+    pthread_cond_broadcast(&condition);
+    pthread_mutex_unlock(&mutex);
+    for (size_t j = 0; j < threads.size(); j++) pthread_join(threads[j], NULL);
+    threads.clear();
+  }
+};
+
+/* A variable in the output file with a time dimension, time steps are buffered until a full time chunk can be written */
+class OutputVariable {
+public:
+  OutputVariable() {
+    buffer = NULL;
+    varId = -1;
+  }
+  ~OutputVariable() { CDF::freeData(&buffer); }
+  CT::string name;
+  int varId;
+  CDFType type;
+  size_t timeDimIndex;
+  std::vector<size_t> dimLengths;
+  size_t sliceSize;
+  void *buffer;
+};
+
+void progress(const char *message, float percentage) { printf("{\"message\":%s,\"percentage\":\"%d\"}\n", message, (int)(percentage)); }
 
 void applyChangesToCDFObject(CDFObject *cdfObject, CT::StackList<CT::string> variablesToDo) {
   for (size_t j = 0; j < variablesToDo.size(); j++) {
@@ -54,22 +208,164 @@ void applyChangesToCDFObject(CDFObject *cdfObject, CT::StackList<CT::string> var
     if (varWithoutTime != NULL) {
       varWithoutTime->dimensionlinks.insert(varWithoutTime->dimensionlinks.begin(), cdfObject->getDimension("time"));
     } else {
-      CDBWarning("Variable %s not found");
+      CDBWarning("Variable %s not found", variablesToDo[j].c_str());
+    }
+  }
+}
+
+int getTimeDimIndex(CDF::Variable *var) {
+  for (size_t d = 0; d < var->dimensionlinks.size(); d++) {
+    if (var->dimensionlinks[d]->name.equals("time")) return d;
+  }
+  return -1;
+}
+
+/* Reads the time values of a file as seconds since epoch */
+int readTimeValues(NCFileObject *fileObject, CTime &epochCTime) {
+  CDF::Variable *timeVar = fileObject->cdfObject->getVariableNE("time");
+  if (timeVar == NULL) {
+    CDBError("Unable to find time variable in %s", fileObject->fullName.c_str());
+    return 1;
+  }
+  if (timeVar->readData(CDF_DOUBLE) != 0 || timeVar->getSize() == 0) {
+    CDBError("Unable to read time variable in %s", fileObject->fullName.c_str());
+    return 1;
+  }
+  CTime time;
+  if (time.init(timeVar) != 0) {
+    CDBError("Unable to initialize time for %s", fileObject->fullName.c_str());
+    return 1;
+  }
+  fileObject->timeValues.clear();
+  for (size_t j = 0; j < timeVar->getSize(); j++) {
+    fileObject->timeValues.push_back(epochCTime.dateToOffset(time.getDate(((double *)timeVar->data)[j])));
+  }
+  fileObject->timeValue = fileObject->timeValues[0];
+  return 0;
+}
+
+/* Defines a new output file with the structure of the template and copies the variables without a time dimension */
+int createOutputFile(CDFObject *templateCDFObject, const char *outputFile) {
+  size_t bytesPerTimeStep = 0;
+  for (size_t v = 0; v < templateCDFObject->variables.size(); v++) {
+    CDF::Variable *var = templateCDFObject->variables[v];
+    if (var->isDimension || getTimeDimIndex(var) == -1) continue;
+    size_t sliceSize = CDF::getTypeSize(var->currentType);
+    for (size_t d = 0; d < var->dimensionlinks.size(); d++) {
+      if (!var->dimensionlinks[d]->name.equals("time")) sliceSize *= var->dimensionlinks[d]->getSize();
+    }
+    bytesPerTimeStep += sliceSize;
+  }
+  size_t timeChunk = AGGREGATE_TIME_MAX_TIME_CHUNK;
+  if (bytesPerTimeStep > 0) timeChunk = std::max(size_t(1), std::min(timeChunk, size_t(AGGREGATE_TIME_BUFFER_SIZE) / bytesPerTimeStep));
+
+  CDFNetCDFWriter netCDFWriter(templateCDFObject);
+  netCDFWriter.setNetCDFMode(4);
+  netCDFWriter.setUnlimitedDimension("time");
+  netCDFWriter.setChunkSize("time", timeChunk);
+  for (size_t v = 0; v < templateCDFObject->variables.size(); v++) {
+    CDF::Variable *var = templateCDFObject->variables[v];
+    size_t numDims = var->dimensionlinks.size();
+    if (numDims > 2 && getTimeDimIndex(var) != -1) {
+      netCDFWriter.setChunkSize(var->dimensionlinks[numDims - 1]->name.c_str(), AGGREGATE_TIME_SPATIAL_CHUNK);
+      netCDFWriter.setChunkSize(var->dimensionlinks[numDims - 2]->name.c_str(), AGGREGATE_TIME_SPATIAL_CHUNK);
+    }
+  }
+  netCDFWriter.disableVariableWrite();
+  if (netCDFWriter.write(outputFile) != 0) {
+    CDBError("Unable to define output file %s", outputFile);
+    return 1;
+  }
+
+  int ncId;
+  int status = nc_open(outputFile, NC_WRITE, &ncId);
+  if (status != NC_NOERR) {
+    CDBError("Unable to open %s: %s", outputFile, nc_strerror(status));
+    return 1;
+  }
+  for (size_t v = 0; v < templateCDFObject->variables.size(); v++) {
+    CDF::Variable *var = templateCDFObject->variables[v];
+    if (var->dimensionlinks.size() == 0 || getTimeDimIndex(var) != -1) continue;
+    int varId;
+    status = nc_inq_varid(ncId, var->name.c_str(), &varId);
+    if (status == NC_NOERR) {
+      if (var->readData(var->currentType) != 0) {
+        CDBError("Unable to read variable %s", var->name.c_str());
+        status = NC_EINVAL;
+      } else {
+        status = nc_put_var(ncId, varId, var->data);
+        var->freeData();
+      }
+    }
+    if (status != NC_NOERR) {
+      CDBError("Unable to copy variable %s: %s", var->name.c_str(), nc_strerror(status));
+      nc_close(ncId);
+      return 1;
+    }
+  }
+  nc_close(ncId);
+  return 0;
+}
+
+/* Writes the buffered time steps of all variables with time as first dimension */
+int flushTimeChunk(int ncId, std::vector<OutputVariable *> &outputVariables, size_t bufferStart, size_t numSteps) {
+  if (numSteps == 0) return 0;
+  for (size_t v = 0; v < outputVariables.size(); v++) {
+    OutputVariable *outVar = outputVariables[v];
+    if (outVar->timeDimIndex != 0) continue;
+    std::vector<size_t> start(outVar->dimLengths.size(), 0), count(outVar->dimLengths);
+    start[0] = bufferStart;
+    count[0] = numSteps;
+    int status = nc_put_vara(ncId, outVar->varId, &start[0], &count[0], outVar->buffer);
+    if (status != NC_NOERR) {
+      CDBError("Unable to write variable %s: %s", outVar->name.c_str(), nc_strerror(status));
+      return 1;
     }
   }
+  return 0;
+}
+
+/* Reads one time step of a variable from an input file. Variables without time dimension in the input are read as a whole */
+CDF::Variable *readTimeStep(CDFObject *cdfObject, OutputVariable *outVar, size_t timeIndex) {
+  CDF::Variable *srcVar = cdfObject->getVariableNE(outVar->name.c_str());
+  if (srcVar == NULL) {
+    CDBError("Variable %s not found", outVar->name.c_str());
+    return NULL;
+  }
+  size_t numDims = srcVar->dimensionlinks.size();
+  int srcTimeDimIndex = getTimeDimIndex(srcVar);
+  std::vector<size_t> start(numDims + 1, 0), count(numDims + 1, 1);
+  std::vector<ptrdiff_t> stride(numDims + 1, 1);
+  for (size_t d = 0; d < numDims; d++) count[d] = srcVar->dimensionlinks[d]->getSize();
+  if (srcTimeDimIndex != -1) {
+    start[srcTimeDimIndex] = timeIndex;
+    count[srcTimeDimIndex] = 1;
+  }
+  srcVar->freeData();
+  if (srcVar->readData(outVar->type, &start[0], &count[0], &stride[0]) != 0) {
+    CDBError("Unable to read variable %s", outVar->name.c_str());
+    return NULL;
+  }
+  if (srcVar->getSize() != outVar->sliceSize) {
+    CDBError("Variable %s has %d elements per time step instead of %d", outVar->name.c_str(), srcVar->getSize(), outVar->sliceSize);
+    srcVar->freeData();
+    return NULL;
+  }
+  return srcVar;
 }
 
 int main(int argc, const char *argv[]) {
   int status = 0;
-  /* Chunk cache needs to be set to zero, otherwise netcdf runs out of its memory.... */
-  status = nc_set_chunk_cache(0, 0, 0);
+  /* Only one input file is open at a time, so a modest chunk cache is enough */
+  status = nc_set_chunk_cache(AGGREGATE_TIME_CHUNK_CACHE_SIZE, AGGREGATE_TIME_CHUNK_CACHE_NELEMS, AGGREGATE_TIME_CHUNK_CACHE_PREEMPTION);
   if (status != NC_NOERR) {
-    CDBError("Unable to set nc_set_chunk_cache to zero");
+    CDBError("Unable to set nc_set_chunk_cache");
     return 1;
   }
 
   if (argc != 3 && argc != 4) {
     CDBDebug("Argument count is wrong, please specifiy an input dir and output file, plus optionally a comma separated list of variable names to add the time variable to.");
+    CDBDebug("When the output file already exists, only the time steps which are not in it yet are appended.");
     return 1;
   }
 
@@ -95,112 +391,261 @@ int main(int argc, const char *argv[]) {
     variablesToAddTimeTo = variableList.splitToStack(",");
   }
 
+  CTime epochCTime;
+  epochCTime.init("seconds since 1970-01-01 0:0:0", NULL);
+
+  /* When the output exists, read its time steps so only the steps which are not in it yet are appended */
+  struct stat outputStat;
+  bool appendToExisting = stat(outputFile.c_str(), &outputStat) == 0;
+  std::vector<double> existingTimeValues;
+  if (appendToExisting) {
+    NCFileObject existingFile(outputFile.c_str());
+    if (existingFile.open() != 0 || readTimeValues(&existingFile, epochCTime) != 0) {
+      CDBError("Unable to read existing output file %s, remove it to aggregate from scratch", outputFile.c_str());
+      return 1;
+    }
+    existingTimeValues = existingFile.timeValues;
+    std::sort(existingTimeValues.begin(), existingTimeValues.end());
+  }
+
   /* Create a vector which holds information for all the inputfiles. */
   std::vector<NCFileObject *> fileObjects;
-  std::vector<NCFileObject *>::iterator fileObjectsIt;
 
-  /* Loop through all files and gather information */
-  try {
-    for (size_t j = 0; j < dirReader.fileList.size(); j++) {
-      NCFileObject *fileObject = new NCFileObject(CT::string(dirReader.fileList[j].c_str()).basename().c_str());
-      fileObjects.push_back(fileObject);
-      fileObject->fullName = dirReader.fileList[j].c_str();
-      fileObject->baseName = CT::string(dirReader.fileList[j].c_str()).basename().c_str();
-
-      status = fileObject->cdfObject->open(fileObject->fullName.c_str());
+  /* Loop through all files and gather their time values, files are closed directly afterwards */
+  for (size_t j = 0; j < dirReader.fileList.size(); j++) {
+    NCFileObject *fileObject = new NCFileObject(dirReader.fileList[j].c_str());
+    if (fileObject->open() != 0 || readTimeValues(fileObject, epochCTime) != 0) {
+      CDBError("Unable to read file %s", fileObject->fullName.c_str());
+      delete fileObject;
+      for (size_t i = 0; i < fileObjects.size(); i++) delete fileObjects[i];
+      return 1;
+    }
+    fileObject->close();
 
-      if (status != 0) {
-        CDBError("Unable to read file %s", fileObject->fullName.c_str());
-        throw(__LINE__);
-      }
+    CT::string message;
+    message.print("\"Checking file (%d/%d) %s, has start date %s\"", j, dirReader.fileList.size(), fileObject->baseName.c_str(),
+                  epochCTime.dateToISOString(epochCTime.getDate(fileObject->timeValue)).c_str());
+    progress(message.c_str(), (float(j) / float(dirReader.fileList.size())) * 50);
+    fileObjects.push_back(fileObject);
+  }
 
-      CDF::Variable *timeVar = fileObject->cdfObject->getVariableNE("time");
-      if (timeVar == NULL) {
-        CDBError("Unable to find time variable");
-        throw(__LINE__);
-      }
+  /* Sort the dates according the timeValue */
+  std::stable_sort(fileObjects.begin(), fileObjects.end(), NCFileObject::sortFunction);
 
-      timeVar->readData(CDF_DOUBLE);
-      double value = ((double *)(timeVar->data))[0];
-      CT::string units;
-      try {
-        units = timeVar->getAttribute("units")->getDataAsString().c_str();
-      } catch (int e) {
-        CDBError("Unable to find units attribute for time variable");
-        throw(__LINE__);
-      }
+  /* Merge the time steps of all files in time order. Files may overlap or have their steps out of order, when steps have the same time the
+   * one of the file with the earliest start is used. */
+  std::vector<InputStep> inputSteps;
+  for (size_t j = 0; j < fileObjects.size(); j++) {
+    for (size_t t = 0; t < fileObjects[j]->timeValues.size(); t++) inputSteps.push_back(InputStep(j, t, fileObjects[j]->timeValues[t]));
+  }
+  std::stable_sort(inputSteps.begin(), inputSteps.end(), InputStep::sortFunction);
 
-      CTime time;
-      time.init(timeVar);
-      CTime::Date date = time.getDate(value);
-      CTime epochCTime;
-      epochCTime.init("seconds since 1970-01-01 0:0:0", NULL);
+  /* Steps which are already in the output are skipped, steps which can not be written in time order are dropped with a warning */
+  std::vector<InputStep> stepsToWrite;
+  for (size_t j = 0; j < inputSteps.size(); j++) {
+    const InputStep &step = inputSteps[j];
+    std::vector<double>::iterator existing = std::lower_bound(existingTimeValues.begin(), existingTimeValues.end(), step.timeValue - AGGREGATE_TIME_EPSILON);
+    if (existing != existingTimeValues.end() && *existing <= step.timeValue + AGGREGATE_TIME_EPSILON) continue;
+    const char *reason = NULL;
+    if (existingTimeValues.size() > 0 && step.timeValue < existingTimeValues.back()) {
+      reason = "it is older than the last time step of the output file";
+    } else if (stepsToWrite.size() > 0 && step.timeValue <= stepsToWrite.back().timeValue + AGGREGATE_TIME_EPSILON) {
+      reason = "this time step is also in another input file";
+    }
+    if (reason != NULL) {
+      CDBWarning("Dropping time step %s of %s, %s", epochCTime.dateToISOString(epochCTime.getDate(step.timeValue)).c_str(), fileObjects[step.fileIndex]->baseName.c_str(), reason);
+      continue;
+    }
+    stepsToWrite.push_back(step);
+  }
 
-      fileObject->timeValue = epochCTime.dateToOffset(date);
+  if (stepsToWrite.size() == 0) {
+    progress("\"No new time steps to append\"", 100);
+    for (size_t j = 0; j < fileObjects.size(); j++) delete fileObjects[j];
+    CCachedDirReader::free();
+    CTime::cleanInstances();
+    return 0;
+  }
 
-      CT::string message;
-      message.print("\"Checking file (%d/%d) %s, has start date %s\"", j, dirReader.fileList.size(), fileObject->baseName.c_str(), epochCTime.dateToISOString(date).c_str());
-      progress(message.c_str(), (float(j) / float(dirReader.fileList.size())) * 50);
+  if (!appendToExisting) {
+    NCFileObject templateFile(fileObjects[stepsToWrite[0].fileIndex]->fullName.c_str());
+    if (templateFile.open() != 0) {
+      CDBError("Unable to read file %s", templateFile.fullName.c_str());
+      for (size_t j = 0; j < fileObjects.size(); j++) delete fileObjects[j];
+      return 1;
+    }
+    applyChangesToCDFObject(templateFile.cdfObject, variablesToAddTimeTo);
+    if (createOutputFile(templateFile.cdfObject, outputFile.c_str()) != 0) {
+      for (size_t j = 0; j < fileObjects.size(); j++) delete fileObjects[j];
+      return 1;
+    }
+  }
 
-      fileObject->keep = true;
-      fileObject->cdfObject->close();
+  /* Describe the time dependent variables of the output file */
+  std::vector<OutputVariable *> outputVariables;
+  size_t outputTimeIndex = 0;
+  CTime outputCTime;
+  {
+    NCFileObject outputFileObject(outputFile.c_str());
+    status = outputFileObject.open();
+    CDF::Variable *outputTimeVar = status == 0 ? outputFileObject.cdfObject->getVariableNE("time") : NULL;
+    if (outputTimeVar == NULL || outputCTime.init(outputTimeVar) != 0) {
+      CDBError("Unable to read time from output file %s", outputFile.c_str());
+      for (size_t j = 0; j < fileObjects.size(); j++) delete fileObjects[j];
+      return 1;
+    }
+    outputTimeIndex = outputFileObject.cdfObject->getDimension("time")->getSize();
+    for (size_t v = 0; v < outputFileObject.cdfObject->variables.size(); v++) {
+      CDF::Variable *var = outputFileObject.cdfObject->variables[v];
+      int timeDimIndex = getTimeDimIndex(var);
+      if (var->isDimension || timeDimIndex == -1) continue;
+      if (var->getType() == CDF_STRING) {
+        CDBWarning("Skipping string variable %s", var->name.c_str());
+        continue;
+      }
+      OutputVariable *outVar = new OutputVariable();
+      outVar->name = var->name;
+      outVar->type = var->getType();
+      outVar->timeDimIndex = timeDimIndex;
+      outVar->sliceSize = 1;
+      for (size_t d = 0; d < var->dimensionlinks.size(); d++) {
+        size_t length = int(d) == timeDimIndex ? 1 : var->dimensionlinks[d]->getSize();
+        outVar->dimLengths.push_back(length);
+        outVar->sliceSize *= length;
+      }
+      outputVariables.push_back(outVar);
     }
-  } catch (int linenr) {
+  }
 
-    CDBError("Exception at line %d", linenr);
+  int ncId;
+  status = nc_open(outputFile.c_str(), NC_WRITE, &ncId);
+  if (status != NC_NOERR) {
+    CDBError("Unable to open %s for writing: %s", outputFile.c_str(), nc_strerror(status));
     for (size_t j = 0; j < fileObjects.size(); j++) delete fileObjects[j];
+    for (size_t v = 0; v < outputVariables.size(); v++) delete outputVariables[v];
     return 1;
   }
 
-  /* Sort the dates according the timeValue */
-  std::sort(fileObjects.begin(), fileObjects.end(), NCFileObject::sortFunction);
+  /* Buffer as many time steps as fit in one chunk of the output, so every chunk is written at once */
+  int timeVarId = -1;
+  size_t timeChunk = 0;
+  bool hasError = nc_inq_varid(ncId, "time", &timeVarId) != NC_NOERR;
+  if (!hasError) {
+    int timeDimId = -1, numUnlimitedDims = 0, unlimitedDimIds[NC_MAX_DIMS];
+    nc_inq_dimid(ncId, "time", &timeDimId);
+    nc_inq_unlimdims(ncId, &numUnlimitedDims, unlimitedDimIds);
+    if (std::find(unlimitedDimIds, unlimitedDimIds + numUnlimitedDims, timeDimId) == unlimitedDimIds + numUnlimitedDims) {
+      CDBError("The time dimension of %s is not unlimited, remove the file to aggregate from scratch", outputFile.c_str());
+      hasError = true;
+    }
+  }
+  for (size_t v = 0; v < outputVariables.size() && !hasError; v++) {
+    OutputVariable *outVar = outputVariables[v];
+    hasError = nc_inq_varid(ncId, outVar->name.c_str(), &outVar->varId) != NC_NOERR;
+    if (!hasError && outVar->timeDimIndex == 0 && timeChunk == 0) {
+      int storage = NC_CONTIGUOUS;
+      size_t chunkSizes[NC_MAX_VAR_DIMS];
+      if (nc_inq_var_chunking(ncId, outVar->varId, &storage, chunkSizes) == NC_NOERR && storage == NC_CHUNKED) {
+        timeChunk = chunkSizes[0];
+      }
+    }
+  }
+  timeChunk = std::max(size_t(1), timeChunk);
+  for (size_t v = 0; v < outputVariables.size() && !hasError; v++) {
+    if (outputVariables[v]->timeDimIndex == 0) {
+      hasError = CDF::allocateData(outputVariables[v]->type, &outputVariables[v]->buffer, timeChunk * outputVariables[v]->sliceSize) != 0;
+    }
+  }
+  if (hasError) {
+    CDBError("Unable to prepare the variables of output file %s", outputFile.c_str());
+  }
 
-  CT::string netcdfFile = fileObjects[0]->fullName.c_str();
-  CT::string netcdfFileBase = fileObjects[0]->baseName.c_str();
-  CDFObject *destCDFObject = new CDFObject();
-  CDFReader *cdfReader;
-  if (netcdfFile.endsWith(".h5")) {
-    cdfReader = new CDFHDF5Reader();
-    ((CDFHDF5Reader *)cdfReader)->enableKNMIHDF5toCFConversion();
-  } else {
-    cdfReader = new CDFNetCDFReader();
-  }
-  destCDFObject->attachCDFReader(cdfReader);
-  status = destCDFObject->open(netcdfFile.c_str());
-  applyChangesToCDFObject(destCDFObject, variablesToAddTimeTo);
-  if (status != 0) {
-    CDBError("Unable to read file %s", netcdfFile.c_str());
-    throw(__LINE__);
-  }
-
-  try {
-    for (size_t j = 0; j < fileObjects.size(); j++) {
-      try {
-        applyChangesToCDFObject(fileObjects[j]->cdfObject, variablesToAddTimeTo);
-        if (destCDFObject->aggregateDim(fileObjects[j]->cdfObject, "time") != 0) throw(__LINE__);
-      } catch (int e) {
-        CDBError("Unable to aggregate dimension for %s", fileObjects[j]->baseName.c_str());
-        throw(__LINE__);
+  /* Stream through the time steps in time order, the input files are prefetched in the order in which they are first needed */
+  std::vector<CT::string> fileNames;
+  std::vector<size_t> prefetchIndices(fileObjects.size(), fileObjects.size());
+  for (size_t j = 0; j < stepsToWrite.size(); j++) {
+    size_t fileIndex = stepsToWrite[j].fileIndex;
+    if (prefetchIndices[fileIndex] != fileObjects.size()) continue;
+    prefetchIndices[fileIndex] = fileNames.size();
+    fileNames.push_back(fileObjects[fileIndex]->fullName);
+  }
+  FilePrefetcher prefetcher;
+  prefetcher.start(fileNames, AGGREGATE_TIME_PREFETCH_THREADS);
+
+  size_t bufferStart = outputTimeIndex;
+  NCFileObject *openFileObject = NULL;
+  for (size_t s = 0; s < stepsToWrite.size() && !hasError; s++) {
+    NCFileObject *fileObject = fileObjects[stepsToWrite[s].fileIndex];
+    size_t t = stepsToWrite[s].timeIndex;
+    /* Files with interleaved time steps are opened again when needed, only one input file is open at a time */
+    if (fileObject != openFileObject) {
+      if (openFileObject != NULL) openFileObject->close();
+      openFileObject = fileObject;
+      prefetcher.setCurrentFile(prefetchIndices[stepsToWrite[s].fileIndex]);
+      if (fileObject->open() != 0) {
+        CDBError("Unable to read file %s", fileObject->fullName.c_str());
+        hasError = true;
+        break;
       }
+
+      CT::string message;
+      message.print("\"Aggregating file (%d/%d) %s\"", prefetchIndices[stepsToWrite[s].fileIndex], fileNames.size(), fileObject->baseName.c_str());
+      progress(message.c_str(), (float(s) / float(stepsToWrite.size())) * 50 + 50);
+    }
+
+    for (size_t v = 0; v < outputVariables.size() && !hasError; v++) {
+      OutputVariable *outVar = outputVariables[v];
+      CDF::Variable *srcVar = readTimeStep(fileObject->cdfObject, outVar, t);
+      if (srcVar == NULL) {
+        CDBError("Unable to aggregate %s", fileObject->baseName.c_str());
+        hasError = true;
+        break;
+      }
+      if (outVar->timeDimIndex == 0) {
+        CDF::DataCopier::copy(outVar->buffer, outVar->type, srcVar->data, outVar->type, (outputTimeIndex - bufferStart) * outVar->sliceSize, 0, outVar->sliceSize);
+      } else {
+        std::vector<size_t> start(outVar->dimLengths.size(), 0);
+        start[outVar->timeDimIndex] = outputTimeIndex;
+        status = nc_put_vara(ncId, outVar->varId, &start[0], &outVar->dimLengths[0], srcVar->data);
+        if (status != NC_NOERR) {
+          CDBError("Unable to write variable %s: %s", outVar->name.c_str(), nc_strerror(status));
+          hasError = true;
+        }
+      }
+      srcVar->freeData();
+    }
+    if (hasError) break;
+
+    double outputTimeValue = outputCTime.dateToOffset(epochCTime.getDate(fileObject->timeValues[t]));
+    status = nc_put_var1_double(ncId, timeVarId, &outputTimeIndex, &outputTimeValue);
+    if (status != NC_NOERR) {
+      CDBError("Unable to write time: %s", nc_strerror(status));
+      hasError = true;
+      break;
+    }
+    outputTimeIndex++;
+
+    if (outputTimeIndex % timeChunk == 0) {
+      hasError = flushTimeChunk(ncId, outputVariables, bufferStart, outputTimeIndex - bufferStart) != 0;
+      bufferStart = outputTimeIndex;
     }
-  } catch (int e) {
-    for (size_t j = 0; j < fileObjects.size(); j++) delete fileObjects[j];
-    delete cdfReader;
-    delete destCDFObject;
-    return 1;
   }
+  if (openFileObject != NULL) openFileObject->close();
+  prefetcher.stop();
 
-  CDFNetCDFWriter *netCDFWriter = new CDFNetCDFWriter(destCDFObject);
-  netCDFWriter->setNetCDFMode(4);
-  status = netCDFWriter->write(outputFile.c_str(), &progresswrite);
-  delete netCDFWriter;
+  if (!hasError) hasError = flushTimeChunk(ncId, outputVariables, bufferStart, outputTimeIndex - bufferStart) != 0;
+  status = nc_close(ncId);
+  if (status != NC_NOERR) {
+    CDBError("Unable to close %s: %s", outputFile.c_str(), nc_strerror(status));
+    hasError = true;
+  }
+  if (!hasError) progress("\"Done\"", 100);
 
   for (size_t j = 0; j < fileObjects.size(); j++) delete fileObjects[j];
-  delete cdfReader;
-  delete destCDFObject;
+  for (size_t v = 0; v < outputVariables.size(); v++) delete outputVariables[v];
 
   CCachedDirReader::free();
   CTime::cleanInstances();
 
-  return 0;
+  return hasError ? 1 : 0;
 }
@@ -0,0 +1,213 @@
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <netcdf.h>
+#include "CCDFDataModel.h"
+#include "CCDFNetCDFIO.h"
+#include "CDataReader.h"
+
+#define VERSION "ADAGUC overviews 1.0"
+
+/* Overviews are made with factors 2, 4, 8, ... until the overview gets smaller than this in x or y */
+#define CREATE_OVERVIEWS_MIN_SIZE 256
+
+DEF_ERRORMAIN()
+
+/* One reduced resolution level of a variable */
+class OverviewLevel {
+public:
+  size_t factor, width, height;
+  CDF::Variable *variable;
+};
+
+/* Returns the overview dimension for the given source dimension, the coordinate variable is the block mean of the source coordinates */
+CDF::Dimension *getOverviewDimension(CDFObject *cdfObject, CDF::Dimension *sourceDim, size_t factor) {
+  CT::string name;
+  name.print("%s_ov%d", sourceDim->name.c_str(), (int)factor);
+  CDF::Dimension *dim = cdfObject->getDimensionNE(name.c_str());
+  if (dim != NULL) return dim;
+
+  size_t sourceSize = sourceDim->getSize();
+  size_t size = sourceSize / factor;
+  dim = cdfObject->addDimension(new CDF::Dimension(name.c_str(), size));
+
+  CDF::Variable *sourceVar = cdfObject->getVariableNE(sourceDim->name.c_str());
+  if (sourceVar == NULL) return dim;
+  CDF::Dimension *dims[] = {dim};
+  CDF::Variable *coordVar = cdfObject->addVariable(new CDF::Variable(name.c_str(), CDF_DOUBLE, dims, 1, true));
+  for (size_t j = 0; j < sourceVar->attributes.size(); j++) {
+    coordVar->addAttribute(new CDF::Attribute(sourceVar->attributes[j]));
+  }
+  if (sourceVar->readData(CDF_DOUBLE) != 0) {
+    CDBError("Unable to read coordinate variable %s", sourceVar->name.c_str());
+    return NULL;
+  }
+  coordVar->allocateData(size);
+  double *src = (double *)sourceVar->data;
+  double *dst = (double *)coordVar->data;
+  for (size_t j = 0; j < size; j++) {
+    double sum = 0;
+    for (size_t k = 0; k < factor; k++) sum += src[j * factor + k];
+    dst[j] = sum / factor;
+  }
+  return dim;
+}
+
+/* Averages blocks of factor x factor cells, nodata cells are skipped. With nearest the center cell of each block is taken */
+void reduceSlice(const float *src, size_t srcWidth, float *dst, size_t width, size_t height, size_t factor, float fNodataValue, bool hasNodata, bool nearest) {
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      if (nearest) {
+        dst[x + y * width] = src[(x * factor + factor / 2) + (y * factor + factor / 2) * srcWidth];
+        continue;
+      }
+      double sum = 0;
+      size_t n = 0;
+      for (size_t by = 0; by < factor; by++) {
+        const float *row = src + (y * factor + by) * srcWidth + x * factor;
+        for (size_t bx = 0; bx < factor; bx++) {
+          float v = row[bx];
+          if (v != v || (hasNodata && v == fNodataValue)) continue;
+          sum += v;
+          n++;
+        }
+      }
+      dst[x + y * width] = n > 0 ? float(sum / n) : (hasNodata ? fNodataValue : NAN);
+    }
+  }
+}
+
+int createOverviews(CDFObject *cdfObject, CDF::Variable *var, bool nearest) {
+  size_t numDims = var->dimensionlinks.size();
+  if (numDims < 2) {
+    CDBError("Variable %s has less than two dimensions", var->name.c_str());
+    return 1;
+  }
+  CDF::Dimension *dimX = var->dimensionlinks[numDims - 1];
+  CDF::Dimension *dimY = var->dimensionlinks[numDims - 2];
+  size_t srcWidth = dimX->getSize(), srcHeight = dimY->getSize();
+
+  float fNodataValue = NAN;
+  bool hasNodata = false;
+  CDF::Attribute *fillValue = var->getAttributeNE("_FillValue");
+  if (fillValue == NULL) fillValue = var->getAttributeNE("missing_value");
+  if (fillValue != NULL) {
+    fNodataValue = float(fillValue->toString().toDouble());
+    hasNodata = true;
+  }
+
+  std::vector<OverviewLevel> levels;
+  CT::string overviewNames;
+  for (size_t factor = 2; srcWidth / factor >= CREATE_OVERVIEWS_MIN_SIZE && srcHeight / factor >= CREATE_OVERVIEWS_MIN_SIZE; factor *= 2) {
+    OverviewLevel level;
+    level.factor = factor;
+    level.width = srcWidth / factor;
+    level.height = srcHeight / factor;
+    CDF::Dimension *dims[numDims];
+    for (size_t d = 0; d < numDims - 2; d++) dims[d] = var->dimensionlinks[d];
+    dims[numDims - 2] = getOverviewDimension(cdfObject, dimY, factor);
+    dims[numDims - 1] = getOverviewDimension(cdfObject, dimX, factor);
+    if (dims[numDims - 2] == NULL || dims[numDims - 1] == NULL) return 1;
+    CT::string name;
+    name.print("%s_ov%d", var->name.c_str(), (int)factor);
+    level.variable = cdfObject->addVariable(new CDF::Variable(name.c_str(), CDF_FLOAT, dims, numDims, false));
+    for (size_t j = 0; j < var->attributes.size(); j++) {
+      CDF::Attribute *attr = var->attributes[j];
+      if (attr->name.equals(CDATAREADER_OVERVIEWS_ATTR) || attr->name.equals("_FillValue") || attr->name.equals("missing_value")) continue;
+      level.variable->addAttribute(new CDF::Attribute(attr));
+    }
+    level.variable->setAttribute("_FillValue", CDF_FLOAT, &fNodataValue, 1);
+    size_t size = level.width * level.height;
+    for (size_t d = 0; d < numDims - 2; d++) size *= var->dimensionlinks[d]->getSize();
+    level.variable->allocateData(size);
+    levels.push_back(level);
+    if (overviewNames.length() > 0) overviewNames.concat(" ");
+    overviewNames.concat(name.c_str());
+  }
+  if (levels.size() == 0) {
+    CDBWarning("Variable %s is too small for overviews", var->name.c_str());
+    return 0;
+  }
+
+  /* Every level is reduced from the full resolution, one 2D slice of the leading dimensions at a time */
+  size_t numSlices = 1;
+  for (size_t d = 0; d < numDims - 2; d++) numSlices *= var->dimensionlinks[d]->getSize();
+  for (size_t slice = 0; slice < numSlices; slice++) {
+    size_t start[numDims], count[numDims];
+    ptrdiff_t stride[numDims];
+    size_t index = slice;
+    for (int d = numDims - 3; d >= 0; d--) {
+      size_t dimSize = var->dimensionlinks[d]->getSize();
+      start[d] = index % dimSize;
+      index /= dimSize;
+      count[d] = 1;
+      stride[d] = 1;
+    }
+    start[numDims - 2] = 0;
+    start[numDims - 1] = 0;
+    count[numDims - 2] = srcHeight;
+    count[numDims - 1] = srcWidth;
+    stride[numDims - 2] = 1;
+    stride[numDims - 1] = 1;
+    var->freeData();
+    if (var->readData(CDF_FLOAT, start, count, stride, false) != 0) {
+      CDBError("Unable to read slice %d of variable %s", (int)slice, var->name.c_str());
+      return 1;
+    }
+    for (size_t l = 0; l < levels.size(); l++) {
+      OverviewLevel &level = levels[l];
+      float *dst = ((float *)level.variable->data) + slice * level.width * level.height;
+      reduceSlice((float *)var->data, srcWidth, dst, level.width, level.height, level.factor, fNodataValue, hasNodata, nearest);
+    }
+  }
+  var->freeData();
+  var->setAttributeText(CDATAREADER_OVERVIEWS_ATTR, overviewNames.c_str(), overviewNames.length());
+  CDBDebug("Created %d overviews for %s: %s", (int)levels.size(), var->name.c_str(), overviewNames.c_str());
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  if (argc != 4 && argc != 5) {
+    CDBDebug("%s", VERSION);
+    CDBDebug("Usage: create_overviews <input file> <output file> <comma separated variable names> [average|nearest]");
+    CDBDebug("Adds reduced resolution copies of the variables, which are used by the server for zoomed out maps.");
+    CDBDebug("Use nearest for categorical data, the default is to average the valid cells.");
+    return 1;
+  }
+  bool nearest = argc == 5 && CT::string(argv[4]).equals("nearest");
+
+  CDFObject *cdfObject = new CDFObject();
+  CDFNetCDFReader *cdfReader = new CDFNetCDFReader();
+  cdfObject->attachCDFReader(cdfReader);
+  int status = cdfObject->open(argv[1]);
+  if (status != 0) {
+    CDBError("Unable to open %s", argv[1]);
+    delete cdfObject;
+    delete cdfReader;
+    return 1;
+  }
+
+  CT::StackList<CT::string> variableNames = CT::string(argv[3]).splitToStack(",");
+  for (size_t j = 0; j < variableNames.size() && status == 0; j++) {
+    CDF::Variable *var = cdfObject->getVariableNE(variableNames[j].c_str());
+    if (var == NULL) {
+      CDBError("Variable %s not found in %s", variableNames[j].c_str(), argv[1]);
+      status = 1;
+    } else {
+      status = createOverviews(cdfObject, var, nearest);
+    }
+  }
+
+  if (status == 0) {
+    CDFNetCDFWriter netCDFWriter(cdfObject);
+    netCDFWriter.setNetCDFMode(4);
+    status = netCDFWriter.write(argv[2]);
+    if (status != 0) {
+      CDBError("Unable to write %s", argv[2]);
+    }
+  }
+  cdfObject->close();
+  delete cdfObject;
+  delete cdfReader;
+  return status;
+}
@@ -1,9 +1,51 @@
 #include "CDebugger.h"
 #include "CGenericDataWarperTools.h"
+#include "CMarchingSquares.h"
+#include "CSmoothingFilter.h"
+#include "CPolygonRasterizer.h"
+#include "COpenDAPEncoder.h"
+#include "CAffineResampler.h"
+#include "CAsyncLogger.h"
+#include "CDBStore.h"
 #include <assert.h>
+#include <algorithm>
+#include <string>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 DEF_ERRORMAIN()
 
+static std::string readWholeFile(FILE *file) {
+  std::string contents;
+  char buffer[4096];
+  size_t bytesRead;
+  rewind(file);
+  while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) contents.append(buffer, bytesRead);
+  return contents;
+}
+
+static size_t countOccurrences(const std::string &text, const char *pattern) {
+  size_t count = 0;
+  for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) count++;
+  return count;
+}
+
+/* Reads the log pipe after a delay, so that the logger first runs into a full pipe and a full ring */
+class LogPipeReader {
+public:
+  int fd;
+  std::string contents;
+};
+static void *readLogPipe(void *userData) {
+  LogPipeReader *reader = (LogPipeReader *)userData;
+  usleep(200000);
+  char buffer[65536];
+  ssize_t bytesRead;
+  while ((bytesRead = read(reader->fd, buffer, sizeof(buffer))) > 0) reader->contents.append(buffer, bytesRead);
+  return NULL;
+}
+
 int main() {
   double dfSourceW = 1000;
   double dfSourceExtW = 360;
@@ -51,5 +93,327 @@ int main() {
   }
 
   // CDBDebug("OK %f", linearTransform(5.0, dfSourceW, dfSourceExtW, dfSourceOrigX, dfDestOrigX, dfDestExtW, dfDestW));
+
+  // Marching squares: a cone gives one closed line per level, a ramp gives one straight open line
+  int W = 21, H = 21;
+  float grid[21 * 21];
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      grid[x + y * W] = 10 - sqrt((x - 10) * (x - 10) + (y - 10) * (y - 10));
+    }
+  }
+  std::vector<float> isoValues;
+  isoValues.push_back(2.5);
+  isoValues.push_back(5.5);
+  std::vector<CContourLine> lines;
+  CMarchingSquares::traceIsoLines(grid, W, H, W, -9999, isoValues, 0, lines);
+  if (lines.size() != 2) {
+    CDBError("Expected 2 contour lines, got %d", (int)lines.size());
+    throw __LINE__;
+  }
+  for (size_t j = 0; j < lines.size(); j++) {
+    if (lines[j].x.front() != lines[j].x.back() || lines[j].y.front() != lines[j].y.back()) {
+      CDBError("Contour line %d is not closed", (int)j);
+      throw __LINE__;
+    }
+  }
+
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      grid[x + y * W] = x;
+    }
+  }
+  grid[0] = -9999;
+  isoValues.clear();
+  isoValues.push_back(4.25);
+  lines.clear();
+  CMarchingSquares::traceIsoLines(grid, W, H, W, -9999, isoValues, 0, lines);
+  if (lines.size() != 1 || lines[0].x.size() != size_t(H)) {
+    CDBError("Expected 1 contour line with %d points", H);
+    throw __LINE__;
+  }
+  for (size_t j = 0; j < lines[0].x.size(); j++) {
+    if (fabs(lines[0].x[j] - 4.25) > 0.0001) {
+      CDBError("Contour line at wrong position %f", lines[0].x[j]);
+      throw __LINE__;
+    }
+  }
+
+  // Smoothing: a constant field with nodata holes stays constant, an impulse is spread with a tent kernel
+  int sW = 300, sH = 200;
+  std::vector<float> field(sW * sH, 5);
+  for (int j = 0; j < sW * sH; j += 7) field[j] = -9999;
+  CSmoothingFilter::smooth(&field[0], -9999, 10, sW, sH);
+  for (int j = 0; j < sW * sH; j++) {
+    float expected = j % 7 == 0 ? -9999 : 5;
+    if (fabs(field[j] - expected) > 0.0001) {
+      CDBError("Smoothing constant field gives %f at %d", field[j], j);
+      throw __LINE__;
+    }
+  }
+  std::fill(field.begin(), field.end(), 0);
+  field[100 + 100 * sW] = 36;
+  CSmoothingFilter::smooth(&field[0], -9999, 3, sW, sH);
+  // Radii 2 and 1 give 1D weights 1,2,3,3,3,2,1 (sum 15), center weight 9 out of 225
+  if (fabs(field[100 + 100 * sW] - 36.0 * 9 / 225) > 0.0001 || fabs(field[103 + 100 * sW] - 36.0 * 3 / 225) > 0.0001 || field[104 + 100 * sW] != 0) {
+    CDBError("Smoothing impulse gives wrong kernel %f %f %f", field[100 + 100 * sW], field[103 + 100 * sW], field[104 + 100 * sW]);
+    throw __LINE__;
+  }
+
+  // Rasterizer: edge function and scanline fills of a convex polygon are identical, holes are left out
+  int rW = 40, rH = 30;
+  float hexX[6], hexY[6];
+  for (int j = 0; j < 6; j++) {
+    hexX[j] = 20 + 12 * cos(j * M_PI / 3);
+    hexY[j] = 15 + 12 * sin(j * M_PI / 3);
+  }
+  std::vector<float> convexGrid(rW * rH, -1), scanlineGrid(rW * rH, -1);
+  CPolygonRasterizer convexRasterizer, scanlineRasterizer;
+  convexRasterizer.addConvexPolygon(hexX, hexY, 6, 5);
+  convexRasterizer.fill(&convexGrid[0], rW, rH);
+  scanlineRasterizer.addPolygon(5);
+  scanlineRasterizer.addRing(hexX, hexY, 6);
+  scanlineRasterizer.fill(&scanlineGrid[0], rW, rH);
+  if (convexGrid != scanlineGrid || std::count(convexGrid.begin(), convexGrid.end(), 5) == 0) {
+    CDBError("Convex and scanline fills differ");
+    throw __LINE__;
+  }
+  std::vector<unsigned short> indexGrid(rW * rH, 65535u);
+  float outer[8] = {2, 2, 38, 2, 38, 28, 2, 28}, hole[8] = {10, 10, 30, 10, 30, 20, 10, 20};
+  CPolygonRasterizer holeRasterizer;
+  holeRasterizer.addPolygon(1);
+  holeRasterizer.addRing(outer, 4);
+  holeRasterizer.addRing(hole, 4);
+  holeRasterizer.fill(&indexGrid[0], rW, rH);
+  if (std::count(indexGrid.begin(), indexGrid.end(), 1) != 36 * 26 - 20 * 10) {
+    CDBError("Polygon with hole fills %d cells", (int)std::count(indexGrid.begin(), indexGrid.end(), 1));
+    throw __LINE__;
+  }
+
+  // Rasterizer: the scanline fill of the GeoJSON converter samples rows at their top edge, so row 2 stays empty and row 28 is filled
+  std::vector<unsigned short> geoJSONGrid(rW * rH, 65535u);
+  CPolygonRasterizer geoJSONRasterizer;
+  geoJSONRasterizer.addPolygon(1);
+  geoJSONRasterizer.addRing(outer, 4);
+  geoJSONRasterizer.setScanlineFill(2, 2, 38, 28);
+  geoJSONRasterizer.addRing(hole, 4);
+  geoJSONRasterizer.fill(&geoJSONGrid[0], rW, rH);
+  if (std::count(geoJSONGrid.begin(), geoJSONGrid.end(), 1) != 36 * 26 - 20 * 10 || geoJSONGrid[5 + 2 * rW] != 65535u || geoJSONGrid[5 + 28 * rW] != 1 || geoJSONGrid[20 + 20 * rW] != 65535u ||
+      geoJSONGrid[20 + 21 * rW] != 1 || geoJSONGrid[37 + 10 * rW] != 1 || geoJSONGrid[38 + 10 * rW] != 65535u) {
+    CDBError("Scanline fill of polygon with hole is wrong");
+    throw __LINE__;
+  }
+
+  // Cell index: a query returns the overlapping cells in ascending order, including cells spanning the date line
+  std::vector<float> cellBBOX;
+  for (int j = 0; j < 10000; j++) {
+    float lon = -180 + (j % 100) * 3.6, lat = -90 + (j / 100) * 1.8;
+    float bbox[4] = {lon, lat, lon + 3.6f, lat + 1.8f};
+    cellBBOX.insert(cellBBOX.end(), bbox, bbox + 4);
+  }
+  float dateLineCell[4] = {-179, 0, 179, 1};
+  cellBBOX.insert(cellBBOX.end(), dateLineCell, dateLineCell + 4);
+  CPolygonCellIndex cellIndex;
+  cellIndex.build(cellBBOX);
+  double query[4] = {0.5, 0.5, 10, 10};
+  std::vector<int> cells;
+  cellIndex.query(query, cells);
+  if (cells.size() != 3 * 6 + 1 || cells.front() != 50 * 100 + 50 || cells.back() != 10000) {
+    CDBError("Cell index query returns %d cells", (int)cells.size());
+    throw __LINE__;
+  }
+
+  // OpenDAP JSON: doubles are written exactly as "%f" would, also for tiny, large, negative zero, non finite and rounding boundary values
+  std::vector<double> jsonValues;
+  double fixedValues[] = {0, -0.0, 1e-300, -1e-300, 5e-324, 1e-7, -1e-7, 4.9999999e-7, 5e-7, 1.5e-6, 2.5e-6, 1.0000005, 2.0000015, 123.4567895, -123.4567895, 0.1234565, 999999.9999995,
+                          999999.9999994, 1e6, -1e6, 1e20, -1e20, 1.7976931348623157e308, NAN, -NAN, INFINITY, -INFINITY, 0.1, 0.7, 1.0 / 3, -2.0 / 3, -42.4242425};
+  jsonValues.insert(jsonValues.end(), fixedValues, fixedValues + sizeof(fixedValues) / sizeof(double));
+  unsigned int seed = 12345;
+  for (int j = 0; j < 100000; j++) {
+    seed = seed * 1103515245u + 12345u;
+    double mantissa = double(seed >> 8) / (1 << 24) - 0.5;
+    // Values on and around the sixth decimal rounding boundary, and values spread over many magnitudes
+    jsonValues.push_back(j % 2 == 0 ? (int(seed >> 4) % 2000000 - 1000000) / 1e6 + 5e-7 : mantissa * pow(10, int(seed % 27) - 12));
+  }
+  for (size_t j = 0; j < jsonValues.size(); j++) {
+    std::vector<char> out;
+    COpenDAPEncoder::appendJSONDouble(jsonValues[j], out);
+    out.push_back(0);
+    char expectedJSON[512];
+    snprintf(expectedJSON, sizeof(expectedJSON), "%f", jsonValues[j]);
+    if (strcmp(&out[0], expectedJSON) != 0) {
+      CDBError("appendJSONDouble gives [%s] instead of [%s] for %.17g", &out[0], expectedJSON, jsonValues[j]);
+      throw __LINE__;
+    }
+  }
+  // Affine resampler, nearest neighbour: the edge pixels map to the first and last column and row, pixels outside the grid get -1
+  double gridBBOX[4] = {-180, -90, 180, 90};
+  double tileX[4] = {180, 180, -180, -180}, tileY[4] = {90, -90, -90, 90};
+  CAffineResampler resampler;
+  if (!resampler.initNearest(gridBBOX, 360, 180, tileX, tileY, 720, 360) || resampler.columns[0] != 0 || resampler.columns[719] != 359 || resampler.getNearestRow(0) != 0 ||
+      resampler.getNearestRow(359) != 179) {
+    CDBError("Affine nearest edge columns %d %d rows %d %d", resampler.columns[0], resampler.columns[719], resampler.rows[0], resampler.rows[359]);
+    throw __LINE__;
+  }
+  double wideTileX[4] = {200, 200, -200, -200};
+  if (!resampler.initNearest(gridBBOX, 360, 180, wideTileX, tileY, 400, 180) || resampler.columns[19] != -1 || resampler.columns[20] != 0 || resampler.columns[379] != 359 ||
+      resampler.columns[380] != -1) {
+    CDBError("Affine nearest columns outside the grid %d %d %d %d", resampler.columns[19], resampler.columns[20], resampler.columns[379], resampler.columns[380]);
+    throw __LINE__;
+  }
+  double outsideTileX[4] = {300, 300, 200, 200};
+  if (!resampler.initNearest(gridBBOX, 360, 180, outsideTileX, tileY, 100, 180) || std::count(resampler.columns.begin(), resampler.columns.end(), -1) != 100 ||
+      std::count(resampler.rows.begin(), resampler.rows.end(), -1) != 180) {
+    CDBError("Affine nearest tile outside the grid is drawn");
+    throw __LINE__;
+  }
+  double skewedTileX[4] = {180, 180, -170, -180};
+  if (resampler.initNearest(gridBBOX, 360, 180, skewedTileX, tileY, 720, 360)) {
+    CDBError("Affine nearest accepts a tile which is not axis aligned");
+    throw __LINE__;
+  }
+
+  // Affine resampler, bilinear: identical grids map column to column, the right column of the last one wraps to the first one
+  resampler.init(gridBBOX, 360, 180, gridBBOX, 360, 180);
+  if (resampler.columns0[0] != 0 || resampler.columns0[359] != 359 || resampler.columns1[358] != 359 || resampler.columns1[359] != 0 || resampler.weightsX[0] != 0) {
+    CDBError("Affine bilinear columns %d %d %d %d", resampler.columns0[0], resampler.columns0[359], resampler.columns1[358], resampler.columns1[359]);
+    throw __LINE__;
+  }
+  double leftImageBBOX[4] = {-181, -90, 180, 90};
+  resampler.init(gridBBOX, 360, 180, leftImageBBOX, 361, 180);
+  if (resampler.columns0[0] != -1 || resampler.columns0[1] != 0 || resampler.columns0[360] != 359) {
+    CDBError("Affine bilinear columns left of the grid %d %d %d", resampler.columns0[0], resampler.columns0[1], resampler.columns0[360]);
+    throw __LINE__;
+  }
+
+  // Affine resampler, bilinear: rows and values are interpolated between cell centers, outside the grid and next to NaN gives nodata
+  double smallBBOX[4] = {0, 0, 4, 2};
+  resampler.init(smallBBOX, 4, 2, smallBBOX, 8, 4);
+  int row0 = 0, row1 = 0;
+  float weightY = 0;
+  if (resampler.getBilinearRows(0, row0, row1, weightY) || !resampler.getBilinearRows(1, row0, row1, weightY) || row0 != 0 || row1 != 1 || weightY != 0.25f ||
+      resampler.getBilinearRows(3, row0, row1, weightY)) {
+    CDBError("Affine bilinear rows %d %d %f", row0, row1, weightY);
+    throw __LINE__;
+  }
+  float gridRow0[4] = {0, 1, 2, 3}, gridRow1[4] = {10, 11, 12, 13};
+  float bilinearRow[8];
+  resampler.gatherBilinear(gridRow0, gridRow1, 0.5f, -9999.f, bilinearRow);
+  if (bilinearRow[0] != -9999.f || bilinearRow[1] != 5.25f || bilinearRow[7] != 7.25f) {
+    CDBError("Affine bilinear values %f %f %f", bilinearRow[0], bilinearRow[1], bilinearRow[7]);
+    throw __LINE__;
+  }
+  gridRow0[2] = NAN;
+  resampler.gatherBilinear(gridRow0, gridRow1, 0.5f, -9999.f, bilinearRow);
+  if (bilinearRow[2] == -9999.f || bilinearRow[3] != -9999.f || bilinearRow[4] != -9999.f || bilinearRow[5] != -9999.f || bilinearRow[6] != -9999.f) {
+    CDBError("Affine bilinear values next to NaN %f %f %f %f %f", bilinearRow[2], bilinearRow[3], bilinearRow[4], bilinearRow[5], bilinearRow[6]);
+    throw __LINE__;
+  }
+  // Store: typed columns are parsed from the row-major values
+  CDBStore::ColumnModel *columnModel = new CDBStore::ColumnModel(2);
+  columnModel->setColumn(0, "time");
+  columnModel->setColumn(1, "dimtime");
+  CDBStore::Store typedStore(columnModel);
+  const char *storeTimes[] = {"1970-01-01T00:00:00Z", "2024-02-29 12:30:15", "1899-12-31T23:59:59.5Z", "not a time"};
+  const char *storeIndices[] = {"0", "17", "-3", ""};
+  for (int j = 0; j < 4; j++) {
+    typedStore.addRow();
+    typedStore.setValue(0, storeTimes[j]);
+    typedStore.setValue(1, storeIndices[j]);
+  }
+  const std::vector<double> &storeTimeColumn = typedStore.getTimeColumn(typedStore.getColumnIndex("time"));
+  const std::vector<double> &storeIndexColumn = typedStore.getDoubleColumn(typedStore.getColumnIndex("dimtime"));
+  if (storeTimeColumn.size() != 4 || storeTimeColumn[0] != 0 || storeTimeColumn[1] != 1709209815 || storeTimeColumn[2] != -2208988800.5 || !isnan(storeTimeColumn[3])) {
+    CDBError("Store time column is wrong: %f %f %f", storeTimeColumn[0], storeTimeColumn[1], storeTimeColumn[2]);
+    throw __LINE__;
+  }
+  if (storeIndexColumn[0] != 0 || storeIndexColumn[1] != 17 || storeIndexColumn[2] != -3 || !isnan(storeIndexColumn[3]) || strcmp(typedStore.getValue(1, 0), storeTimes[1]) != 0) {
+    CDBError("Store double column is wrong");
+    throw __LINE__;
+  }
+
+  // Async logger: JSON records carry level, source, message and StopWatch durations
+  FILE *logFile = tmpfile();
+  if (CAsyncLogger::start(logFile, true, CAsyncLogger::FORMAT_JSON) != 0) {
+    CDBError("Unable to start the async logger");
+    throw __LINE__;
+  }
+  CAsyncLogger::setLayer("testlayer");
+  CAsyncLogger::write("[D:001:pid1: CTest.cpp:10 CTest] ", CAsyncLogger::LEVEL_DEBUG);
+  CAsyncLogger::write("quoted \"value\"\n", CAsyncLogger::LEVEL_DEBUG);
+  CAsyncLogger::write("[D:002:pid1: CTest.cpp:11 CTest] ", CAsyncLogger::LEVEL_DEBUG);
+  CAsyncLogger::write("[T] 12.3 ms\t4.5 ms: phase one\n", CAsyncLogger::LEVEL_DEBUG);
+  CAsyncLogger::write("[E:003:pid1: CTest.cpp:12 CTest] ", CAsyncLogger::LEVEL_ERROR);
+  CAsyncLogger::write("failed\n", CAsyncLogger::LEVEL_ERROR);
+  CAsyncLogger::stop();
+  std::string jsonLog = readWholeFile(logFile);
+  fclose(logFile);
+  const char *expectedJSON[] = {"\"level\":\"debug\"", "\"layer\":\"testlayer\"", "\"source\":\"CTest.cpp:10 CTest\"", "\"message\":\"quoted \\\"value\\\"\"",
+                                "\"phase\":\"phase one\",\"elapsed_ms\":12.300,\"duration_ms\":4.500", "\"level\":\"error\",", "\"message\":\"failed\"}"};
+  for (size_t j = 0; j < sizeof(expectedJSON) / sizeof(const char *); j++) {
+    if (jsonLog.find(expectedJSON[j]) == std::string::npos) {
+      CDBError("Async logger JSON misses [%s] in [%s]", expectedJSON[j], jsonLog.c_str());
+      throw __LINE__;
+    }
+  }
+  if (countOccurrences(jsonLog, "\n") != 3) {
+    CDBError("Async logger JSON has not one record per line [%s]", jsonLog.c_str());
+    throw __LINE__;
+  }
+
+  // Async logger: a forked child writes synchronously, its lines are in the log although it leaves with _exit
+  logFile = tmpfile();
+  CAsyncLogger::start(logFile, true, CAsyncLogger::FORMAT_TEXT);
+  CAsyncLogger::write("parent before fork\n", CAsyncLogger::LEVEL_DEBUG);
+  pid_t child = fork();
+  if (child == 0) {
+    CAsyncLogger::write("child line\n", CAsyncLogger::LEVEL_DEBUG);
+    _exit(0);
+  }
+  int childStatus = 0;
+  waitpid(child, &childStatus, 0);
+  CAsyncLogger::write("parent after fork\n", CAsyncLogger::LEVEL_DEBUG);
+  CAsyncLogger::stop();
+  std::string forkLog = readWholeFile(logFile);
+  fclose(logFile);
+  if (forkLog != "parent before fork\nchild line\nparent after fork\n") {
+    CDBError("Async logger fork log is [%s]", forkLog.c_str());
+    throw __LINE__;
+  }
+
+  // Async logger: when the ring stays full debug lines are dropped and counted, error lines are never dropped
+  int logPipe[2];
+  if (pipe(logPipe) != 0) {
+    CDBError("Unable to create pipe");
+    throw __LINE__;
+  }
+  logFile = fdopen(logPipe[1], "w");
+  CAsyncLogger::start(logFile, false, CAsyncLogger::FORMAT_TEXT);
+  size_t droppedBefore = CAsyncLogger::getNumDropped();
+  int numDebugLines = 5000, numErrorLines = 1000;
+  char logLine[256];
+  for (int j = 0; j < numDebugLines; j++) {
+    snprintf(logLine, sizeof(logLine), "debug line %d padded to make the pipe fill up quickly .......................................\n", j);
+    CAsyncLogger::write(logLine, CAsyncLogger::LEVEL_DEBUG);
+  }
+  LogPipeReader pipeReader;
+  pipeReader.fd = logPipe[0];
+  pthread_t readerThread;
+  pthread_create(&readerThread, NULL, readLogPipe, &pipeReader);
+  for (int j = 0; j < numErrorLines; j++) {
+    snprintf(logLine, sizeof(logLine), "error line %d\n", j);
+    CAsyncLogger::write(logLine, CAsyncLogger::LEVEL_ERROR);
+  }
+  CAsyncLogger::stop();
+  fclose(logFile);
+  pthread_join(readerThread, NULL);
+  close(logPipe[0]);
+  size_t numDropped = CAsyncLogger::getNumDropped() - droppedBefore;
+  size_t numDebugWritten = countOccurrences(pipeReader.contents, "debug line ");
+  if (numDropped == 0 || numDebugWritten + numDropped != size_t(numDebugLines) || countOccurrences(pipeReader.contents, "error line ") != size_t(numErrorLines) ||
+      countOccurrences(pipeReader.contents, "log lines dropped, log buffer was full") == 0) {
+    CDBError("Async logger overflow: %d dropped, %d debug and %d error lines written", (int)numDropped, (int)numDebugWritten, (int)countOccurrences(pipeReader.contents, "error line "));
+    throw __LINE__;
+  }
   return 0;
 }
@@ -26,6 +26,7 @@ function clean {
   rm -f h5ncdump
   rm -f aggregate_time
   rm -f geojsondump
+  rm -f adagucbenchmark
   rm -rf CMakeFiles CMakeCache.txt
 
   test -d $CURRENTDIR/bin || mkdir $CURRENTDIR/bin/
@@ -33,6 +34,7 @@ function clean {
   rm -f $CURRENTDIR/bin/h5ncdump
   rm -f $CURRENTDIR/bin/aggregate_time
   rm -f $CURRENTDIR/bin/geojsondump
+  rm -f $CURRENTDIR/bin/adagucbenchmark
 }
 
 function build {
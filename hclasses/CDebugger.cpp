@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <new>
+#include <atomic>
 
 bool Tracer::Ready = false;
 extern Tracer NewTrace;
@@ -123,8 +124,35 @@ void _printDebugStream(const char *pszMessage) {
   printf("%s", pszMessage);
 }
 
+/*
+ * Sampling is decided in _printDebug and _printWarning, which print the prefix of CDBDebug, CDBWarning and StopWatch_Stop.
+ * The line following a skipped prefix is skipped as well, before anything is formatted.
+ */
+static std::atomic<unsigned int> debugSampling(1);
+static std::atomic<unsigned int> warningSampling(1);
+static std::atomic<unsigned int> debugSampleCounter(0);
+static std::atomic<unsigned int> warningSampleCounter(0);
+static thread_local bool skipDebugLine = false;
+static thread_local bool skipWarningLine = false;
+
+void setDebugSampling(unsigned int keepEveryNth) { debugSampling = keepEveryNth; }
+void setWarningSampling(unsigned int keepEveryNth) { warningSampling = keepEveryNth; }
+
+/* The counters are shared by all threads, each message takes its own ticket */
+static inline bool isSampledOut(unsigned int sampling, std::atomic<unsigned int> &counter) {
+  if (sampling == 1) return false;
+  if (sampling == 0) return true;
+  return (counter.fetch_add(1, std::memory_order_relaxed) % sampling) != 0;
+}
+
+bool isDebugLineSkipped() { return skipDebugLine; }
+
 void _printDebugLine(const char *pszMessage, ...) {
   logMessageNumber++;
+  if (skipDebugLine) {
+    skipDebugLine = false;
+    return;
+  }
   char szTemp[2048];
   va_list ap;
   va_start(ap, pszMessage);
@@ -136,6 +164,10 @@ void _printDebugLine(const char *pszMessage, ...) {
 
 void _printWarningLine(const char *pszMessage, ...) {
   logMessageNumber++;
+  if (skipWarningLine) {
+    skipWarningLine = false;
+    return;
+  }
   char szTemp[2048];
   va_list ap;
   va_start(ap, pszMessage);
@@ -163,6 +195,10 @@ void makeEqualWidth(CT::string *t1) {
   }
 }
 void _printDebug(const char *pszMessage, ...) {
+  if (isSampledOut(debugSampling, debugSampleCounter)) {
+    skipDebugLine = true;
+    return;
+  }
   char szTemp[2048];
   va_list ap;
   va_start(ap, pszMessage);
@@ -174,6 +210,10 @@ void _printDebug(const char *pszMessage, ...) {
 }
 
 void _printWarning(const char *pszMessage, ...) {
+  if (isSampledOut(warningSampling, warningSampleCounter)) {
+    skipWarningLine = true;
+    return;
+  }
   char szTemp[2048];
   va_list ap;
   va_start(ap, pszMessage);
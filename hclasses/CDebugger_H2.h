@@ -51,6 +51,13 @@ void setDebugFunction(void (*function)(const char *));
 void setWarningFunction(void (*function)(const char *));
 void setErrorFunction(void (*function)(const char *));
 
+/* Only format and emit every Nth debug or warning message, 1 means all, 0 means none. Errors are never sampled. */
+void setDebugSampling(unsigned int keepEveryNth);
+void setWarningSampling(unsigned int keepEveryNth);
+
+/* True when the debug line following the current prefix is sampled out, so callers can skip formatting it */
+bool isDebugLineSkipped();
+
 void _printDebugLine(const char *pszMessage, ...);
 void _printWarningLine(const char *pszMessage, ...);
 void _printErrorLine(const char *pszMessage, ...);
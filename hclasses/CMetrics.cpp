@@ -0,0 +1,209 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "CMetrics.h"
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+static const char *phaseNames[CMetrics::NUM_PHASES] = {"config", "db", "fileopen", "read", "warp", "postprocess", "colour", "encode"};
+static const char *counterNames[CMetrics::NUM_COUNTERS] = {"bytes_read",    "files_opened",    "cdfobjectstore_hits", "cdfobjectstore_misses",
+                                                           "cdfcache_hits", "cdfcache_misses", "ccache_hits",         "ccache_misses"};
+
+/* Totals in nanoseconds, timers can run on the worker threads of CParallelFor */
+static std::atomic<long long> phaseTotals[CMetrics::NUM_PHASES];
+static std::atomic<long long> counters[CMetrics::NUM_COUNTERS];
+static timespec requestStart = {0, 0};
+static bool headerEnabled = false;
+
+/* The innermost running timer of this thread */
+static thread_local CMetrics::Timer *currentTimer = NULL;
+
+static inline double secondsBetween(const timespec &a, const timespec &b) { return double(b.tv_sec - a.tv_sec) + double(b.tv_nsec - a.tv_nsec) * 1e-9; }
+
+CMetrics::Timer::Timer(Phase phase) {
+  this->phase = phase;
+  elapsed = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  parent = currentTimer;
+  if (parent != NULL) parent->pause(start);
+  currentTimer = this;
+}
+
+CMetrics::Timer::~Timer() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pause(now);
+  phaseTotals[phase] += (long long)(elapsed * 1e9);
+  currentTimer = parent;
+  if (parent != NULL) parent->resume(now);
+}
+
+void CMetrics::Timer::pause(const timespec &now) { elapsed += secondsBetween(start, now); }
+
+void CMetrics::Timer::resume(const timespec &now) { start = now; }
+
+void CMetrics::reset() {
+  for (int j = 0; j < NUM_PHASES; j++) phaseTotals[j] = 0;
+  for (int j = 0; j < NUM_COUNTERS; j++) counters[j] = 0;
+  clock_gettime(CLOCK_MONOTONIC, &requestStart);
+}
+
+double CMetrics::getPhaseTime(int phase) {
+  if (phase < 0 || phase >= NUM_PHASES) return 0;
+  return double(phaseTotals[phase].load()) * 1e-9;
+}
+
+const char *CMetrics::getPhaseName(int phase) {
+  if (phase < 0 || phase >= NUM_PHASES) return "unknown";
+  return phaseNames[phase];
+}
+
+void CMetrics::increment(Counter counter, long long amount) { counters[counter] += amount; }
+
+long long CMetrics::getCounter(int counter) {
+  if (counter < 0 || counter >= NUM_COUNTERS) return 0;
+  return counters[counter].load();
+}
+
+const char *CMetrics::getCounterName(int counter) {
+  if (counter < 0 || counter >= NUM_COUNTERS) return "unknown";
+  return counterNames[counter];
+}
+
+double CMetrics::getRequestTime() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return secondsBetween(requestStart, now);
+}
+
+void CMetrics::setHeaderEnabled(bool enabled) { headerEnabled = enabled; }
+
+void CMetrics::printHeader() {
+  if (!headerEnabled) return;
+  CT::string header = "Server-Timing: ";
+  header.printconcat("total;dur=%.3f", getRequestTime() * 1000);
+  for (int j = 0; j < NUM_PHASES; j++) {
+    header.printconcat(", %s;dur=%.3f", phaseNames[j], getPhaseTime(j) * 1000);
+  }
+  for (int j = 0; j < NUM_COUNTERS; j++) {
+    header.printconcat(", %s;desc=\"%lld\"", counterNames[j], getCounter(j));
+  }
+  printf("%s%c%c", header.c_str(), 13, 10);
+  fflush(stdout);
+}
+
+CT::string CMetrics::getJSON() {
+  CT::string json;
+  json.print("{\"duration\":%.6f,\"phases\":{", getRequestTime());
+  for (int j = 0; j < NUM_PHASES; j++) {
+    json.printconcat("%s\"%s\":%.6f", j > 0 ? "," : "", phaseNames[j], getPhaseTime(j));
+  }
+  json.concat("},\"counters\":{");
+  for (int j = 0; j < NUM_COUNTERS; j++) {
+    json.printconcat("%s\"%s\":%lld", j > 0 ? "," : "", counterNames[j], getCounter(j));
+  }
+  json.concat("}}");
+  return json;
+}
+
+class CMetricsPrometheusSample {
+public:
+  std::string family, labels, help;
+  double value;
+  CMetricsPrometheusSample(const char *family, const char *labels, const char *help, double value) : family(family), labels(labels), help(help), value(value) {}
+  std::string getKey() const { return labels.empty() ? family : family + "{" + labels + "}"; }
+};
+
+int CMetrics::addToPrometheusFile(const char *fileName) {
+  static const char *cacheNames[] = {"cdfobjectstore", "cdfcache", "ccache"};
+  std::vector<CMetricsPrometheusSample> samples;
+  samples.push_back(CMetricsPrometheusSample("adaguc_requests_total", "", "Number of handled requests", 1));
+  samples.push_back(CMetricsPrometheusSample("adaguc_request_duration_seconds_total", "", "Time spent handling requests", getRequestTime()));
+  for (int j = 0; j < NUM_PHASES; j++) {
+    CT::string label;
+    label.print("phase=\"%s\"", phaseNames[j]);
+    samples.push_back(CMetricsPrometheusSample("adaguc_phase_duration_seconds_total", label.c_str(), "Time spent per processing phase", getPhaseTime(j)));
+  }
+  samples.push_back(CMetricsPrometheusSample("adaguc_bytes_read_total", "", "Bytes of variable data read from files", getCounter(COUNTER_BYTES_READ)));
+  samples.push_back(CMetricsPrometheusSample("adaguc_files_opened_total", "", "Number of opened data files", getCounter(COUNTER_FILES_OPENED)));
+  /* The hit and miss counters of each cache follow each other in the Counter enum */
+  for (int hits = 1; hits >= 0; hits--) {
+    for (int j = 0; j < 3; j++) {
+      CT::string label;
+      label.print("cache=\"%s\"", cacheNames[j]);
+      samples.push_back(CMetricsPrometheusSample(hits ? "adaguc_cache_hits_total" : "adaguc_cache_misses_total", label.c_str(), hits ? "Number of cache hits" : "Number of cache misses",
+                                                 getCounter(COUNTER_CDFOBJECTSTORE_HITS + j * 2 + (hits ? 0 : 1))));
+    }
+  }
+
+  CT::string lockFileName = fileName;
+  lockFileName.concat(".lock");
+  int lockFd = open(lockFileName.c_str(), O_CREAT | O_RDWR, 0644);
+  if (lockFd == -1 || flock(lockFd, LOCK_EX) != 0) {
+    if (lockFd != -1) close(lockFd);
+    return 1;
+  }
+
+  /* Add the totals of the previous requests */
+  std::map<std::string, double> previous;
+  FILE *pFile = fopen(fileName, "r");
+  if (pFile != NULL) {
+    char line[1024], key[1024];
+    double value;
+    while (fgets(line, sizeof(line), pFile) != NULL) {
+      if (line[0] == '#') continue;
+      if (sscanf(line, "%1023s %lf", key, &value) == 2) previous[key] = value;
+    }
+    fclose(pFile);
+  }
+
+  CT::string tempFileName;
+  tempFileName.print("%s.%d", fileName, (int)getpid());
+  pFile = fopen(tempFileName.c_str(), "w");
+  int status = 1;
+  if (pFile != NULL) {
+    for (size_t j = 0; j < samples.size(); j++) {
+      const CMetricsPrometheusSample &sample = samples[j];
+      if (j == 0 || sample.family != samples[j - 1].family) {
+        fprintf(pFile, "# HELP %s %s\n# TYPE %s counter\n", sample.family.c_str(), sample.help.c_str(), sample.family.c_str());
+      }
+      std::string key = sample.getKey();
+      std::map<std::string, double>::iterator it = previous.find(key);
+      fprintf(pFile, "%s %.15g\n", key.c_str(), sample.value + (it != previous.end() ? it->second : 0));
+    }
+    status = fclose(pFile) == 0 && rename(tempFileName.c_str(), fileName) == 0 ? 0 : 1;
+    if (status != 0) remove(tempFileName.c_str());
+  }
+  flock(lockFd, LOCK_UN);
+  close(lockFd);
+  return status;
+}
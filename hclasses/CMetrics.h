@@ -0,0 +1,130 @@
+/******************************************************************************
+ *
+ * Project:  ADAGUC Server
+ * Purpose:  ADAGUC OGC Server
+ * Author:   Maarten Plieger, plieger "at" knmi.nl
+ * Date:     2013-06-01
+ *
+ ******************************************************************************
+ *
+ * Copyright 2013, Royal Netherlands Meteorological Institute (KNMI)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef CMETRICS_H
+#define CMETRICS_H
+
+#include <time.h>
+#include "CTString.h"
+
+/**
+ * @brief Accumulates the time a request spends in each processing phase and counts I/O and cache events.
+ * Timers are exclusive per thread: a nested timer pauses the enclosing one, so the phase totals of a single threaded request never add up to more than the request time.
+ *
+ * The totals are reported as a Server-Timing response header (ADAGUC_METRICS_HEADER=true), as a metrics line in the log and
+ * accumulated over requests in a Prometheus text file (ADAGUC_METRICS_FILE), which can be read by the node exporter textfile collector.
+ */
+class CMetrics {
+public:
+  enum Phase { PHASE_CONFIG = 0, PHASE_DB, PHASE_FILEOPEN, PHASE_READ, PHASE_WARP, PHASE_POSTPROCESS, PHASE_COLOUR, PHASE_ENCODE, NUM_PHASES };
+  enum Counter {
+    COUNTER_BYTES_READ = 0,
+    COUNTER_FILES_OPENED,
+    COUNTER_CDFOBJECTSTORE_HITS,
+    COUNTER_CDFOBJECTSTORE_MISSES,
+    COUNTER_CDFCACHE_HITS,
+    COUNTER_CDFCACHE_MISSES,
+    COUNTER_CCACHE_HITS,
+    COUNTER_CCACHE_MISSES,
+    NUM_COUNTERS
+  };
+
+  /**
+   * @brief Scoped timer, adds the time between construction and destruction to the given phase
+   */
+  class Timer {
+  private:
+    Phase phase;
+    timespec start;
+    double elapsed;
+    Timer *parent;
+    void pause(const timespec &now);
+    void resume(const timespec &now);
+
+  public:
+    Timer(Phase phase);
+    ~Timer();
+  };
+
+  /**
+   * @brief Sets all phase totals and counters to zero and marks the start of the request
+   */
+  static void reset();
+
+  /**
+   * @brief Returns the accumulated time in seconds for the phase
+   */
+  static double getPhaseTime(int phase);
+
+  /**
+   * @brief Returns the name of the phase as used in reports, e.g. "warp"
+   */
+  static const char *getPhaseName(int phase);
+
+  /**
+   * @brief Adds amount to the counter
+   */
+  static void increment(Counter counter, long long amount = 1);
+
+  /**
+   * @brief Returns the value of the counter
+   */
+  static long long getCounter(int counter);
+
+  /**
+   * @brief Returns the name of the counter as used in reports, e.g. "files_opened"
+   */
+  static const char *getCounterName(int counter);
+
+  /**
+   * @brief Returns the seconds since the last reset
+   */
+  static double getRequestTime();
+
+  /**
+   * @brief Enables the Server-Timing header written by printHeader
+   */
+  static void setHeaderEnabled(bool enabled);
+
+  /**
+   * @brief Writes a Server-Timing header line to stdout when enabled. Needs to be called before the Content-Type line,
+   * the header therefore contains the phases up to that moment and never the encode phase.
+   */
+  static void printHeader();
+
+  /**
+   * @brief Returns the request time, phases and counters as a single line JSON object
+   */
+  static CT::string getJSON();
+
+  /**
+   * @brief Adds the totals of this request to a Prometheus text file. The file is locked while it is updated and replaced atomically.
+   *
+   * @return Zero on success
+   */
+  static int addToPrometheusFile(const char *fileName);
+};
+
+#endif
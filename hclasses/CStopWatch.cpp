@@ -65,6 +65,11 @@ void __StopWatch_Stop(const char *msg) {
 }
 
 void _StopWatch_Stop(const char *a, ...) {
+  /* A sampled out line is not formatted, only the time of this stop is kept */
+  if (isDebugLineSkipped()) {
+    __StopWatch_Stop("");
+    return;
+  }
   va_list ap;
   char szTemp[8192 + 1];
   va_start(ap, a);
@@ -1,8 +1,16 @@
 #include "CDirReader.h"
 #include "CDebugger.h"
+#include "CStopWatch.h"
 
 DEF_ERRORMAIN()
 
+static int numDebugStreamCalls = 0;
+static CT::string lastDebugStream;
+static void countDebugStream(const char *message) {
+  numDebugStreamCalls++;
+  lastDebugStream.concat(message);
+}
+
 int main() {
 
   CDirReader::test_makeCleanPath();
@@ -139,6 +147,24 @@ int main() {
     throw __LINE__;
   }
 
+  /* Sampled out debug and StopWatch lines are not printed, the line after them is */
+  setDebugFunction(countDebugStream);
+  setDebugSampling(0);
+  CDBDebug("sampled out %d", 1);
+  StopWatch_Stop("sampled out %s", "too");
+  setDebugSampling(1);
+  if (numDebugStreamCalls != 0) {
+    setDebugFunction(_printDebugStream);
+    CDBError("Sampled out lines were printed %d times", numDebugStreamCalls);
+    throw __LINE__;
+  }
+  StopWatch_Stop("printed");
+  setDebugFunction(_printDebugStream);
+  if (numDebugStreamCalls != 3 || lastDebugStream.indexOf("printed") == -1) {
+    CDBError("StopWatch line after sampling was not printed: %d [%s]", numDebugStreamCalls, lastDebugStream.c_str());
+    throw __LINE__;
+  }
+
   CDBDebug("OK");
   return 0;
 }
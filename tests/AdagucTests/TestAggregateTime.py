@@ -0,0 +1,86 @@
+import os
+import unittest
+import subprocess
+import netCDF4
+import numpy
+from .AdagucTestTools import AdagucTestTools
+
+ADAGUC_PATH = os.environ['ADAGUC_PATH']
+
+
+class TestAggregateTime(unittest.TestCase):
+
+  def createInputFile(self, fileName, hours, offset):
+    # Each value is the hour plus an offset, so it shows from which file a time step was taken
+    dataset = netCDF4.Dataset(fileName, 'w', format='NETCDF4')
+    dataset.createDimension('time', None)
+    dataset.createDimension('lat', 2)
+    dataset.createDimension('lon', 3)
+    timeVar = dataset.createVariable('time', 'f8', ('time',))
+    timeVar.units = 'hours since 2020-01-01 00:00:00'
+    timeVar.standard_name = 'time'
+    latVar = dataset.createVariable('lat', 'f4', ('lat',))
+    latVar.units = 'degrees_north'
+    latVar[:] = [50, 51]
+    lonVar = dataset.createVariable('lon', 'f4', ('lon',))
+    lonVar.units = 'degrees_east'
+    lonVar[:] = [4, 5, 6]
+    valueVar = dataset.createVariable('value', 'f4', ('time', 'lat', 'lon'))
+    timeVar[:] = hours
+    for j, hour in enumerate(hours):
+      valueVar[j, :, :] = numpy.full((2, 3), hour + offset)
+    dataset.close()
+
+  def runAggregateTime(self, inputDir, outputFile):
+    process = subprocess.Popen([ADAGUC_PATH + '/bin/aggregate_time', inputDir, outputFile], stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = process.communicate()[0].decode()
+    return process.returncode, output
+
+  def readOutputFile(self, outputFile):
+    dataset = netCDF4.Dataset(outputFile, 'r')
+    hours = list(dataset.variables['time'][:])
+    values = [float(dataset.variables['value'][j, 0, 0]) for j in range(len(hours))]
+    dataset.close()
+    return hours, values
+
+  def test_AggregateTime_overlappingFiles(self):
+    AdagucTestTools().cleanTempDir()
+    inputDir = os.environ['ADAGUC_TMP'] + '/aggregate_overlap/'
+    AdagucTestTools().mkdir_p(inputDir)
+    outputFile = os.environ['ADAGUC_TMP'] + '/aggregate_overlap.nc'
+    self.createInputFile(inputDir + 'a.nc', [0, 2, 4], 0)
+    self.createInputFile(inputDir + 'b.nc', [3, 1, 2], 100)
+
+    status, output = self.runAggregateTime(inputDir, outputFile)
+    self.assertEqual(status, 0, output)
+    hours, values = self.readOutputFile(outputFile)
+    # Steps of both files are merged in time order, the duplicate hour 2 is taken from the file which starts first
+    self.assertEqual(hours, [0, 1, 2, 3, 4])
+    self.assertEqual(values, [0, 101, 2, 103, 4])
+    self.assertIn('Dropping time step 2020-01-01T02:00:00Z of b.nc', output)
+
+  def test_AggregateTime_append(self):
+    AdagucTestTools().cleanTempDir()
+    inputDir = os.environ['ADAGUC_TMP'] + '/aggregate_append/'
+    AdagucTestTools().mkdir_p(inputDir)
+    outputFile = os.environ['ADAGUC_TMP'] + '/aggregate_append.nc'
+    self.createInputFile(inputDir + 'a.nc', [0, 2, 4], 0)
+    status, output = self.runAggregateTime(inputDir, outputFile)
+    self.assertEqual(status, 0, output)
+
+    # Hour 4 is already in the output, hour 3 can not be inserted before it and is dropped with a warning
+    self.createInputFile(inputDir + 'c.nc', [3, 4, 5, 6], 200)
+    status, output = self.runAggregateTime(inputDir, outputFile)
+    self.assertEqual(status, 0, output)
+    hours, values = self.readOutputFile(outputFile)
+    self.assertEqual(hours, [0, 2, 4, 5, 6])
+    self.assertEqual(values, [0, 2, 4, 205, 206])
+    self.assertIn('Dropping time step 2020-01-01T03:00:00Z of c.nc', output)
+    self.assertNotIn('Dropping time step 2020-01-01T04:00:00Z', output)
+    self.assertNotIn('of a.nc', output)
+
+    # Running again without new time steps leaves the output unchanged
+    status, output = self.runAggregateTime(inputDir, outputFile)
+    self.assertEqual(status, 0, output)
+    self.assertIn('No new time steps to append', output)
+    self.assertEqual(self.readOutputFile(outputFile)[0], [0, 2, 4, 5, 6])